@@ -0,0 +1,328 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Surface Correspondence Implementation (correspondence.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	CORRESPONDENCE.CPP v0.1.0
+////
+////	Geometric correspondence between the surfaces of two objects
+////
+////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <vector>
+
+#include "correspondence.h"
+#include "parallel.h"
+
+#define CORR_CELLS_PER_ITEM		8		// Upper bound on the grid size
+#define CORR_QUERIES_PER_THREAD	512		// Minimum queries per thread
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Uniform grid
+//
+//		Each item is stored in every cell its box overlaps, in
+//		increasing item order.  The cell size follows the extent of
+//		the items as if they were spread over a surface.
+//
+struct CorrGrid {
+	Real						lo[3], h;
+	int							dim[3];
+	std::vector<unsigned int>	ptr, item;
+
+	void	Cell(const Real *p, int *c) const
+	{
+		for(int k = 0; k < 3; k++) {
+			c[k] = (int) floor((p[k] - lo[k]) / h);
+			if(c[k] < 0)		c[k] = 0;
+			if(c[k] >= dim[k])	c[k] = dim[k] - 1;
+		}
+	}
+
+	unsigned int	Index(int x, int y, int z) const	{ return (unsigned int) ((z * dim[1] + y) * dim[0] + x); }
+
+	// box holds the low and high corners of each item, 6 Reals each
+	void	Build(unsigned int n, const Real *box)
+	{
+		Real			hi[3], ext = 0.0;
+		unsigned int	i, k;
+		int				a[3], b[3], x, y, z;
+
+		for(k = 0; k < 3; k++) { lo[k] = 0.0; hi[k] = 0.0; }
+		for(i = 0; i < n; i++)
+			for(k = 0; k < 3; k++) {
+				if(i == 0 || box[6*i+k] < lo[k])	lo[k] = box[6*i+k];
+				if(i == 0 || box[6*i+3+k] > hi[k])	hi[k] = box[6*i+3+k];
+			}
+		for(k = 0; k < 3; k++) if(hi[k] - lo[k] > ext) ext = hi[k] - lo[k];
+
+		h = (ext > 0.0) ? ext / ceil(sqrt((double) n)) : 1.0;
+		for(;;) {
+			double	cells = 1.0;
+			for(k = 0; k < 3; k++) {
+				dim[k]	= (int) floor((hi[k] - lo[k]) / h) + 1;
+				cells	*= dim[k];
+			}
+			if(cells <= CORR_CELLS_PER_ITEM * (double) n + CORR_CELLS_PER_ITEM) break;
+			h *= 2.0;
+		}
+
+		ptr.assign(dim[0] * dim[1] * dim[2] + 1, 0);
+		for(i = 0; i < n; i++) {
+			Cell(box+6*i, a);	Cell(box+6*i+3, b);
+			for(z = a[2]; z <= b[2]; z++)
+				for(y = a[1]; y <= b[1]; y++)
+					for(x = a[0]; x <= b[0]; x++) ptr[Index(x, y, z)+1]++;
+		}
+		for(k = 1; k < ptr.size(); k++) ptr[k] += ptr[k-1];
+		item.resize(ptr.back());
+		std::vector<unsigned int>	fill(ptr.begin(), ptr.end()-1);
+		for(i = 0; i < n; i++) {
+			Cell(box+6*i, a);	Cell(box+6*i+3, b);
+			for(z = a[2]; z <= b[2]; z++)
+				for(y = a[1]; y <= b[1]; y++)
+					for(x = a[0]; x <= b[0]; x++) item[fill[Index(x, y, z)]++] = i;
+		}
+	}
+};
+
+
+// Closest point of triangle (a, b, c) to p as barycentric weights, following
+// Ericson, Real-Time Collision Detection, 5.1.5.  Returns the squared distance.
+static Real ClosestPointOnTriangle(const Real *p, const Real *a, const Real *b, const Real *c, Real *w)
+{
+	Real	ab[3], ac[3], ap[3], bp[3], cp[3], q[3], d = 0.0;
+	int		k;
+
+	for(k = 0; k < 3; k++) {
+		ab[k] = b[k] - a[k];	ac[k] = c[k] - a[k];
+		ap[k] = p[k] - a[k];	bp[k] = p[k] - b[k];	cp[k] = p[k] - c[k];
+	}
+	Real	d1 = ab[0]*ap[0] + ab[1]*ap[1] + ab[2]*ap[2];
+	Real	d2 = ac[0]*ap[0] + ac[1]*ap[1] + ac[2]*ap[2];
+	Real	d3 = ab[0]*bp[0] + ab[1]*bp[1] + ab[2]*bp[2];
+	Real	d4 = ac[0]*bp[0] + ac[1]*bp[1] + ac[2]*bp[2];
+	Real	d5 = ab[0]*cp[0] + ab[1]*cp[1] + ab[2]*cp[2];
+	Real	d6 = ac[0]*cp[0] + ac[1]*cp[1] + ac[2]*cp[2];
+	Real	va = d3*d6 - d5*d4, vb = d5*d2 - d1*d6, vc = d1*d4 - d3*d2;
+
+	if(d1 <= 0.0 && d2 <= 0.0)						{ w[0] = 1.0;	w[1] = 0.0;	w[2] = 0.0; }
+	else if(d3 >= 0.0 && d4 <= d3)					{ w[0] = 0.0;	w[1] = 1.0;	w[2] = 0.0; }
+	else if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)	{ w[1] = d1 / (d1 - d3);	w[0] = 1.0 - w[1];	w[2] = 0.0; }
+	else if(d6 >= 0.0 && d5 <= d6)					{ w[0] = 0.0;	w[1] = 0.0;	w[2] = 1.0; }
+	else if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)	{ w[2] = d2 / (d2 - d6);	w[0] = 1.0 - w[2];	w[1] = 0.0; }
+	else if(va <= 0.0 && d4 >= d3 && d5 >= d6)		{ w[2] = (d4 - d3) / ((d4 - d3) + (d5 - d6));	w[1] = 1.0 - w[2];	w[0] = 0.0; }
+	else if(va + vb + vc != 0.0) {
+		w[1] = vb / (va + vb + vc);
+		w[2] = vc / (va + vb + vc);
+		w[0] = 1.0 - w[1] - w[2];
+	}
+	else											{ w[0] = 1.0;	w[1] = 0.0;	w[2] = 0.0; }
+
+	for(k = 0; k < 3; k++) {
+		q[k] = p[k] - (w[0]*a[k] + w[1]*b[k] + w[2]*c[k]);
+		d += q[k]*q[k];
+	}
+	return d;
+}
+
+
+typedef struct {
+	const CorrGrid		*grid;
+	const Real			*pos_a;
+	const Real			*pos_b;
+	const unsigned int	*tri;
+	Real				tol;
+	unsigned int		*match;
+	Real				*bary;
+} CorrTaskArg;
+
+
+// ParallelFor task: nearest vertices of a[begin, end)
+static void NearestVertexTask(void *arg, unsigned int begin, unsigned int end, unsigned int /*thread*/)
+{
+	CorrTaskArg		*t = (CorrTaskArg *) arg;
+	const CorrGrid	&g = *t->grid;
+	Real			tol2 = t->tol * t->tol, lo[3], hi[3];
+	int				a[3], b[3], x, y, z, k;
+
+	for(unsigned int i = begin; i < end; i++) {
+		const Real		*p = t->pos_a + 3*i;
+		unsigned int	best = CORR_NONE;
+		Real			dbest = tol2;
+
+		for(k = 0; k < 3; k++) { lo[k] = p[k] - t->tol;	hi[k] = p[k] + t->tol; }
+		g.Cell(lo, a);	g.Cell(hi, b);
+		for(z = a[2]; z <= b[2]; z++)
+			for(y = a[1]; y <= b[1]; y++)
+				for(x = a[0]; x <= b[0]; x++) {
+					unsigned int	c = g.Index(x, y, z);
+					for(unsigned int e = g.ptr[c]; e < g.ptr[c+1]; e++) {
+						unsigned int	j = g.item[e];
+						const Real		*q = t->pos_b + 3*j;
+						Real			d = (p[0]-q[0])*(p[0]-q[0]) + (p[1]-q[1])*(p[1]-q[1]) + (p[2]-q[2])*(p[2]-q[2]);
+						if(d < dbest || (d == dbest && j < best)) { dbest = d;	best = j; }
+					}
+				}
+		t->match[i] = best;
+	}
+}
+
+
+// ParallelFor task: closest surface points of a[begin, end)
+static void ClosestPointTask(void *arg, unsigned int begin, unsigned int end, unsigned int /*thread*/)
+{
+	CorrTaskArg		*t = (CorrTaskArg *) arg;
+	const CorrGrid	&g = *t->grid;
+	Real			tol2 = t->tol * t->tol, w[3];
+	int				a[3];
+
+	for(unsigned int i = begin; i < end; i++) {
+		const Real		*p = t->pos_a + 3*i;
+		unsigned int	best = CORR_NONE;
+		Real			dbest = tol2;
+
+		// Triangle boxes are grown by tol, so the cell of p holds them all
+		g.Cell(p, a);
+		unsigned int	c = g.Index(a[0], a[1], a[2]);
+		for(unsigned int e = g.ptr[c]; e < g.ptr[c+1]; e++) {
+			unsigned int		f = g.item[e];
+			const unsigned int	*v = t->tri + 3*f;
+			Real				d = ClosestPointOnTriangle(p, t->pos_b + 3*v[0], t->pos_b + 3*v[1], t->pos_b + 3*v[2], w);
+			if(d < dbest || (d == dbest && f < best)) {
+				dbest	= d;
+				best	= f;
+				t->bary[3*i+0] = w[0];	t->bary[3*i+1] = w[1];	t->bary[3*i+2] = w[2];
+			}
+		}
+		t->match[i] = best;
+		if(best == CORR_NONE) t->bary[3*i+0] = t->bary[3*i+1] = t->bary[3*i+2] = 0.0;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CorrNearestVertex()
+//
+unsigned int CorrNearestVertex(unsigned int num_a, const Real *pos_a,
+							   unsigned int num_b, const Real *pos_b,
+							   Real tol, unsigned int *match)
+{
+	CorrGrid			grid;
+	CorrTaskArg			arg;
+	std::vector<Real>	box(6*num_b);
+	unsigned int		i, k, n = 0;
+
+	for(i = 0; i < num_b; i++)
+		for(k = 0; k < 3; k++) box[6*i+k] = box[6*i+3+k] = pos_b[3*i+k];
+	grid.Build(num_b, num_b ? &box[0] : NULL);
+
+	arg.grid	= &grid;
+	arg.pos_a	= pos_a;
+	arg.pos_b	= pos_b;
+	arg.tri		= NULL;
+	arg.tol		= tol;
+	arg.match	= match;
+	arg.bary	= NULL;
+	ParallelFor(num_a, NearestVertexTask, &arg, CORR_QUERIES_PER_THREAD);
+
+	for(i = 0; i < num_a; i++) if(match[i] != CORR_NONE) n++;
+	return n;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CorrClosestPoint()
+//
+unsigned int CorrClosestPoint(unsigned int num_a, const Real *pos_a,
+							  unsigned int /*num_b*/, const Real *pos_b,
+							  unsigned int num_tri, const unsigned int *tri,
+							  Real tol, unsigned int *face, Real *bary)
+{
+	CorrGrid			grid;
+	CorrTaskArg			arg;
+	std::vector<Real>	box(6*num_tri);
+	unsigned int		i, j, k, n = 0;
+
+	for(i = 0; i < num_tri; i++)
+		for(k = 0; k < 3; k++) {
+			Real	lo = pos_b[3*tri[3*i]+k], hi = lo;
+			for(j = 1; j < 3; j++) {
+				Real	x = pos_b[3*tri[3*i+j]+k];
+				if(x < lo) lo = x;
+				if(x > hi) hi = x;
+			}
+			box[6*i+k]		= lo - tol;
+			box[6*i+3+k]	= hi + tol;
+		}
+	grid.Build(num_tri, num_tri ? &box[0] : NULL);
+
+	arg.grid	= &grid;
+	arg.pos_a	= pos_a;
+	arg.pos_b	= pos_b;
+	arg.tri		= tri;
+	arg.tol		= tol;
+	arg.match	= face;
+	arg.bary	= bary;
+	ParallelFor(num_a, ClosestPointTask, &arg, CORR_QUERIES_PER_THREAD);
+
+	for(i = 0; i < num_a; i++) if(face[i] != CORR_NONE) n++;
+	return n;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CorrMatchFaces()
+//
+//		Looks for each triangle among the triangles of b around its
+//		first mapped vertex.
+//
+unsigned int CorrMatchFaces(unsigned int num_tri_a, const unsigned int *tri_a, const unsigned int *vmatch,
+							unsigned int num_b, unsigned int num_tri_b, const unsigned int *tri_b,
+							unsigned int *match)
+{
+	std::vector<unsigned int>	ptr(num_b+1, 0), adj(3*num_tri_b);
+	unsigned int				i, k, n = 0;
+
+	for(i = 0; i < 3*num_tri_b; i++) ptr[tri_b[i]+1]++;
+	for(i = 0; i < num_b; i++) ptr[i+1] += ptr[i];
+	std::vector<unsigned int>	fill(ptr.begin(), ptr.end()-1);
+	for(i = 0; i < 3*num_tri_b; i++) adj[fill[tri_b[i]]++] = i / 3;
+
+	for(i = 0; i < num_tri_a; i++) {
+		unsigned int	v[3];
+		match[i] = CORR_NONE;
+		for(k = 0; k < 3; k++) v[k] = vmatch[tri_a[3*i+k]];
+		if(v[0] == CORR_NONE || v[1] == CORR_NONE || v[2] == CORR_NONE) continue;
+		for(k = ptr[v[0]]; k < ptr[v[0]+1]; k++) {
+			const unsigned int	*t = tri_b + 3*adj[k];
+			if((t[0] == v[1] || t[1] == v[1] || t[2] == v[1]) &&
+			   (t[0] == v[2] || t[1] == v[2] || t[2] == v[2])) {
+				match[i] = adj[k];
+				n++;
+				break;
+			}
+		}
+	}
+	return n;
+}
@@ -0,0 +1,68 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Surface Correspondence Header (correspondence.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	CORRESPONDENCE.H v0.1.0
+////
+////	Geometric correspondence between the surfaces of two objects
+////
+////		CorrNearestVertex	-	Nearest vertex of the other surface
+////									within a tolerance.
+////		CorrClosestPoint	-	Closest point on the triangles of the
+////									other surface within a tolerance, as a
+////									triangle and its barycentric weights.
+////		CorrMatchFaces		-	Triangle of the other surface with the
+////									same vertices under a vertex
+////									correspondence.
+////
+////	The queries use a uniform grid over the other surface and run with
+////	ParallelFor.  Ties go to the lowest index, so the results do not
+////	depend on the thread count.  Positions are 3 Reals per vertex and
+////	triangles 3 vertex indices each.
+////
+////////////////////////////////////////////////////////////////
+
+#ifndef _CORRESPONDENCE_H
+#define _CORRESPONDENCE_H
+
+#include "algebra.h"
+
+#define CORR_NONE		0xffffffff		// No correspondence within the tolerance
+
+// match[i] = vertex of b nearest to vertex i of a, within tol.  Returns the
+// number of matched vertices.
+unsigned int	CorrNearestVertex(unsigned int num_a, const Real *pos_a,
+								  unsigned int num_b, const Real *pos_b,
+								  Real tol, unsigned int *match);
+
+// face[i] = triangle of b closest to vertex i of a, within tol, and
+// bary[3*i..3*i+2] the weights of its vertices at the closest point.
+// Returns the number of vertices found.
+unsigned int	CorrClosestPoint(unsigned int num_a, const Real *pos_a,
+								 unsigned int num_b, const Real *pos_b,
+								 unsigned int num_tri, const unsigned int *tri,
+								 Real tol, unsigned int *face, Real *bary);
+
+// match[i] = triangle of b with the vertices of triangle i of a mapped by
+// vmatch, in any order.  Returns the number of matched triangles.
+unsigned int	CorrMatchFaces(unsigned int num_tri_a, const unsigned int *tri_a, const unsigned int *vmatch,
+							   unsigned int num_b, unsigned int num_tri_b, const unsigned int *tri_b,
+							   unsigned int *match);
+
+#endif
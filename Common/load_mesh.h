@@ -59,6 +59,8 @@ typedef struct {
     MeshType    type;
     LDNode		*node;
     int			num_node;
+	int			*node_id;		// File index of each node, NULL if the nodes are
+								//   in file order, see ReorderLoadData()
     LDElement	*element;
     int			num_element;
     LDFace		*face;
@@ -29,6 +29,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include <math.h>
 #include <float.h>
 #include "load_mesh.h"
+#include "mesh_order.h"
 
 #define EMPTY_LINE_CHAR 10
 #define DELIM " \t"
@@ -59,7 +60,8 @@ void updateBBox(LoadData *data, double x, double y, double z)
 //
 //	Load_Neutral()
 //
-//	    Reads in .neu files
+//	    Reads in .neu files.  The nodes and elements are renumbered
+//		by GetMeshOrder(), see ReorderLoadData().
 //
 LoadData* LoadNeutral(const char *filename)
 {
@@ -84,6 +86,9 @@ LoadData* LoadNeutral(const char *filename)
     data->num_node		= 0;
     data->num_element	= 0;
     data->num_face		= 0;
+    data->num_edge		= 0;
+	data->edge			= NULL;
+	data->node_id		= NULL;
 
 	node_offset			= 1;
 
@@ -198,6 +203,8 @@ LoadData* LoadNeutral(const char *filename)
 
 	printf("done\n");
 
+	ReorderLoadData(data, GetMeshOrder());
+
     return data;
 }
 
@@ -27,7 +27,11 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "load_mesh.h"
+#include "mapped_file.h"
+#include "mesh_order.h"
 
 #define EMPTY_LINE_CHAR 10
 #define DELIM " \t"
@@ -484,11 +488,375 @@ int Load_Face(const char *basename, int node_offset, LoadData *data)
 
 
 
+/****************************************/
+/*	Binary mesh cache (.meshb)			*/
+/****************************************/
+// LoadNode() keeps the parsed mesh, with the node-element incidence and the
+// element neighbours it derives, in <basename>.meshb.  The file is an
+// MeshBHeader followed by the sections of MeshBSectionIndex, each on a
+// MESHB_ALIGN byte boundary.  The header records the size and modification
+// time of every source file; the cache is used only if they all still
+// match, and is rewritten after each text load otherwise.  Like the .msdb
+// files, it is stored in the byte order of the machine that wrote it.
+// Bump MESHB_VERSION whenever the layout changes.
+#define		MESHB_MAGIC			"GIPSIMSH"
+#define		MESHB_VERSION		1
+#define		MESHB_BYTE_ORDER	0x01020304
+#define		MESHB_ALIGN			8
+
+enum MeshBSourceIndex {
+	MESHB_SRC_NODE = 0,
+	MESHB_SRC_ELE,
+	MESHB_SRC_FACE,			// .face for tetrahedra, .edge for triangles
+	MESHB_NUM_SOURCES
+};
+
+enum MeshBSectionIndex {
+	MESHB_NODE_POS = 0,		// double[3*num_node]
+	MESHB_NODE_BOUNDARY,	// int[num_node]
+	MESHB_NODE_ATTRIB,		// double[num_node*num_node_attrib]
+	MESHB_NODE_ELEM_PTR,	// int[num_node+1], elements incident to each node
+	MESHB_NODE_ELEM,		// int[node_elem_ptr[num_node]]
+	MESHB_ELEM_NODE,		// int[4*num_element]
+	MESHB_ELEM_NEIGH,		// int[4*num_element]
+	MESHB_ELEM_ATTRIB,		// double[num_element*num_element_attrib]
+	MESHB_FACE,				// int[4*num_face], 3 nodes and the boundary marker
+	MESHB_EDGE,				// int[3*num_edge], 2 nodes and the boundary marker
+	MESHB_NUM_SECTIONS
+};
+
+typedef struct {
+	char			magic[8];		// MESHB_MAGIC, not terminated
+	unsigned int	version;		// MESHB_VERSION
+	unsigned int	byte_order;		// MESHB_BYTE_ORDER as written
+	int				type;			// MeshType
+	int				num_node;
+	int				num_element;
+	int				num_face;
+	int				num_edge;
+	int				num_node_attrib;
+	int				num_element_attrib;
+	int				element_nodes;	// nodes per element
+	double			bbox[6];		// minx, miny, minz, maxx, maxy, maxz
+	long long		source_size[MESHB_NUM_SOURCES];		// -1 for a missing file
+	long long		source_time[MESHB_NUM_SOURCES];
+	unsigned int	offset[MESHB_NUM_SECTIONS];
+	unsigned int	size[MESHB_NUM_SECTIONS];
+} MeshBHeader;
+
+static const char	*meshb_source_ext[MESHB_NUM_SOURCES] = { "node", "ele", "face" };
+
+
+////////////////////////////////////////////////////////////////
+//
+//	MeshBStamp()
+//
+//		Size and modification time of the source files of basename
+//
+static void MeshBStamp(const char *basename, MeshType type, long long *size, long long *time)
+{
+    char		*filename = (char *) malloc(sizeof(char)*(strlen(basename)+6));
+	struct stat	st;
+
+	for(int s = 0; s < MESHB_NUM_SOURCES; s++) {
+		const char	*ext = meshb_source_ext[s];
+		if(s == MESHB_SRC_FACE && type == TRIANGLE) ext = "edge";
+		sprintf(filename, "%s.%s", basename, ext);
+		if(stat(filename, &st) == 0) {
+			size[s] = (long long) st.st_size;
+			time[s] = (long long) st.st_mtime;
+		}
+		else size[s] = time[s] = -1;
+	}
+
+	free(filename);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Load_MeshB()
+//
+//		Reads in the .meshb cache of basename.  Returns NULL if it
+//		is missing, was written elsewhere, is older than the text
+//		files or is truncated or malformed.  The per-node element lists and the attributes point
+//		into the mapped image, which stays mapped for the life of the
+//		process like the LoadData it backs.
+//
+static LoadData* Load_MeshB(const char *basename)
+{
+    char			*filename = (char *) malloc(sizeof(char)*(strlen(basename)+7));
+	MappedFile		*file = new MappedFile();
+	long long		size[MESHB_NUM_SOURCES], time[MESHB_NUM_SOURCES];
+	int				i, j, s;
+
+    sprintf(filename, "%s.meshb", basename);
+	bool	opened = file->Open(filename);
+	free(filename);
+	if(!opened || file->Size() < sizeof(MeshBHeader)) {
+		delete file;
+		return NULL;
+	}
+
+	char			*image	= file->Data();
+	MeshBHeader		*h		= (MeshBHeader *) image;
+
+	if(memcmp(h->magic, MESHB_MAGIC, 8) != 0 || h->version != MESHB_VERSION ||
+	   h->byte_order != MESHB_BYTE_ORDER) {
+		delete file;
+		return NULL;
+	}
+	MeshBStamp(basename, (MeshType) h->type, size, time);
+	for(s = 0; s < MESHB_NUM_SOURCES; s++) {
+		if(size[s] != h->source_size[s] || time[s] != h->source_time[s]) {
+			delete file;
+			return NULL;
+		}
+	}
+	if(h->num_node < 0 || h->num_element < 0 || h->num_face < 0 || h->num_edge < 0 ||
+	   h->num_node_attrib < 0 || h->num_element_attrib < 0 ||
+	   h->element_nodes < 0 || h->element_nodes > 4) {
+		delete file;
+		return NULL;
+	}
+
+	// Every section has to have the size Save_MeshB() gives it and lie
+	// inside the file.  The size of the node-element lists is checked
+	// against their row pointers below.
+	long long	expected[MESHB_NUM_SECTIONS];
+	expected[MESHB_NODE_POS]		= (long long) sizeof(double)*3*h->num_node;
+	expected[MESHB_NODE_BOUNDARY]	= (long long) sizeof(int)*h->num_node;
+	expected[MESHB_NODE_ATTRIB]		= (long long) sizeof(double)*h->num_node*h->num_node_attrib;
+	expected[MESHB_NODE_ELEM_PTR]	= (long long) sizeof(int)*(h->num_node+1);
+	expected[MESHB_NODE_ELEM]		= h->size[MESHB_NODE_ELEM];
+	expected[MESHB_ELEM_NODE]		= (long long) sizeof(int)*4*h->num_element;
+	expected[MESHB_ELEM_NEIGH]		= (long long) sizeof(int)*4*h->num_element;
+	expected[MESHB_ELEM_ATTRIB]		= (long long) sizeof(double)*h->num_element*h->num_element_attrib;
+	expected[MESHB_FACE]			= (long long) sizeof(int)*4*h->num_face;
+	expected[MESHB_EDGE]			= (long long) sizeof(int)*3*h->num_edge;
+	for(s = 0; s < MESHB_NUM_SECTIONS; s++) {
+		if((long long) h->size[s] != expected[s] || (h->offset[s] % MESHB_ALIGN) != 0 ||
+		   h->offset[s] < sizeof(MeshBHeader) ||
+		   (size_t) h->offset[s] + h->size[s] > file->Size()) {
+			delete file;
+			return NULL;
+		}
+	}
+
+	// The node-element lists have to be well formed
+	int		*elem_ptr		= (int *) (image + h->offset[MESHB_NODE_ELEM_PTR]);
+	int		*node_elem		= (int *) (image + h->offset[MESHB_NODE_ELEM]);
+	bool	valid			= (elem_ptr[0] == 0 &&
+							   (long long) sizeof(int)*elem_ptr[h->num_node] == h->size[MESHB_NODE_ELEM]);
+	for(i = 0; i < h->num_node && valid; i++)
+		valid = (elem_ptr[i+1] >= elem_ptr[i]);
+	for(i = 0; valid && i < elem_ptr[h->num_node]; i++)
+		valid = (node_elem[i] >= 0 && node_elem[i] < h->num_element);
+	if(!valid) {
+		delete file;
+		return NULL;
+	}
+
+	printf("\n\tLoading Mesh Cache ...\t\t");
+
+	double	*pos			= (double *) (image + h->offset[MESHB_NODE_POS]);
+	int		*boundary		= (int *) (image + h->offset[MESHB_NODE_BOUNDARY]);
+	double	*node_attrib	= (double *) (image + h->offset[MESHB_NODE_ATTRIB]);
+	int		*elem_node		= (int *) (image + h->offset[MESHB_ELEM_NODE]);
+	int		*elem_neigh		= (int *) (image + h->offset[MESHB_ELEM_NEIGH]);
+	double	*elem_attrib	= (double *) (image + h->offset[MESHB_ELEM_ATTRIB]);
+	int		*face			= (int *) (image + h->offset[MESHB_FACE]);
+	int		*edge			= (int *) (image + h->offset[MESHB_EDGE]);
+
+    LoadData	*data = (LoadData *) malloc(sizeof(LoadData));
+
+	data->type			= (MeshType) h->type;
+	data->num_node		= h->num_node;
+	data->num_element	= h->num_element;
+	data->num_face		= h->num_face;
+	data->num_edge		= h->num_edge;
+	data->node_id		= NULL;
+	data->minx = h->bbox[0];	data->miny = h->bbox[1];	data->minz = h->bbox[2];
+	data->maxx = h->bbox[3];	data->maxy = h->bbox[4];	data->maxz = h->bbox[5];
+
+    data->node		= (LDNode *) malloc(sizeof(LDNode)*data->num_node);
+    data->element	= (LDElement *) malloc(sizeof(LDElement)*data->num_element);
+	data->face		= (data->num_face > 0) ? (LDFace *) malloc(sizeof(LDFace)*data->num_face) : NULL;
+	data->edge		= (data->num_edge > 0) ? (LDEdge *) malloc(sizeof(LDEdge)*data->num_edge) : NULL;
+
+	for(i = 0; i < data->num_node; i++) {
+		LDNode	&n = data->node[i];
+		for(j = 0; j < 3; j++) n.pos[j] = pos[3*i+j];
+		n.boundary		= boundary[i];
+		n.num_attrib	= h->num_node_attrib;
+		n.attrib		= (h->num_node_attrib > 0) ? node_attrib + i*h->num_node_attrib : NULL;
+		n.num_element	= elem_ptr[i+1] - elem_ptr[i];
+		n.element		= node_elem + elem_ptr[i];
+	}
+
+	for(i = 0; i < data->num_element; i++) {
+		LDElement	&e = data->element[i];
+		for(j = 0; j < 4; j++) {
+			e.node[j]	= elem_node[4*i+j];
+			e.neigh[j]	= elem_neigh[4*i+j];
+		}
+		e.num_node		= h->element_nodes;
+		e.num_attrib	= h->num_element_attrib;
+		e.attrib		= (h->num_element_attrib > 0) ? elem_attrib + i*h->num_element_attrib : NULL;
+	}
+
+	for(i = 0; i < data->num_face; i++) {
+		for(j = 0; j < 3; j++) data->face[i].node[j] = face[4*i+j];
+		data->face[i].boundary = face[4*i+3];
+	}
+
+	for(i = 0; i < data->num_edge; i++) {
+		for(j = 0; j < 2; j++) data->edge[i].node[j] = edge[3*i+j];
+		data->edge[i].boundary = edge[3*i+2];
+	}
+
+	printf("done\n");
+
+	return data;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Save_MeshB()
+//
+//		Writes the .meshb cache of a mesh loaded from the text files
+//		of basename.  Failing to write it is not an error.
+//
+static int Save_MeshB(const char *basename, LoadData *data)
+{
+	MeshBHeader		h;
+	int				i, j, s;
+	int				num_node_attrib = 0, num_element_attrib = 0, element_nodes = 0;
+
+	if(data->num_node > 0)		num_node_attrib		= data->node[0].attrib ? data->node[0].num_attrib : 0;
+	if(data->num_element > 0) {
+		num_element_attrib	= data->element[0].attrib ? data->element[0].num_attrib : 0;
+		element_nodes		= data->element[0].num_node;
+	}
+
+	// Flatten the sections
+	int		num_node_elem = 0;
+	for(i = 0; i < data->num_node; i++) num_node_elem += data->node[i].num_element;
+
+	double	*pos			= (double *) malloc(sizeof(double)*(3*data->num_node + 1));
+	int		*boundary		= (int *) malloc(sizeof(int)*(data->num_node + 1));
+	double	*node_attrib	= (double *) malloc(sizeof(double)*(data->num_node*num_node_attrib + 1));
+	int		*elem_ptr		= (int *) malloc(sizeof(int)*(data->num_node + 1));
+	int		*node_elem		= (int *) malloc(sizeof(int)*(num_node_elem + 1));
+	int		*elem_node		= (int *) malloc(sizeof(int)*(4*data->num_element + 1));
+	int		*elem_neigh		= (int *) malloc(sizeof(int)*(4*data->num_element + 1));
+	double	*elem_attrib	= (double *) malloc(sizeof(double)*(data->num_element*num_element_attrib + 1));
+	int		*face			= (int *) malloc(sizeof(int)*(4*data->num_face + 1));
+	int		*edge			= (int *) malloc(sizeof(int)*(3*data->num_edge + 1));
+
+	elem_ptr[0] = 0;
+	for(i = 0; i < data->num_node; i++) {
+		LDNode	&n = data->node[i];
+		for(j = 0; j < 3; j++)					pos[3*i+j] = n.pos[j];
+		for(j = 0; j < num_node_attrib; j++)	node_attrib[i*num_node_attrib+j] = n.attrib[j];
+		for(j = 0; j < n.num_element; j++)		node_elem[elem_ptr[i]+j] = n.element[j];
+		boundary[i]		= n.boundary;
+		elem_ptr[i+1]	= elem_ptr[i] + n.num_element;
+	}
+	for(i = 0; i < data->num_element; i++) {
+		LDElement	&e = data->element[i];
+		for(j = 0; j < 4; j++) {
+			elem_node[4*i+j]	= (j < e.num_node) ? e.node[j] : -1;
+			elem_neigh[4*i+j]	= e.neigh[j];
+		}
+		for(j = 0; j < num_element_attrib; j++)	elem_attrib[i*num_element_attrib+j] = e.attrib[j];
+	}
+	for(i = 0; i < data->num_face; i++) {
+		for(j = 0; j < 3; j++) face[4*i+j] = data->face[i].node[j];
+		face[4*i+3] = data->face[i].boundary;
+	}
+	for(i = 0; i < data->num_edge; i++) {
+		for(j = 0; j < 2; j++) edge[3*i+j] = data->edge[i].node[j];
+		edge[3*i+2] = data->edge[i].boundary;
+	}
+
+	const void		*section[MESHB_NUM_SECTIONS] = {
+		pos, boundary, node_attrib, elem_ptr, node_elem, elem_node, elem_neigh, elem_attrib, face, edge };
+	unsigned int	section_size[MESHB_NUM_SECTIONS];
+	section_size[MESHB_NODE_POS]		= (unsigned int) (sizeof(double)*3*data->num_node);
+	section_size[MESHB_NODE_BOUNDARY]	= (unsigned int) (sizeof(int)*data->num_node);
+	section_size[MESHB_NODE_ATTRIB]		= (unsigned int) (sizeof(double)*data->num_node*num_node_attrib);
+	section_size[MESHB_NODE_ELEM_PTR]	= (unsigned int) (sizeof(int)*(data->num_node+1));
+	section_size[MESHB_NODE_ELEM]		= (unsigned int) (sizeof(int)*num_node_elem);
+	section_size[MESHB_ELEM_NODE]		= (unsigned int) (sizeof(int)*4*data->num_element);
+	section_size[MESHB_ELEM_NEIGH]		= (unsigned int) (sizeof(int)*4*data->num_element);
+	section_size[MESHB_ELEM_ATTRIB]		= (unsigned int) (sizeof(double)*data->num_element*num_element_attrib);
+	section_size[MESHB_FACE]			= (unsigned int) (sizeof(int)*4*data->num_face);
+	section_size[MESHB_EDGE]			= (unsigned int) (sizeof(int)*3*data->num_edge);
+
+	// Header
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MESHB_MAGIC, 8);
+	h.version				= MESHB_VERSION;
+	h.byte_order			= MESHB_BYTE_ORDER;
+	h.type					= data->type;
+	h.num_node				= data->num_node;
+	h.num_element			= data->num_element;
+	h.num_face				= data->num_face;
+	h.num_edge				= data->num_edge;
+	h.num_node_attrib		= num_node_attrib;
+	h.num_element_attrib	= num_element_attrib;
+	h.element_nodes			= element_nodes;
+	h.bbox[0] = data->minx;	h.bbox[1] = data->miny;	h.bbox[2] = data->minz;
+	h.bbox[3] = data->maxx;	h.bbox[4] = data->maxy;	h.bbox[5] = data->maxz;
+	MeshBStamp(basename, data->type, h.source_size, h.source_time);
+
+	unsigned int	offset = (sizeof(MeshBHeader) + MESHB_ALIGN - 1) / MESHB_ALIGN * MESHB_ALIGN;
+	for(s = 0; s < MESHB_NUM_SECTIONS; s++) {
+		h.offset[s]	= offset;
+		h.size[s]	= section_size[s];
+		offset		= (offset + section_size[s] + MESHB_ALIGN - 1) / MESHB_ALIGN * MESHB_ALIGN;
+	}
+
+	// Write
+    char	*filename = (char *) malloc(sizeof(char)*(strlen(basename)+7));
+    sprintf(filename, "%s.meshb", basename);
+	FILE	*fp = fopen(filename, "wb");
+	int		ok = (fp != NULL);
+	if(ok) {
+		static const char	pad[MESHB_ALIGN] = { 0 };
+		unsigned int		written = sizeof(MeshBHeader);
+
+		ok = (fwrite(&h, sizeof(MeshBHeader), 1, fp) == 1);
+		for(s = 0; s < MESHB_NUM_SECTIONS && ok; s++) {
+			ok = (fwrite(pad, 1, h.offset[s] - written, fp) == h.offset[s] - written);
+			if(ok && section_size[s] > 0) ok = (fwrite(section[s], section_size[s], 1, fp) == 1);
+			written = h.offset[s] + section_size[s];
+		}
+		fclose(fp);
+		if(!ok) remove(filename);
+	}
+	free(filename);
+
+	free(pos);			free(boundary);		free(node_attrib);
+	free(elem_ptr);		free(node_elem);	free(elem_node);
+	free(elem_neigh);	free(elem_attrib);	free(face);		free(edge);
+
+	return ok;
+}
+
+
+
 ////////////////////////////////////////////////////////////////
 //
 //	Load_Node()
 //
-//	    Reads in .node files
+//	    Reads in .node files, or their .meshb cache when it is
+//		up to date.  The nodes and elements are renumbered by
+//		GetMeshOrder(), see ReorderLoadData().
 //
 LoadData* LoadNode(const char *basename)
 {
@@ -505,6 +873,11 @@ LoadData* LoadNode(const char *basename)
     double		x, y, z;
     LoadData	*data;
 
+	if((data = Load_MeshB(basename)) != NULL) {
+		ReorderLoadData(data, GetMeshOrder());
+		return data;
+	}
+
 	printf("\n\tLoading Nodes ...\t\t");
 
     filename = (char *) malloc(sizeof(char)*(strlen(basename)+6));
@@ -522,6 +895,7 @@ LoadData* LoadNode(const char *basename)
     data->num_element	= 0;
     data->num_edge		= 0;
     data->num_face		= 0;
+	data->node_id		= NULL;
 
 	data->maxx = data->maxy = data->maxz = -DBL_MAX;
 	data->minx = data->miny = data->minz =  DBL_MAX;
@@ -610,6 +984,11 @@ LoadData* LoadNode(const char *basename)
     if (data->type == TETRAHEDRA)
 		Load_Face(basename, node_offset, data);
 
+	Save_MeshB(basename, data);
+
+	// The cache keeps the file order
+	ReorderLoadData(data, GetMeshOrder());
+
     return data;
 }
 
@@ -345,6 +345,7 @@ LoadData* LoadObj(const char *filename)
 
 	data = new LoadData;
     data->num_node	= 0;
+	data->node_id	= NULL;
     data->num_face	= 0;
 
 	info.nNormals	= 0;
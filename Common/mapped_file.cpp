@@ -0,0 +1,127 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Memory Mapped File Implementation (mapped_file.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MAPPED_FILE.CPP v0.1.0
+////
+////	Private copy-on-write view of a whole file mapped into memory
+////
+////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapped_file.h"
+
+
+MappedFile::MappedFile()
+: data(NULL), size(0)
+{
+#ifdef WIN32
+	file	= INVALID_HANDLE_VALUE;
+	mapping	= NULL;
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	MappedFile::Open()
+//
+//		Maps the whole file copy-on-write
+//
+bool MappedFile::Open(const char *filename)
+{
+	Close();
+
+#ifdef WIN32
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+						OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER	file_size;
+	if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if(mapping == NULL) {
+		Close();
+		return false;
+	}
+
+	data = (char *) MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if(data == NULL) {
+		Close();
+		return false;
+	}
+	size = (size_t) file_size.QuadPart;
+#else
+	int		fd = open(filename, O_RDONLY);
+	if(fd < 0) return false;
+
+	struct stat		st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void	*p = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if(p == MAP_FAILED) return false;
+
+	data = (char *) p;
+	size = (size_t) st.st_size;
+#endif
+
+	return true;
+}
+
+
+void MappedFile::Close(void)
+{
+#ifdef WIN32
+	if(data != NULL)					UnmapViewOfFile(data);
+	if(mapping != NULL)					CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)	CloseHandle(file);
+	mapping	= NULL;
+	file	= INVALID_HANDLE_VALUE;
+#else
+	if(data != NULL) munmap(data, size);
+#endif
+
+	data	= NULL;
+	size	= 0;
+}
@@ -0,0 +1,66 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Memory Mapped File Header (mapped_file.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MAPPED_FILE.H v0.1.0
+////
+////	Private copy-on-write view of a whole file mapped into memory
+////
+////		MappedFile			-	Maps a file copy-on-write so that loaders
+////									can point model arrays straight into the
+////									file image.  Pages written by the
+////									simulation are private to the process
+////									and never reach the file.
+////
+////////////////////////////////////////////////////////////////
+
+
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <stddef.h>
+
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Returns false if the file does not exist or cannot be mapped
+	bool			Open(const char *filename);
+	void			Close(void);
+
+	bool			IsOpen(void) const			{ return data != NULL; }
+	char			*Data(void) const			{ return data; }
+	size_t			Size(void) const			{ return size; }
+
+private:
+	char			*data;
+	size_t			size;
+
+#ifdef WIN32
+	void			*file;
+	void			*mapping;
+#endif
+
+	// Not copyable
+	MappedFile(const MappedFile &);
+	void operator=(const MappedFile &);
+};
+
+#endif
@@ -133,20 +133,10 @@ void multMM(Matrix<double> &result, const Matrix<double> &a1, const Matrix<doubl
 
 
 template<>
-int invM(Matrix<double> &result, const Matrix<double> &M) {
-	doublereal		*work = new doublereal[M.m()*BLOCKSIZE];
-	integer			lwork = M.m()*BLOCKSIZE;
-	integer			n, lda;
-	integer			*ipiv = new integer[M.m()]; 
+int invM(Matrix<double> &result, const Matrix<double> &M, DenseWorkspace &ws) {
+	integer			n, lda, lwork;
 	integer			info;
 
-//  the ALGEBRA_USE_MKL define's make the above code appear as:
-/*	double		*work = new double[M.m()*BLOCKSIZE];
-	int			lwork = M.m()*BLOCKSIZE;
-	int			n, lda;
-	int			*ipiv = new int[M.m()]; 
-	int			info;		*/
-
 	ASSERT(M.m() == M.n());
 
 	if(result.begin() != M.begin()) result = M;
@@ -154,85 +144,220 @@ int invM(Matrix<double> &result, const Matrix<double> &M) {
 	n	= result.n();
 	lda = n;
 
+	switch(n) {
+		case 2:	return invKernel2(result.begin(), result.begin());
+		case 3:	return invKernel3(result.begin(), result.begin());
+		case 4:	return invKernel4(result.begin(), result.begin());
+	}
+
+	lwork = n * BLOCKSIZE;
+
+	doublereal		*work = ws.RealBuffer(lwork);
+	integer			*ipiv = (integer *) ws.IndexBuffer(n * sizeof(integer));
+
 	dgetrf_(&n, &n, result.begin(), &lda,  &ipiv[0], &info);
+	if(info != 0) return info;
 	dgetri_(&n, result.begin(), &lda, &ipiv[0], &work[0], &lwork, &info);
 	// former MKL function calls:
 	//DGETRF(&n, &n, result.begin(), &lda,  &ipiv[0], &info);
 	//DGETRI(&n, result.begin(), &lda, &ipiv[0], &work[0], &lwork, &info);
 
-	delete[] work;
-	delete[] ipiv;
-
 	return info;
 }
 
 // NOTE: The pseudo inverse is not tested with non-square matrices!!
 template<>
-int pinvM(Matrix<double> &result, const Matrix<double> &M) {
-	
-	integer			lwork	= M.m()*M.m()*BLOCKSIZE;
-	doublereal		*work	= new doublereal[lwork];
-	integer			*iwork	= new integer[8*M.m()];
-	integer			lda, ldu, ldvt;
-	integer			info;
+int pinvM(Matrix<double> &result, const Matrix<double> &M, DenseWorkspace &ws) {
 	integer			m		= M.m();
 	integer			n		= M.n();
-	char		jobu	= 'A';
-	char		jobvt	= 'A';
-	int			lds		= MAX(m, n);
-	doublereal		*S		= new doublereal[MAX(M.m(), M.n())];
-	Matrix<doublereal>	U(m, m, 0.0);
-	Matrix<doublereal>	VT(n, n, 0.0);
-	Matrix<double>	PS(lds, lds, 0.0);
-	Matrix<double>	temp(m, n, 0.0);
-	
-//  the ALGEBRA_USE_MKL define's make the above code appear as:
-/*	int			lwork	= M.m()*M.m()*BLOCKSIZE;
-	double		*work	= new double[lwork];
-	int			*iwork	= new int[8*M.m()];
-	int			lda, ldu, ldvt;
-	int			info;
-	int			m		= M.m();
-	int			n		= M.n();
-	char		jobu	= 'A';
-	char		jobvt	= 'A';
-	int			lds		= MAX(m, n);
-	double		*S		= new double[MAX(M.m(), M.n())];
-	Matrix<double>	U(m, m, 0.0);
-	Matrix<double>	VT(n, n, 0.0);
-	Matrix<double>	PS(lds, lds, 0.0);
-	Matrix<double>	temp(m, n, 0.0);	*/
+	integer			lwork	= m * m * BLOCKSIZE;
+	integer			lda		= m;
+	integer			ldu		= m;
+	integer			ldvt	= n;
+	integer			info;
+	integer			k		= (m < n) ? m : n;
+	char			jobu	= 'A';
+	char			jobvt	= 'A';
+
+	ASSERT(result.m() == (unsigned int) n && result.n() == (unsigned int) m);
+
+	// Carve all real scratch arrays out of one workspace block
+	doublereal		*work	= ws.RealBuffer(lwork + k + m * m + n * n + m * n);
+	doublereal		*S		= work + lwork;
+	doublereal		*U		= S + k;
+	doublereal		*VT		= U + m * m;
+	doublereal		*A		= VT + n * n;
+	integer			*iwork	= (integer *) ws.IndexBuffer(8 * MAX(m, n) * sizeof(integer));
+
+	// Row-major M is column-major M^T, so hand LAPACK the transpose
+	for(integer i = 0; i < m; i++)
+		for(integer j = 0; j < n; j++)
+			A[j * m + i] = M[i][j];
+
+	dgesdd_(&jobu, &m, &n, A, &lda, S, U, &ldu, VT, &ldvt, &work[0], &lwork, &iwork[0], &info);
+	// former MKL function call:
+	//DGESDD(&jobu, &m, &n, result.begin(), &lda, S, U.begin(), &ldu, VT.begin(), &ldvt, 
+	//		&work[0], &lwork, &iwork[0], &info);
+
+	// Read back row-major, U holds U^T and VT holds V.  pinv(M) = V S^+ U^T
+	for(integer i = 0; i < n; i++)
+		for(integer j = 0; j < m; j++) {
+			doublereal	sum = 0.0;
+			for(integer l = 0; l < k; l++)
+				if(!zero(S[l])) sum += VT[i * n + l] * U[l * m + j] / S[l];
+			result[i][j] = sum;
+		}
+
+	return info;
+}
+
+
+#endif
+
+
+#ifndef USE_MATH_LIBS
+
+// Without LAPACK invM falls back to the closed-form kernels and an
+// in-house LU factorization
+template<>
+int invM(Matrix<double> &result, const Matrix<double> &M, DenseWorkspace &ws) {
+	ASSERT(M.m() == M.n());
 
 	if(result.begin() != M.begin()) result = M;
 
-	lda		= m;
-	ldu		= m;
-	ldvt	= n;
+	return invMBatch(result.begin(), result.begin(), result.n(), 1, ws);
+}
 
-	transposeM(result, M);
+#endif
 
-	printf("\tPerforming SVD ..."); 
-	dgesdd_(&jobu, &m, &n, result.begin(), &lda, S, U.begin(), &ldu, VT.begin(), &ldvt, &work[0], &lwork, &iwork[0], &info);
-	// former MKL function call:
-	//DGESDD(&jobu, &m, &n, result.begin(), &lda, S, U.begin(), &ldu, VT.begin(), &ldvt, 
-	//		&work[0], &lwork, &iwork[0], &info);
 
-	printf("\tInverting S ...");
-	for(int i=0; i<lds; i++) {
-		if(!zero(S[i])) PS[i][i] = 1.0/S[i];
+template<>
+int invM(Matrix<double> &result, const Matrix<double> &M) {
+	return invM(result, M, DenseWorkspace::ThreadDefault());
+}
+
+#ifdef USE_MATH_LIBS
+template<>
+int pinvM(Matrix<double> &result, const Matrix<double> &M) {
+	return pinvM(result, M, DenseWorkspace::ThreadDefault());
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Small dense batch kernels
+//
+
+DenseWorkspace &DenseWorkspace::ThreadDefault(void)
+{
+	static ALGEBRA_TLS DenseWorkspace	*ws = NULL;
+
+	// One workspace per thread, kept until the process exits
+	if(ws == NULL) ws = new DenseWorkspace();
+
+	return *ws;
+}
+
+
+int invMBatch(Real *result, const Real *M, unsigned int n, unsigned int count, DenseWorkspace &ws)
+{
+	unsigned int	nn = n * n;
+	int				failed = 0;
+
+	switch(n) {
+		case 1:
+			for(unsigned int b = 0; b < count; b++) {
+				if(M[b] == 0.0) failed++;
+				else result[b] = 1.0 / M[b];
+			}
+			return failed;
+		case 2:
+			for(unsigned int b = 0; b < count; b++)
+				failed += invKernel2(result + b * nn, M + b * nn);
+			return failed;
+		case 3:
+			for(unsigned int b = 0; b < count; b++)
+				failed += invKernel3(result + b * nn, M + b * nn);
+			return failed;
+		case 4:
+			for(unsigned int b = 0; b < count; b++)
+				failed += invKernel4(result + b * nn, M + b * nn);
+			return failed;
 	}
 
-	printf("\tMultiplying ...");
-	// NOTE: Couldn't be slower than this !!
-	multMM(temp, PS, U);
-	multMM(result, VT, temp); 
+	Real	*lu		= ws.RealBuffer(nn + n);
+	Real	*col	= lu + nn;
+	int		*ipiv	= (int *) ws.IndexBuffer(n * sizeof(int));
 
-	delete[]	work;
-	delete[]	S;
+	for(unsigned int b = 0; b < count; b++) {
+		const Real	*a = M + b * nn;
+		Real		*r = result + b * nn;
 
-	return info;
+		for(unsigned int i = 0; i < nn; i++) lu[i] = a[i];
+		if(factorLU(lu, ipiv, n) != 0) {
+			failed++;
+			continue;
+		}
+
+		for(unsigned int j = 0; j < n; j++) {
+			for(unsigned int i = 0; i < n; i++) col[i] = 0.0;
+			col[j] = 1.0;
+			solveLU(lu, ipiv, col, n);
+			for(unsigned int i = 0; i < n; i++) r[i * n + j] = col[i];
+		}
+	}
+
+	return failed;
 }
 
 
-#endif
+int invSPDBatch(Real *result, const Real *M, unsigned int n, unsigned int count, DenseWorkspace &ws)
+{
+	unsigned int	nn = n * n;
+	int				failed = 0;
+	Real			*l		= ws.RealBuffer(nn + n);
+	Real			*col	= l + nn;
+
+	for(unsigned int b = 0; b < count; b++) {
+		const Real	*a = M + b * nn;
+		Real		*r = result + b * nn;
+
+		for(unsigned int i = 0; i < nn; i++) l[i] = a[i];
+		if(factorCholesky(l, n) != 0) {
+			failed++;
+			continue;
+		}
+
+		// The inverse is symmetric: solve for the lower triangle only
+		for(unsigned int j = 0; j < n; j++) {
+			for(unsigned int i = 0; i < n; i++) col[i] = 0.0;
+			col[j] = 1.0;
+			solveCholesky(l, col, n);
+			for(unsigned int i = j; i < n; i++) r[i * n + j] = r[j * n + i] = col[i];
+		}
+	}
+
+	return failed;
+}
+
 
+int factorCholeskyBatch(Real *A, unsigned int n, unsigned int count)
+{
+	unsigned int	nn = n * n;
+	int				failed = 0;
+
+	for(unsigned int b = 0; b < count; b++)
+		if(factorCholesky(A + b * nn, n) != 0) failed++;
+
+	return failed;
+}
+
+
+void solveCholeskyBatch(const Real *L, Real *b, unsigned int n, unsigned int count)
+{
+	unsigned int	nn = n * n;
+
+	for(unsigned int k = 0; k < count; k++)
+		solveCholesky(L + k * nn, b + k * n, n);
+}
@@ -29,6 +29,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #define _MATRIX_H
 
 #include "algebra.h"
+#include "memory_pool.h"
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
@@ -80,6 +81,11 @@ template<class T> int		invM(Matrix<T> &result, const Matrix<T> &M);
 template<class T> int		pinvM(Matrix<T> &result, const Matrix<T> &M);
 template<class T> T			traceM(const Matrix<T> &M);
 
+// Small dense factorizations with caller owned workspaces (see below)
+class DenseWorkspace;
+template<class T> int		invM(Matrix<T> &result, const Matrix<T> &M, DenseWorkspace &ws);
+template<class T> int		pinvM(Matrix<T> &result, const Matrix<T> &M, DenseWorkspace &ws);
+
 
 // General MxN dimensional Matrix Template
 template <class T> 
@@ -120,7 +126,7 @@ public:
 
 // Destructor
 	~Matrix<T>() {
-		if (data != NULL) delete[] data; 
+		if (data != NULL) AlgebraDeallocate(data, _m * _n * sizeof(T));
 		data = NULL;
 	}
 
@@ -168,8 +174,9 @@ protected:
 	T				*data;		// Component array
 	unsigned int	_m, _n;		// Dimensions of the matrix
 
+	// Component storage goes through the algebra allocator (memory_pool.h)
 	void init(int m, int n) {
-		data = new T[m * n];
+		data = (T *) AlgebraAllocate(m * n * sizeof(T));
 
 		_m = m;
 		_n = n;
@@ -525,7 +532,270 @@ inline T traceM(const Matrix<T> &M)
 }
 
 
+// ****************************************************************
+// *			SMALL DENSE FACTORIZATIONS						  *  
+// ****************************************************************
+//
+//	The kernels below work on raw row-major n x n arrays so that they can
+//	be run over contiguous batches (count matrices stored back to back)
+//	without touching the allocator.  They return 0 on success and a
+//	positive value when the matrix is singular (not positive definite for
+//	the Cholesky kernels), following the LAPACK info convention.
+//
+//	invM/pinvM dispatch to the closed-form 2x2/3x3/4x4 kernels and use
+//	the thread's default DenseWorkspace for the general case, so repeated
+//	calls do not allocate once the workspace has grown to the largest size.
+//
 
+// Grow-only scratch storage for the LU/SVD paths
+class DenseWorkspace {
+public:
+	DenseWorkspace() : rbuf(NULL), rsize(0), ibuf(NULL), isize(0) {}
+	~DenseWorkspace() {
+		if(rbuf != NULL) ::operator delete(rbuf);
+		if(ibuf != NULL) ::operator delete(ibuf);
+	}
 
-#endif
+	Real	*RealBuffer(size_t n) {
+		if(n > rsize) {
+			if(rbuf != NULL) ::operator delete(rbuf);
+			rbuf	= (Real *) ::operator new(n * sizeof(Real));
+			rsize	= n;
+		}
+		return rbuf;
+	}
+
+	void	*IndexBuffer(size_t bytes) {
+		if(bytes > isize) {
+			if(ibuf != NULL) ::operator delete(ibuf);
+			ibuf	= ::operator new(bytes);
+			isize	= bytes;
+		}
+		return ibuf;
+	}
+
+	// Workspace used by the two argument invM/pinvM on the calling thread
+	static DenseWorkspace	&ThreadDefault(void);
+
+private:
+	Real	*rbuf;
+	size_t	rsize;
+	void	*ibuf;
+	size_t	isize;
+
+	// Not copyable
+	DenseWorkspace(const DenseWorkspace &);
+	void operator=(const DenseWorkspace &);
+};
+
+
+// Closed-form inverses.  r may alias a.
+template<class T>
+inline int invKernel2(T *r, const T *a)
+{
+	T	det = a[0] * a[3] - a[1] * a[2];
+
+	if(det == 0.0) return 1;
+	T	idet = 1.0 / det;
+	T	a0 = a[0];
+
+	r[1] = -a[1] * idet;
+	r[2] = -a[2] * idet;
+	r[0] =  a[3] * idet;
+	r[3] =  a0 * idet;
+
+	return 0;
+}
+
+template<class T>
+inline int invKernel3(T *r, const T *a)
+{
+	T	c0 = a[4] * a[8] - a[5] * a[7];
+	T	c1 = a[5] * a[6] - a[3] * a[8];
+	T	c2 = a[3] * a[7] - a[4] * a[6];
+	T	det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+
+	if(det == 0.0) return 1;
+	T	idet = 1.0 / det;
+	T	t[9];
+
+	t[0] = c0 * idet;
+	t[1] = (a[2] * a[7] - a[1] * a[8]) * idet;
+	t[2] = (a[1] * a[5] - a[2] * a[4]) * idet;
+	t[3] = c1 * idet;
+	t[4] = (a[0] * a[8] - a[2] * a[6]) * idet;
+	t[5] = (a[2] * a[3] - a[0] * a[5]) * idet;
+	t[6] = c2 * idet;
+	t[7] = (a[1] * a[6] - a[0] * a[7]) * idet;
+	t[8] = (a[0] * a[4] - a[1] * a[3]) * idet;
+
+	for(int i = 0; i < 9; i++) r[i] = t[i];
+
+	return 0;
+}
+
+template<class T>
+inline int invKernel4(T *r, const T *a)
+{
+	// 2x2 sub-determinants of the upper and lower row pairs
+	T	s0 = a[0] * a[5]  - a[4]  * a[1];
+	T	s1 = a[0] * a[6]  - a[4]  * a[2];
+	T	s2 = a[0] * a[7]  - a[4]  * a[3];
+	T	s3 = a[1] * a[6]  - a[5]  * a[2];
+	T	s4 = a[1] * a[7]  - a[5]  * a[3];
+	T	s5 = a[2] * a[7]  - a[6]  * a[3];
+	T	c5 = a[10] * a[15] - a[14] * a[11];
+	T	c4 = a[9]  * a[15] - a[13] * a[11];
+	T	c3 = a[9]  * a[14] - a[13] * a[10];
+	T	c2 = a[8]  * a[15] - a[12] * a[11];
+	T	c1 = a[8]  * a[14] - a[12] * a[10];
+	T	c0 = a[8]  * a[13] - a[12] * a[9];
+	T	det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+	if(det == 0.0) return 1;
+	T	idet = 1.0 / det;
+	T	t[16];
+
+	t[0]  = ( a[5]  * c5 - a[6]  * c4 + a[7]  * c3) * idet;
+	t[1]  = (-a[1]  * c5 + a[2]  * c4 - a[3]  * c3) * idet;
+	t[2]  = ( a[13] * s5 - a[14] * s4 + a[15] * s3) * idet;
+	t[3]  = (-a[9]  * s5 + a[10] * s4 - a[11] * s3) * idet;
+	t[4]  = (-a[4]  * c5 + a[6]  * c2 - a[7]  * c1) * idet;
+	t[5]  = ( a[0]  * c5 - a[2]  * c2 + a[3]  * c1) * idet;
+	t[6]  = (-a[12] * s5 + a[14] * s2 - a[15] * s1) * idet;
+	t[7]  = ( a[8]  * s5 - a[10] * s2 + a[11] * s1) * idet;
+	t[8]  = ( a[4]  * c4 - a[5]  * c2 + a[7]  * c0) * idet;
+	t[9]  = (-a[0]  * c4 + a[1]  * c2 - a[3]  * c0) * idet;
+	t[10] = ( a[12] * s4 - a[13] * s2 + a[15] * s0) * idet;
+	t[11] = (-a[8]  * s4 + a[9]  * s2 - a[11] * s0) * idet;
+	t[12] = (-a[4]  * c3 + a[5]  * c1 - a[6]  * c0) * idet;
+	t[13] = ( a[0]  * c3 - a[1]  * c1 + a[2]  * c0) * idet;
+	t[14] = (-a[12] * s3 + a[13] * s1 - a[14] * s0) * idet;
+	t[15] = ( a[8]  * s3 - a[9]  * s1 + a[10] * s0) * idet;
+
+	for(int i = 0; i < 16; i++) r[i] = t[i];
+
+	return 0;
+}
+
+
+// In-place LU factorization with partial pivoting (a = P L U).  On return a
+// holds L (unit diagonal, below) and U (on and above the diagonal).
+template<class T>
+inline int factorLU(T *a, int *ipiv, unsigned int n)
+{
+	int		info = 0;
+
+	for(unsigned int k = 0; k < n; k++) {
+		unsigned int	p = k;
+		T				pmax = fabs(a[k * n + k]);
 
+		for(unsigned int i = k + 1; i < n; i++)
+			if(fabs(a[i * n + k]) > pmax) { pmax = fabs(a[i * n + k]); p = i; }
+
+		ipiv[k] = p;
+		if(pmax == 0.0) {
+			if(info == 0) info = k + 1;
+			continue;
+		}
+		if(p != k)
+			for(unsigned int j = 0; j < n; j++) {
+				T	tmp = a[k * n + j];
+				a[k * n + j] = a[p * n + j];
+				a[p * n + j] = tmp;
+			}
+
+		T	ipivot = 1.0 / a[k * n + k];
+		for(unsigned int i = k + 1; i < n; i++) {
+			T	l = (a[i * n + k] *= ipivot);
+			if(l != 0.0)
+				for(unsigned int j = k + 1; j < n; j++)
+					a[i * n + j] -= l * a[k * n + j];
+		}
+	}
+
+	return info;
+}
+
+// Solves (P L U) x = b in place for a factorization from factorLU
+template<class T>
+inline void solveLU(const T *lu, const int *ipiv, T *b, unsigned int n)
+{
+	for(unsigned int k = 0; k < n; k++)
+		if((unsigned int) ipiv[k] != k) {
+			T	tmp = b[k];
+			b[k] = b[ipiv[k]];
+			b[ipiv[k]] = tmp;
+		}
+
+	for(unsigned int i = 1; i < n; i++) {
+		T	sum = b[i];
+		for(unsigned int j = 0; j < i; j++) sum -= lu[i * n + j] * b[j];
+		b[i] = sum;
+	}
+
+	for(int i = n - 1; i >= 0; i--) {
+		T	sum = b[i];
+		for(unsigned int j = i + 1; j < n; j++) sum -= lu[i * n + j] * b[j];
+		b[i] = sum / lu[i * n + i];
+	}
+}
+
+// In-place Cholesky factorization a = L L^T of a symmetric positive definite
+// matrix.  Only the lower triangle is referenced and overwritten with L.
+template<class T>
+inline int factorCholesky(T *a, unsigned int n)
+{
+	for(unsigned int j = 0; j < n; j++) {
+		T	d = a[j * n + j];
+		for(unsigned int k = 0; k < j; k++) d -= a[j * n + k] * a[j * n + k];
+		if(d <= 0.0) return j + 1;
+
+		d = sqrt(d);
+		a[j * n + j] = d;
+
+		T	id = 1.0 / d;
+		for(unsigned int i = j + 1; i < n; i++) {
+			T	sum = a[i * n + j];
+			for(unsigned int k = 0; k < j; k++) sum -= a[i * n + k] * a[j * n + k];
+			a[i * n + j] = sum * id;
+		}
+	}
+
+	return 0;
+}
+
+// Solves L L^T x = b in place for a factorization from factorCholesky
+template<class T>
+inline void solveCholesky(const T *l, T *b, unsigned int n)
+{
+	for(unsigned int i = 0; i < n; i++) {
+		T	sum = b[i];
+		for(unsigned int k = 0; k < i; k++) sum -= l[i * n + k] * b[k];
+		b[i] = sum / l[i * n + i];
+	}
+
+	for(int i = n - 1; i >= 0; i--) {
+		T	sum = b[i];
+		for(unsigned int k = i + 1; k < n; k++) sum -= l[k * n + i] * b[k];
+		b[i] = sum / l[i * n + i];
+	}
+}
+
+
+// Batched inversion of count n x n matrices stored back to back.  result
+// may alias M.  Returns the number of singular matrices in the batch; their
+// result blocks are left unspecified.
+int		invMBatch(Real *result, const Real *M, unsigned int n, unsigned int count, DenseWorkspace &ws);
+
+// Batched inversion of symmetric positive definite matrices via Cholesky.
+// Returns the number of matrices that were not positive definite.
+int		invSPDBatch(Real *result, const Real *M, unsigned int n, unsigned int count, DenseWorkspace &ws);
+
+// Batched Cholesky factorization (in place) and solve, for reusing the
+// factors of a batch of small SPD systems over several right hand sides.
+int		factorCholeskyBatch(Real *A, unsigned int n, unsigned int count);
+void	solveCholeskyBatch(const Real *L, Real *b, unsigned int n, unsigned int count);
+
+
+#endif
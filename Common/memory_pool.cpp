@@ -0,0 +1,329 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Linear Algebra Storage Allocator Implementation (memory_pool.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MEMORY_POOL.CPP v0.1.0
+////
+////	Storage allocator for the Vector and Matrix component arrays
+////
+////////////////////////////////////////////////////////////////
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+#include "memory_pool.h"
+#include "errors.h"
+
+
+// Free list link stored in the first word of an unused pool block
+typedef struct PoolBlock {
+	struct PoolBlock	*next;
+} PoolBlock;
+
+// Pool of one thread.  The free lists are private to the owner, so the
+// fast path needs no locking.  Blocks freed on another thread go onto the
+// remote lists under remote_mutex and are taken back by the owner before
+// it carves a new slab, so the memory of a thread stays bounded by its own
+// peak usage.  Pools are never destroyed since their blocks may outlive
+// the thread.
+typedef struct AlgebraPool {
+	PoolBlock				*free_list[POOL_NUM_CLASSES];
+	PoolBlock				*remote_list[POOL_NUM_CLASSES];
+	volatile unsigned int	remote_count;
+	pthread_mutex_t			remote_mutex;
+} AlgebraPool;
+
+// Header at the start of every slab.  Slabs are aligned to their size so
+// that the owner of a block is found by masking its address.
+typedef struct {
+	AlgebraPool		*owner;
+} PoolSlab;
+
+#define POOL_SLAB_HEADER	POOL_GRANULE		// Header size, keeps blocks aligned
+
+static ALGEBRA_TLS AlgebraPool			*tls_pool = NULL;
+static ALGEBRA_TLS AlgebraArena			*tls_arena = NULL;
+static ALGEBRA_TLS AlgebraAllocStats	tls_stats;
+
+AlgebraArena	*AlgebraArena::arena_list = NULL;
+
+
+inline static unsigned int PoolClass(size_t bytes)
+{
+	return (bytes == 0) ? 0 : (unsigned int) ((bytes - 1) / POOL_GRANULE);
+}
+
+
+inline static AlgebraPool *PoolOwner(const void *p)
+{
+	return ((PoolSlab *) ((size_t) p & ~((size_t) POOL_SLAB_BYTES - 1)))->owner;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	PoolCreate()
+//
+//		Creates the pool of the calling thread
+//
+static AlgebraPool *PoolCreate(void)
+{
+	AlgebraPool		*pool = new AlgebraPool;
+
+	if(pool == NULL) error_exit(-1, "Cannot allocate memory for algebra pool!\n");
+	memset(pool->free_list, 0, sizeof(pool->free_list));
+	memset(pool->remote_list, 0, sizeof(pool->remote_list));
+	pool->remote_count = 0;
+	pthread_mutex_init(&pool->remote_mutex, NULL);
+
+	return pool;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	PoolReclaim()
+//
+//		Moves the blocks freed by other threads back onto the
+//		free lists of the owner
+//
+static void PoolReclaim(AlgebraPool *pool)
+{
+	pthread_mutex_lock(&pool->remote_mutex);
+	for(unsigned int c = 0; c < POOL_NUM_CLASSES; c++) {
+		PoolBlock	*b = pool->remote_list[c];
+		while(b != NULL) {
+			PoolBlock	*next = b->next;
+			b->next = pool->free_list[c];
+			pool->free_list[c] = b;
+			b = next;
+		}
+		pool->remote_list[c] = NULL;
+	}
+	pool->remote_count = 0;
+	pthread_mutex_unlock(&pool->remote_mutex);
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	PoolRefill()
+//
+//		Carves a new slab into blocks of the given size class
+//		and pushes them onto the free list of the pool
+//
+static void PoolRefill(AlgebraPool *pool, unsigned int c)
+{
+	size_t		block_size	= (c + 1) * POOL_GRANULE;
+	size_t		num_blocks	= (POOL_SLAB_BYTES - POOL_SLAB_HEADER) / block_size;
+	char		*slab;
+
+#ifdef WIN32
+	slab = (char *) _aligned_malloc(POOL_SLAB_BYTES, POOL_SLAB_BYTES);
+#else
+	if(posix_memalign((void **) &slab, POOL_SLAB_BYTES, POOL_SLAB_BYTES) != 0) slab = NULL;
+#endif
+	if(slab == NULL) error_exit(-1, "Cannot allocate memory for algebra pool!\n");
+
+	((PoolSlab *) slab)->owner = pool;
+	slab += POOL_SLAB_HEADER;
+
+	for(size_t i = num_blocks; i > 0; i--) {
+		PoolBlock	*b = (PoolBlock *) (slab + (i - 1) * block_size);
+		b->next = pool->free_list[c];
+		pool->free_list[c] = b;
+	}
+	tls_stats.slabs++;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	AlgebraAllocate()
+//
+//		Returns storage for a component array of the given size
+//
+void *AlgebraAllocate(size_t bytes)
+{
+	if(tls_arena != NULL) {
+		void	*p = tls_arena->Allocate(bytes);
+		if(p != NULL) {
+			tls_stats.arena_allocs++;
+			return p;
+		}
+	}
+
+#ifndef ALGEBRA_NO_POOL
+	if(bytes <= POOL_MAX_BYTES) {
+		unsigned int	c = PoolClass(bytes);
+		AlgebraPool		*pool = tls_pool;
+
+		if(pool == NULL) pool = tls_pool = PoolCreate();
+
+		if(pool->free_list[c] == NULL) {
+			if(pool->remote_count != 0) PoolReclaim(pool);
+			if(pool->free_list[c] == NULL) PoolRefill(pool, c);
+		}
+
+		PoolBlock	*b = pool->free_list[c];
+		pool->free_list[c] = b->next;
+		tls_stats.pool_allocs++;
+		return b;
+	}
+#endif
+
+	tls_stats.heap_allocs++;
+	return ::operator new(bytes);
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	AlgebraDeallocate()
+//
+//		Releases storage obtained from AlgebraAllocate
+//
+void AlgebraDeallocate(void *p, size_t bytes)
+{
+	if(p == NULL) return;
+
+	// Arena blocks are reclaimed in bulk by AlgebraArena::Reset()
+	if(AlgebraArena::FindOwner(p) != NULL) return;
+
+#ifndef ALGEBRA_NO_POOL
+	if(bytes <= POOL_MAX_BYTES) {
+		unsigned int	c = PoolClass(bytes);
+		PoolBlock		*b = (PoolBlock *) p;
+		AlgebraPool		*owner = PoolOwner(p);
+
+		if(owner == tls_pool) {
+			b->next = owner->free_list[c];
+			owner->free_list[c] = b;
+		}
+		else {
+			// Hand the block back to the thread that allocated it
+			pthread_mutex_lock(&owner->remote_mutex);
+			b->next = owner->remote_list[c];
+			owner->remote_list[c] = b;
+			owner->remote_count++;
+			pthread_mutex_unlock(&owner->remote_mutex);
+			tls_stats.remote_frees++;
+		}
+		tls_stats.pool_frees++;
+		return;
+	}
+#endif
+
+	tls_stats.heap_frees++;
+	::operator delete(p);
+}
+
+
+void GetAlgebraAllocStats(AlgebraAllocStats &stats)
+{
+	stats = tls_stats;
+}
+
+
+void ResetAlgebraAllocStats(void)
+{
+	memset(&tls_stats, 0, sizeof(AlgebraAllocStats));
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	AlgebraArena
+//
+AlgebraArena::AlgebraArena(size_t capacity)
+: capacity(capacity), used(0), high_water(0)
+{
+	// Keep the capacity a multiple of the pool granule so that every
+	// block handed out stays aligned the same way pool blocks are
+	this->capacity = ((capacity + POOL_GRANULE - 1) / POOL_GRANULE) * POOL_GRANULE;
+	base = (char *) ::operator new(this->capacity);
+	if(base == NULL) error_exit(-1, "Cannot allocate memory for algebra arena!\n");
+
+	next_arena = arena_list;
+	arena_list = this;
+}
+
+
+AlgebraArena::~AlgebraArena()
+{
+	AlgebraArena	**a = &arena_list;
+
+	while(*a != NULL) {
+		if(*a == this) {
+			*a = next_arena;
+			break;
+		}
+		a = &((*a)->next_arena);
+	}
+
+	::operator delete(base);
+	base = NULL;
+}
+
+
+void *AlgebraArena::Allocate(size_t bytes)
+{
+	size_t	size = ((bytes + POOL_GRANULE - 1) / POOL_GRANULE) * POOL_GRANULE;
+
+	if(size == 0) size = POOL_GRANULE;
+	if(used + size > capacity) return NULL;
+
+	void	*p = base + used;
+	used += size;
+	if(used > high_water) high_water = used;
+
+	return p;
+}
+
+
+AlgebraArena *AlgebraArena::FindOwner(const void *p)
+{
+	for(AlgebraArena *a = arena_list; a != NULL; a = a->next_arena)
+		if(a->Owns(p)) return a;
+
+	return NULL;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	AlgebraArenaScope
+//
+AlgebraArenaScope::AlgebraArenaScope(AlgebraArena &arena)
+{
+	previous = tls_arena;
+	tls_arena = &arena;
+}
+
+
+AlgebraArenaScope::~AlgebraArenaScope()
+{
+	tls_arena = previous;
+}
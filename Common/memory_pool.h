@@ -0,0 +1,132 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Linear Algebra Storage Allocator Header (memory_pool.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MEMORY_POOL.H v0.1.0
+////
+////	Storage allocator for the Vector and Matrix component arrays
+////
+////		AlgebraAllocate / AlgebraDeallocate
+////								-	Entry points used by Vector and Matrix.
+////									Small blocks come from a per-thread
+////									size-class pool, everything else from
+////									the heap.  Pool blocks freed on another
+////									thread go back to the allocating one.
+////		AlgebraArena		-	Bump allocator for per-step temporaries.
+////									Active on a thread only inside an
+////									AlgebraArenaScope, released by Reset().
+////		AlgebraAllocStats	-	Per-thread allocation counters.
+////
+////	Define ALGEBRA_NO_POOL to fall back to plain operator new/delete.
+////
+////////////////////////////////////////////////////////////////
+
+
+#ifndef _MEMORY_POOL_H
+#define _MEMORY_POOL_H
+
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#define ALGEBRA_TLS		__declspec(thread)
+#else
+#define ALGEBRA_TLS		__thread
+#endif
+
+// Pool geometry: size classes are multiples of POOL_GRANULE bytes up to
+// POOL_MAX_BYTES, which covers the 3-vectors, 3x3 and 4x4 matrices that
+// dominate the per-step temporaries.  Blocks are carved out of
+// POOL_SLAB_BYTES slabs, aligned to their size, which are never returned
+// to the system.  POOL_SLAB_BYTES must be a power of two.
+#define POOL_GRANULE		16
+#define POOL_MAX_BYTES		512
+#define POOL_NUM_CLASSES	(POOL_MAX_BYTES / POOL_GRANULE)
+#define POOL_SLAB_BYTES		16384
+
+typedef struct {
+	unsigned long	heap_allocs;		// Blocks served by operator new
+	unsigned long	heap_frees;			// Blocks returned to operator delete
+	unsigned long	pool_allocs;		// Blocks served by the size-class pool
+	unsigned long	pool_frees;			// Blocks returned to the size-class pool
+	unsigned long	remote_frees;		// Pool frees handed back to another thread
+	unsigned long	arena_allocs;		// Blocks served by an active arena
+	unsigned long	slabs;				// Pool slabs allocated by this thread
+} AlgebraAllocStats;
+
+
+// Component storage entry points.  The size passed to AlgebraDeallocate
+// must be the size passed to AlgebraAllocate for the same block.
+void	*AlgebraAllocate(size_t bytes);
+void	AlgebraDeallocate(void *p, size_t bytes);
+
+// Allocation counters of the calling thread
+void	GetAlgebraAllocStats(AlgebraAllocStats &stats);
+void	ResetAlgebraAllocStats(void);
+
+
+// Resettable bump allocator.  All storage handed out inside an
+// AlgebraArenaScope has to be released (or simply abandoned) before Reset()
+// is called; deallocation of arena blocks is a no-op.  Requests that do not
+// fit in the remaining capacity fall through to the pool/heap.
+//
+// Arenas register themselves in a global list so that blocks can be
+// recognized wherever they are freed.  Create and destroy arenas while
+// no other thread is allocating (i.e. at initialization and shutdown).
+class AlgebraArena {
+public:
+	AlgebraArena(size_t capacity);
+	~AlgebraArena();
+
+	void			*Allocate(size_t bytes);
+	void			Reset(void)					{ used = 0; }
+	bool			Owns(const void *p) const	{ return ((const char *) p >= base) && ((const char *) p < base + capacity); }
+
+	size_t			Capacity(void) const		{ return capacity; }
+	size_t			Used(void) const			{ return used; }
+	size_t			HighWater(void) const		{ return high_water; }
+
+	static AlgebraArena	*FindOwner(const void *p);
+
+private:
+	char			*base;
+	size_t			capacity;
+	size_t			used;
+	size_t			high_water;
+
+	AlgebraArena	*next_arena;
+	static AlgebraArena	*arena_list;
+
+	// Not copyable
+	AlgebraArena(const AlgebraArena &);
+	void operator=(const AlgebraArena &);
+};
+
+
+// Makes an arena the allocation source of the calling thread for the
+// lifetime of the scope object.  Scopes nest.
+class AlgebraArenaScope {
+public:
+	AlgebraArenaScope(AlgebraArena &arena);
+	~AlgebraArenaScope();
+
+private:
+	AlgebraArena	*previous;
+};
+
+#endif
@@ -0,0 +1,391 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Mesh Reordering Implementation (mesh_order.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MESH_ORDER.CPP v0.1.0
+////
+////	Node and element renumbering for memory locality
+////
+////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "mesh_order.h"
+
+#define MESH_ORDER_SFC_BITS		10		// Hilbert grid of 2^10 cells per axis
+#define MESH_ORDER_RCM_SWEEPS	5		// Pseudo-peripheral node search
+
+
+static int		mesh_order = -1;		// -1 until first use
+
+
+// Orders indices by a key array
+struct MeshOrderKey {
+	const unsigned int	*key;
+	MeshOrderKey(const unsigned int *k) : key(k) {}
+	bool operator()(unsigned int a, unsigned int b) const { return key[a] < key[b]; }
+};
+
+
+static int DefaultMeshOrder(void)
+{
+	const char	*env = getenv("GIPSI_MESH_ORDER");
+
+	if(env != NULL) {
+		if(!strcmp(env, "none"))	return MESH_ORDER_NONE;
+		if(!strcmp(env, "sfc"))		return MESH_ORDER_SFC;
+	}
+	return MESH_ORDER_RCM;
+}
+
+
+void SetMeshOrder(int method)
+{
+	mesh_order = method;
+}
+
+
+int GetMeshOrder(void)
+{
+	if(mesh_order < 0) mesh_order = DefaultMeshOrder();
+	return mesh_order;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Reverse Cuthill-McKee
+//
+//		Each connected component is numbered breadth first from a
+//		pseudo-peripheral node (George and Liu 1979), neighbours in
+//		order of increasing degree, and the whole order is reversed.
+//
+
+// Breadth first levels from root over the unnumbered nodes.  Returns the
+// last level in queue[first..] and its depth.
+static unsigned int RCMLevels(unsigned int root, const std::vector<unsigned int> &ptr, const std::vector<unsigned int> &adj,
+							  std::vector<int> &mark, int stamp, std::vector<unsigned int> &queue, unsigned int &first)
+{
+	unsigned int	head = 0, depth = 0, level_end;
+
+	queue.clear();
+	queue.push_back(root);
+	mark[root]	= stamp;
+	first		= 0;
+	level_end	= 1;
+	while(head < queue.size()) {
+		unsigned int	i = queue[head++];
+		for(unsigned int k = ptr[i]; k < ptr[i+1]; k++) {
+			unsigned int	j = adj[k];
+			if(mark[j] == stamp || mark[j] == -1) continue;
+			mark[j] = stamp;
+			queue.push_back(j);
+		}
+		if(head == level_end && head < queue.size()) {
+			first		= head;
+			level_end	= queue.size();
+			depth++;
+		}
+	}
+	return depth;
+}
+
+
+static void RCMOrder(unsigned int n, unsigned int num_pair, const unsigned int *pairs, unsigned int *order)
+{
+	std::vector<unsigned int>	ptr(n+1, 0), adj, queue;
+	std::vector<int>			mark(n, 0);
+	unsigned int				i, k, next = 0;
+	int							stamp = 0;
+
+	if(n == 0) return;
+
+	// Symmetric adjacency without duplicates or self loops
+	for(k = 0; k < num_pair; k++)
+		if(pairs[2*k] != pairs[2*k+1]) {
+			ptr[pairs[2*k]+1]++;
+			ptr[pairs[2*k+1]+1]++;
+		}
+	for(i = 0; i < n; i++) ptr[i+1] += ptr[i];
+	adj.resize(ptr[n]);
+	std::vector<unsigned int>	fill(ptr.begin(), ptr.end()-1);
+	for(k = 0; k < num_pair; k++)
+		if(pairs[2*k] != pairs[2*k+1]) {
+			adj[fill[pairs[2*k]]++]		= pairs[2*k+1];
+			adj[fill[pairs[2*k+1]]++]	= pairs[2*k];
+		}
+	unsigned int	nnz = 0;
+	for(i = 0; i < n; i++) {
+		unsigned int	begin = ptr[i], end;
+		std::sort(adj.begin() + begin, adj.begin() + ptr[i+1]);
+		end = std::unique(adj.begin() + begin, adj.begin() + ptr[i+1]) - adj.begin();
+		ptr[i] = nnz;
+		for(k = begin; k < end; k++) adj[nnz++] = adj[k];
+	}
+	ptr[n] = nnz;
+
+	// mark: -1 numbered, otherwise the stamp of the last level search
+	std::vector<unsigned int>	by_degree(n);
+	for(i = 0; i < n; i++) by_degree[i] = i;
+	std::vector<unsigned int>	degree(n);
+	for(i = 0; i < n; i++) degree[i] = ptr[i+1] - ptr[i];
+	std::stable_sort(by_degree.begin(), by_degree.end(), MeshOrderKey(&degree[0]));
+
+	for(unsigned int s = 0; s < n; s++) {
+		unsigned int	root = by_degree[s], first, depth, sweep;
+		if(mark[root] == -1) continue;
+
+		// Pseudo-peripheral root: restart from the lowest degree node of
+		// the last level while the depth grows
+		depth = RCMLevels(root, ptr, adj, mark, ++stamp, queue, first);
+		for(sweep = 0; sweep < MESH_ORDER_RCM_SWEEPS; sweep++) {
+			unsigned int	best = queue[first];
+			for(k = first; k < queue.size(); k++)
+				if(degree[queue[k]] < degree[best]) best = queue[k];
+			unsigned int	d = RCMLevels(best, ptr, adj, mark, ++stamp, queue, first);
+			if(d <= depth) break;
+			depth	= d;
+			root	= best;
+		}
+
+		// Cuthill-McKee numbering of the component
+		unsigned int	head = next;
+		order[next++]	= root;
+		mark[root]		= -1;
+		while(head < next) {
+			unsigned int	i = order[head++], start = next;
+			for(k = ptr[i]; k < ptr[i+1]; k++) {
+				unsigned int	j = adj[k];
+				if(mark[j] == -1) continue;
+				mark[j]			= -1;
+				order[next++]	= j;
+			}
+			std::stable_sort(order + start, order + next, MeshOrderKey(&degree[0]));
+		}
+	}
+
+	std::reverse(order, order + n);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Hilbert curve
+//
+//		Index of each node on the Hilbert curve through a 2^b grid
+//		over the bounding box, from the transposed Gray code of
+//		Skilling (2004).
+//
+static unsigned int HilbertKey(unsigned int x[3])
+{
+	unsigned int	M = 1u << (MESH_ORDER_SFC_BITS-1), P, Q, t;
+	int				i, b;
+
+	for(Q = M; Q > 1; Q >>= 1) {
+		P = Q - 1;
+		for(i = 0; i < 3; i++) {
+			if(x[i] & Q) x[0] ^= P;
+			else {
+				t = (x[0] ^ x[i]) & P;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+	for(i = 1; i < 3; i++) x[i] ^= x[i-1];
+	t = 0;
+	for(Q = M; Q > 1; Q >>= 1)
+		if(x[2] & Q) t ^= Q - 1;
+	for(i = 0; i < 3; i++) x[i] ^= t;
+
+	unsigned int	key = 0;
+	for(b = MESH_ORDER_SFC_BITS-1; b >= 0; b--)
+		for(i = 0; i < 3; i++) key = (key << 1) | ((x[i] >> b) & 1);
+	return key;
+}
+
+
+static void SFCOrder(unsigned int n, const double *pos, unsigned int *order)
+{
+	double			lo[3], hi[3];
+	unsigned int	i, c;
+
+	if(n == 0) return;
+	for(c = 0; c < 3; c++) lo[c] = hi[c] = (n > 0) ? pos[c] : 0.0;
+	for(i = 0; i < n; i++)
+		for(c = 0; c < 3; c++) {
+			if(pos[3*i+c] < lo[c]) lo[c] = pos[3*i+c];
+			if(pos[3*i+c] > hi[c]) hi[c] = pos[3*i+c];
+		}
+
+	std::vector<unsigned int>	key(n);
+	const unsigned int			cells = 1u << MESH_ORDER_SFC_BITS;
+	for(i = 0; i < n; i++) {
+		unsigned int	x[3];
+		for(c = 0; c < 3; c++) {
+			double	s = (hi[c] > lo[c]) ? (pos[3*i+c] - lo[c]) / (hi[c] - lo[c]) : 0.0;
+			x[c] = (unsigned int) (s * cells);
+			if(x[c] >= cells) x[c] = cells - 1;
+		}
+		key[i] = HilbertKey(x);
+	}
+
+	for(i = 0; i < n; i++) order[i] = i;
+	std::stable_sort(order, order + n, MeshOrderKey(&key[0]));
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	MeshNodeOrder()
+//
+void MeshNodeOrder(int method, unsigned int num_node, const double *pos,
+				   unsigned int num_pair, const unsigned int *pairs, unsigned int *order)
+{
+	switch(method) {
+		case MESH_ORDER_RCM:
+			RCMOrder(num_node, num_pair, pairs, order);
+			break;
+		case MESH_ORDER_SFC:
+			SFCOrder(num_node, pos, order);
+			break;
+		default:
+			for(unsigned int i = 0; i < num_node; i++) order[i] = i;
+			break;
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	MeshItemOrder()
+//
+//		Counting sort, stable
+//
+void MeshItemOrder(unsigned int num_item, const unsigned int *key, unsigned int num_key, unsigned int *order)
+{
+	std::vector<unsigned int>	start(num_key+1, 0);
+	unsigned int				i;
+
+	for(i = 0; i < num_item; i++) start[key[i]+1]++;
+	for(i = 0; i < num_key; i++) start[i+1] += start[i];
+	for(i = 0; i < num_item; i++) order[start[key[i]]++] = i;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ReorderLoadData()
+//
+//		Renumbers the nodes by method and sorts the elements by their
+//		lowest new node.  Element and face node indices, element
+//		neighbours and node element lists follow.  The node element
+//		lists are renumbered in place, whether they were allocated by
+//		the text loaders or point into the copy-on-write .meshb image.
+//
+void ReorderLoadData(LoadData *data, int method)
+{
+	const unsigned int	n = data->num_node, ne = data->num_element;
+	unsigned int		i, j, k;
+
+	if(method == MESH_ORDER_NONE || n == 0) return;
+
+	// Node graph of the elements, or of the faces of a surface mesh
+	std::vector<unsigned int>	pairs;
+	std::vector<double>			pos(3*n);
+	for(i = 0; i < ne; i++) {
+		LDElement	&e = data->element[i];
+		for(j = 0; j < (unsigned int) e.num_node; j++)
+			for(k = j+1; k < (unsigned int) e.num_node; k++) {
+				pairs.push_back(e.node[j]);
+				pairs.push_back(e.node[k]);
+			}
+	}
+	if(ne == 0)
+		for(i = 0; i < (unsigned int) data->num_face; i++)
+			for(j = 0; j < 3; j++) {
+				pairs.push_back(data->face[i].node[j]);
+				pairs.push_back(data->face[i].node[(j+1)%3]);
+			}
+	for(i = 0; i < n; i++)
+		for(j = 0; j < 3; j++) pos[3*i+j] = data->node[i].pos[j];
+
+	std::vector<unsigned int>	order(n), inv(n);
+	MeshNodeOrder(method, n, &pos[0], pairs.size()/2, pairs.empty() ? NULL : &pairs[0], &order[0]);
+	for(i = 0; i < n; i++) inv[order[i]] = i;
+
+	// Elements by lowest new node
+	std::vector<unsigned int>	key(ne), eorder(ne), einv(ne);
+	for(i = 0; i < ne; i++) {
+		LDElement	&e = data->element[i];
+		key[i] = n;
+		for(j = 0; j < (unsigned int) e.num_node; j++)
+			if(inv[e.node[j]] < key[i]) key[i] = inv[e.node[j]];
+	}
+	if(ne > 0) MeshItemOrder(ne, &key[0], n+1, &eorder[0]);
+	for(i = 0; i < ne; i++) einv[eorder[i]] = i;
+
+	LDElement	*element = (LDElement *) malloc(sizeof(LDElement)*ne);
+	LDNode		*node = (LDNode *) malloc(sizeof(LDNode)*n);
+	int			*node_id = (int *) malloc(sizeof(int)*n);
+	if((ne > 0 && element == NULL) || node == NULL || node_id == NULL) {
+		printf("Cannot allocate memory for reordering!\n");
+		free(element);
+		free(node);
+		free(node_id);
+		return;
+	}
+
+	for(i = 0; i < ne; i++) {
+		LDElement	&e = element[i];
+		e = data->element[eorder[i]];
+		for(j = 0; j < (unsigned int) e.num_node; j++) e.node[j] = inv[e.node[j]];
+		for(j = 0; j < 4; j++)
+			if(e.neigh[j] >= 0 && e.neigh[j] < (int) ne) e.neigh[j] = einv[e.neigh[j]];
+	}
+
+	for(i = 0; i < n; i++) {
+		LDNode	&v = node[i];
+		v = data->node[order[i]];
+		node_id[i] = (data->node_id != NULL) ? data->node_id[order[i]] : (int) order[i];
+		for(j = 0; j < (unsigned int) v.num_element; j++) v.element[j] = einv[v.element[j]];
+		std::sort(v.element, v.element + v.num_element);
+	}
+
+	for(i = 0; i < (unsigned int) data->num_face; i++)
+		for(j = 0; j < 3; j++) data->face[i].node[j] = inv[data->face[i].node[j]];
+	for(i = 0; i < (unsigned int) data->num_edge; i++)
+		for(j = 0; j < 2; j++) data->edge[i].node[j] = inv[data->edge[i].node[j]];
+
+	free(data->element);
+	free(data->node);
+	free(data->node_id);
+	data->element	= element;
+	data->node		= node;
+	data->node_id	= node_id;
+}
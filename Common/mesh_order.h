@@ -0,0 +1,70 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Mesh Reordering Header (mesh_order.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MESH_ORDER.H v0.1.0
+////
+////	Node and element renumbering for memory locality
+////
+////		MeshNodeOrder		-	New order of the nodes of a mesh, either
+////									reverse Cuthill-McKee on the node graph
+////									or along a Hilbert curve through the
+////									node positions.  Both keep neighbouring
+////									nodes close in memory.
+////		MeshItemOrder		-	Stable order of elements, springs or faces
+////									by a node key, normally their lowest
+////									renumbered node.
+////		ReorderLoadData		-	Renumbers the nodes and elements of a
+////									loaded mesh.  Faces and edges keep their
+////									file order.
+////		SetMeshOrder		-	Method used by the mesh loaders.  Defaults
+////									to GIPSI_MESH_ORDER from the environment
+////									("none", "rcm" or "sfc"), or RCM.
+////
+////	The orders are deterministic, so every object loading the same file
+////	gets the same numbering.
+////
+////////////////////////////////////////////////////////////////
+
+#ifndef _MESH_ORDER_H
+#define _MESH_ORDER_H
+
+#include "load_mesh.h"
+
+#define MESH_ORDER_NONE		0		// File order
+#define MESH_ORDER_RCM		1		// Reverse Cuthill-McKee
+#define MESH_ORDER_SFC		2		// Hilbert space filling curve
+
+// order[new] = old.  pairs are num_pair node pairs (a, b) in the style of
+// BlockCRSMatrix::initPattern(), pos holds 3 coordinates per node.  RCM
+// only uses the pairs, SFC only the positions.
+void	MeshNodeOrder(int method, unsigned int num_node, const double *pos,
+					  unsigned int num_pair, const unsigned int *pairs, unsigned int *order);
+
+// order[new] = old, items sorted by key in [0, num_key), ties in item order
+void	MeshItemOrder(unsigned int num_item, const unsigned int *key, unsigned int num_key, unsigned int *order);
+
+// Sets data->node_id to the file index of each node unless method is
+// MESH_ORDER_NONE
+void	ReorderLoadData(LoadData *data, int method);
+
+void	SetMeshOrder(int method);
+int		GetMeshOrder(void);
+
+#endif
@@ -0,0 +1,471 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Modal Basis Implementation (modal_basis.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MODAL_BASIS.CPP v0.1.0
+////
+////	Linear vibration modes of a deformable object
+////
+////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include "modal_basis.h"
+
+#define	MODAL_MAGIC			"GIPSIMOD"
+#define	MODAL_VERSION		1
+#define	MODAL_BYTE_ORDER	0x01020304
+
+typedef struct {
+	char			magic[8];
+	unsigned int	version;
+	unsigned int	byte_order;
+	unsigned int	real_size;
+	unsigned int	key;
+	unsigned int	num_node;
+	unsigned int	num_modes;
+} ModalHeader;
+
+
+ModalBasis::ModalBasis()
+: basis(NULL), lambda(NULL), num_node(0), num_modes(0)
+{
+}
+
+
+ModalBasis::~ModalBasis()
+{
+	Release();
+}
+
+
+void ModalBasis::Allocate(unsigned int nn, unsigned int nm)
+{
+	Release();
+
+	num_node	= nn;
+	num_modes	= nm;
+	basis		= new Real[3*nn*nm];
+	lambda		= new Real[nm];
+}
+
+
+void ModalBasis::Release(void)
+{
+	if(basis != NULL)	delete[] basis;
+	if(lambda != NULL)	delete[] lambda;
+	basis		= NULL;
+	lambda		= NULL;
+	num_node	= 0;
+	num_modes	= 0;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	JacobiEigen()
+//
+//		Cyclic Jacobi eigensolver for a dense symmetric p x p
+//		matrix a (row major, destroyed).  On return d holds the
+//		eigenvalues and the columns of v the eigenvectors.
+//
+static void JacobiEigen(Real *a, Real *v, Real *d, unsigned int p)
+{
+	unsigned int	i, j, k, sweep;
+
+	for(i=0; i<p; i++)
+		for(j=0; j<p; j++) v[i*p+j] = (i == j) ? 1.0 : 0.0;
+
+	for(sweep=0; sweep<50; sweep++) {
+		Real	off = 0.0, diag = 0.0;
+		for(i=0; i<p; i++) {
+			diag += a[i*p+i] * a[i*p+i];
+			for(j=i+1; j<p; j++) off += a[i*p+j] * a[i*p+j];
+		}
+		if(off <= 1e-30 * diag) break;
+
+		for(i=0; i<p; i++) {
+			for(j=i+1; j<p; j++) {
+				Real	aij = a[i*p+j];
+				if(aij == 0.0) continue;
+
+				// Rotation that annihilates a(i,j)
+				Real	theta	= (a[j*p+j] - a[i*p+i]) / (2.0 * aij);
+				Real	t		= ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+				Real	c		= 1.0 / sqrt(t*t + 1.0);
+				Real	s		= t * c;
+
+				for(k=0; k<p; k++) {
+					Real	aki = a[k*p+i], akj = a[k*p+j];
+					a[k*p+i] = c*aki - s*akj;
+					a[k*p+j] = s*aki + c*akj;
+				}
+				for(k=0; k<p; k++) {
+					Real	aik = a[i*p+k], ajk = a[j*p+k];
+					a[i*p+k] = c*aik - s*ajk;
+					a[j*p+k] = s*aik + c*ajk;
+				}
+				for(k=0; k<p; k++) {
+					Real	vki = v[k*p+i], vkj = v[k*p+j];
+					v[k*p+i] = c*vki - s*vkj;
+					v[k*p+j] = s*vki + c*vkj;
+				}
+			}
+		}
+	}
+
+	for(i=0; i<p; i++) d[i] = a[i*p+i];
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ModalBasis::Compute()
+//
+//		Subspace iteration: a block of p > num_modes vectors is
+//		repeatedly multiplied by (K + sigma M)^-1 M and projected
+//		(Rayleigh-Ritz) until the lowest num_modes Ritz values
+//		settle.  The small shift sigma keeps K + sigma M positive
+//		definite for unconstrained objects, whose six rigid body
+//		modes then come out with eigenvalues near zero.
+//
+bool ModalBasis::Compute(const BlockCRSMatrix<Real> &K, const Real *mass, const unsigned char *fixed,
+						 unsigned int r, unsigned int max_iter, Real tol)
+{
+	unsigned int	nn = K.mb(), n = 3*nn;
+	unsigned int	i, j, k, l, free_dof = 0;
+
+	for(i=0; i<nn; i++) if(!fixed[i]) free_dof += 3;
+	if(r > free_dof) r = free_dof;
+	Release();
+	if(r == 0) return false;
+
+	unsigned int	p = (2*r > r+8) ? 2*r : r+8;
+	if(p > free_dof) p = free_dof;
+
+	// Shift relative to the average stiffness per unit mass
+	Real	ktrace = 0.0, mtrace = 0.0;
+	for(i=0; i<nn; i++) {
+		if(fixed[i]) continue;
+		const Real	*d = K.block(K.find(i, i));
+		ktrace	+= d[0] + d[4] + d[8];
+		mtrace	+= 3.0 * mass[i];
+	}
+	Real	sigma = (mtrace > 0.0) ? 1e-4 * ktrace / mtrace : 1e-4;
+
+	// Envelope of K: every scalar row of block row i starts at the first
+	// column of the leftmost block in that row
+	unsigned int	*pairs = new unsigned int[2*n];
+	for(i=0; i<nn; i++) {
+		unsigned int	c = K.col(K.rowBegin(i));
+		for(l=0; l<3; l++) {
+			pairs[2*(3*i+l)]	= 3*i + l;
+			pairs[2*(3*i+l)+1]	= 3*c;
+		}
+	}
+	SkylineCholesky<Real>	A;
+	A.initPattern(n, n, pairs);
+	delete[] pairs;
+
+	// A = K + sigma M with the constrained rows and columns replaced by
+	// the identity
+	for(i=0; i<nn; i++) {
+		if(fixed[i]) {
+			for(l=0; l<3; l++) A.add(3*i+l, 3*i+l, 1.0);
+			continue;
+		}
+		for(k=K.rowBegin(i); k<K.rowEnd(i); k++) {
+			j = K.col(k);
+			if(j > i || fixed[j]) continue;
+			const Real	*b = K.block(k);
+			for(unsigned int rr=0; rr<3; rr++)
+				for(unsigned int cc=0; cc<3; cc++)
+					if(3*j+cc <= 3*i+rr) A.add(3*i+rr, 3*j+cc, b[3*rr+cc]);
+		}
+		for(l=0; l<3; l++) A.add(3*i+l, 3*i+l, sigma * mass[i]);
+	}
+	if(!A.factor()) return false;
+
+	Real	*X		= new Real[n*p];
+	Real	*Y		= new Real[n*p];
+	Real	*Kr		= new Real[p*p];
+	Real	*Mr		= new Real[p*p];
+	Real	*V		= new Real[p*p];
+	Real	*W		= new Real[p*p];
+	Real	*theta	= new Real[p];
+	Real	*prev	= new Real[p];
+
+	// Deterministic start block, zero on the constrained nodes
+	unsigned int	seed = 12345;
+	for(i=0; i<n; i++) {
+		for(k=0; k<p; k++) {
+			seed = 1664525 * seed + 1013904223;
+			X[i*p+k] = fixed[i/3] ? 0.0 : ((Real) (seed >> 8) / (Real) (1 << 24)) - 0.5;
+		}
+	}
+	for(k=0; k<p; k++) prev[k] = 0.0;
+
+	bool	converged = false;
+	for(unsigned int iter=0; iter<max_iter && !converged; iter++) {
+		// Y = M X, X = A^-1 Y
+		for(i=0; i<n; i++) {
+			Real	m = fixed[i/3] ? 0.0 : mass[i/3];
+			for(k=0; k<p; k++) Y[i*p+k] = m * X[i*p+k];
+		}
+		memcpy(X, Y, n*p*sizeof(Real));
+		for(k=0; k<p; k++) A.solve(X + k, p);
+
+		// Projections Kr = X^T A X = X^T Y and Mr = X^T M X
+		for(k=0; k<p*p; k++) Kr[k] = Mr[k] = 0.0;
+		for(i=0; i<n; i++) {
+			const Real	*xi	= X + i*p;
+			const Real	*yi	= Y + i*p;
+			Real		m	= fixed[i/3] ? 0.0 : mass[i/3];
+			for(k=0; k<p; k++) {
+				for(l=0; l<=k; l++) {
+					Kr[k*p+l] += xi[k] * yi[l];
+					Mr[k*p+l] += m * xi[k] * xi[l];
+				}
+			}
+		}
+		for(k=0; k<p; k++)
+			for(l=0; l<k; l++) {
+				Kr[l*p+k] = Kr[k*p+l] = 0.5 * (Kr[k*p+l] + Kr[l*p+k]);
+			}
+
+		// Reduce Kr w = theta Mr w to standard form with Mr = L L^T
+		if(factorCholesky(Mr, p) != 0) break;
+		// W = L^-1 Kr
+		for(l=0; l<p; l++)
+			for(k=0; k<p; k++) {
+				Real	sum = Kr[k*p+l];
+				for(j=0; j<k; j++) sum -= Mr[k*p+j] * W[j*p+l];
+				W[k*p+l] = sum / Mr[k*p+k];
+			}
+		// Kr = L^-1 W^T = L^-1 Kr L^-T
+		for(l=0; l<p; l++)
+			for(k=0; k<p; k++) {
+				Real	sum = W[l*p+k];
+				for(j=0; j<k; j++) sum -= Mr[k*p+j] * Kr[j*p+l];
+				Kr[k*p+l] = sum / Mr[k*p+k];
+			}
+		JacobiEigen(Kr, V, theta, p);
+
+		// Ascending order
+		for(k=0; k<p; k++) {
+			unsigned int	m = k;
+			for(l=k+1; l<p; l++) if(theta[l] < theta[m]) m = l;
+			if(m != k) {
+				Real	t = theta[k]; theta[k] = theta[m]; theta[m] = t;
+				for(l=0; l<p; l++) {
+					t = V[l*p+k]; V[l*p+k] = V[l*p+m]; V[l*p+m] = t;
+				}
+			}
+		}
+
+		// W = L^-T V
+		for(l=0; l<p; l++)
+			for(k=p; k>0; k--) {
+				Real	sum = V[(k-1)*p+l];
+				for(j=k; j<p; j++) sum -= Mr[j*p+(k-1)] * W[j*p+l];
+				W[(k-1)*p+l] = sum / Mr[(k-1)*p+(k-1)];
+			}
+
+		// X = X W, mass orthonormal
+		for(i=0; i<n; i++) {
+			Real	*xi = X + i*p;
+			for(k=0; k<p; k++) {
+				Real	sum = 0.0;
+				for(l=0; l<p; l++) sum += xi[l] * W[l*p+k];
+				Y[k] = sum;
+			}
+			for(k=0; k<p; k++) xi[k] = Y[k];
+		}
+
+		converged = true;
+		for(k=0; k<r; k++)
+			if(fabs(theta[k] - prev[k]) > tol * fabs(theta[k])) converged = false;
+		for(k=0; k<p; k++) prev[k] = theta[k];
+	}
+
+	Allocate(nn, r);
+	for(k=0; k<r; k++) {
+		lambda[k] = prev[k] - sigma;
+		if(lambda[k] < 0.0) lambda[k] = 0.0;
+	}
+	for(i=0; i<n; i++)
+		for(k=0; k<r; k++) basis[i*r+k] = X[i*p+k];
+
+	delete[] X;
+	delete[] Y;
+	delete[] Kr;
+	delete[] Mr;
+	delete[] V;
+	delete[] W;
+	delete[] theta;
+	delete[] prev;
+
+	return converged;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ModalBasis::Key()
+//
+//		FNV-1a hash of everything Compute() depends on
+//
+static unsigned int HashBytes(unsigned int h, const void *p, size_t size)
+{
+	const unsigned char	*b = (const unsigned char *) p;
+	for(size_t i=0; i<size; i++) {
+		h ^= b[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int ModalBasis::Key(const BlockCRSMatrix<Real> &K, const Real *mass, const unsigned char *fixed,
+							 unsigned int r)
+{
+	unsigned int	h = 2166136261u, nn = K.mb();
+
+	h = HashBytes(h, &nn, sizeof(nn));
+	h = HashBytes(h, &r, sizeof(r));
+	for(unsigned int i=0; i<nn; i++) {
+		for(unsigned int k=K.rowBegin(i); k<K.rowEnd(i); k++) {
+			unsigned int	c = K.col(k);
+			h = HashBytes(h, &c, sizeof(c));
+			h = HashBytes(h, K.block(k), 9*sizeof(Real));
+		}
+	}
+	h = HashBytes(h, mass, nn*sizeof(Real));
+	h = HashBytes(h, fixed, nn);
+
+	return h;
+}
+
+
+bool ModalBasis::Save(const char *filename, unsigned int key) const
+{
+	ModalHeader		header;
+	FILE			*fp;
+
+	if(basis == NULL) return false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MODAL_MAGIC, 8);
+	header.version		= MODAL_VERSION;
+	header.byte_order	= MODAL_BYTE_ORDER;
+	header.real_size	= sizeof(Real);
+	header.key			= key;
+	header.num_node		= num_node;
+	header.num_modes	= num_modes;
+
+	if((fp = fopen(filename, "wb")) == NULL) return false;
+
+	bool	ok =	fwrite(&header, sizeof(header), 1, fp) == 1 &&
+					fwrite(lambda, sizeof(Real), num_modes, fp) == num_modes &&
+					fwrite(basis, sizeof(Real), 3*num_node*num_modes, fp) == 3*num_node*num_modes;
+	if(fclose(fp) != 0) ok = false;
+
+	return ok;
+}
+
+
+bool ModalBasis::Load(const char *filename, unsigned int key)
+{
+	ModalHeader		header;
+	FILE			*fp;
+
+	if((fp = fopen(filename, "rb")) == NULL) return false;
+
+	if(fread(&header, sizeof(header), 1, fp) != 1 ||
+		memcmp(header.magic, MODAL_MAGIC, 8) != 0 ||
+		header.version != MODAL_VERSION ||
+		header.byte_order != MODAL_BYTE_ORDER ||
+		header.real_size != sizeof(Real) ||
+		header.key != key ||
+		header.num_modes == 0) {
+		fclose(fp);
+		return false;
+	}
+
+	Allocate(header.num_node, header.num_modes);
+	bool	ok =	fread(lambda, sizeof(Real), num_modes, fp) == num_modes &&
+					fread(basis, sizeof(Real), 3*num_node*num_modes, fp) == 3*num_node*num_modes;
+	fclose(fp);
+
+	if(!ok) Release();
+	return ok;
+}
+
+
+void ModalBasis::ReconstructNode(Real *u, unsigned int node, const Real *q) const
+{
+	const Real		*b = basis + 3*node*num_modes;
+
+	for(unsigned int l=0; l<3; l++, b+=num_modes) {
+		Real	sum = 0.0;
+		for(unsigned int k=0; k<num_modes; k++) sum += b[k] * q[k];
+		u[l] = sum;
+	}
+}
+
+
+void ModalBasis::Project(Real *fq, const Real *f) const
+{
+	unsigned int	k;
+
+	for(k=0; k<num_modes; k++) fq[k] = 0.0;
+	for(unsigned int i=0; i<3*num_node; i++) {
+		const Real	*b = basis + i*num_modes;
+		Real		fi = f[i];
+		if(fi == 0.0) continue;
+		for(k=0; k<num_modes; k++) fq[k] += b[k] * fi;
+	}
+}
+
+
+void ModalBasis::ProjectNode(Real *fq, unsigned int node, const Real *f) const
+{
+	const Real		*b = basis + 3*node*num_modes;
+
+	for(unsigned int l=0; l<3; l++, b+=num_modes)
+		for(unsigned int k=0; k<num_modes; k++) fq[k] += b[k] * f[l];
+}
+
+
+void ModalBasis::ProjectDiagonal(Real *c, const BlockCRSMatrix<Real> &C) const
+{
+	for(unsigned int k=0; k<num_modes; k++) {
+		Real	sum = 0.0;
+		for(unsigned int i=0; i<num_node; i++) {
+			for(unsigned int e=C.rowBegin(i); e<C.rowEnd(i); e++) {
+				const Real		*b	= C.block(e);
+				unsigned int	j	= C.col(e);
+				for(unsigned int rr=0; rr<3; rr++)
+					for(unsigned int cc=0; cc<3; cc++)
+						sum += basis[(3*i+rr)*num_modes+k] * b[3*rr+cc] * basis[(3*j+cc)*num_modes+k];
+			}
+		}
+		c[k] = sum;
+	}
+}
@@ -0,0 +1,86 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Modal Basis Header (modal_basis.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MODAL_BASIS.H v0.1.0
+////
+////	Linear vibration modes of a deformable object
+////
+////		ModalBasis			-	Lowest modes of K u = lambda M u for a
+////									3D stiffness matrix K of 3x3 node
+////									blocks and a lumped mass M, with
+////									constrained nodes removed.  The modes
+////									are mass normalized (U^T M U = I).
+////
+////////////////////////////////////////////////////////////////
+
+
+#ifndef _MODAL_BASIS_H
+#define _MODAL_BASIS_H
+
+#include "algebra.h"
+
+class ModalBasis {
+public:
+	ModalBasis();
+	~ModalBasis();
+
+	// Subspace iteration on the shifted, skyline factored K.  mass holds one
+	// value per node, nodes with fixed[i] != 0 do not move in any mode.
+	// Returns false if the iteration did not converge to tol within
+	// max_iter sweeps; the best estimate is kept in that case.
+	bool			Compute(const BlockCRSMatrix<Real> &K, const Real *mass, const unsigned char *fixed,
+							unsigned int num_modes, unsigned int max_iter = 100, Real tol = 1e-8);
+
+	// Binary cache.  key identifies the model the modes were computed for
+	// (see Key()); Load() rejects files written for a different key.
+	bool			Save(const char *filename, unsigned int key) const;
+	bool			Load(const char *filename, unsigned int key);
+	static unsigned int	Key(const BlockCRSMatrix<Real> &K, const Real *mass, const unsigned char *fixed,
+							unsigned int num_modes);
+
+	unsigned int	NumModes(void) const				{ return num_modes; }
+	unsigned int	NumNodes(void) const				{ return num_node; }
+	Real			Eigenvalue(unsigned int k) const	{ return lambda[k]; }		// omega_k^2
+
+	// u = U q for the three coordinates of one node
+	void			ReconstructNode(Real *u, unsigned int node, const Real *q) const;
+	// fq = U^T f for a full force vector, 3 entries per node
+	void			Project(Real *fq, const Real *f) const;
+	// fq += U^T f for a force f on a single node
+	void			ProjectNode(Real *fq, unsigned int node, const Real *f) const;
+	// c_k = u_k^T C u_k, the diagonal of C in modal coordinates
+	void			ProjectDiagonal(Real *c, const BlockCRSMatrix<Real> &C) const;
+
+protected:
+	void			Allocate(unsigned int num_node, unsigned int num_modes);
+	void			Release(void);
+
+	Real			*basis;			// Mode shapes, row major: basis[dof*num_modes + k]
+	Real			*lambda;		// Eigenvalues in increasing order
+	unsigned int	num_node;
+	unsigned int	num_modes;
+
+private:
+	// Not copyable
+	ModalBasis(const ModalBasis &);
+	void operator=(const ModalBasis &);
+};
+
+#endif
@@ -0,0 +1,694 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Multigrid Solver Implementation (multigrid.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MULTIGRID.CPP v0.1.0
+////
+////	Algebraic multigrid for sparse systems of 3x3 blocks
+////
+////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include "multigrid.h"
+
+#define	MG_STRENGTH			0.08	// Strong coupling: |A_ij| > theta sqrt(|A_ii| |A_jj|)
+#define	MG_POWER_ITERATIONS	10		// Spectral radius estimate of the prolongator smoother
+#define	MG_COARSE_SWEEPS	20		// Smoothing on the coarsest level if it cannot be factored
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Block helpers
+//
+static void Multiply(const BlockCRSMatrix<Real> &A, const Real *x, Real *y)
+{
+	for(unsigned int i=0; i<A.mb(); i++) {
+		Real	y0 = 0.0, y1 = 0.0, y2 = 0.0;
+
+		for(unsigned int k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			const Real	*b	= A.block(k);
+			const Real	*xj	= x + 3*A.col(k);
+
+			y0 += b[0]*xj[0] + b[1]*xj[1] + b[2]*xj[2];
+			y1 += b[3]*xj[0] + b[4]*xj[1] + b[5]*xj[2];
+			y2 += b[6]*xj[0] + b[7]*xj[1] + b[8]*xj[2];
+		}
+		y[3*i]		= y0;
+		y[3*i+1]	= y1;
+		y[3*i+2]	= y2;
+	}
+}
+
+// c += a b
+static inline void MultAddBlock(Real *c, const Real *a, const Real *b)
+{
+	for(unsigned int r=0; r<3; r++)
+		for(unsigned int s=0; s<3; s++)
+			c[3*r+s] += a[3*r]*b[s] + a[3*r+1]*b[3+s] + a[3*r+2]*b[6+s];
+}
+
+// c += a^T b
+static inline void MultAddBlockT(Real *c, const Real *a, const Real *b)
+{
+	for(unsigned int r=0; r<3; r++)
+		for(unsigned int s=0; s<3; s++)
+			c[3*r+s] += a[r]*b[s] + a[3+r]*b[3+s] + a[6+r]*b[6+s];
+}
+
+static inline Real Dot(const Real *a, const Real *b, unsigned int n)
+{
+	Real	s = 0.0;
+	for(unsigned int i=0; i<n; i++) s += a[i] * b[i];
+	return s;
+}
+
+
+
+Multigrid::Multigrid()
+: num_levels(0), coarse_factored(false), cycle(MG_V_CYCLE), smoother(MG_SMOOTH_GAUSS_SEIDEL),
+  pre_sweeps(1), post_sweeps(1), jacobi_omega(2.0/3.0)
+{
+}
+
+
+Multigrid::~Multigrid()
+{
+	Release();
+}
+
+
+void Multigrid::Release(void)
+{
+	for(unsigned int l=0; l<level.size(); l++)
+		if(level[l].owned != NULL) delete level[l].owned;
+	level.clear();
+	coarse.clear();
+	num_levels		= 0;
+	coarse_factored	= false;
+}
+
+
+void Multigrid::SetSmoother(int type, unsigned int pre, unsigned int post, Real omega)
+{
+	smoother		= type;
+	pre_sweeps		= pre;
+	post_sweeps		= post;
+	jacobi_omega	= omega;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Setup()
+//
+//		Aggregates each level into the next until the coarse size
+//		is reached or the aggregation stalls, then computes the
+//		coarse matrices and factors the coarsest one.
+//
+void Multigrid::Setup(const BlockCRSMatrix<Real> &A, unsigned int max_levels, unsigned int coarse_nodes)
+{
+	unsigned int	l, i, k;
+
+	Release();
+
+	level.resize(1);
+	level[0].A		= &A;
+	level[0].owned	= NULL;
+	num_levels		= 1;
+	InvertDiagonal(0);
+
+	while(num_levels < max_levels && level[num_levels-1].A->mb() > coarse_nodes) {
+		l = num_levels - 1;
+		Coarsen(l);
+		if(level.size() == num_levels) break;
+		num_levels++;
+		Galerkin(l);
+		InvertDiagonal(l+1);
+	}
+
+	for(l=0; l<num_levels; l++) {
+		unsigned int	n = 3*level[l].A->mb();
+		level[l].x.resize(n);
+		level[l].b.resize(n);
+		level[l].r.resize(n);
+	}
+
+	// Scalar envelope of the coarsest matrix, see ModalBasis::Compute()
+	const BlockCRSMatrix<Real>	&C = *level[num_levels-1].A;
+	unsigned int	*pairs = new unsigned int[6*C.mb()];
+	for(i=0; i<C.mb(); i++) {
+		unsigned int	c = C.col(C.rowBegin(i));
+		for(k=0; k<3; k++) {
+			pairs[2*(3*i+k)]	= 3*i + k;
+			pairs[2*(3*i+k)+1]	= 3*c;
+		}
+	}
+	coarse.initPattern(3*C.mb(), 3*C.mb(), pairs);
+	delete[] pairs;
+	FactorCoarse();
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Refresh()
+//
+void Multigrid::Refresh(void)
+{
+	InvertDiagonal(0);
+	for(unsigned int l=0; l+1<num_levels; l++) {
+		Galerkin(l);
+		InvertDiagonal(l+1);
+	}
+	FactorCoarse();
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::InvertDiagonal()
+//
+//		Inverts the diagonal blocks of level l.  Singular blocks are
+//		left out of the smoothing.
+//
+void Multigrid::InvertDiagonal(unsigned int l)
+{
+	const BlockCRSMatrix<Real>	&A = *level[l].A;
+	std::vector<Real>			&dinv = level[l].dinv;
+
+	dinv.resize(9*A.mb());
+	for(unsigned int i=0; i<A.mb(); i++) {
+		const Real	*d = A.block(A.find(i, i));
+		Real		*e = &dinv[9*i];
+		Real		det =	d[0] * (d[4]*d[8] - d[5]*d[7]) -
+							d[1] * (d[3]*d[8] - d[5]*d[6]) +
+							d[2] * (d[3]*d[7] - d[4]*d[6]);
+
+		if(fabs(det) <= 1e-300) {
+			for(unsigned int c=0; c<9; c++) e[c] = 0.0;
+			continue;
+		}
+		for(unsigned int r=0; r<3; r++)
+			for(unsigned int c=0; c<3; c++) {
+				unsigned int	r1 = (c+1)%3, r2 = (c+2)%3, c1 = (r+1)%3, c2 = (r+2)%3;
+				e[3*r+c] = (d[3*r1+c1]*d[3*r2+c2] - d[3*r1+c2]*d[3*r2+c1]) / det;
+			}
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Coarsen()
+//
+//		Smoothed aggregation of level l.  Nodes are grouped with
+//		their strongly coupled neighbours (Vanek, Mandel and Brezina
+//		1996).  The tentative prolongator injects each aggregate
+//		into one coarse node and is smoothed by one damped block
+//		Jacobi step,
+//
+//		P = (I - 4/(3 rho) D^-1 F) P0,		rho = rho(D^-1 A)
+//
+//		with F the matrix of the strong couplings, see below.
+//		Nodes without strong neighbours, such as the Dirichlet
+//		nodes, join no aggregate and are left to the smoother.
+//		Appends the coarse level with the pattern of P^T A P, or
+//		nothing if the level cannot be coarsened.
+//
+void Multigrid::Coarsen(unsigned int l)
+{
+	const BlockCRSMatrix<Real>	&A = *level[l].A;
+	const Real					*dinv = &level[l].dinv[0];
+	const unsigned int			n = A.mb();
+	unsigned int				i, j, k, e, f, c;
+
+	// Strength of the off-diagonal blocks
+	std::vector<Real>			dnorm(n);
+	std::vector<unsigned char>	strong(A.nnzb(), 0);
+	for(i=0; i<n; i++) dnorm[i] = sqrt(Dot(A.block(A.find(i, i)), A.block(A.find(i, i)), 9));
+	for(i=0; i<n; i++)
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			j = A.col(k);
+			if(j == i) continue;
+			strong[k] = Dot(A.block(k), A.block(k), 9) > MG_STRENGTH * MG_STRENGTH * dnorm[i] * dnorm[j];
+		}
+
+	// Aggregates: -1 unassigned, -2 isolated
+	std::vector<int>	agg(n, -1);
+	int					nc = 0;
+	for(i=0; i<n; i++) {
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++)
+			if(strong[k]) break;
+		if(k == A.rowEnd(i)) agg[i] = -2;
+	}
+	// 1: nodes whose strong neighbours are all free, with those neighbours
+	for(i=0; i<n; i++) {
+		if(agg[i] != -1) continue;
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++)
+			if(strong[k] && agg[A.col(k)] != -1) break;
+		if(k != A.rowEnd(i)) continue;
+		agg[i] = nc;
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++)
+			if(strong[k]) agg[A.col(k)] = nc;
+		nc++;
+	}
+	// 2: the rest join the aggregate of their strongest neighbour from step 1
+	std::vector<int>	agg1(agg);
+	for(i=0; i<n; i++) {
+		if(agg[i] != -1) continue;
+		Real	best = 0.0;
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			Real	s = Dot(A.block(k), A.block(k), 9);
+			if(strong[k] && agg1[A.col(k)] >= 0 && s > best) {
+				best	= s;
+				agg[i]	= agg1[A.col(k)];
+			}
+		}
+	}
+	// 3: leftovers, with their free strong neighbours
+	for(i=0; i<n; i++) {
+		if(agg[i] != -1) continue;
+		agg[i] = nc;
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++)
+			if(strong[k] && agg[A.col(k)] == -1) agg[A.col(k)] = nc;
+		nc++;
+	}
+	if(nc == 0 || (unsigned int) nc >= n) return;
+
+	// rho(D^-1 A) by power iteration
+	std::vector<Real>	v(3*n), w(3*n), t(3*n);
+	unsigned int		seed = 12345;
+	Real				rho = 1.0;
+	for(i=0; i<3*n; i++) {
+		seed = 1664525 * seed + 1013904223;
+		v[i] = ((Real) (seed >> 8) / (Real) (1 << 24)) + 0.5;
+	}
+	for(unsigned int it=0; it<MG_POWER_ITERATIONS; it++) {
+		Multiply(A, &v[0], &t[0]);
+		for(i=0; i<n; i++)
+			for(c=0; c<3; c++)
+				w[3*i+c] = Dot(dinv + 9*i + 3*c, &t[3*i], 3);
+		Real	nv = sqrt(Dot(&v[0], &v[0], 3*n)), nw = sqrt(Dot(&w[0], &w[0], 3*n));
+		if(nw == 0.0 || nv == 0.0) break;
+		rho = nw / nv;
+		for(i=0; i<3*n; i++) v[i] = w[i] / nw;
+	}
+	Real	omega = 4.0 / (3.0 * rho);
+
+	// P rows: -omega D_i^-1 sum_j F_ij P0_j, plus P0_i.  F is A with the
+	// weak blocks lumped into the diagonal, which keeps the coarse
+	// stencils from growing.
+	Level				&L = level[l];
+	std::vector<int>	mark(nc, -1);
+	L.p_ptr.assign(1, 0);
+	L.p_col.clear();
+	L.p_val.clear();
+	for(i=0; i<n; i++) {
+		unsigned int	row = L.p_col.size();
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			j = A.col(k);
+			if(j != i && !strong[k]) j = i;
+			if(agg[j] < 0) continue;
+			if(mark[agg[j]] < 0) {
+				mark[agg[j]] = L.p_col.size();
+				L.p_col.push_back(agg[j]);
+				L.p_val.resize(L.p_val.size() + 9, 0.0);
+			}
+			Real	blk[9] = { 0.0 };
+			MultAddBlock(blk, dinv + 9*i, A.block(k));
+			Real	*p = &L.p_val[9*mark[agg[j]]];
+			for(c=0; c<9; c++) p[c] -= omega * blk[c];
+		}
+		if(agg[i] >= 0) {
+			if(mark[agg[i]] < 0) {
+				mark[agg[i]] = L.p_col.size();
+				L.p_col.push_back(agg[i]);
+				L.p_val.resize(L.p_val.size() + 9, 0.0);
+			}
+			Real	*p = &L.p_val[9*mark[agg[i]]];
+			p[0] += 1.0;	p[4] += 1.0;	p[8] += 1.0;
+		}
+		for(e=row; e<L.p_col.size(); e++) mark[L.p_col[e]] = -1;
+		L.p_ptr.push_back(L.p_col.size());
+	}
+
+	// Transpose of P
+	L.pt_ptr.assign(nc+1, 0);
+	for(e=0; e<L.p_col.size(); e++) L.pt_ptr[L.p_col[e]+1]++;
+	for(c=0; c<(unsigned int) nc; c++) L.pt_ptr[c+1] += L.pt_ptr[c];
+	L.pt_row.resize(L.p_col.size());
+	L.pt_ent.resize(L.p_col.size());
+	std::vector<unsigned int>	fill(L.pt_ptr.begin(), L.pt_ptr.end() - 1);
+	for(i=0; i<n; i++)
+		for(e=L.p_ptr[i]; e<L.p_ptr[i+1]; e++) {
+			unsigned int	q = fill[L.p_col[e]]++;
+			L.pt_row[q] = i;
+			L.pt_ent[q] = e;
+		}
+
+	// Pattern of A P
+	L.ap_ptr.assign(1, 0);
+	L.ap_col.clear();
+	for(i=0; i<n; i++) {
+		unsigned int	row = L.ap_col.size();
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			j = A.col(k);
+			for(e=L.p_ptr[j]; e<L.p_ptr[j+1]; e++)
+				if(mark[L.p_col[e]] < 0) {
+					mark[L.p_col[e]] = 1;
+					L.ap_col.push_back(L.p_col[e]);
+				}
+		}
+		for(f=row; f<L.ap_col.size(); f++) mark[L.ap_col[f]] = -1;
+		L.ap_ptr.push_back(L.ap_col.size());
+	}
+	L.ap_val.resize(9*L.ap_col.size());
+
+	// Pattern of P^T A P, upper triangle
+	std::vector<unsigned int>	pairs;
+	for(c=0; c<(unsigned int) nc; c++) {
+		unsigned int	first = pairs.size();
+		for(e=L.pt_ptr[c]; e<L.pt_ptr[c+1]; e++) {
+			i = L.pt_row[e];
+			for(f=L.ap_ptr[i]; f<L.ap_ptr[i+1]; f++) {
+				unsigned int	d = L.ap_col[f];
+				if(d > c && mark[d] < 0) {
+					mark[d] = 1;
+					pairs.push_back(c);
+					pairs.push_back(d);
+				}
+			}
+		}
+		for(f=first+1; f<pairs.size(); f+=2) mark[pairs[f]] = -1;
+	}
+
+	Level	coarse_level;
+	coarse_level.owned = new BlockCRSMatrix<Real>();
+	coarse_level.owned->initPattern(nc, pairs.size()/2, pairs.empty() ? NULL : &pairs[0]);
+	coarse_level.A = coarse_level.owned;
+	level.push_back(coarse_level);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Galerkin()
+//
+//		Coarse matrix of level l+1 = P^T A P, with the patterns of
+//		Coarsen()
+//
+void Multigrid::Galerkin(unsigned int l)
+{
+	Level						&L = level[l];
+	const BlockCRSMatrix<Real>	&A = *L.A;
+	BlockCRSMatrix<Real>		&C = *level[l+1].owned;
+	std::vector<int>			mark(C.mb(), -1);
+	unsigned int				i, k, e, f;
+
+	// A P
+	for(i=0; i<A.mb(); i++) {
+		for(f=L.ap_ptr[i]; f<L.ap_ptr[i+1]; f++) {
+			mark[L.ap_col[f]] = f;
+			for(unsigned int c=0; c<9; c++) L.ap_val[9*f+c] = 0.0;
+		}
+		for(k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			unsigned int	j = A.col(k);
+			for(e=L.p_ptr[j]; e<L.p_ptr[j+1]; e++)
+				MultAddBlock(&L.ap_val[9*mark[L.p_col[e]]], A.block(k), &L.p_val[9*e]);
+		}
+		for(f=L.ap_ptr[i]; f<L.ap_ptr[i+1]; f++) mark[L.ap_col[f]] = -1;
+	}
+
+	// P^T (A P), row by row of the coarse matrix
+	C.zero();
+	for(unsigned int c=0; c<C.mb(); c++) {
+		for(k=C.rowBegin(c); k<C.rowEnd(c); k++) mark[C.col(k)] = k;
+		for(e=L.pt_ptr[c]; e<L.pt_ptr[c+1]; e++) {
+			i = L.pt_row[e];
+			const Real	*p = &L.p_val[9*L.pt_ent[e]];
+			for(f=L.ap_ptr[i]; f<L.ap_ptr[i+1]; f++)
+				MultAddBlockT(C.block(mark[L.ap_col[f]]), p, &L.ap_val[9*f]);
+		}
+		for(k=C.rowBegin(c); k<C.rowEnd(c); k++) mark[C.col(k)] = -1;
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::FactorCoarse()
+//
+void Multigrid::FactorCoarse(void)
+{
+	const BlockCRSMatrix<Real>	&C = *level[num_levels-1].A;
+
+	coarse.zero();
+	for(unsigned int i=0; i<C.mb(); i++)
+		for(unsigned int k=C.rowBegin(i); k<C.rowEnd(i); k++) {
+			unsigned int	j = C.col(k);
+			if(j > i) continue;
+			const Real	*b = C.block(k);
+			for(unsigned int r=0; r<3; r++)
+				for(unsigned int c=0; c<3; c++)
+					if(3*j+c <= 3*i+r) coarse.add(3*i+r, 3*j+c, b[3*r+c]);
+		}
+	coarse_factored = coarse.factor();
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Smooth()
+//
+//		Block Jacobi, or Gauss-Seidel in increasing (forward) or
+//		decreasing node order.  With the forward sweeps before and
+//		the backward sweeps after the coarse correction the cycle
+//		is a symmetric preconditioner.
+//
+void Multigrid::Smooth(unsigned int l, Real *x, const Real *b, unsigned int sweeps, bool forward)
+{
+	const BlockCRSMatrix<Real>	&A = *level[l].A;
+	const Real					*dinv = &level[l].dinv[0];
+	const unsigned int			n = A.mb();
+	unsigned int				i, c;
+
+	for(unsigned int s=0; s<sweeps; s++) {
+		if(smoother == MG_SMOOTH_JACOBI) {
+			Real	*r = &level[l].r[0];
+			Multiply(A, x, r);
+			for(i=0; i<3*n; i++) r[i] = b[i] - r[i];
+			for(i=0; i<n; i++)
+				for(c=0; c<3; c++)
+					x[3*i+c] += jacobi_omega * Dot(dinv + 9*i + 3*c, r + 3*i, 3);
+			continue;
+		}
+
+		for(unsigned int m=0; m<n; m++) {
+			i = forward ? m : n-1-m;
+			Real	s0 = b[3*i], s1 = b[3*i+1], s2 = b[3*i+2];
+
+			for(unsigned int k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+				unsigned int	j = A.col(k);
+				if(j == i) continue;
+				const Real	*a	= A.block(k);
+				const Real	*xj	= x + 3*j;
+				s0 -= a[0]*xj[0] + a[1]*xj[1] + a[2]*xj[2];
+				s1 -= a[3]*xj[0] + a[4]*xj[1] + a[5]*xj[2];
+				s2 -= a[6]*xj[0] + a[7]*xj[1] + a[8]*xj[2];
+			}
+			const Real	*d = dinv + 9*i;
+			x[3*i]		= d[0]*s0 + d[1]*s1 + d[2]*s2;
+			x[3*i+1]	= d[3]*s0 + d[4]*s1 + d[5]*s2;
+			x[3*i+2]	= d[6]*s0 + d[7]*s1 + d[8]*s2;
+		}
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::CycleLevel()
+//
+//		Presmoothing, cycle coarse corrections of the residual,
+//		postsmoothing.  The coarsest level is solved with its
+//		factor.
+//
+void Multigrid::CycleLevel(unsigned int l, Real *x, const Real *b)
+{
+	const unsigned int	n = level[l].A->mb();
+	unsigned int		i, e, c;
+
+	if(l == num_levels-1) {
+		if(coarse_factored) {
+			memcpy(x, b, 3*n*sizeof(Real));
+			coarse.solve(x);
+		}
+		else Smooth(l, x, b, MG_COARSE_SWEEPS, true);
+		return;
+	}
+
+	Level	&L = level[l], &C = level[l+1];
+	Real	*r = &L.r[0];
+
+	Smooth(l, x, b, pre_sweeps, true);
+
+	// Restriction of r = b - A x
+	Multiply(*L.A, x, r);
+	for(i=0; i<3*n; i++) r[i] = b[i] - r[i];
+	for(i=0; i<C.b.size(); i++) C.b[i] = C.x[i] = 0.0;
+	for(i=0; i<n; i++)
+		for(e=L.p_ptr[i]; e<L.p_ptr[i+1]; e++) {
+			const Real	*p	= &L.p_val[9*e];
+			Real		*bc	= &C.b[3*L.p_col[e]];
+			for(c=0; c<3; c++) bc[c] += p[c]*r[3*i] + p[3+c]*r[3*i+1] + p[6+c]*r[3*i+2];
+		}
+
+	for(unsigned int g=0; g<cycle; g++) {
+		CycleLevel(l+1, &C.x[0], &C.b[0]);
+		if(l+1 == num_levels-1) break;
+	}
+
+	// Prolongation of the correction
+	for(i=0; i<n; i++)
+		for(e=L.p_ptr[i]; e<L.p_ptr[i+1]; e++) {
+			const Real	*p	= &L.p_val[9*e];
+			const Real	*xc	= &C.x[3*L.p_col[e]];
+			for(c=0; c<3; c++) x[3*i+c] += p[3*c]*xc[0] + p[3*c+1]*xc[1] + p[3*c+2]*xc[2];
+		}
+
+	Smooth(l, x, b, post_sweeps, false);
+}
+
+
+void Multigrid::Cycle(Real *x, const Real *b)
+{
+	CycleLevel(0, x, b);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	Multigrid::Solve()
+//
+//		Preconditioned conjugate gradients, one cycle from zero per
+//		iteration as the preconditioner
+//
+unsigned int Multigrid::Solve(Real *x, const Real *b, Real tol, unsigned int max_iter)
+{
+	const BlockCRSMatrix<Real>	&A = *level[0].A;
+	const unsigned int			n = 3*A.mb();
+	std::vector<Real>			r(n), z(n), p(n), q(n);
+	unsigned int				i, it;
+
+	Real	normb = sqrt(Dot(b, b, n));
+	if(normb == 0.0) {
+		for(i=0; i<n; i++) x[i] = 0.0;
+		return 0;
+	}
+
+	Multiply(A, x, &r[0]);
+	for(i=0; i<n; i++) r[i] = b[i] - r[i];
+	if(sqrt(Dot(&r[0], &r[0], n)) <= tol * normb) return 0;
+
+	for(i=0; i<n; i++) z[i] = 0.0;
+	Cycle(&z[0], &r[0]);
+	p = z;
+	Real	rz = Dot(&r[0], &z[0], n);
+
+	for(it=1; it<=max_iter; it++) {
+		Multiply(A, &p[0], &q[0]);
+		Real	pq = Dot(&p[0], &q[0], n);
+		if(pq <= 0.0) break;
+		Real	alpha = rz / pq;
+		for(i=0; i<n; i++) {
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+		}
+		if(sqrt(Dot(&r[0], &r[0], n)) <= tol * normb) break;
+
+		for(i=0; i<n; i++) z[i] = 0.0;
+		Cycle(&z[0], &r[0]);
+		Real	rz1 = Dot(&r[0], &z[0], n);
+		Real	beta = rz1 / rz;
+		rz = rz1;
+		for(i=0; i<n; i++) p[i] = z[i] + beta * p[i];
+	}
+	return (it > max_iter) ? max_iter : it;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ImplicitMultigrid::Solve()
+//
+unsigned int ImplicitMultigrid::Solve(Real *dv, Real *dx, const BlockCRSMatrix<Real> &A11, const BlockCRSMatrix<Real> &A12,
+									  Real a21, Real a22, const Real *bv, const Real *bx, const Real *mass,
+									  const unsigned char *fixed, Real tol, unsigned int max_iter)
+{
+	const unsigned int	n = A11.mb();
+	const Real			s = a21 / a22;
+	unsigned int		i, k, c;
+
+	if(S.empty()) {
+		S.copyPattern(A11);
+		rhs = new Real[3*n];
+	}
+
+	// S = M (A11 - s A12), rhs = M (bv - A12 bx / a22)
+	for(i=0; i<n; i++) {
+		Real	m = mass[i], ax[3] = { 0.0, 0.0, 0.0 };
+
+		for(k=S.rowBegin(i); k<S.rowEnd(i); k++) {
+			unsigned int	j = S.col(k);
+			const Real		*a = A11.block(k), *b = A12.block(k);
+			Real			*d = S.block(k);
+
+			for(c=0; c<3; c++) ax[c] += b[3*c]*bx[3*j] + b[3*c+1]*bx[3*j+1] + b[3*c+2]*bx[3*j+2];
+			if(fixed[i] || fixed[j]) {
+				for(c=0; c<9; c++) d[c] = 0.0;
+				if(i == j) d[0] = d[4] = d[8] = 1.0;
+				continue;
+			}
+			for(c=0; c<9; c++) d[c] = m * (a[c] - s * b[c]);
+		}
+		for(c=0; c<3; c++) rhs[3*i+c] = fixed[i] ? 0.0 : m * (bv[3*i+c] - ax[c] / a22);
+	}
+
+	if(mg.NumLevels() == 0)	mg.Setup(S);
+	else					mg.Refresh();
+
+	for(i=0; i<3*n; i++) dv[i] = 0.0;
+	unsigned int	it = mg.Solve(dv, rhs, tol, max_iter);
+
+	// dx = (bx - a21 dv) / a22
+	for(i=0; i<3*n; i++) dx[i] = (bx[i] - a21 * dv[i]) / a22;
+	return it;
+}
@@ -0,0 +1,173 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Multigrid Solver Header (multigrid.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	MULTIGRID.H v0.1.0
+////
+////	Algebraic multigrid for sparse systems of 3x3 blocks
+////
+////		Multigrid			-	Smoothed aggregation hierarchy of a
+////									symmetric positive definite
+////									BlockCRSMatrix, used on its own or
+////									as the preconditioner of conjugate
+////									gradients.  The coarse levels come
+////									from the matrix graph, so tetrahedral
+////									meshes and spring networks are
+////									handled alike.
+////		ImplicitMultigrid	-	Multigrid solution of the Jacobian
+////									systems of the implicit integrators
+////
+////////////////////////////////////////////////////////////////
+
+
+#ifndef _MULTIGRID_H
+#define _MULTIGRID_H
+
+#include <vector>
+
+#include "algebra.h"
+
+// Cycle index: coarse corrections per level
+#define MG_V_CYCLE				1
+#define MG_W_CYCLE				2
+
+// Smoothers
+#define MG_SMOOTH_JACOBI		0		// Damped block Jacobi
+#define MG_SMOOTH_GAUSS_SEIDEL	1		// Block Gauss-Seidel, forward before and
+										//   backward after the coarse correction
+
+// Cycle and smoother of a hierarchy, kept by the objects so that a
+// new hierarchy gets the values of the project file
+class MultigridParameters {
+public:
+	MultigridParameters() : cycle(MG_V_CYCLE), smoother(MG_SMOOTH_GAUSS_SEIDEL),
+							pre_sweeps(1), post_sweeps(1), omega(2.0/3.0) {}
+
+	unsigned int	cycle;
+	int				smoother;
+	unsigned int	pre_sweeps, post_sweeps;
+	Real			omega;
+};
+
+class Multigrid {
+public:
+	Multigrid();
+	~Multigrid();
+
+	// Defaults are V cycles with one Gauss-Seidel sweep before and after
+	// the coarse correction.  omega only damps the Jacobi smoother.
+	void			SetCycle(unsigned int gamma)	{ cycle = gamma; }
+	void			SetSmoother(int type, unsigned int pre, unsigned int post, Real omega = 2.0/3.0);
+	void			SetParameters(const MultigridParameters &p)
+					{ SetCycle(p.cycle); SetSmoother(p.smoother, p.pre_sweeps, p.post_sweeps, p.omega); }
+
+	// Builds the hierarchy of A, coarsening until a level has at most
+	// coarse_nodes block rows.  A is referenced, not copied.
+	void			Setup(const BlockCRSMatrix<Real> &A, unsigned int max_levels = 10, unsigned int coarse_nodes = 100);
+	// New values in the matrix of Setup(): the aggregates and the
+	// prolongators are kept, the coarse matrices are recomputed
+	void			Refresh(void);
+
+	// One cycle on A x = b, from the given x
+	void			Cycle(Real *x, const Real *b);
+	// Conjugate gradients preconditioned by one cycle, from the given x,
+	// until |b - A x| <= tol |b|.  Returns the number of iterations.
+	unsigned int	Solve(Real *x, const Real *b, Real tol, unsigned int max_iter);
+
+	unsigned int	NumLevels(void) const					{ return num_levels; }
+	unsigned int	LevelNodes(unsigned int l) const		{ return level[l].A->mb(); }
+
+protected:
+	typedef struct {
+		const BlockCRSMatrix<Real>	*A;			// Matrix of the level, the finest is the caller's
+		BlockCRSMatrix<Real>		*owned;		// A of the coarse levels
+		std::vector<Real>			dinv;		// Inverted diagonal blocks
+		// Prolongator to the next level, one block row per node
+		std::vector<unsigned int>	p_ptr, p_col;
+		std::vector<Real>			p_val;
+		// Transpose of the prolongator: node and P entry of each coarse row
+		std::vector<unsigned int>	pt_ptr, pt_row, pt_ent;
+		// A P, one block row per node
+		std::vector<unsigned int>	ap_ptr, ap_col;
+		std::vector<Real>			ap_val;
+		std::vector<Real>			x, b, r;	// Work vectors, 3 per node
+	} Level;
+
+	void			Release(void);
+	void			Coarsen(unsigned int l);
+	void			InvertDiagonal(unsigned int l);
+	void			Galerkin(unsigned int l);
+	void			FactorCoarse(void);
+	void			Smooth(unsigned int l, Real *x, const Real *b, unsigned int sweeps, bool forward);
+	void			CycleLevel(unsigned int l, Real *x, const Real *b);
+
+	std::vector<Level>		level;
+	unsigned int			num_levels;
+	SkylineCholesky<Real>	coarse;			// Factor of the coarsest matrix
+	bool					coarse_factored;
+	unsigned int			cycle;
+	int						smoother;
+	unsigned int			pre_sweeps, post_sweeps;
+	Real					jacobi_omega;
+
+private:
+	// Not copyable
+	Multigrid(const Multigrid &);
+	void operator=(const Multigrid &);
+};
+
+
+// Jacobian systems of the implicit integrators,
+//
+//		| A11		A12		| | dv |   | bv |
+//		| a21 I		a22 I	| | dx | = | bx |
+//
+// Eliminating dx = (bx - a21 dv) / a22 leaves the velocity system
+//
+//		M (A11 - a21/a22 A12) dv = M (bv - A12 bx / a22)
+//
+// with M the lumped mass.  For A11 = I + h/m C and A12 = h/m K this
+// is M + h C + h^2 K, symmetric positive definite once the rows and
+// columns of the Dirichlet nodes are replaced by the identity.
+class ImplicitMultigrid {
+public:
+	ImplicitMultigrid() : rhs(NULL) {}
+	~ImplicitMultigrid()						{ if(rhs != NULL) delete[] rhs; }
+
+	Multigrid		&Hierarchy(void)			{ return mg; }
+
+	// A11 and A12 share their pattern.  Fixed nodes get dv = 0.  The
+	// hierarchy is built by the first call and refreshed afterwards.
+	// Returns the number of conjugate gradient iterations.
+	unsigned int	Solve(Real *dv, Real *dx, const BlockCRSMatrix<Real> &A11, const BlockCRSMatrix<Real> &A12,
+						  Real a21, Real a22, const Real *bv, const Real *bx, const Real *mass,
+						  const unsigned char *fixed, Real tol, unsigned int max_iter);
+
+protected:
+	Multigrid				mg;
+	BlockCRSMatrix<Real>	S;				// Velocity system
+	Real					*rhs;
+
+private:
+	// Not copyable
+	ImplicitMultigrid(const ImplicitMultigrid &);
+	void operator=(const ImplicitMultigrid &);
+};
+
+#endif
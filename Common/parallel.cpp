@@ -0,0 +1,210 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Parallel Loop Implementation (parallel.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	PARALLEL.CPP v0.1.0
+////
+////	Fork-join parallel loops over a persistent pthread worker pool
+////
+////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "parallel.h"
+#include "memory_pool.h"
+
+#define MAX_PARALLEL_THREADS	64
+
+// Pool state.  Workers sleep on job_cond and pick up a new job whenever
+// job_generation changes; the caller sleeps on done_cond until all workers
+// have checked in.
+static pthread_mutex_t	pool_mutex	= PTHREAD_MUTEX_INITIALIZER;	// One parallel loop at a time
+static pthread_mutex_t	job_mutex	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	job_cond	= PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	done_cond	= PTHREAD_COND_INITIALIZER;
+
+static unsigned int		num_threads		= 0;	// 0 until first use
+static unsigned int		num_workers		= 0;	// Spawned worker threads
+static unsigned long	job_generation	= 0;
+static unsigned int		job_pending		= 0;
+static unsigned int		job_chunks		= 0;
+static unsigned int		job_count		= 0;
+static ParallelTask		job_task		= NULL;
+static void				*job_arg		= NULL;
+
+static unsigned long	worker_start[MAX_PARALLEL_THREADS];	// Generation at spawn time
+
+static ALGEBRA_TLS int	tls_in_parallel	= 0;
+
+
+static unsigned int DefaultThreads(void)
+{
+	const char	*env = getenv("GIPSI_THREADS");
+	int			n = 0;
+
+	if(env != NULL) n = atoi(env);
+
+	if(n <= 0) {
+#ifdef WIN32
+		SYSTEM_INFO	info;
+		GetSystemInfo(&info);
+		n = info.dwNumberOfProcessors;
+#else
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+
+	if(n < 1) n = 1;
+	if(n > MAX_PARALLEL_THREADS) n = MAX_PARALLEL_THREADS;
+
+	return n;
+}
+
+
+inline static void RunChunk(unsigned int chunk)
+{
+	unsigned int	begin	= (unsigned int) (((unsigned long long) job_count * chunk) / job_chunks);
+	unsigned int	end		= (unsigned int) (((unsigned long long) job_count * (chunk + 1)) / job_chunks);
+
+	if(begin < end) job_task(job_arg, begin, end, chunk);
+}
+
+
+static void *WorkerMain(void *arg)
+{
+	unsigned int	id = (unsigned int) (size_t) arg;	// 1 .. num_workers
+
+	tls_in_parallel = 1;
+
+	pthread_mutex_lock(&job_mutex);
+	unsigned long	seen = worker_start[id];
+	for(;;) {
+		while(job_generation == seen)
+			pthread_cond_wait(&job_cond, &job_mutex);
+		seen = job_generation;
+		pthread_mutex_unlock(&job_mutex);
+
+		if(id < job_chunks) RunChunk(id);
+
+		pthread_mutex_lock(&job_mutex);
+		if(--job_pending == 0) pthread_cond_signal(&done_cond);
+	}
+
+	return NULL;
+}
+
+
+// Spawns workers up to num_threads - 1.  Called with pool_mutex held.
+static void GrowPool(void)
+{
+	while(num_workers + 1 < num_threads) {
+		pthread_t		thread;
+		unsigned int	id = num_workers + 1;
+
+		// Jobs issued before the worker existed are not its business
+		worker_start[id] = job_generation;
+
+		if(pthread_create(&thread, NULL, WorkerMain, (void *) (size_t) id) != 0) {
+			perror("pthread_create");
+			num_threads = num_workers + 1;
+			return;
+		}
+		pthread_detach(thread);
+
+		pthread_mutex_lock(&job_mutex);
+		num_workers++;
+		pthread_mutex_unlock(&job_mutex);
+	}
+}
+
+
+void SetParallelThreads(unsigned int threads)
+{
+	if(threads < 1) threads = 1;
+	if(threads > MAX_PARALLEL_THREADS) threads = MAX_PARALLEL_THREADS;
+
+	pthread_mutex_lock(&pool_mutex);
+	num_threads = threads;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+
+unsigned int GetParallelThreads(void)
+{
+	if(num_threads == 0) {
+		pthread_mutex_lock(&pool_mutex);
+		if(num_threads == 0) num_threads = DefaultThreads();
+		pthread_mutex_unlock(&pool_mutex);
+	}
+
+	return num_threads;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ParallelFor()
+//
+//		Runs task over [0, count) split into contiguous chunks
+//
+void ParallelFor(unsigned int count, ParallelTask task, void *arg, unsigned int min_per_thread)
+{
+	unsigned int	chunks = GetParallelThreads();
+
+	if(min_per_thread < 1) min_per_thread = 1;
+	if(count / min_per_thread < chunks) chunks = count / min_per_thread;
+
+	if(chunks <= 1 || tls_in_parallel || pthread_mutex_trylock(&pool_mutex) != 0) {
+		if(count > 0) task(arg, 0, count, 0);
+		return;
+	}
+
+	GrowPool();
+	if(chunks > num_workers + 1) chunks = num_workers + 1;
+
+	pthread_mutex_lock(&job_mutex);
+	job_task	= task;
+	job_arg		= arg;
+	job_count	= count;
+	job_chunks	= chunks;
+	job_pending	= num_workers;
+	job_generation++;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&job_mutex);
+
+	// The calling thread takes chunk 0
+	tls_in_parallel = 1;
+	RunChunk(0);
+	tls_in_parallel = 0;
+
+	pthread_mutex_lock(&job_mutex);
+	while(job_pending > 0)
+		pthread_cond_wait(&done_cond, &job_mutex);
+	pthread_mutex_unlock(&job_mutex);
+
+	pthread_mutex_unlock(&pool_mutex);
+}
@@ -0,0 +1,52 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is GiPSi Parallel Loop Header (parallel.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	PARALLEL.H v0.1.0
+////
+////	Fork-join parallel loops over a persistent pthread worker pool
+////
+////		ParallelFor			-	Splits [0, count) into one contiguous
+////									chunk per thread and runs the task on
+////									each chunk.  The split only depends on
+////									count and the thread count, so a given
+////									configuration is deterministic.
+////		SetParallelThreads	-	Number of threads used by ParallelFor,
+////									including the calling thread.  Defaults
+////									to GIPSI_THREADS from the environment,
+////									or the number of processors.
+////
+////	Calls made from inside a task, or while another thread is running a
+////	parallel loop, run serially on the calling thread.
+////
+////////////////////////////////////////////////////////////////
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+// Loop body: processes indices [begin, end).  thread is in [0, threads) and
+// can be used to select per-thread scratch buffers.
+typedef void (*ParallelTask)(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
+void			ParallelFor(unsigned int count, ParallelTask task, void *arg, unsigned int min_per_thread = 256);
+
+void			SetParallelThreads(unsigned int threads);
+unsigned int	GetParallelThreads(void);
+
+#endif
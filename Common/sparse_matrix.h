@@ -32,12 +32,18 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 
 template<class T> class CRSMatrix;
 
 template<class T> void multMV(Vector<T> &result, CRSMatrix<T> &A, Vector<T> &x);
 
+template<class T> class BlockCRSMatrix;
+
+template<class T> void multMV(Vector<T> &result, const BlockCRSMatrix<T> &A, const Vector<T> &x);
+template<class T> void multAddMV(Vector<T> &result, const BlockCRSMatrix<T> &A, const Vector<T> &x);
+
 
 // General mxn dimensional Compressed Row Storage Sparse Matrix Template
 template <class T> 
@@ -191,6 +197,445 @@ void multMV(Vector<T> &result, CRSMatrix<T> &A, Vector<T> &x) {
 	}
 }
 
+// Square Compressed Row Storage matrix of 3x3 blocks.
+//
+// The sparsity pattern is fixed at initPattern() from a list of block
+// (row, column) pairs; the diagonal blocks are always present.  Values are
+// then refilled in place (zero(), addBlock(), ...) without reallocating,
+// which is what the implicit integrators need for their per step Jacobians.
+// Each block is stored row-major in 9 consecutive entries.
+template <class T> 
+class BlockCRSMatrix {
+public:
+// Constructors
+	BlockCRSMatrix() :	data(NULL), row_ptr(NULL), col_ind(NULL), diag_ind(NULL),
+						_mb(0), _nnzb(0) {}
+
+// Destructor
+	~BlockCRSMatrix<T>() {
+		this->clear();
+	}
+
+// Pattern construction.  pairs holds num_pairs (row, column) block indices;
+// both (i,j) and (j,i) are inserted so the pattern is structurally symmetric.
+	void initPattern(unsigned int mb, unsigned int num_pairs, const unsigned int *pairs) {
+		unsigned int	i, k;
+
+		this->clear();
+
+		_mb		= mb;
+		row_ptr	= new unsigned int[mb+1];
+		diag_ind= new unsigned int[mb];
+
+		// Count (upper bound, duplicates are squeezed out below)
+		for(i=0; i<=mb; i++)	row_ptr[i] = 0;
+		for(i=0; i<mb; i++)		row_ptr[i+1]++;
+		for(k=0; k<num_pairs; k++) {
+			row_ptr[pairs[2*k]+1]++;
+			row_ptr[pairs[2*k+1]+1]++;
+		}
+		for(i=0; i<mb; i++)		row_ptr[i+1] += row_ptr[i];
+
+		unsigned int	*fill	= new unsigned int[mb];
+		unsigned int	*cols	= new unsigned int[row_ptr[mb]];
+
+		for(i=0; i<mb; i++) {
+			fill[i] = row_ptr[i];
+			cols[fill[i]++] = i;
+		}
+		for(k=0; k<num_pairs; k++) {
+			unsigned int	r = pairs[2*k], c = pairs[2*k+1];
+			cols[fill[r]++] = c;
+			cols[fill[c]++] = r;
+		}
+
+		// Sort and unique each row in place, then compact
+		unsigned int	nnzb = 0;
+		for(i=0; i<mb; i++) {
+			unsigned int	*first	= cols + row_ptr[i];
+			unsigned int	*last	= cols + row_ptr[i+1];
+
+			std::sort(first, last);
+			last = std::unique(first, last);
+
+			row_ptr[i] = nnzb;
+			for(unsigned int *c = first; c != last; c++) cols[nnzb++] = *c;
+		}
+		row_ptr[mb] = nnzb;
+
+		_nnzb	= nnzb;
+		col_ind	= new unsigned int[nnzb];
+		data	= new T[9*nnzb];
+		for(k=0; k<nnzb; k++)	col_ind[k] = cols[k];
+		for(i=0; i<mb; i++)		diag_ind[i] = find(i, i);
+
+		delete[] fill;
+		delete[] cols;
+
+		this->zero();
+	}
+
+// Same pattern as A, all blocks zero
+	void copyPattern(const BlockCRSMatrix<T> &A) {
+		unsigned int	i;
+
+		this->clear();
+
+		_mb		= A._mb;
+		_nnzb	= A._nnzb;
+		row_ptr	= new unsigned int[_mb+1];
+		diag_ind= new unsigned int[_mb];
+		col_ind	= new unsigned int[_nnzb];
+		data	= new T[9*_nnzb];
+		for(i=0; i<=_mb; i++)	row_ptr[i] = A.row_ptr[i];
+		for(i=0; i<_mb; i++)	diag_ind[i] = A.diag_ind[i];
+		for(i=0; i<_nnzb; i++)	col_ind[i] = A.col_ind[i];
+
+		this->zero();
+	}
+
+	void clear(void) {
+		if (data != NULL)		delete[] data;
+		if (row_ptr != NULL)	delete[] row_ptr;
+		if (col_ind != NULL)	delete[] col_ind;
+		if (diag_ind != NULL)	delete[] diag_ind;
+		data	= NULL;
+		row_ptr = col_ind = diag_ind = NULL;
+		_mb		= _nnzb = 0;
+	}
+
+// Query functions
+	unsigned int	m()		const { return 3*_mb; }
+	unsigned int	n()		const { return 3*_mb; }
+	unsigned int	mb()	const { return _mb; }
+	unsigned int	nnzb()	const { return _nnzb; }
+	bool			empty() const { return (data == NULL && _nnzb == 0); }
+
+	// Index of block (i,j) in the storage, or -1 if it is not in the pattern
+	int				find(unsigned int i, unsigned int j) const {
+		const unsigned int	*first	= col_ind + row_ptr[i];
+		const unsigned int	*last	= col_ind + row_ptr[i+1];
+		const unsigned int	*c		= std::lower_bound(first, last, j);
+
+		return (c != last && *c == j) ? (int) (c - col_ind) : -1;
+	}
+
+	T*				block(unsigned int k)				{ return data + 9*k; }
+	const T*		block(unsigned int k) const			{ return data + 9*k; }
+	T*				diag(unsigned int i)				{ return data + 9*diag_ind[i]; }
+	unsigned int	rowBegin(unsigned int i) const		{ return row_ptr[i]; }
+	unsigned int	rowEnd(unsigned int i) const		{ return row_ptr[i+1]; }
+	unsigned int	col(unsigned int k) const			{ return col_ind[k]; }
+
+// Numerical refill
+	void zero(void) {
+		for(unsigned int k=0; k<9*_nnzb; k++) data[k] = (T) 0;
+	}
+
+	// block(k) += alpha * b
+	void addBlock(unsigned int k, const T *b, T alpha) {
+		T	*d = data + 9*k;
+		for(unsigned int l=0; l<9; l++) d[l] += alpha * b[l];
+	}
+
+	// Scales the three scalar rows of block row i
+	void scaleRow(unsigned int i, T alpha) {
+		for(unsigned int k=9*row_ptr[i]; k<9*row_ptr[i+1]; k++) data[k] *= alpha;
+	}
+
+	// Replaces block row i with the corresponding rows of the identity
+	void setRowIdentity(unsigned int i) {
+		for(unsigned int k=9*row_ptr[i]; k<9*row_ptr[i+1]; k++) data[k] = (T) 0;
+		T	*d = diag(i);
+		d[0] = d[4] = d[8] = (T) 1;
+	}
+
+	// Expands into a dense matrix (debugging output only)
+	void toDense(Matrix<T> &A) const {
+		A = (T) 0;
+		for(unsigned int i=0; i<_mb; i++)
+			for(unsigned int k=row_ptr[i]; k<row_ptr[i+1]; k++)
+				for(unsigned int r=0; r<3; r++)
+					for(unsigned int c=0; c<3; c++)
+						A[3*i+r][3*col_ind[k]+c] = data[9*k + 3*r + c];
+	}
+
+protected:
+	T				*data;		// Block array, 9 entries per block
+	unsigned int	*row_ptr;	// Block row pointers
+	unsigned int	*col_ind;	// Block column indices, sorted within each row
+	unsigned int	*diag_ind;	// Position of the diagonal block of each row
+	unsigned int	_mb;		// Number of block rows (= block columns)
+	unsigned int	_nnzb;		// Number of stored blocks
+
+private:
+	// Not copyable: the pattern is shared by nothing and owned here
+	BlockCRSMatrix(const BlockCRSMatrix<T> &);
+	void operator=(const BlockCRSMatrix<T> &);
+};
+
+
+// result = A * x
+template<class T>
+void multMV(Vector<T> &result, const BlockCRSMatrix<T> &A, const Vector<T> &x) {
+	ASSERT(result.dim() == A.m() && x.dim() == A.n());
+
+	for(unsigned int i=0; i<A.m(); i++) result[i] = (T) 0;
+	multAddMV(result, A, x);
+}
+
+// result += A * x
+template<class T>
+void multAddMV(Vector<T> &result, const BlockCRSMatrix<T> &A, const Vector<T> &x) {
+	const T		*xv = x.begin();
+	T			*yv = result.begin();
+
+	ASSERT(result.dim() == A.m() && x.dim() == A.n());
+
+	for(unsigned int i=0; i<A.mb(); i++) {
+		T	y0 = (T) 0, y1 = (T) 0, y2 = (T) 0;
+
+		for(unsigned int k=A.rowBegin(i); k<A.rowEnd(i); k++) {
+			const T	*b	= A.block(k);
+			const T	*xj	= xv + 3*A.col(k);
+
+			y0 += b[0]*xj[0] + b[1]*xj[1] + b[2]*xj[2];
+			y1 += b[3]*xj[0] + b[4]*xj[1] + b[5]*xj[2];
+			y2 += b[6]*xj[0] + b[7]*xj[1] + b[8]*xj[2];
+		}
+
+		yv[3*i]   += y0;
+		yv[3*i+1] += y1;
+		yv[3*i+2] += y2;
+	}
+}
+
+
+
+// Cholesky factorization of a symmetric positive definite nxn matrix in
+// skyline (envelope) storage.
+//
+// Row i keeps the lower triangle from its first structural nonzero column
+// first[i] through the diagonal.  Fill-in of the factor stays inside this
+// envelope, so factor() overwrites the matrix in place and the cost is set
+// by the profile: order the unknowns for a small bandwidth.  Like
+// BlockCRSMatrix the envelope is fixed at initPattern() and the values are
+// refilled in place before each factor().
+template <class T> 
+class SkylineCholesky {
+public:
+// Constructors
+	SkylineCholesky() :	data(NULL), row_ptr(NULL), first(NULL),
+						_n(0), _nnz(0), factored(false) {}
+
+// Destructor
+	~SkylineCholesky<T>() {
+		this->clear();
+	}
+
+// Envelope construction from num_pairs off-diagonal (row, column) pairs,
+// in either order
+	void initPattern(unsigned int n, unsigned int num_pairs, const unsigned int *pairs) {
+		unsigned int	i, k;
+
+		this->clear();
+
+		_n		= n;
+		first	= new unsigned int[n];
+		row_ptr	= new unsigned int[n+1];
+
+		for(i=0; i<n; i++) first[i] = i;
+		for(k=0; k<num_pairs; k++) {
+			unsigned int	r = pairs[2*k], c = pairs[2*k+1];
+			if(r < c) std::swap(r, c);
+			if(c < first[r]) first[r] = c;
+		}
+
+		row_ptr[0] = 0;
+		for(i=0; i<n; i++) row_ptr[i+1] = row_ptr[i] + (i - first[i] + 1);
+
+		_nnz	= row_ptr[n];
+		data	= new T[_nnz];
+
+		this->zero();
+	}
+
+	void clear(void) {
+		if (data != NULL)		delete[] data;
+		if (row_ptr != NULL)	delete[] row_ptr;
+		if (first != NULL)		delete[] first;
+		data	= NULL;
+		row_ptr = first = NULL;
+		_n		= _nnz = 0;
+		factored= false;
+	}
+
+// Query functions
+	unsigned int	n()			const { return _n; }
+	unsigned int	nnz()		const { return _nnz; }			// Stored entries of the envelope
+	bool			isFactored()const { return factored; }
+	bool			inPattern(unsigned int i, unsigned int j) const {
+		if(i < j) std::swap(i, j);
+		return j >= first[i];
+	}
+
+// Numerical refill of the lower triangle, (i,j) must be inside the envelope
+	void zero(void) {
+		for(unsigned int k=0; k<_nnz; k++) data[k] = (T) 0;
+		factored = false;
+	}
+
+	// A(i,j) += value, (j,i) is the same entry
+	void add(unsigned int i, unsigned int j, T value) {
+		if(i < j) std::swap(i, j);
+		ASSERT(j >= first[i]);
+		data[row_ptr[i] + j - first[i]] += value;
+	}
+
+	T get(unsigned int i, unsigned int j) const {
+		if(i < j) std::swap(i, j);
+		return (j >= first[i]) ? data[row_ptr[i] + j - first[i]] : (T) 0;
+	}
+
+	// Replaces row and column i with those of the identity (Dirichlet rows)
+	void setRowIdentity(unsigned int i) {
+		for(unsigned int k=row_ptr[i]; k<row_ptr[i+1]; k++) data[k] = (T) 0;
+		data[row_ptr[i+1]-1] = (T) 1;
+		for(unsigned int r=i+1; r<_n; r++)
+			if(first[r] <= i) data[row_ptr[r] + i - first[r]] = (T) 0;
+	}
+
+// Factorization A = L L^T, in place.  Returns false if A is not positive
+// definite; the contents are undefined in that case.
+	bool factor(void) {
+		for(unsigned int i=0; i<_n; i++) {
+			T		*Li	= data + row_ptr[i] - first[i];		// Li[j] = L(i,j)
+
+			for(unsigned int j=first[i]; j<i; j++) {
+				const T		*Lj		= data + row_ptr[j] - first[j];
+				unsigned int	k0	= (first[i] > first[j]) ? first[i] : first[j];
+				T			sum		= Li[j];
+
+				for(unsigned int k=k0; k<j; k++) sum -= Li[k] * Lj[k];
+				Li[j] = sum / Lj[j];
+			}
+
+			T	d = Li[i];
+			for(unsigned int k=first[i]; k<i; k++) d -= Li[k] * Li[k];
+			if(d <= (T) 0) {
+				factored = false;
+				return false;
+			}
+			Li[i] = sqrt(d);
+		}
+
+		factored = true;
+		return true;
+	}
+
+// Solves A x = b in place with the factor.  x[stride*i] is unknown i, which
+// lets one call solve a single component of interleaved 3D vectors.  If b
+// is zero above row begin, so is y in L y = b and the forward pass starts
+// there.
+	void solve(T *x, unsigned int stride = 1, unsigned int begin = 0) const {
+		unsigned int	i, k;
+
+		ASSERT(factored);
+
+		// L y = b
+		for(i=begin; i<_n; i++) {
+			const T		*Li	= data + row_ptr[i] - first[i];
+			T			sum	= x[stride*i];
+
+			for(k=first[i]; k<i; k++) sum -= Li[k] * x[stride*k];
+			x[stride*i] = sum / Li[i];
+		}
+
+		// L^T x = y, column oriented so that only row i of L is read
+		for(i=_n; i>0; i--) {
+			const T		*Li	= data + row_ptr[i-1] - first[i-1];
+			T			xi	= x[stride*(i-1)] / Li[i-1];
+
+			x[stride*(i-1)] = xi;
+			for(k=first[i-1]; k<i-1; k++) x[stride*k] -= Li[k] * xi;
+		}
+	}
+
+protected:
+	T				*data;		// Envelope rows, each ending with the diagonal
+	unsigned int	*row_ptr;	// Start of each row in data
+	unsigned int	*first;		// First stored column of each row
+	unsigned int	_n;			// Number of rows (= columns)
+	unsigned int	_nnz;		// Number of stored entries
+	bool			factored;	// data holds L rather than A
+
+private:
+	// Not copyable
+	SkylineCholesky(const SkylineCholesky<T> &);
+	void operator=(const SkylineCholesky<T> &);
+};
+
+
+// Static condensation of the factored system A and a block matrix C of the
+// same size to the three unknowns of block node i.  The columns X = A^-1 E
+// of the unit loads at the node give its compliance G = E^T X, so the
+// condensed stiffness is K = G^-1 and the field of a unit displacement of
+// the node is Psi = X K, on which C reduces to Psi^T C Psi.  X is scratch
+// of 9*C.mb() entries and holds Psi on return.  Returns false if G is
+// singular.
+template<class T>
+bool condenseNode(T *K, T *Ci, const SkylineCholesky<T> &A, const BlockCRSMatrix<T> &C,
+				  unsigned int i, T *X) {
+	const unsigned int	n = C.n();
+	unsigned int		j, k, r, c, l;
+
+	ASSERT(A.n() == n);
+
+	// X[3*dof + c], column c is the response to the unit load c
+	for(j=0; j<3*n; j++) X[j] = (T) 0;
+	for(c=0; c<3; c++) X[3*(3*i+c) + c] = (T) 1;
+	for(c=0; c<3; c++) A.solve(X + c, 3, 3*i + c);
+
+	// K = G^-1
+	const T		*G	= X + 9*i;
+	T			det	=	G[0] * (G[4]*G[8] - G[5]*G[7]) -
+						G[1] * (G[3]*G[8] - G[5]*G[6]) +
+						G[2] * (G[3]*G[7] - G[4]*G[6]);
+	if(det == (T) 0) return false;
+	for(r=0; r<3; r++)
+		for(c=0; c<3; c++) {
+			unsigned int	r1 = (c+1)%3, r2 = (c+2)%3, c1 = (r+1)%3, c2 = (r+2)%3;
+			K[3*r+c] = (G[3*r1+c1]*G[3*r2+c2] - G[3*r1+c2]*G[3*r2+c1]) / det;
+		}
+
+	// X = Psi
+	for(j=0; j<n; j++) {
+		T	x[3] = { X[3*j], X[3*j+1], X[3*j+2] };
+		for(c=0; c<3; c++)
+			X[3*j+c] = x[0]*K[c] + x[1]*K[3+c] + x[2]*K[6+c];
+	}
+
+	// Ci = Psi^T C Psi, over the blocks of C
+	for(c=0; c<9; c++) Ci[c] = (T) 0;
+	for(j=0; j<C.mb(); j++) {
+		const T		*Pj = X + 9*j;
+		for(k=C.rowBegin(j); k<C.rowEnd(j); k++) {
+			const T		*Pl	= X + 9*C.col(k);
+			const T		*b	= C.block(k);
+			T			t[9];
+
+			// t = C_jl Psi_l, then Ci += Psi_j^T t
+			for(r=0; r<3; r++)
+				for(c=0; c<3; c++)
+					t[3*r+c] = b[3*r]*Pl[c] + b[3*r+1]*Pl[3+c] + b[3*r+2]*Pl[6+c];
+			for(r=0; r<3; r++)
+				for(c=0; c<3; c++)
+					for(l=0; l<3; l++) Ci[3*r+c] += Pj[3*l+r] * t[3*l+c];
+		}
+	}
+
+	return true;
+}
 
 
 inline int CRSMatrix<Real>::save(const char *filename) {
@@ -29,6 +29,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #define _CVECTOR_H
 
 #include "algebra.h"
+#include "memory_pool.h"
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
@@ -116,7 +117,7 @@ public:
 	~Vector<T>() {
 		// Destroy data only if this is not a reference
 		if(!_ref)
-			if (data != NULL) delete[] data; 
+			if (data != NULL) AlgebraDeallocate(data, _dim * sizeof(T));
 		data = NULL;
 	}
 
@@ -135,7 +136,8 @@ public:
 // CResize clears the old values.
 	void cresize(int new_dim) {
 		if(!this->empty()) {
-			delete[] data;
+			if(!_ref) AlgebraDeallocate(data, _dim * sizeof(T));
+			_ref = false;
 			_dim = 0;
 		}
 
@@ -194,8 +196,10 @@ protected:
 	unsigned int	_dim;		// Dimension (size) of the vector
 	int				_ref;		// True if this is a reference
 
+	// Component storage goes through the algebra allocator (memory_pool.h),
+	// so T is expected to be an arithmetic type
 	void init(int dim) {
-		data = new T[dim];
+		data = (T *) AlgebraAllocate(dim * sizeof(T));
 
 		_dim = dim;
 	}
@@ -378,7 +382,7 @@ inline bool operator==(const Vector<T> &v1, const Vector<T> &v2)
 	T				*v1data, *v2data;
 	unsigned int	dim;
 
-	dim		= v1.dim;
+	dim		= v1.dim();
 	v1data	= v1.begin();
 	v2data	= v2.begin();
 
@@ -400,7 +404,7 @@ inline bool operator!=(const Vector<T> &v1, const Vector<T> &v2)
 	T				*v1data, *v2data;
 	unsigned int	dim;
 
-	dim		= v1.dim;
+	dim		= v1.dim();
 	v1data	= v1.begin();
 	v2data	= v2.begin();
 
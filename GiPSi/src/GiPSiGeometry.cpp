@@ -561,6 +561,80 @@ void TriSurface::calcNormals(void)
 
 
 
+// n = normalize(C * m)
+static inline void TransformNormal(Real *n, const Real *C, const Real *m)
+{
+	Real	x = C[0]*m[0] + C[1]*m[1] + C[2]*m[2];
+	Real	y = C[3]*m[0] + C[4]*m[1] + C[5]*m[2];
+	Real	z = C[6]*m[0] + C[7]*m[1] + C[8]*m[2];
+	Real	l = (Real) sqrt(x*x + y*y + z*z);
+
+	if(l > 0.0) { x /= l;	y /= l;	z /= l; }
+	n[0] = x;	n[1] = y;	n[2] = z;
+}
+
+// Whether A is a rotation times a uniform scale, A^T A = s I
+static inline bool IsSimilarity(const Real *A)
+{
+	Real	G[9], s;
+	int		r, c;
+
+	for(r = 0; r < 3; r++)
+		for(c = 0; c < 3; c++) G[3*r+c] = A[r]*A[c] + A[3+r]*A[3+c] + A[6+r]*A[6+c];
+	s = (G[0] + G[4] + G[8]) / 3.0;
+	for(r = 0; r < 3; r++)
+		for(c = 0; c < 3; c++)
+			if(fabs(G[3*r+c] - ((r == c) ? s : 0.0)) > 1e-6 * s) return false;
+	return true;
+}
+
+/**
+ * Sets the surface to an affine transform of the same surface at rest in a
+ * single pass.  Normals are mapped by the cofactor matrix of A, which takes
+ * the cross product of two edges to the cross product of the transformed
+ * edges, so face normals come out as calcNormals() would give them.  Vertex
+ * normals map the same way only if A is a similarity; otherwise they are
+ * rebuilt from the transformed face normals as in calcNormals().
+ * 
+ * @param rest Surface at rest with its normals, same connectivity.
+ * @param A Linear part, 3x3 row major.
+ * @param t Translation.
+ */
+void TriSurface::Transform(const TriSurface &rest, const Real *A, const Real *t)
+{
+	Real			C[9];
+	unsigned int	i;
+	bool			similar = IsSimilarity(A);
+
+	C[0] = A[4]*A[8] - A[5]*A[7];	C[1] = A[5]*A[6] - A[3]*A[8];	C[2] = A[3]*A[7] - A[4]*A[6];
+	C[3] = A[2]*A[7] - A[1]*A[8];	C[4] = A[0]*A[8] - A[2]*A[6];	C[5] = A[1]*A[6] - A[0]*A[7];
+	C[6] = A[1]*A[5] - A[2]*A[4];	C[7] = A[2]*A[3] - A[0]*A[5];	C[8] = A[0]*A[4] - A[1]*A[3];
+
+	for(i = 0; i < num_vertex; i++) {
+		const Real	*p = rest.vertex[i].pos.begin();
+		Real		*q = vertex[i].pos.begin();
+
+		q[0] = A[0]*p[0] + A[1]*p[1] + A[2]*p[2] + t[0];
+		q[1] = A[3]*p[0] + A[4]*p[1] + A[5]*p[2] + t[1];
+		q[2] = A[6]*p[0] + A[7]*p[1] + A[8]*p[2] + t[2];
+		if(similar)	TransformNormal(vertex[i].n.begin(), C, rest.vertex[i].n.begin());
+		else		vertex[i].n = 0.0;
+	}
+	for(i = 0; i < num_face; i++) {
+		Triangle	*f = &(face[i]);
+
+		TransformNormal(f->n.begin(), C, rest.face[i].n.begin());
+		if(similar) continue;
+		f->vertex[0]->n += f->n;
+		f->vertex[1]->n += f->n;
+		f->vertex[2]->n += f->n;
+	}
+	if(!similar)
+		for(i = 0; i < num_vertex; i++) vertex[i].n.normalize();
+}
+
+
+
 /**
  * Reads in .obj file.
  * 
@@ -295,6 +295,9 @@ public:
 	void			Load(char*);
 	void			Load(LoadData*);
 	void			calcNormals(void);			// Updates normals
+	// Positions A * pos + t of the same surface at rest, A row major, and
+	// the normals calcNormals() would give for them
+	void			Transform(const TriSurface &rest, const Real *A, const Real *t);
 };
 
 
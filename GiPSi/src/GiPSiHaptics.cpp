@@ -23,6 +23,8 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 ////
 ////////////////////////////////////////////////////////////////
 
+#include <string.h>
+
 #include "GiPSiHaptics.h"
 
 HapticInterfaceObject::HapticInterfaceObject(XMLNode * simObjNode): RigidSolidObject(simObjNode)
@@ -209,4 +211,67 @@ void HapticInterfaceObject::SetBaseConfiguration(const Matrix<Real> &config)
 {
 	GetRotationMatrix(R_w_lh, config);
 	GetTranslationVector(t_w_lh, config);
-}
\ No newline at end of file
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	ReserveHapticModel()
+//
+//		Sizes Model and clears it. The storage of Model is reused
+//		when it has the requested dimensions, otherwise it is freed
+//		and reallocated. Model has to be zeroed or sized by an
+//		earlier call.
+//
+void ReserveHapticModel(GiPSiLowOrderLinearHapticModel &Model, unsigned int n, unsigned int m, unsigned int k)
+{
+	unsigned int	n_2 = n/2;
+
+	if(Model._n != n || Model._m != m || Model._k != k || Model.A11 == NULL) {
+		FreeHapticModel(Model);
+		Model._n = n;
+		Model._m = m;
+		Model._k = k;
+		Model.A11 = new Matrix<Real>(n_2, n_2, 0.0);
+		Model.A12 = new Matrix<Real>(n_2, n_2, 0.0);
+		Model.B1  = new Matrix<Real>(n_2, m  , 0.0);
+		Model.C11 = new Matrix<Real>(k  , n_2, 0.0);
+		Model.C12 = new Matrix<Real>(k  , n_2, 0.0);
+		Model.D   = new Matrix<Real>(k  , m  , 0.0);
+		Model.f_0 = new Vector<Real>(k, 0.0);
+		Model.zdot_0 = new Vector<Real>(n, 0.0);
+		Model.normal = new Vector<Real>(k, 0.0);
+		return;
+	}
+
+	*(Model.A11)	= 0.0;
+	*(Model.A12)	= 0.0;
+	*(Model.B1)		= 0.0;
+	*(Model.C11)	= 0.0;
+	*(Model.C12)	= 0.0;
+	*(Model.D)		= 0.0;
+	*(Model.f_0)	= 0.0;
+	*(Model.zdot_0)	= 0.0;
+	*(Model.normal)	= 0.0;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FreeHapticModel()
+//
+//		Releases the storage of Model and zeroes it
+//
+void FreeHapticModel(GiPSiLowOrderLinearHapticModel &Model)
+{
+	delete Model.A11;
+	delete Model.A12;
+	delete Model.B1;
+	delete Model.C11;
+	delete Model.C12;
+	delete Model.D;
+	delete Model.f_0;
+	delete Model.zdot_0;
+	delete Model.normal;
+	memset(&Model, 0, sizeof(GiPSiLowOrderLinearHapticModel));
+}
@@ -71,6 +71,12 @@ typedef struct {
 	Vector<Real>	*normal;	// _k x  1 vector	
 } GiPSiLowOrderLinearHapticModel ;
 
+// Sizes Model to n states, m inputs and k outputs and clears it, reusing
+// its storage when the dimensions match and freeing it otherwise
+void	ReserveHapticModel(GiPSiLowOrderLinearHapticModel &Model, unsigned int n, unsigned int m, unsigned int k);
+// Releases the storage of a model sized by ReserveHapticModel()
+void	FreeHapticModel(GiPSiLowOrderLinearHapticModel &Model);
+
 #include "GiPSiSimObject.h"
 #include "XMLNode.h"
 #include "XMLNodeList.h"
@@ -117,6 +123,7 @@ public:
 			Orientation = R;
 			ButtonState = 0x0000;
 		}
+	// Copies Model for the haptic loop, Model stays owned by the caller
 	virtual	void	UseHapticModel		(GiPSiLowOrderLinearHapticModel &Model) {}
 	virtual			~HapticInterface()
 		{
@@ -459,6 +459,31 @@ void ImplicitEuler<S>::Solver(S &system, State &state, Real h)
 }
 
 
+////////////////////////////////////////////////////////////////
+//
+//	Implicit Euler MG
+//
+//		The Implicit Euler with the Jacobian system solved by
+//		multigrid preconditioned CG.  The system eliminates the
+//		position update and solves for the velocities with
+//		MultigridSolve(x, J, b, tol, max), see ImplicitMultigrid;
+//		the iterations stay nearly constant as the mesh is refined.
+//
+template <class S>
+class ImplicitEulerMG : public ImplicitEuler<S> {
+public:
+	ImplicitEulerMG(S &system) : ImplicitEuler<S>(system) {}
+protected:
+	void	Solver(S &system, State &state, Real h);
+};
+
+template <class S>
+void ImplicitEulerMG<S>::Solver(S &system, State &state, Real h)
+{
+	system.MultigridSolve(state, J, B, error, state.size);
+}
+
+
 ////////////////////////////////////////////////////////////////
 //
 //	Implicit Euler NT
@@ -709,6 +734,112 @@ void ImplicitMidPoint<S>::Solver(S &system, State &state, Real h)
 	CG(system, state, J, B, state.size, error);  
 }
 
+////////////////////////////////////////////////////////////////
+//
+//	Projective Dynamics
+//
+//		Local/global solver for internal forces that derive from
+//		quadratic distances to constraint projections:
+//
+//		y = x(t) + h v(t) + h^2 M^-1 f_ext(t);
+//		x = y;
+//		repeat iterations times:
+//			p = P(x);									(local step)
+//			x = (M/h^2 + L)^-1 (M/h^2 y + J p);			(global step)
+//		v(t+h) = (x - x(t)) / h;
+//
+//		M/h^2 + L does not depend on the state, so the system factors it
+//		once per time step size and each iteration costs one local pass
+//		and one pair of triangular solves.  The iteration count is fixed,
+//		which keeps the cost of a step predictable.
+//
+//		The system provides the steps: ProjectiveBegin(state, h),
+//		ProjectiveLocal(state), ProjectiveGlobal(state) and
+//		ProjectiveEnd(state, h).
+//
+template <class S>
+class ProjectiveDynamics : public Integrator<S> {
+public:
+	ProjectiveDynamics(S &system, unsigned int iterations = 10) : iterations(iterations) {}
+
+	void					Integrate(S &system, Real h);
+	void					SetIterations(unsigned int num) { iterations = num; }
+
+protected:
+	unsigned int			iterations;
+};
+
+
+template <class S>
+void ProjectiveDynamics<S>::Integrate(S &system, Real h)
+{
+	State &state = system.GetState();
+
+	// y, initial guess and the step constant terms
+	system.ProjectiveBegin(state, h);
+
+	for(unsigned int k = 0; k < iterations; k++) {
+		system.ProjectiveLocal(state);
+		system.ProjectiveGlobal(state);
+	}
+
+	// v = (x - x(t)) / h
+	system.ProjectiveEnd(state, h);
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	Modal Integrator
+//
+//		Integrates a system reduced to a few linear vibration modes.
+//		In mass normalized modal coordinates the equations decouple
+//
+//		q_k'' + c_k q_k' + lambda_k q_k = f_k
+//
+//		and each mode takes an implicit Euler step of its own:
+//
+//		q_k'(t+h) = (q_k' + h (f_k - lambda_k q_k)) / (1 + h c_k + h^2 lambda_k);
+//		q_k(t+h)  = q_k + h q_k'(t+h);
+//
+//		which is unconditionally stable, so stiff modes only cost
+//		accuracy.  The system provides ModalBegin(state, h), which
+//		projects the forces of the step (f_k), the reduced coordinates
+//		through ModalCount(), ModalCoord(), ModalVelocity(),
+//		ModalForce(), ModalStiffness(k) and ModalDamping(k), and
+//		ModalEnd(state), which maps the result back to the state.
+//
+template <class S>
+class ModalIntegrator : public Integrator<S> {
+public:
+	ModalIntegrator(S &system) {}
+
+	void					Integrate(S &system, Real h);
+};
+
+
+template <class S>
+void ModalIntegrator<S>::Integrate(S &system, Real h)
+{
+	State &state = system.GetState();
+
+	system.ModalBegin(state, h);
+
+	unsigned int	n		= system.ModalCount();
+	Real			*q		= system.ModalCoord();
+	Real			*qdot	= system.ModalVelocity();
+	const Real		*f		= system.ModalForce();
+
+	for(unsigned int k = 0; k < n; k++) {
+		Real	lambda	= system.ModalStiffness(k);
+		Real	c		= system.ModalDamping(k);
+
+		qdot[k]	= (qdot[k] + h * (f[k] - lambda * q[k])) / (1.0 + h * c + h * h * lambda);
+		q[k]	+= h * qdot[k];
+	}
+
+	system.ModalEnd(state);
+}
+
 // NOTE: Everything below is incomplete!!
 
 template <class S>
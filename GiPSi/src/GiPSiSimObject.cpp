@@ -30,6 +30,48 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong
 
 #include "GiPSiAPI.h"
 
+////////////////////////////////////////////////////////////////
+//
+//	CollisionEnabledBoundary::GetPositions
+//
+//		Get Positions of the listed nodes of the boundary
+//
+void			CollisionEnabledBoundary::GetPositions(unsigned int n, const unsigned int *index, Real *Bpos)
+{
+	for (unsigned int i=0; i < n; i++, Bpos+=3) {
+		Vector<Real>	p = GetPosition(index[i]);
+		Bpos[0]=p[0];	Bpos[1]=p[1];	Bpos[2]=p[2];
+	}
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	CollisionEnabledBoundary::GetVelocities
+//
+//		Get Velocities of the listed nodes of the boundary
+//
+void			CollisionEnabledBoundary::GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel)
+{
+	for (unsigned int i=0; i < n; i++, Bvel+=3) {
+		Vector<Real>	v = GetVelocity(index[i]);
+		Bvel[0]=v[0];	Bvel[1]=v[1];	Bvel[2]=v[2];
+	}
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	CollisionEnabledBoundary::GetReactionForces
+//
+//		Get Reaction forces of the listed nodes of the boundary
+//
+void			CollisionEnabledBoundary::GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce)
+{
+	for (unsigned int i=0; i < n; i++, Bforce+=3) {
+		Vector<Real>	f = GetReactionForce(index[i]);
+		Bforce[0]=f[0];	Bforce[1]=f[1];	Bforce[2]=f[2];
+	}
+}
+
 ////////////////////////////////////////////////////////////////
 //
 //	SolidBoundary:::GetPosition
@@ -149,6 +191,39 @@ void			SolidBoundary::ResetBoundaryCondition(void)
 	Object->ResetInitialBoundaryCondition();
 }
 
+////////////////////////////////////////////////////////////////
+//
+//	SolidBoundary::GetBoundaryTypes
+//
+//		Get Boundary types of the listed nodes
+//
+void			SolidBoundary::GetBoundaryTypes(unsigned int n, const unsigned int *index, unsigned int *Btype)
+{
+	for (unsigned int i=0; i < n; i++) {
+		Btype[i]=boundary_type[index[i]];
+	}
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	SolidBoundary::SetBoundaryValues
+//
+//		Sets the boundary condition of the listed nodes
+//
+void			SolidBoundary::SetBoundaryValues(unsigned int n, const unsigned int *index,
+												 unsigned int boundary_type, const Real *boundary_value)
+{
+	for (unsigned int i=0; i < n; i++, boundary_value+=3) {
+		unsigned int	k = index[i];
+		Real			*v = this->boundary_value[k].begin(), *v2 = this->boundary_value2_vector[k].begin();
+
+		this->boundary_type[k]			=boundary_type;
+		v[0]=boundary_value[0];	v[1]=boundary_value[1];	v[2]=boundary_value[2];
+		this->boundary_value2_scalar[k]	=0.0;
+		v2[0]=v2[1]=v2[2]=0.0;
+	}
+}
+
 bool			SolidBoundary::isTypeOneBoundary(unsigned int index)
 {
 	if (boundary_type[index] == 1)
@@ -277,6 +352,65 @@ void ToRotationMatrix(Matrix<Real> &R, const Real &angle, const Real &ax, const
 	R[2][2] = 1-2*a*a-2*b*b;
 }
 
+////////////////////////////////////////////////////////////////
+//
+//	GetMultigridParameters
+//
+//		Reads the optional "multigrid" node of NHParameters into
+//		param: cycle "V" or "W", smoother "GaussSeidel" or "Jacobi",
+//		the preSmooth and postSmooth sweeps and the Jacobi omega.
+//		Missing entries keep the values of param.
+//
+void GetMultigridParameters(XMLNodeList * NHParametersChildren, MultigridParameters &param)
+{
+	for (unsigned int i = 0; i < NHParametersChildren->GetLength(); i++)
+	{
+		XMLNode * node = NHParametersChildren->GetNode(i);
+		char * name = node->GetName();
+		if (strcmp(name, "multigrid") == 0)
+		{
+			XMLNodeList * multigridChildren = node->GetChildren();
+			for (unsigned int j = 0; j < multigridChildren->GetLength(); j++)
+			{
+				XMLNode * paramNode = multigridChildren->GetNode(j);
+				char * paramName = paramNode->GetName();
+				if (strcmp(paramName, "cycle") == 0) {
+					const char * value = paramNode->GetValue();
+					if (strcmp(value, "V") == 0)		param.cycle = MG_V_CYCLE;
+					else if (strcmp(value, "W") == 0)	param.cycle = MG_W_CYCLE;
+					delete value;
+				}
+				else if (strcmp(paramName, "smoother") == 0) {
+					const char * value = paramNode->GetValue();
+					if (strcmp(value, "GaussSeidel") == 0)	param.smoother = MG_SMOOTH_GAUSS_SEIDEL;
+					else if (strcmp(value, "Jacobi") == 0)	param.smoother = MG_SMOOTH_JACOBI;
+					delete value;
+				}
+				else if (strcmp(paramName, "preSmooth") == 0) {
+					const char * value = paramNode->GetValue();
+					param.pre_sweeps = (unsigned int)atoi(value);
+					delete value;
+				}
+				else if (strcmp(paramName, "postSmooth") == 0) {
+					const char * value = paramNode->GetValue();
+					param.post_sweeps = (unsigned int)atoi(value);
+					delete value;
+				}
+				else if (strcmp(paramName, "omega") == 0) {
+					const char * value = paramNode->GetValue();
+					param.omega = (Real)atof(value);
+					delete value;
+				}
+				delete paramName;
+				delete paramNode;
+			}
+			delete multigridChildren;
+		}
+		delete name;
+		delete node;
+	}
+}
+
 void CollisionRule::initialize(int numBoundary)
 {
 	numCEBoundary = numBoundary;
@@ -36,6 +36,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 #include "GiPSiDisplay.h"
 #include "XMLNode.h"
 #include "XMLNodeList.h"
+#include "multigrid.h"
 
 #include <vector>
 #include <set>
@@ -56,6 +57,8 @@ void ToTransformationMatrix(Matrix<Real> &result, const Matrix<Real> &rotation,
 void GetRotationMatrix(Matrix<Real> &result, const Matrix<Real> &a);
 void GetTranslationVector(Vector<Real> &result, const Matrix<Real> &a);
 void ToRotationMatrix(Matrix<Real> &R, const Real &angle, const Real &ax, const Real &ay, const Real &az);
+// Optional "multigrid" node of the NHParameters of an object
+void GetMultigridParameters(XMLNodeList * NHParametersChildren, MultigridParameters &param);
 
 ///****************************************************************
 // *						SIMULATION OBJECT					  *  
@@ -412,6 +415,13 @@ public:
 	virtual void		GetVelocity(Vector<Real> *Bvel) = 0;
 	virtual Vector<Real>	GetReactionForce(unsigned int index) = 0;
 	virtual void		GetReactionForce(Vector<Real> *Bforce) = 0;
+
+	// Bulk access to the boundary nodes index[0..n).  Vectors are packed as
+	//   3 Reals per listed node.  The defaults go through the single node
+	//   interface, derived boundaries read their state directly.
+	virtual void		GetPositions(unsigned int n, const unsigned int *index, Real *Bpos);
+	virtual void		GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel);
+	virtual void		GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce);
 	
 	virtual void	Set(unsigned int index, unsigned int boundary_type, 
 								Vector<Real> boundary_value, 
@@ -460,6 +470,12 @@ public:
 
 	//void					SetGlobal_id(unsigned int index, unsigned int value) { global_id[index] = value; }
 	virtual int				GetBoundaryType(unsigned int index) { return boundary_type[index]; }
+	// Bulk versions of GetBoundaryType() and Set() for the nodes index[0..n).
+	//   boundary_value holds 3 Reals per listed node, the secondary boundary
+	//   values are cleared.
+	void					GetBoundaryTypes(unsigned int n, const unsigned int *index, unsigned int *Btype);
+	void					SetBoundaryValues(unsigned int n, const unsigned int *index,
+											  unsigned int boundary_type, const Real *boundary_value);
 	virtual void			Set(unsigned int index, unsigned int boundary_type, 
 								Vector<Real> boundary_value, 
 								Real boundary_value2_scalar, Vector<Real> boundary_value2_vector);
@@ -230,6 +230,7 @@ CORBAHapticInterface_i::~CORBAHapticInterface_i (void)
 		(*hm.normal)[i] = model.normal[i];
 
 	hi->UseHapticModel(hm);
+	FreeHapticModel(hm);
 
 	return 1;
 }
@@ -483,6 +484,7 @@ CORBAPhantomHapticInterface_i::~CORBAPhantomHapticInterface_i (void)
 		(*hm.normal)[i] = model.normal[i];
 
 	phi->UseHapticModel(hm);
+	FreeHapticModel(hm);
 
 	return 1;
 }
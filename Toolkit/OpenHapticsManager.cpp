@@ -294,6 +294,10 @@ void *HapticsManager_Start(void *arg)
         }
     }
 	
+#ifdef HAPTICS_TEST
+	FreeHapticModel(model);
+#endif // HAPTICS_TEST
+
 	// Disable device
 	Phantom1.Disable();
 	printf("Phantom Haptic Device Disabled...\n");
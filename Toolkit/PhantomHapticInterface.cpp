@@ -144,6 +144,7 @@ void	PhantomHapticInterface::ReadConfiguration	(Vector<Real> &Position, Matrix<R
 
 // *******************************************************************************
 //  Use this function to send data to the haptic interface
+//  NewModel is copied into the inactive model, it stays owned by the caller
 // *******************************************************************************
 void	PhantomHapticInterface::UseHapticModel	(GiPSiLowOrderLinearHapticModel &NewModel)
 {
@@ -189,16 +190,6 @@ void	PhantomHapticInterface::UseHapticModel	(GiPSiLowOrderLinearHapticModel &New
 	
 	*(*deststate)	=   *zerostate;
 	
-	delete source->A11;
-	delete source->A12;
-	delete source->B1;
-	delete source->C11;
-	delete source->C12;
-	delete source->D;
-	delete source->f_0;
-	delete source->zdot_0;
-	delete source->normal;		
-	
 	delete zerostate;
 	
 	// Pass a thread-safe copy of the parameters	
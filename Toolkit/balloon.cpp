@@ -55,6 +55,7 @@ BalloonObject::BalloonObject(XMLNode * simObjectNode):DeformableSolidObject(simO
 		R_lb_b = zero_matrix3;
 		t_lb_b = zero_vector3;
 		s_lb_b = zero_vector3;
+		geom_current = false;
 
 		// Extract initialization information
 		if (simObjectNode == NULL)
@@ -436,28 +437,24 @@ inline void BalloonObject::State2Geom(void)
 	TriSurface *geom = (TriSurface *) geometry;
 	Matrix<Real> g_lb_b = zero_matrix4;
 	Matrix<Real> g_w_b = zero_matrix4;
+	Real transform[12];
+	bool changed = !geom_current;
 
 	ToTransformationMatrix(g_lb_b, R_lb_b, t_lb_b, s_lb_b);
 	g_w_b = g_w_lb * g_lb_b;
 	
-	// reset to initial setup (at origin with initial rotation and translation)
-	for (unsigned int i=0; i<geom->num_vertex; i++) {
-		geom->vertex[i].pos = InitialGeometry->vertex[i].pos;
-	}	
-	
-	// inflate or deflate ballon
-	geom->Scale(bScale);
-
-	// rotation
-	Matrix<Real> rotation = zero_matrix3;
-	GetRotationMatrix(rotation, g_w_b);
-	geom->Rotate(rotation);		
-	// translate 
-	Vector<Real> translate = zero_vector3;
-	GetTranslationVector(translate, g_w_b);
-	geom->Translate(translate);
+	// inflate or deflate ballon, then rotate and translate
+	for (int i=0; i<3; i++) {
+		for (int j=0; j<3; j++)	transform[3*i+j] = g_w_b[i][j] * bScale[j];
+		transform[9+i] = g_w_b[i][3];
+	}
+	for (int i=0; i<12; i++)
+		if (transform[i] != geom_transform[i]) { changed = true; geom_transform[i] = transform[i]; }
 	
-	geom->calcNormals();
+	// set from the initial setup (at origin with initial rotation and translation)
+	if (changed)
+		geom->Transform(*InitialGeometry, geom_transform, geom_transform+9);
+	geom_current = true;
 }
 
 /**
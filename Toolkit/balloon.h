@@ -87,6 +87,9 @@ protected:
 	Vector<Real>	t_lb_b;	// translation from balloon to local balloon
 	Vector<Real>	s_lb_b;	// scaling the translation from balloon to local balloon
 
+	Real			geom_transform[12];	// A (row major) and t the geometry was last set to
+	bool			geom_current;		//   valid once State2Geom() has run
+
 	friend LoaderUnitTest;
 };
 
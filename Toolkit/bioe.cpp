@@ -28,6 +28,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <string.h>
 
 #include "algebra.h"
 #include "bioe.h"
@@ -36,6 +37,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include "GiPSiCompToolset.h"
 #include "GiPSiException.h"
 #include "logger.h"
+#include "parallel.h"
 #include "timing.h"
 #include "XMLNodeList.h"
 
@@ -51,7 +53,8 @@ CardiacBioEObject::CardiacBioEObject(	XMLNode * simObjectNode,
 					Real SpVel,
 					Real DCycle)
 					:	SIMObject(simObjectNode),
-						TemporalFreq(OscFreq),SpatialVel(SpVel), DutyCycle(DCycle)
+						TemporalFreq(OscFreq),SpatialVel(SpVel), DutyCycle(DCycle),
+						num_tet(0), tet_xloc(NULL), excitation(NULL), excitation_band(2), display_band(2)
 {
 	try
 	{
@@ -79,6 +82,7 @@ CardiacBioEObject::CardiacBioEObject(	XMLNode * simObjectNode,
 
 		// Final setup
 //		Geom2State();
+		PrecomputeExcitation();
 		SetupDisplay(simObjectChildren);
 		delete simObjectChildren;
 	}
@@ -465,6 +469,8 @@ void CardiacBioEObject::Simulate(void)
 {
 	integrator->Integrate(*this, timestep);
 	time+=timestep;
+
+	UpdateExcitation();
 }
 
 
@@ -497,9 +503,16 @@ void CardiacBioEObject::Display(void)
 inline void CardiacBioEObject::State2Geom(void)
 {
 	static TetVolume *geom = (TetVolume *) geometry;
+	Real	lo, hi;
+	int		band = ExcitationBand(lo, hi);
+
+	// The colours only change with the excitation band
+	if(band == display_band)	return;
+	display_band = band;
 
 	for(unsigned int i=0; i<geom->num_vertex; i++) {
-		geom->vertex[i].color[1] = CalcExcitation(geom->vertex[i].pos[0]);
+		Real	x = geom->vertex[i].pos[0];
+		geom->vertex[i].color[1] = (x > lo && x < hi) ? 1.0 : 0.0;
 	}
 }
 
@@ -559,12 +572,7 @@ void CardiacBioEObject::SetupDisplay(XMLNodeList * simObjectChildren)
 //
 Real	CardiacBioEObject::GetExcitation(unsigned int index)
 {
-	Real xloc=0.0;
-
-	for (int i=0; i<4; i++) 
-		xloc += 0.25*HeartMuscleGeometry->tet[index].vertex[i]->pos[0];
-
-	return CalcExcitation(xloc);
+	return excitation[index];
 }
 
 ////////////////////////////////////////////////////////////////
@@ -577,25 +585,112 @@ Real	CardiacBioEObject::GetExcitation(unsigned int index)
 
 Real	CardiacBioEObject::CalcExcitation(Real xloc)
 {
-	Real refcoord= 0.0;
+	Real	lo, hi;
 
+	ExcitationBand(lo, hi);
+
+	return (xloc > lo && xloc < hi) ? 1.0 : 0.0;
+
+	// The following is a simple wave propagation bioelectric model
+	//   used in the single chamber heart model
+	//Real refcoord= 0.0;
+	//Real temp=cos(2*M_PI*TemporalFreq*(time-(xloc-refcoord)/SpatialVel)+M_PI)-cos(M_PI*DutyCycle);
+	//return (xloc>0)? ((temp>0)?1:0):(0.0) ;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CardiacBioEObject::ExcitationBand()
+//
+//		Returns the band of locations (lo, hi) that is excited for
+//		the current state, and an id of the band
+//
+int		CardiacBioEObject::ExcitationBand(Real &lo, Real &hi)
+{
 	// The following is a simple finite state machine bioelectric model
 	//   used in the two chamber heart simulation
 	// Timing of the switching is coupled to the second order oscillator
 	//   from the state of the model
 	if (state.x[0]>0.1) {
-		return (xloc>2.5)?1:0;
+		lo = 2.5;		hi = DBL_MAX;
+		return 1;
 	}
 	else if (state.x[0]<-0.1) {
-		return (xloc<-2.5)?1:0;
+		lo = -DBL_MAX;	hi = -2.5;
+		return -1;
 	}
 	else {
-		return 0.0;
+		lo = DBL_MAX;	hi = -DBL_MAX;
+		return 0;
 	}
-	// The following is a simple wave propagation bioelectric model
-	//   used in the single chamber heart model
-	//Real temp=cos(2*M_PI*TemporalFreq*(time-(xloc-refcoord)/SpatialVel)+M_PI)-cos(M_PI*DutyCycle);
-	//return (xloc>0)? ((temp>0)?1:0):(0.0) ;
+}
+
+
+// Minimum work per thread of the excitation update
+#define		BIOE_ELEMENTS_PER_THREAD	4096
+
+////////////////////////////////////////////////////////////////
+//
+//	CardiacBioEObject::PrecomputeExcitation()
+//
+//		Stores the x coordinate of each element center and computes
+//		the initial excitation
+//
+void	CardiacBioEObject::PrecomputeExcitation(void)
+{
+	num_tet		= HeartMuscleGeometry->num_tet;
+	tet_xloc	= new Real[num_tet];
+	excitation	= new Real[num_tet];
+	if(tet_xloc == NULL || excitation == NULL) {
+		error_exit(-1, "Cannot allocate memory for excitation!\n");
+	}
+
+	for(unsigned int i=0; i<num_tet; i++) {
+		Real	xloc=0.0;
+		for(int j=0; j<4; j++)
+			xloc += 0.25*HeartMuscleGeometry->tet[i].vertex[j]->pos[0];
+		tet_xloc[i] = xloc;
+	}
+
+	excitation_band = 2;
+	UpdateExcitation();
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CardiacBioEObject::UpdateExcitation()
+//
+//		Evaluates the excitation of all the elements.  The
+//		evaluation is skipped while the state stays in the same band.
+//
+void	CardiacBioEObject::UpdateExcitation(void)
+{
+	int		band = ExcitationBand(excitation_lo, excitation_hi);
+
+	if(band == excitation_band)		return;
+	excitation_band = band;
+
+	ParallelFor(num_tet, ExcitationTask, this, BIOE_ELEMENTS_PER_THREAD);
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	CardiacBioEObject::ExcitationTask()
+//
+//		ParallelFor task: excitation of elements [begin, end)
+//
+void	CardiacBioEObject::ExcitationTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	CardiacBioEObject	*obj = (CardiacBioEObject *) arg;
+	const Real			*x = obj->tet_xloc;
+	Real				*e = obj->excitation;
+	Real				lo = obj->excitation_lo, hi = obj->excitation_hi;
+
+	for(unsigned int i = begin; i < end; i++)
+		e[i] = (x[i] > lo && x[i] < hi) ? 1.0 : 0.0;
 }
 
 
@@ -698,8 +793,12 @@ Real		CardiacBioEDomain::GetExcitation(unsigned int element_index)
 
 void		CardiacBioEDomain::GetExcitation(Real *Excitation_Array)
 {
-	for (unsigned int index=0; index < this->num_tet; index++){
-		Excitation_Array[index]=Object->GetExcitation(index);
-	}
+	memcpy(Excitation_Array, Object->GetExcitation(), this->num_tet * sizeof(Real));
+}
+
+
+const Real *CardiacBioEDomain::GetExcitation(void)
+{
+	return  Object->GetExcitation();
 }
 
@@ -58,6 +58,7 @@ public:
 
 	// Get and Set interfaces for the Boundary and the Domain
 	Real				GetExcitation(unsigned int index);
+	const Real *		GetExcitation(void)		{	return excitation; }
 	void				SetMuscleStrain(unsigned int index, Matrix<Real> Strain);	// we will need this for the real thing
 	void				SetHeartMuscleGeometry(TetVolume *newgeom);					// will we need this ???
 
@@ -84,6 +85,22 @@ protected:
 	Integrator<CardiacBioEObject>		*integrator;
 	// Excitation Calculators
 	Real				CalcExcitation(Real xloc);
+	int					ExcitationBand(Real &lo, Real &hi);
+
+	// Excitation of all the elements at once.  The element centers are
+	//   taken from the geometry after the initial transformation, the
+	//   muscle geometry does not move afterwards.
+	void				PrecomputeExcitation(void);
+	void				UpdateExcitation(void);
+	static void			ExcitationTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
+	unsigned int		num_tet;
+	Real				*tet_xloc;			// x coordinate of the element centers
+	Real				*excitation;		// Excitation of the elements
+	Real				excitation_lo;		// Elements with x in (lo, hi) are excited
+	Real				excitation_hi;
+	int					excitation_band;	// Band of excitation, 2 if not computed yet
+	int					display_band;		// Band of the vertex colours
 
 	friend LoaderUnitTest;
 };
@@ -98,6 +115,7 @@ public:
 	// Get and Set interfaces
 	Real			GetExcitation(unsigned int element_index);
 	void			GetExcitation(Real *Excitation_Array);
+	const Real *	GetExcitation(void);
 
 	void			SetDomainStrain(unsigned int element_index, Matrix<Real> Strain_Tensor);		// we will need this for the real thing
 	void			SetDomainStrain(Matrix<Real> *Strain_Tensor_Array);					// we will need this for the real thing
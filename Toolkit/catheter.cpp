@@ -40,7 +40,8 @@ using namespace std;
 #include "catheter.h"
 
 CatheterHIO::CatheterHIO(XMLNode * simObjectNode) :
-	HapticInterfaceObject(simObjectNode)
+	HapticInterfaceObject(simObjectNode),
+	geom_current(false)
 {
 	try
 	{
@@ -499,22 +500,21 @@ inline void CatheterHIO::State2Geom(void)
 {
 	TriSurface *geom = (TriSurface *) geometry;
 	Matrix<Real> g_w_c = GetConfiguration();
+	Real transform[12];
+	bool changed = !geom_current;
 	
-	// reset to initial setup (at origin with initial rotation)
-	for (unsigned int i=0; i<geom->num_vertex; i++) {
-		geom->vertex[i].pos = InitialGeometry->vertex[i].pos;
-	}	
+	// rotation and translation
+	for (int i=0; i<3; i++) {
+		for (int j=0; j<3; j++)	transform[3*i+j] = g_w_c[i][j];
+		transform[9+i] = g_w_c[i][3];
+	}
+	for (int i=0; i<12; i++)
+		if (transform[i] != geom_transform[i]) { changed = true; geom_transform[i] = transform[i]; }
 
-	// rotation
-	Matrix<Real> rotation = zero_matrix3;
-	GetRotationMatrix(rotation, g_w_c);
-	geom->Rotate(rotation);		
-	// translate 
-	Vector<Real> translate = zero_vector3;
-	GetTranslationVector(translate, g_w_c);
-	geom->Translate(translate);
-	
-	geom->calcNormals();
+	// set from the initial setup (at origin with initial rotation)
+	if (changed)
+		geom->Transform(*InitialGeometry, geom_transform, geom_transform+9);
+	geom_current = true;
 }
 
 ////////////////////////////////////////////////////////////////
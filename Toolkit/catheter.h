@@ -67,6 +67,9 @@ protected:
 	unsigned int	*mapping;		/**< mapping array size = 2*num_mapping */
 	unsigned int	num_mapping;	/**< number of mapping */
 
+	Real			geom_transform[12];	/**< A (row major) and t the geometry was last set to */
+	bool			geom_current;		/**< geom_transform is valid */
+
 	friend LoaderUnitTest;
 };
 
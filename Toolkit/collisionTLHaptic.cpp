@@ -230,16 +230,16 @@ void TLHapticCollision::response(void)
 				// apply the boundary type 1 to that deformable solid boundary node
 				CBound->Set(nodeIndex, 1, ((HapticCollisionInfo*)collisionInfos.get(i))->HTip.pos, 0.0, zero_vector3);
 				
-				// call returnHapticModel function from deformable solid boundary 
-				GiPSiLowOrderLinearHapticModel *LModel = new GiPSiLowOrderLinearHapticModel();
-				int result = CBound->ReturnHapticModel(nodeIndex, *LModel);
+				// call returnHapticModel function from deformable solid boundary,
+				// which fills the model storage of the probe in place
+				GiPSiLowOrderLinearHapticModel &LModel = probeBound->ContactModel();
+				int result = CBound->ReturnHapticModel(nodeIndex, LModel);
 				
 				if (result==0) {																			
 					// set the HapticModel
-					probeBound->SetHapticModel(nodeIndex, *LModel);
+					probeBound->SetHapticModel(nodeIndex, LModel);
 					//printf("collision at msd node: %d, haptic node:%d\n",nodeIndex,collisionInfoList[i].HTip.refid);
 				}	
-				delete LModel;			
 			}			
 		}		
 	}		
@@ -25,9 +25,203 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriy Natsupakpong.
 ////////////////////////////////////////////////////////////////
 
 #include "connector.h"
+#include "correspondence.h"
 #include "GiPSiException.h"
+#include "parallel.h"
 #include "XMLNodeList.h"
 
+#define CORR_STAMP_SIZE		128		// Characters of a generated correspondence stamp
+
+/**
+ * Tolerance for generating the correspondence file.
+ *
+ * @param parametersChildren Connector parameters XMLNodeList.
+ * @return Optional corrTolerance value, -1 if it is not given.
+ */
+static Real GetCorrTolerance(XMLNodeList * parametersChildren)
+{
+	Real tolerance = -1.0;
+
+	for (unsigned int i = 0; i < parametersChildren->GetLength(); i++)
+	{
+		XMLNode * node = parametersChildren->GetNode(i);
+		char * name = node->GetName();
+		if (strcmp(name, "corrTolerance") == 0)
+		{
+			const char * toleranceVal = node->GetValue();
+			tolerance = (Real)atof(toleranceVal);
+			delete toleranceVal;
+		}
+		delete name;
+		delete node;
+	}
+	return tolerance;
+}
+
+/**
+ * Whether a correspondence file exists.  A hand-made file always takes
+ * precedence over a generated one.
+ *
+ * @param filename Character string containing file name.
+ */
+static bool CorrFileExists(const char *filename)
+{
+	FILE	*fp;
+
+	if ((fp = fopen(filename, "r")) == NULL)	return false;
+	fclose(fp);
+	return true;
+}
+
+/**
+ * FNV-1a checksum of a block of memory, continued from h.
+ *
+ * @param h Checksum so far.
+ * @param data Memory block.
+ * @param bytes Size of the block.
+ * @return Updated checksum.
+ */
+static unsigned int CorrChecksum(unsigned int h, const void *data, size_t bytes)
+{
+	const unsigned char	*c = (const unsigned char *) data;
+
+	for (size_t i=0; i<bytes; i++)	h = (h ^ c[i]) * 16777619u;
+	return h;
+}
+
+/**
+ * Stamp of a generated correspondence: the sizes of both surfaces, a
+ * checksum of their vertex positions and faces, and the tolerance.  The
+ * connectors do not know the mesh files behind the boundaries, so the
+ * geometry is stamped by content, which also catches a changed
+ * transformation of an object.
+ *
+ * @param stamp Output string of CORR_STAMP_SIZE characters.
+ * @param num_vertex_a Number of vertices of a.
+ * @param pos_a Positions of a.
+ * @param num_face_a Number of faces of a.
+ * @param tri_a Vertex indices of the faces of a.
+ * @param num_vertex_b Number of vertices of b.
+ * @param pos_b Positions of b.
+ * @param num_face_b Number of faces of b.
+ * @param tri_b Vertex indices of the faces of b.
+ * @param tolerance Distance tolerance.
+ */
+static void CorrStamp(char *stamp,
+					  unsigned int num_vertex_a, const Real *pos_a, unsigned int num_face_a, const unsigned int *tri_a,
+					  unsigned int num_vertex_b, const Real *pos_b, unsigned int num_face_b, const unsigned int *tri_b,
+					  Real tolerance)
+{
+	unsigned int	h = 2166136261u;
+
+	h = CorrChecksum(h, pos_a, 3*num_vertex_a*sizeof(Real));
+	h = CorrChecksum(h, tri_a, 3*num_face_a*sizeof(unsigned int));
+	h = CorrChecksum(h, pos_b, 3*num_vertex_b*sizeof(Real));
+	h = CorrChecksum(h, tri_b, 3*num_face_b*sizeof(unsigned int));
+	sprintf(stamp, "%u %u %u %u %08x %.17g", num_vertex_a, num_face_a, num_vertex_b, num_face_b, h, (double) tolerance);
+}
+
+/**
+ * Whether a generated correspondence file carries the stamp, which Save()
+ * writes on an "s" line after the correspondences.
+ *
+ * @param filename Character string containing file name.
+ * @param stamp Expected stamp.
+ */
+static bool SameCorrStamp(const char *filename, const char *stamp)
+{
+	FILE	*fp;
+	char	line[CORR_STAMP_SIZE+4];
+	bool	same = false;
+
+	if ((fp = fopen(filename, "r")) == NULL)	return false;
+	while (fgets(line, CORR_STAMP_SIZE+4, fp) != NULL)
+		if (line[0] == 's' && line[1] == ' ')
+		{
+			line[strcspn(line, "\r\n")] = 0;
+			same = (strcmp(line+2, stamp) == 0);
+		}
+	fclose(fp);
+	return same;
+}
+
+/**
+ * Positions of the boundary vertices, 3 per vertex, as the objects see them.
+ *
+ * @param bound Boundary.
+ * @param pos Output positions.
+ */
+static void BoundaryPositions(CollisionEnabledBoundary *bound, Real *pos)
+{
+	unsigned int	*index = new unsigned int[bound->num_vertex];
+
+	for (unsigned int i=0; i<bound->num_vertex; i++)	index[i]=i;
+	bound->GetPositions(bound->num_vertex, index, pos);
+	delete[] index;
+}
+
+/**
+ * Positions of the surface vertices, 3 per vertex.
+ *
+ * @param surface Triangle surface.
+ * @param pos Output positions.
+ */
+static void SurfacePositions(TriSurface *surface, Real *pos)
+{
+	for (unsigned int i=0; i<surface->num_vertex; i++)
+		for (unsigned int j=0; j<3; j++)
+			pos[3*i+j] = surface->vertex[i].pos[j];
+}
+
+/**
+ * Vertex indices of the surface faces, 3 per face.
+ *
+ * @param surface Triangle surface.
+ * @param tri Output vertex indices.
+ */
+static void SurfaceTriangles(TriSurface *surface, unsigned int *tri)
+{
+	for (unsigned int i=0; i<surface->num_face; i++)
+		for (unsigned int j=0; j<3; j++)
+			tri[3*i+j] = (unsigned int) (surface->face[i].vertex[j] - surface->vertex);
+}
+
+/**
+ * Vertex correspondence of two surfaces by nearest vertices.  Vertices of a
+ * that lie on b away from any vertex of b are reported, as they cannot be
+ * coupled node to node.
+ *
+ * @param num_a Number of vertices of a.
+ * @param pos_a Positions of a.
+ * @param num_b Number of vertices of b.
+ * @param pos_b Positions of b.
+ * @param num_tri_b Number of faces of b.
+ * @param tri_b Vertex indices of the faces of b.
+ * @param tolerance Distance tolerance.
+ * @param match Output vertex of b for each vertex of a, CORR_NONE if none.
+ * @return Number of corresponding vertices.
+ */
+static unsigned int NearestVertexCorr(unsigned int num_a, const Real *pos_a,
+									  unsigned int num_b, const Real *pos_b,
+									  unsigned int num_tri_b, const unsigned int *tri_b,
+									  Real tolerance, unsigned int *match)
+{
+	unsigned int	*face = new unsigned int[num_a];
+	Real			*bary = new Real[3*num_a];
+	unsigned int	n, i, missed = 0;
+
+	n = CorrNearestVertex(num_a, pos_a, num_b, pos_b, tolerance, match);
+	CorrClosestPoint(num_a, pos_a, num_b, pos_b, num_tri_b, tri_b, tolerance, face, bary);
+	for (i=0; i<num_a; i++)
+		if (match[i] == CORR_NONE && face[i] != CORR_NONE)	missed++;
+	if (missed > 0)
+		printf("Warning: %d vertices lie on the other surface without a corresponding vertex.\n", missed);
+
+	delete[] face;
+	delete[] bary;
+	return n;
+}
+
 /**
  * Constructor.
  * 
@@ -139,16 +333,23 @@ void FEM3LM_BIOE_Connector::LoadGeometry(XMLNodeList * modelParametersChildren)
 }
 
 
+// Minimum work per thread of the contraction stress update
+#define		BIOE_CONTRACTION_PER_THREAD		2048
+
+typedef struct {
+	FEM3LM_BIOE_Connector	*connector;
+	const Real				*excitation;
+	Matrix<Real>			*stress;
+} ContractionTaskArg;
+
 /**
  * Exchange domain information between models.
  */
 void FEM3LM_BIOE_Connector::process(void)
 {
-
-	for (unsigned int i=0; i<bioe->num_tet; i++) {
-		mech->SetDomainStress(i,Excitation_to_Contraction(bioe->GetExcitation(i)));
-	}
-
+	// The contraction stresses are written in place into the domain stresses
+	//   of the mechanical model
+	Excitation_to_Contraction(bioe->GetExcitation(), mech->DomStress);
 }
 
 
@@ -159,28 +360,65 @@ void FEM3LM_BIOE_Connector::process(void)
  */
 Matrix<Real>	FEM3LM_BIOE_Connector::Excitation_to_Contraction (Real excitation) {
 
-	Matrix<Real>	Stress=zero_Matrix;
+	Matrix<Real>	Stress(3,3);
 
-	if (excitation>0.0) { 
-		Stress[0][0]+=ExcitedStressValueXX;
-		Stress[1][1]+=ExcitedStressValueYY;
-		Stress[2][2]+=ExcitedStressValueZZ;
-	}
+	Excitation_to_Contraction(excitation, Stress);
 	
 	return  Stress;
 
 }
 
+/**
+ * Excitation to Contraction Coupling Model, written into an existing tensor.
+ *
+ * @param excitation Excitation of one element of the bioelectric model;
+ *        the element contracts while it is positive.
+ * @param Stress 3x3 contraction stress of the element, overwritten with
+ *        diag(ExcitedStressValueXX, YY, ZZ) while excited and zero otherwise.
+ */
+void			FEM3LM_BIOE_Connector::Excitation_to_Contraction (Real excitation, Matrix<Real> &Stress) {
+
+	Real	*S = Stress[0];
+	Real	on = (excitation>0.0) ? 1.0 : 0.0;
+
+	S[0] = on*ExcitedStressValueXX;	S[1] = 0.0;							S[2] = 0.0;
+	S[3] = 0.0;							S[4] = on*ExcitedStressValueYY;	S[5] = 0.0;
+	S[6] = 0.0;							S[7] = 0.0;							S[8] = on*ExcitedStressValueZZ;
+
+}
+
 /**
  * Excitation to Contraction Coupling Model.
  * 
  * @param Excitation_Array Placeholder text.
  * @param Stress_Array Placeholder text.
  */
-void			FEM3LM_BIOE_Connector::Excitation_to_Contraction (Real *Excitation_Array, Matrix<Real> *Stress_Array) {
+void			FEM3LM_BIOE_Connector::Excitation_to_Contraction (const Real *Excitation_Array, Matrix<Real> *Stress_Array) {
+
+	ContractionTaskArg	arg;
 
-	for (unsigned int index=0; index < bioe->num_tet; index++){
-		Stress_Array[index]=Excitation_to_Contraction(Excitation_Array[index]);
+	arg.connector	= this;
+	arg.excitation	= Excitation_Array;
+	arg.stress		= Stress_Array;
+
+	ParallelFor(bioe->num_tet, ContractionTask, &arg, BIOE_CONTRACTION_PER_THREAD);
+
+}
+
+/**
+ * ParallelFor task: contraction stresses of elements [begin, end).
+ * 
+ * @param arg ContractionTaskArg of the call.
+ * @param begin First element.
+ * @param end One past the last element.
+ * @param thread Thread index, unused.
+ */
+void			FEM3LM_BIOE_Connector::ContractionTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread) {
+
+	ContractionTaskArg	*a = (ContractionTaskArg *) arg;
+
+	for (unsigned int index=begin; index < end; index++){
+		a->connector->Excitation_to_Contraction(a->excitation[index], a->stress[index]);
 	}
 
 }
@@ -286,21 +524,38 @@ void FEM3LM_LUMPEDFLUID_Connector::LoadGeometry(XMLNodeList * modelParametersChi
 		XMLNode * fileNameNode = corrFileChildren->GetNode("fileName");
 		char fullFilePath[256]("");
 		sprintf_s(fullFilePath, 256, "%s\\%s", pathNode->GetValue(), fileNameNode->GetValue());
-		// Load file
-		Load(fullFilePath);
+		// Load the hand-made file.  Without one, and with corrTolerance
+		// given, the correspondence is generated and cached in <file>.gen,
+		// which is regenerated when its stamp no longer matches.
+		Real tolerance = GetCorrTolerance(FEM_LFParametersChildren);
+		if (tolerance < 0.0 || CorrFileExists(fullFilePath))
+			Load(fullFilePath);
+		else
+		{
+			char genFilePath[260]("");
+			char stamp[CORR_STAMP_SIZE]("");
+			sprintf_s(genFilePath, 260, "%s.gen", fullFilePath);
+			Stamp(stamp, tolerance);
+			if (SameCorrStamp(genFilePath, stamp))
+				Load(genFilePath);
+			else
+			{
+				Generate(tolerance);
+				Save(genFilePath, stamp);
+			}
+		}
 
 		// Other setup stuff
-		mechpos	=	new	Vector<Real>[num_vertex];
-		forceaccum=	new Vector<Real>[mech->num_vertex];
+		Compile();
+		mechpos		=	new	Real[3*num_vertex];
+		nodebuf		=	new	Real[3*num_vertex];
 
-		for	(unsigned int i=0; i<num_vertex; i++)
-			mechpos[i]=mech->GetPosition(*(vcorr+2*i+0));
+		mech->GetPositions(num_vertex, femnode, mechpos);
 		mechtime = mech->Object->GetTime();
-		for (unsigned int i=0; i<mech->num_vertex; i++)
-			forceaccum[i]=zero_Vector; 
 
-		for (unsigned int i=0; i<num_vertex; i++)
-			lfluid->Set(*(vcorr+2*i+1),0, zero_Vector);
+		for (unsigned int i=0; i<3*num_vertex; i++)
+			nodebuf[i]=0.0;
+		lfluid->SetBoundaryValues(num_vertex, fluidnode, 0, nodebuf);
 	}
 	catch (...)
 	{
@@ -310,89 +565,159 @@ void FEM3LM_LUMPEDFLUID_Connector::LoadGeometry(XMLNodeList * modelParametersChi
 }
 
 
+/**
+ * Compiles the correspondence into flat node lists and the face
+ * incidence of the mech boundary nodes.
+ */
+void FEM3LM_LUMPEDFLUID_Connector::Compile(void)
+{
+	unsigned int	i,j,femidx;
+
+	femnode		=	new unsigned int[num_vertex];
+	fluidnode	=	new unsigned int[num_vertex];
+	for	(i=0; i<num_vertex; i++) {
+		femnode[i]		= *(vcorr+2*i+0);
+		fluidnode[i]	= *(vcorr+2*i+1);
+	}
+
+	//  The fluid side of the faces is not needed as pressure is constant
+	//    for the lumped fluid model
+	facevertex	=	new Vertex *[3*num_face];
+	aread3		=	new Real[num_face];
+	nodeface_ptr=	new unsigned int[mech->num_vertex+1];
+	nodeface	=	new unsigned int[3*num_face];
+
+	for (i=0; i<=mech->num_vertex; i++)	nodeface_ptr[i]=0;
+	for (i=0; i<num_face; i++)
+	{
+		femidx		=	*(fcorr+2*i+0);
+		for (j=0; j<3; j++)
+		{
+			facevertex[3*i+j]	=	mech->face[femidx].vertex[j];
+			nodeface_ptr[*(mech->facetovertexids+3*femidx+j)+1]++;
+		}
+	}
+	for (i=0; i<mech->num_vertex; i++)	nodeface_ptr[i+1]+=nodeface_ptr[i];
+	for (i=0; i<num_face; i++)
+	{
+		femidx		=	*(fcorr+2*i+0);
+		for (j=0; j<3; j++)	nodeface[nodeface_ptr[*(mech->facetovertexids+3*femidx+j)]++]=i;
+	}
+	for (i=mech->num_vertex; i>0; i--)	nodeface_ptr[i]=nodeface_ptr[i-1];
+	nodeface_ptr[0]=0;
+}
+
+
+// Minimum work per thread of the connector loops
+#define		LF_CONNECTOR_PER_THREAD		1024
+
+typedef struct {
+	FEM3LM_LUMPEDFLUID_Connector	*connector;
+	Real							pressure;
+} LumpedFluidTaskArg;
+
+/**
+ * ParallelFor task: a third of the area of corresponding faces [begin, end).
+ * 
+ * @param arg LumpedFluidTaskArg of the call.
+ * @param begin First face.
+ * @param end One past the last face.
+ * @param thread Thread index, unused.
+ */
+void FEM3LM_LUMPEDFLUID_Connector::FaceAreaTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	FEM3LM_LUMPEDFLUID_Connector	*c = ((LumpedFluidTaskArg *) arg)->connector;
+
+	for (unsigned int i=begin; i<end; i++)
+	{
+		// TriangleArea() of the face, which is 2D only
+		const Real	*p0 = c->facevertex[3*i+0]->pos.begin();
+		const Real	*p1 = c->facevertex[3*i+1]->pos.begin();
+		const Real	*p2 = c->facevertex[3*i+2]->pos.begin();
+		Real		area = ((p1[0]-p0[0])*(p2[1]-p1[1]) - (p1[1]-p0[1])*(p2[0]-p1[0]))/2.0;
+
+		c->aread3[i] = fabs(area/3.0);
+	}
+}
+
+/**
+ * ParallelFor task: pressure forces of corresponding nodes [begin, end),
+ * gathered from the faces around each node into nodebuf.
+ * 
+ * @param arg LumpedFluidTaskArg of the call.
+ * @param begin First node.
+ * @param end One past the last node.
+ * @param thread Thread index, unused.
+ */
+void FEM3LM_LUMPEDFLUID_Connector::NodeForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	FEM3LM_LUMPEDFLUID_Connector	*c = ((LumpedFluidTaskArg *) arg)->connector;
+	Real							pressure = ((LumpedFluidTaskArg *) arg)->pressure;
+
+	for (unsigned int i=begin; i<end; i++)
+	{
+		unsigned int	k = c->femnode[i];
+		const Real		*n = c->mech->vertex[k].n.begin();
+		Real			*f = c->nodebuf+3*i;
+
+		f[0]=f[1]=f[2]=0.0;
+		for (unsigned int e=c->nodeface_ptr[k]; e<c->nodeface_ptr[k+1]; e++)
+		{
+			Real	a = c->aread3[c->nodeface[e]];
+			f[0] -= pressure*a*n[0];
+			f[1] -= pressure*a*n[1];
+			f[2] -= pressure*a*n[2];
+		}
+	}
+}
+
 /**
  * Exchange boundary information between models.
  */
 void FEM3LM_LUMPEDFLUID_Connector::process(void)
 {
-	unsigned int	i,j,femidx,fluididx,femnodes[3]/*,fluidnodes[3]*/;
-	Real			sum=0;
-	Vector<Real>	v(3,0.0),oldpos(3,0.0);
-	Real			oldtime;
-	Real			pressure;
-	Real			aread3;
+	unsigned int		i;
+	Real				oldtime;
+	LumpedFluidTaskArg	arg;
 
 	oldtime=mechtime;
 	mechtime=mech->Object->GetTime();
 
-	for (i=0; i<num_vertex; i++)
+	// This coupling does not quite work as the two boundaries start to disassociate
+	//  when we use a multistep integrator for the mechanical model.
+	//  This is because when we use a multistep integrator for the mechanical model,
+	//  the nodal velocity varies within the time step, whereas the fluid model uses
+	//  a constant velocity value (the value at the beginning of the time step).
+	//lfluid->Set(fluididx,0,mech->GetVelocity(femidx));
+
+	// This is the alternative approach
+	//	note that the position of fluid boundary follows the solid boundary one step behind
+	//  using this method.
+	if (mechtime>oldtime)
 	{
-		femidx		=	*(vcorr+2*i+0);
-		fluididx	=	*(vcorr+2*i+1);
-
-		// This coupling does not quite work as the two boundaries start to disassociate
-		//  when we use a multistep integrator for the mechanical model.
-		//  This is because when we use a multistep integrator for the mechanical model,
-		//  the nodal velocity varies within the time step, whereas the fluid model uses
-		//  a constant velocity value (the value at the beginning of the time step).
-		//lfluid->Set(fluididx,0,mech->GetVelocity(femidx));
-
-		// This is the alternative approach
-		//	note that the position of fluid boundary follows the solid boundary one step behind
-		//  using this method.
-		if (mechtime>oldtime)
+		mech->GetPositions(num_vertex, femnode, nodebuf);
+		for (i=0; i<3*num_vertex; i++)
 		{
-			oldpos=mechpos[i];
-			mechpos[i]=mech->GetPosition(femidx);
-			lfluid->Set(fluididx,0,(mechpos[i]-oldpos)/(mechtime-oldtime));
+			Real	newpos = nodebuf[i];
+			nodebuf[i] = (newpos-mechpos[i])/(mechtime-oldtime);
+			mechpos[i] = newpos;
 		}
-	
-		// To test if the two boundaries disassociate or not calculate the distance between them
-		//v=(lfluid->vertex[fluididx].pos-mech->vertex[femidx].pos);
-		//v=(lfluid->vertex[fluididx].pos-oldpos);
-		//sum+=v.length();
-
-		// initially assign zero forces on all the fem nodes
-		forceaccum[femidx]=zero_Vector;
+		lfluid->SetBoundaryValues(num_vertex, fluidnode, 0, nodebuf);
 	}
-	//printf("Distance between the two boundaries=\t%f\n",sum);
 
 	//  As pressure is constant for the lumped fluid model we don't need to get pressures for all faces
 	//lfluid->GetPressure(PressureArray);
 	//  Evaluation at a single node will do.
-	pressure=lfluid->GetPressure((unsigned int) 0);
+	arg.connector	= this;
+	arg.pressure	= lfluid->GetPressure((unsigned int) 0);
 
-	for (i=0; i<num_face; i++)
-	{
-		femidx		=	*(fcorr+2*i+0);
-		fluididx	=	*(fcorr+2*i+1);
-
-		aread3=TriangleArea(mech->face[femidx].vertex[0]->pos,
-							mech->face[femidx].vertex[1]->pos,
-							mech->face[femidx].vertex[2]->pos	);
-		aread3=fabs(aread3/3.0);
-
-		//  Find the indices of the nodes which belong to this face
-		femnodes[0]		=   *(mech->facetovertexids+3*femidx+0);
-		femnodes[1]		=   *(mech->facetovertexids+3*femidx+1);
-		femnodes[2]		=   *(mech->facetovertexids+3*femidx+2);
-		//  These will not be needed as pressure is constant for the lumped fluid model
-		/*
-		fluidnodes[0]	=   *(lfluif->facetovertexids+3*fluididx+0);
-		fluidnodes[1]	=   *(lfluif->facetovertexids+3*fluididx+1);
-		fluidnodes[2]	=   *(lfluif->facetovertexids+3*fluididx+2);
-		*/
-		// apply the forces to the nodes that belong to this face
-		for (j=0; j<3; j++) forceaccum[femnodes[j]]+= -pressure*aread3*mech->vertex[femnodes[j]].n;
-	}
+	// apply the forces of the faces to the nodes that belong to them, each
+	//   node sums its faces in face order
+	ParallelFor(num_face, FaceAreaTask, &arg, LF_CONNECTOR_PER_THREAD);
+	ParallelFor(num_vertex, NodeForceTask, &arg, LF_CONNECTOR_PER_THREAD);
 	
 	// apply the boundary conditions
-	for (i=0; i<num_vertex; i++)	
-	{
-		femidx		=	*(vcorr+2*i+0);
-		fluididx	=	*(vcorr+2*i+1);
-		mech->Set(femidx,0,forceaccum[femidx],0.0,zero_Vector);
-	}
+	mech->SetBoundaryValues(num_vertex, femnode, 0, nodebuf);
 }
 
 
@@ -569,6 +894,109 @@ void FEM3LM_LUMPEDFLUID_Connector::Load(char *filename)
 }
 
 
+/**
+ * Generates the correspondence from the geometry of the boundaries: mech
+ * nodes within tolerance of a fluid node, and the faces whose nodes all
+ * correspond.
+ * 
+ * @param tolerance Distance tolerance.
+ */
+void FEM3LM_LUMPEDFLUID_Connector::Generate(Real tolerance)
+{
+	unsigned int	i, n;
+	Real			*mechvpos	= new Real[3*mech->num_vertex];
+	Real			*fluidvpos	= new Real[3*lfluid->num_vertex];
+	unsigned int	*mechtri	= new unsigned int[3*mech->num_face];
+	unsigned int	*fluidtri	= new unsigned int[3*lfluid->num_face];
+	unsigned int	*vmatch		= new unsigned int[mech->num_vertex];
+	unsigned int	*fmatch		= new unsigned int[mech->num_face];
+
+	BoundaryPositions(mech, mechvpos);
+	SurfacePositions(lfluid, fluidvpos);
+	SurfaceTriangles(mech, mechtri);
+	SurfaceTriangles(lfluid, fluidtri);
+
+	num_vertex	= NearestVertexCorr(mech->num_vertex, mechvpos, lfluid->num_vertex, fluidvpos,
+									lfluid->num_face, fluidtri, tolerance, vmatch);
+	num_face	= CorrMatchFaces(mech->num_face, mechtri, vmatch,
+								 lfluid->num_vertex, lfluid->num_face, fluidtri, fmatch);
+	printf("Generated corr\tVertex Corr: %d\tFace Corr: %d\tTolerance: %g\n", num_vertex, num_face, tolerance);
+
+	vcorr = (unsigned int *) malloc(2*num_vertex*sizeof(int));
+	fcorr = (unsigned int *) malloc(2*num_face*sizeof(int));
+	if(vcorr == NULL || fcorr == NULL) {
+		error_exit(-1, "Cannot allocate memory for correspondences!\n");
+	}
+	for (i=0, n=0; i<mech->num_vertex; i++)
+		if (vmatch[i] != CORR_NONE)	{ *(vcorr+2*n)=i;	*(vcorr+2*n+1)=vmatch[i];	n++; }
+	for (i=0, n=0; i<mech->num_face; i++)
+		if (fmatch[i] != CORR_NONE)	{ *(fcorr+2*n)=i;	*(fcorr+2*n+1)=fmatch[i];	n++; }
+
+	delete[] mechvpos;
+	delete[] fluidvpos;
+	delete[] mechtri;
+	delete[] fluidtri;
+	delete[] vmatch;
+	delete[] fmatch;
+}
+
+
+/**
+ * Stamp of the geometry and tolerance a generated correspondence depends
+ * on, see CorrStamp().
+ * 
+ * @param stamp Output string of CORR_STAMP_SIZE characters.
+ * @param tolerance Distance tolerance.
+ */
+void FEM3LM_LUMPEDFLUID_Connector::Stamp(char *stamp, Real tolerance)
+{
+	Real			*mechvpos	= new Real[3*mech->num_vertex];
+	Real			*fluidvpos	= new Real[3*lfluid->num_vertex];
+	unsigned int	*mechtri	= new unsigned int[3*mech->num_face];
+	unsigned int	*fluidtri	= new unsigned int[3*lfluid->num_face];
+
+	BoundaryPositions(mech, mechvpos);
+	SurfacePositions(lfluid, fluidvpos);
+	SurfaceTriangles(mech, mechtri);
+	SurfaceTriangles(lfluid, fluidtri);
+
+	CorrStamp(stamp, mech->num_vertex, mechvpos, mech->num_face, mechtri,
+			  lfluid->num_vertex, fluidvpos, lfluid->num_face, fluidtri, tolerance);
+
+	delete[] mechvpos;
+	delete[] fluidvpos;
+	delete[] mechtri;
+	delete[] fluidtri;
+}
+
+
+/**
+ * Writes the correspondence as an OBJTOOBJ correspondence file, followed
+ * by the stamp of the geometry it was generated from.
+ * 
+ * @param filename Character string containing file name.
+ * @param stamp Stamp from Stamp().
+ */
+void FEM3LM_LUMPEDFLUID_Connector::Save(char *filename, const char *stamp)
+{
+	FILE			*fp;
+	unsigned int	i;
+
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		printf("Cannot write corr file %s\n", filename);
+		return;
+	}
+
+	fprintf(fp, "OBJTOOBJ %d %d 1 1\n", num_vertex, num_face);
+	for (i=0; i<num_vertex; i++)	fprintf(fp, "n %d %d\n", *(vcorr+2*i)+1, *(vcorr+2*i+1)+1);
+	for (i=0; i<num_face; i++)		fprintf(fp, "f %d %d\n", *(fcorr+2*i)+1, *(fcorr+2*i+1)+1);
+	fprintf(fp, "s %s\n", stamp);
+
+	fclose(fp);
+}
+
+
 /**
  * Constructor.
  * 
@@ -667,18 +1095,44 @@ void QSDS_MSD_Connector::LoadGeometry(XMLNodeList * modelParametersChildren)
 		XMLNode * fileNameNode = corrFileChildren->GetNode("fileName");
 		char fullFilePath[256]("");
 		sprintf_s(fullFilePath, 256, "%s\\%s", pathNode->GetValue(), fileNameNode->GetValue());
-		// Load file
-		Load(fullFilePath);
+		// Load the hand-made file.  Without one, and with corrTolerance
+		// given, the correspondence is generated and cached in <file>.gen,
+		// which is regenerated when its stamp no longer matches.
+		Real tolerance = GetCorrTolerance(FEM_LFParametersChildren);
+		if (tolerance < 0.0 || CorrFileExists(fullFilePath))
+			Load(fullFilePath);
+		else
+		{
+			char genFilePath[260]("");
+			char stamp[CORR_STAMP_SIZE]("");
+			sprintf_s(genFilePath, 260, "%s.gen", fullFilePath);
+			Stamp(stamp, tolerance);
+			if (SameCorrStamp(genFilePath, stamp))
+				Load(genFilePath);
+			else
+			{
+				Generate(tolerance);
+				Save(genFilePath, stamp);
+			}
+		}
 
 		// Other setup stuff
-		msdpos = new Vector<Real>[num_vertex];
-		residualforce = new Vector<Real>[num_vertex];
-
-		for	(unsigned int i=0; i<num_vertex; i++)
-			msdpos[i] = msd->GetPosition(*(vcorr+2*i+1));
+		qsdsnode		= new unsigned int[num_vertex];
+		msdnode			= new unsigned int[num_vertex];
+		nodetype		= new unsigned int[num_vertex];
+		qsdslist		= new unsigned int[num_vertex];
+		msdlist			= new unsigned int[num_vertex];
+		msdpos			= new Real[3*num_vertex];
+		residualforce	= new Real[3*num_vertex];
+
+		for	(unsigned int i=0; i<num_vertex; i++) {
+			qsdsnode[i]	= *(vcorr+2*i+0);
+			msdnode[i]	= *(vcorr+2*i+1);
+		}
+		msd->GetPositions(num_vertex, msdnode, msdpos);
 		
-		for (unsigned int i=0; i<num_vertex; i++)
-			residualforce[i] = zero_vector3; 
+		for (unsigned int i=0; i<3*num_vertex; i++)
+			residualforce[i] = 0.0; 
 
 		for (unsigned int i=0; i<num_vertex; i++)
 			qsds->Set(*(vcorr+2*i+1),0, zero_vector3, 0, zero_vector3);
@@ -697,36 +1151,31 @@ void QSDS_MSD_Connector::LoadGeometry(XMLNodeList * modelParametersChildren)
  */
 void QSDS_MSD_Connector::process(void)
 {
-	unsigned int	i,j;
-	unsigned int	qsdsidx,msdidx;			
+	unsigned int	i,n;
 	
+	// check which qsds nodes move, these come first in the lists
+	qsds->GetBoundaryTypes(num_vertex, qsdsnode, nodetype);
+	n = 0;
 	for (i=0; i<num_vertex; i++)
-	{
-		qsdsidx	= *(vcorr+2*i+0);
-		msdidx = *(vcorr+2*i+1);		
-		
-		// check if qsds node move		
-		if (qsds->GetBoundaryType(qsdsidx)==1)
-		{
-			// From QSDS to MSD	
-			msdpos[i] = qsds->GetPosition(qsdsidx);				
-			msd->Set(msdidx, 1, msdpos[i], 0.0, zero_vector3);
-			// From MSD to QSDS
-			// no need force feed back to qsds,
-			// if it set the force back to qsds, the qsds display of the connector node will not move
-			//residualforce[i] = msd->GetReactionForce(msdidx);				
-			//qsds->Set(qsdsidx, 0, residualforce[i], 0.0, zero_vector3);
-		}
-		else //if (msd->GetBoundaryType(msdidx)==1)
-		{
-			// From MSD to QSDS
-			msdpos[i] = msd->GetPosition(msdidx);
-			qsds->Set(qsdsidx, 1, msdpos[i], 0.0, zero_vector3);
-			// From QSDS to MSD	
-			residualforce[i] = qsds->GetReactionForce(qsdsidx);				
-			msd->Set(msdidx, 0, residualforce[i], 0.0, zero_vector3);
-		}
-	}		
+		if (nodetype[i]==1) { qsdslist[n] = qsdsnode[i];	msdlist[n++] = msdnode[i]; }
+	unsigned int	num_qsds = n;
+	for (i=0; i<num_vertex; i++)
+		if (nodetype[i]!=1) { qsdslist[n] = qsdsnode[i];	msdlist[n++] = msdnode[i]; }
+	unsigned int	num_msd = n - num_qsds;
+
+	// From QSDS to MSD	
+	qsds->GetPositions(num_qsds, qsdslist, msdpos);
+	msd->SetBoundaryValues(num_qsds, msdlist, 1, msdpos);
+	// From MSD to QSDS
+	// no need force feed back to qsds,
+	// if it set the force back to qsds, the qsds display of the connector node will not move
+
+	// For the rest, from MSD to QSDS
+	msd->GetPositions(num_msd, msdlist+num_qsds, msdpos+3*num_qsds);
+	qsds->SetBoundaryValues(num_msd, qsdslist+num_qsds, 1, msdpos+3*num_qsds);
+	// From QSDS to MSD	
+	qsds->GetReactionForces(num_msd, qsdslist+num_qsds, residualforce);
+	msd->SetBoundaryValues(num_msd, msdlist+num_qsds, 0, residualforce);
 }
 
 
@@ -799,6 +1248,96 @@ void QSDS_MSD_Connector::Load(char *filename)
 	fclose(fp);
 }
 
+/**
+ * Generates the correspondence from the geometry of the boundaries: QSDS
+ * nodes within tolerance of an MSD node.
+ * 
+ * @param tolerance Distance tolerance.
+ */
+void QSDS_MSD_Connector::Generate(Real tolerance)
+{
+	unsigned int	i, n;
+	Real			*qsdsvpos	= new Real[3*qsds->num_vertex];
+	Real			*msdvpos	= new Real[3*msd->num_vertex];
+	unsigned int	*msdtri		= new unsigned int[3*msd->num_face];
+	unsigned int	*vmatch		= new unsigned int[qsds->num_vertex];
+
+	BoundaryPositions(qsds, qsdsvpos);
+	BoundaryPositions(msd, msdvpos);
+	SurfaceTriangles(msd, msdtri);
+
+	num_vertex	= NearestVertexCorr(qsds->num_vertex, qsdsvpos, msd->num_vertex, msdvpos,
+									msd->num_face, msdtri, tolerance, vmatch);
+	printf("Generated corr\tVertex Corr: %d\tTolerance: %g\n", num_vertex, tolerance);
+
+	vcorr = (unsigned int *) malloc(2*num_vertex*sizeof(int));
+	if(vcorr == NULL) {
+		error_exit(-1, "Cannot allocate memory for correspondences!\n");
+	}
+	for (i=0, n=0; i<qsds->num_vertex; i++)
+		if (vmatch[i] != CORR_NONE)	{ *(vcorr+2*n)=i;	*(vcorr+2*n+1)=vmatch[i];	n++; }
+
+	delete[] qsdsvpos;
+	delete[] msdvpos;
+	delete[] msdtri;
+	delete[] vmatch;
+}
+
+
+/**
+ * Stamp of the geometry and tolerance a generated correspondence depends
+ * on, see CorrStamp().
+ * 
+ * @param stamp Output string of CORR_STAMP_SIZE characters.
+ * @param tolerance Distance tolerance.
+ */
+void QSDS_MSD_Connector::Stamp(char *stamp, Real tolerance)
+{
+	Real			*qsdsvpos	= new Real[3*qsds->num_vertex];
+	Real			*msdvpos	= new Real[3*msd->num_vertex];
+	unsigned int	*qsdstri	= new unsigned int[3*qsds->num_face];
+	unsigned int	*msdtri		= new unsigned int[3*msd->num_face];
+
+	BoundaryPositions(qsds, qsdsvpos);
+	BoundaryPositions(msd, msdvpos);
+	SurfaceTriangles(qsds, qsdstri);
+	SurfaceTriangles(msd, msdtri);
+
+	CorrStamp(stamp, qsds->num_vertex, qsdsvpos, qsds->num_face, qsdstri,
+			  msd->num_vertex, msdvpos, msd->num_face, msdtri, tolerance);
+
+	delete[] qsdsvpos;
+	delete[] msdvpos;
+	delete[] qsdstri;
+	delete[] msdtri;
+}
+
+
+/**
+ * Writes the correspondence as an OBJTOOBJ correspondence file, followed
+ * by the stamp of the geometry it was generated from.
+ * 
+ * @param filename Character string containing file name.
+ * @param stamp Stamp from Stamp().
+ */
+void QSDS_MSD_Connector::Save(char *filename, const char *stamp)
+{
+	FILE			*fp;
+	unsigned int	i;
+
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		printf("Cannot write corr file %s\n", filename);
+		return;
+	}
+
+	fprintf(fp, "OBJTOOBJ %d 1 1\n", num_vertex);
+	for (i=0; i<num_vertex; i++)	fprintf(fp, "n %d %d\n", *(vcorr+2*i)+1, *(vcorr+2*i+1)+1);
+	fprintf(fp, "s %s\n", stamp);
+
+	fclose(fp);
+}
+
 /**
  * Constructor.
  * 
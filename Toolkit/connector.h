@@ -65,8 +65,8 @@ protected:
 	FEMBoundary				*mech;
 	LumpedFluidBoundary		*lfluid;
 	
-	Vector<Real>			*mechpos;
-	Vector<Real>			*forceaccum;
+	Real					*mechpos;		// 3 per corresponding node
+	Real					*nodebuf;		// 3 per corresponding node, scratch
 
 	Real					mechtime;
 
@@ -75,7 +75,21 @@ protected:
 	unsigned int		num_vertex;
 	unsigned int		num_face;
 
+	// Correspondence compiled by Compile()
+	unsigned int		*femnode;		// Node lists of the two sides of vcorr
+	unsigned int		*fluidnode;
+	Vertex				**facevertex;	// 3 mech vertices per corresponding face
+	Real				*aread3;		// A third of the area of each corresponding face
+	unsigned int		*nodeface_ptr;	// Corresponding faces around each mech boundary
+	unsigned int		*nodeface;		//   node, in face order
+
 	void	Load(char *filename);
+	void	Generate(Real tolerance);
+	void	Stamp(char *stamp, Real tolerance);
+	void	Save(char *filename, const char *stamp);
+	void	Compile(void);
+	static void			FaceAreaTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+	static void			NodeForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
 
 	friend LoaderUnitTest;
 };
@@ -99,7 +113,9 @@ protected:
 	Real				ExcitedStressValueXX, ExcitedStressValueYY, ExcitedStressValueZZ ;
 
 	Matrix<Real>		Excitation_to_Contraction (Real excitation);
-	void				Excitation_to_Contraction (Real *Excitation_Array, Matrix<Real> *Stress_Array);
+	void				Excitation_to_Contraction (Real excitation, Matrix<Real> &Stress);
+	void				Excitation_to_Contraction (const Real *Excitation_Array, Matrix<Real> *Stress_Array);
+	static void			ContractionTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
 
 	friend LoaderUnitTest;
 };
@@ -121,13 +137,21 @@ protected:
 	QSDSBoundary			*qsds;
 	MSDBoundary				*msd;
 	
-	Vector<Real>			*msdpos;
-	Vector<Real>			*residualforce;
+	Real					*msdpos;			// 3 per corresponding node
+	Real					*residualforce;		// 3 per corresponding node
 
 	unsigned int		*vcorr;	
+	unsigned int		*qsdsnode;		// Node lists of the two sides of vcorr
+	unsigned int		*msdnode;
+	unsigned int		*nodetype;		// QSDS boundary type of qsdsnode
+	unsigned int		*qsdslist;		// Pairs driven by QSDS first, then the
+	unsigned int		*msdlist;		//   ones driven by MSD
 	unsigned int		num_vertex;	
 
 	void	Load(char *filename);
+	void	Generate(Real tolerance);
+	void	Stamp(char *stamp, Real tolerance);
+	void	Save(char *filename, const char *stamp);
 
 	friend LoaderUnitTest;
 };
@@ -37,6 +37,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include "GiPSiException.h"
 #include "load_mesh.h"
 #include "logger.h"
+#include "parallel.h"
 #include "timing.h"
 #include "XMLNodeList.h"
 
@@ -51,6 +52,13 @@ FEM_3LMObject::FEM_3LMObject(XMLNode * simObjectNode,
 							 Real in_g,
 							 Real mass)
 							 :	DeformableSolidObject(simObjectNode),
+								element_model(FEM_ELEMENT_NONLINEAR),
+								element_block(NULL),
+								modal(NULL),
+								multigrid(NULL),
+								multigrid_fixed(NULL),
+								haptic_KC(NULL),
+								haptic_slot(NULL),
 								g(in_g),
 								defaultMass(mass)
 {
@@ -90,6 +98,7 @@ FEM_3LMObject::FEM_3LMObject(XMLNode * simObjectNode,
 
 		// Final setup
 		Geom2State();
+		BuildHapticModel();
 		SetupDisplay(simObjectChildren);
 		delete simObjectChildren;
 	}
@@ -145,6 +154,50 @@ void FEM_3LMObject::SetParameters(XMLNodeList * simObjectChildren)
 
 		// Set type-specific parameters
 		SetMaterial((Real)atof(RhoVal), (Real)atof(MuVal), (Real)atof(LambdaVal), (Real)atof(NuVal), (Real)atof(PhiVal));
+
+		// Optional element model, "NonLinear" (default) or "Corotational"
+		for (unsigned int i = 0; i < FEMParametersChildren->GetLength(); i++)
+		{
+			XMLNode * node = FEMParametersChildren->GetNode(i);
+			char * name = node->GetName();
+			if (strcmp(name, "Element") == 0)
+			{
+				const char * ElementVal = node->GetValue();
+				if (strcmp(ElementVal, "Corotational") == 0) {
+					element_model = FEM_ELEMENT_COROTATIONAL;
+					PrecomputeCorotational();
+				}
+				delete ElementVal;
+			}
+			delete name;
+			delete node;
+		}
+
+		// Integration method: Load() sets up ERKHeun3, the other
+		// choices are implicit Euler, with CG or multigrid, and the
+		// reduced modal model.  The optional multigrid node sets the
+		// cycle and smoother of the multigrid.
+		XMLNode * numericMethodNode = NHParametersChildren->GetNode("numericMethod");
+		const char * numericMethod = numericMethodNode->GetValue();
+		GetMultigridParameters(NHParametersChildren, multigrid_param);
+		if (strcmp(numericMethod, "ImEuler") == 0) {
+			delete integrator;
+			FreeMultigrid();
+			integrator = new ImplicitEuler<FEM_3LMObject>(*this);
+		}
+		else if (strcmp(numericMethod, "ImEulerMG") == 0) {
+			delete integrator;
+			AllocMultigrid();
+			integrator = new ImplicitEulerMG<FEM_3LMObject>(*this);
+		}
+		else if (strcmp(numericMethod, "Modal") == 0) {
+			delete integrator;
+			FreeMultigrid();
+			AllocModal();
+			integrator = new ModalIntegrator<FEM_3LMObject>(*this);
+		}
+		delete numericMethod;
+		delete numericMethodNode;
 		delete RhoVal;
 		delete MuVal;
 		delete LambdaVal;
@@ -404,15 +457,7 @@ void FEM_3LMObject::init (	unsigned int num_node, unsigned int num_element)
 
 	// Allocate and init state
 	state.size	= num_node;
-	if((state.pos = new Vector<Real>[state.size]) == NULL) {
-		error_exit(-1, "Cannot allocate memory for positions!\n");
-	}
-	for(i=0; i<state.size; i++) state.pos[i] = zero_vector3;
-	
-	if((state.vel = new Vector<Real>[state.size]) == NULL) {
-		error_exit(-1, "Cannot allocate memory for velocity!\n");
-	}
-	for(i=0; i<state.size; i++) state.vel[i] = zero_vector3;
+	AllocState(state);
 
 	// Allocate and init reference positions
 	if((rcpos = new Vector<Real>[num_node]) == NULL) {
@@ -530,6 +575,7 @@ void FEM_3LMObject::Load(char *basename)
 	/****************************************/
 	unsigned int	bno = 0;
 	unsigned int	*g2b = new unsigned int[data->num_node];		// Global to boundary reference table
+	unsigned int	*f2g = new unsigned int[data->num_node];		// File to global node table
 	for(i=0; i<(unsigned int)(data->num_node); i++) {
 		// Initialize state
 		this->state.pos[i] = data->node[i].pos;
@@ -540,9 +586,15 @@ void FEM_3LMObject::Load(char *basename)
 		this->mass[i]	= 0.0;
 		this->force[i]	= 0.0;
 
-		//
-		// Initialize nodes of the boundary
-		//
+		f2g[(data->node_id != NULL) ? data->node_id[i] : i] = i;
+	}
+	//
+	// Initialize nodes of the boundary.  They are numbered in the file
+	// order of the nodes, which the connector correspondences refer
+	// to, however the loader renumbered the nodes.
+	//
+	for(unsigned int f=0; f<(unsigned int)(data->num_node); f++) {
+		i = f2g[f];
 		if(data->node[i].boundary) {
 			bound->vertex[bno].refid	= bno;
 			bound->vertex[bno].pos		= data->node[i].pos;
@@ -594,8 +646,10 @@ void FEM_3LMObject::Load(char *basename)
 		elements[i].computeBeta( state.pos[nid[0]], state.pos[nid[1]], state.pos[nid[2]], state.pos[nid[3]]);
 	}
 	printf("%d tetrahedral elements\n",data->num_element);
+	PrecomputeElements();
 	
 	delete[] g2b;
+	delete[] f2g;
   
 
 	// NOTE: The method is harcoded for now.
@@ -605,6 +659,18 @@ void FEM_3LMObject::Load(char *basename)
 
 
 
+// Elements per batch of the force kernel
+#define		FEM_ELEMENT_BATCH	8
+
+// Minimum work per thread of the parallel element pass
+#define		FEM_ELEMENTS_PER_THREAD	128
+
+typedef struct {
+	FEM_3LMObject			*object;
+	FEM_3LMObject::State	*state;
+	unsigned int			offset;		// First slot of the current colour
+} ElementTaskArg;
+
 ////////////////////////////////////////////////////////////////
 //
 //	FEM_3LMObject::UpdateForces()
@@ -613,46 +679,20 @@ void FEM_3LMObject::Load(char *basename)
 //
 void FEM_3LMObject::UpdateForces(State &state)   
 {
-	unsigned int		i;
-	static				Real g_v[3] = {0.0, -g, 0.0};		// NOTE: this is ugly
-	static	const		Vector<Real> g_Vector(3, g_v), zero_vector3(3, 0.0);
-	static				Vector<Real> g_force, d_force, s_force;
-
-	FEMDomain			*dom = (FEMDomain *) domain;
-
-	// Clear the forces
-	for(i = 0; i < state.size; i++) force[i] = zero_vector3;
-
-	// Update them by adding each component
-	for(i = 0; i < state.size; i++) {
-		// Add gravity
-		g_force = g_Vector;
-		g_force *= mass[i]; 
-//		force[i] += g_force;
-	}
+	ElementTaskArg	arg;
 
-	for(unsigned int k = 0; k < num_element; k++) {
-		Vector<Real>	&p0 = state.pos[elements[k].node_id[0]];
-		Vector<Real>	&p1 = state.pos[elements[k].node_id[1]];
-		Vector<Real>	&p2 = state.pos[elements[k].node_id[2]];
-		Vector<Real>	&p3 = state.pos[elements[k].node_id[3]];
+	arg.object	= this;
+	arg.state	= &state;
 
-		Vector<Real>	&v0 = state.vel[elements[k].node_id[0]];
-		Vector<Real>	&v1 = state.vel[elements[k].node_id[1]];
-		Vector<Real>	&v2 = state.vel[elements[k].node_id[2]];
-		Vector<Real>	&v3 = state.vel[elements[k].node_id[3]];
+	// Clear the forces.  NOTE: Gravity is not applied to the FEM object
+	for(unsigned int i = 0; i < state.size; i++) force[i] = 0.0;
 
-
-		elements[k].computeStrain(p0, p1, p2, p3);
-		elements[k].computeStrainVelocity(p0, p1, p2, p3, v0, v1, v2, v3);
-
-		elements[k].computeStress();
-		elements[k].stress += dom->DomStress[k];
-
-		elements[k].computeForces(p0, p1, p2, p3);
-		
-		for(unsigned int j=0; j<4; j++) 
-			force[elements[k].node_id[j]] += elements[k].NodeForce[j];
+	// One colour at a time, the chunks of a colour scatter into disjoint
+	// nodes.  The sums at each node are taken in colour order whatever
+	// the thread count, so the result does not depend on it.
+	for(unsigned int c = 0; c < tets.num_color; c++) {
+		arg.offset = tets.color_ptr[c];
+		ParallelFor(tets.color_ptr[c+1] - tets.color_ptr[c], ElementForceTask, &arg, FEM_ELEMENTS_PER_THREAD);
 	}
 }
 
@@ -660,92 +700,77 @@ void FEM_3LMObject::UpdateForces(State &state)
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::AccumState()
-//
-//		Computes x(t+h) = x(t) + h * f(..)
+//	FEM_3LMObject::ElementForceTask()
 //
-//		where	x(t+h)	= new_state
-//				x(t)	= state
-//				f(..)	= deriv
+//		ParallelFor task: element forces of slots [begin, end) of
+//		the colour starting at arg->offset
 //
-inline void FEM_3LMObject::AccumState(State &new_state, const State &state, const State &deriv, const Real &h)
+void FEM_3LMObject::ElementForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
 {
-	unsigned int i;
-	FEMBoundary		*bound = (FEMBoundary *) boundary;
-
-	// NOTE: The below is a good point to measure the overhead caused by binary operators
-	for(i = 0; i < state.size; i++) {
-		new_state.pos[i] = state.pos[i] + deriv.pos[i] * h;
-		new_state.vel[i] = state.vel[i] + deriv.vel[i] * h;
-	}
-	for(i = 0; i < bound->num_vertex; i++) {
-		switch (bound->boundary_type[i]) {
-			case (0):   // Neumann type boundary condition   (Specify traction)
-				break;
-			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
-					    // Position specified in boundary_value
-				new_state.pos[bound->global_id[i]]=bound->boundary_value[i];
-				break;
-			case (2):  // Mixed boundary condition type i: 
-					   // Normal displacement (not position) specified in boundary_value2_scalar
-					   //        with normal direction specified in boundary_value2_vector
-					   //   and tangential traction specified in boundary_value
-				new_state.pos[bound->global_id[i]]+=bound->boundary_value2_scalar[i] * bound->boundary_value2_vector[i];
-				break;
-			default:
-				error_exit(0,"Unrecognized boundary condition type\n");
-		}
-	}
+	ElementTaskArg	*a = (ElementTaskArg *) arg;
 
+	if(a->object->element_model == FEM_ELEMENT_COROTATIONAL)
+		a->object->CorotationalForces(*a->state, a->offset + begin, a->offset + end);
+	else
+		a->object->ElementForces(*a->state, a->offset + begin, a->offset + end);
 }
 
-
-
-
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::DerivState()
-//
-//		Computes the derivatives of state variables. This is simply 
-//		the f() evaluation where f() = dx/dt.
+//	FEM_3LMObject::PrecomputeElements()
 //
+//		Copies the rest state of the elements into tets, in colour
+//		order.  The gradients of the shape functions 1..3 are the
+//		rows of the inverse rest shape matrix
+//		Dm^-1 = [X1-X0 X2-X0 X3-X0]^-1, which beta already holds.
 //
-inline void FEM_3LMObject::DerivState(State &deriv, State &state)
+void FEM_3LMObject::PrecomputeElements(void)
 {
-	unsigned int i;
-	FEMBoundary		*bound = (FEMBoundary *) boundary;
-
-	UpdateForces(state);
-
-	for(i = 0; i < state.size; i++) {
-		// dpos/dt = vel
-		deriv.pos[i] = state.vel[i];
-
-		// dvel/dt = force/m
-		deriv.vel[i] = force[i];
-		deriv.vel[i] /= mass[i];
+	unsigned int	n = num_element, i, k, a, r, c;
+
+	tets.num		= n;
+	tets.element	= new unsigned int[n];
+	tets.slot		= new unsigned int[n];
+	tets.node		= new unsigned int[4*n];
+	tets.rest_inv	= new Real[9*n];
+	tets.volume		= new Real[n];
+	tets.mu			= new Real[n];
+	tets.lambda		= new Real[n];
+	tets.nu			= new Real[n];
+	tets.phi		= new Real[n];
+	tets.stress		= new Real[9*n];
+	if(tets.element == NULL || tets.slot == NULL || tets.node == NULL || tets.rest_inv == NULL ||
+	   tets.volume == NULL || tets.mu == NULL || tets.lambda == NULL || tets.nu == NULL ||
+	   tets.phi == NULL || tets.stress == NULL) {
+		error_exit(-1, "Cannot allocate memory for elements!\n");
 	}
-	for(i = 0; i < bound->num_vertex; i++) {
-		switch (bound->boundary_type[i]) {
-			case (0):   // Neumann type boundary condition   (Specify traction)
-				deriv.vel[bound->global_id[i]] += bound->boundary_value[i]*(1.0/mass[bound->global_id[i]]);
-				break;
-			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
-					    // Position specified in boundary_value
-				deriv.vel[bound->global_id[i]] = 0.0;
-				deriv.pos[bound->global_id[i]] = 0.0;
-				break;
-			case (2):  // Mixed boundary condition type i: 
-					   // Normal displacement (not position) specified in boundary_value2_scalar
-					   //        with normal direction specified in boundary_value2_vector
-					   //   and tangential traction specified in boundary_value
-				deriv.vel[bound->global_id[i]] += bound->boundary_value[i]*(1.0/mass[bound->global_id[i]]);
-				deriv.vel[bound->global_id[i]] -= bound->boundary_value2_vector[i] * (deriv.vel[bound->global_id[i]] * bound->boundary_value2_vector[i]);
-				deriv.pos[bound->global_id[i]] -= bound->boundary_value2_vector[i] * (deriv.pos[bound->global_id[i]] * bound->boundary_value2_vector[i]);
-				break;
-			default:
-				error_exit(0,"Unrecognized boundary condition type\n");
-		}
+	tets.rest_edge	= tets.stiffness = tets.damping = tets.rotation = NULL;
+
+	// Bucket the elements by colour, keeping index order within a colour
+	unsigned int	*color = new unsigned int[n];
+	ColorElements(color);
+	tets.color_ptr = new unsigned int[tets.num_color + 1];
+	for(c = 0; c <= tets.num_color; c++)	tets.color_ptr[c] = 0;
+	for(i = 0; i < n; i++)					tets.color_ptr[color[i] + 1]++;
+	for(c = 0; c < tets.num_color; c++)		tets.color_ptr[c + 1] += tets.color_ptr[c];
+	for(i = 0; i < n; i++)					tets.slot[i] = tets.color_ptr[color[i]]++;
+	for(c = tets.num_color; c > 0; c--)		tets.color_ptr[c] = tets.color_ptr[c - 1];
+	tets.color_ptr[0] = 0;
+	delete[] color;
+
+	for(i = 0; i < n; i++) {
+		k = tets.slot[i];
+		tets.element[k] = i;
+		for(a = 0; a < 4; a++)	tets.node[a*n + k] = elements[i].node_id[a];
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				tets.rest_inv[(3*r+c)*n + k] = elements[i].beta[r+1][c];
+		tets.volume[k]	= elements[i].volume;
+		tets.mu[k]		= elements[i].Mu;
+		tets.lambda[k]	= elements[i].Lambda;
+		tets.nu[k]		= elements[i].Nu;
+		tets.phi[k]		= elements[i].Phi;
+		for(r = 0; r < 9; r++) tets.stress[9*k + r] = 0.0;
 	}
 }
 
@@ -753,66 +778,215 @@ inline void FEM_3LMObject::DerivState(State &deriv, State &state)
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::AllocState()
+//	FEM_3LMObject::ColorElements()
 //
-//		Allocates the memory for the integrator's local state 
-//		members
+//		Greedy colouring of the elements: no two elements of the
+//		same colour share a node.  Sets tets.num_color.
 //
-inline void FEM_3LMObject::AllocState(State &s)
+void FEM_3LMObject::ColorElements(unsigned int *color)
 {
-	s.pos = new Vector<Real>[state.size];
-	if(s.pos == NULL) {
-		error_exit(-1, "Cannot allocate memory for positions!\n");
+	unsigned int			i, a, c;
+	vector<unsigned int>	*used = new vector<unsigned int>[num_node];		// colours taken at each node
+	vector<unsigned int>	stamp;											// stamp[c] == i+1 : c is taken for element i
+
+	if(used == NULL) {
+		error_exit(-1, "Cannot allocate memory for element colouring!\n");
 	}
-	for(unsigned int i = 0; i<state.size; i++)	s.pos[i] = zero_vector3;
 
-	s.vel = new Vector<Real>[state.size];
-	if(s.vel == NULL) {
-		error_exit(-1, "Cannot allocate memory for velocity!\n");
+	tets.num_color = 0;
+	for(i = 0; i < num_element; i++) {
+		for(a = 0; a < 4; a++) {
+			vector<unsigned int>	&u = used[elements[i].node_id[a]];
+			for(unsigned int k = 0; k < u.size(); k++) stamp[u[k]] = i + 1;
+		}
+		for(c = 0; c < tets.num_color && stamp[c] == i + 1; c++);
+		if(c == tets.num_color) {
+			tets.num_color++;
+			stamp.push_back(0);
+		}
+		color[i] = c;
+		for(a = 0; a < 4; a++) used[elements[i].node_id[a]].push_back(c);
 	}
-	//for(i = 0; i<state.size; i++)		s.vel[i] = zero_vector3;
-	// why was this changed?
-	for(unsigned int i = 0; i<state.size; i++)		
-		s.vel[i] = zero_vector3;
 
-	s.size = state.size;
+	delete[] used;
 }
 
 
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::Simulate()
+//	FEM_3LMObject::ElementForces()
 //
-//		Simulates the FEM_3LM object by a single timestep
+//		Adds the elastic and viscous forces of elements [begin, end)
+//		to force[].  With Ds = [x1-x0 x2-x0 x3-x0] and the same for
+//		the velocities,
 //
+//		F = Ds Dm^-1,	E = 1/2 (F^T F - I),	Ed = sym(F^T Fd)
+//		S = 2 Mu E + Lambda tr(E) I + 2 Nu Ed + Phi tr(Ed) I + DomStress
+//		[f1 f2 f3] = -V/2 F S Dm^-T,	f0 = -(f1 + f2 + f3)
 //
-void FEM_3LMObject::Simulate(void)
+//		which is what the FEMElement compute*() functions evaluate,
+//		on fixed size arrays.  Each batch is gathered, computed
+//		component by component over the batch, and scattered.  The
+//		function only reads shared data and writes force[] at the
+//		nodes of its slots, so disjoint slot ranges of one colour
+//		can run concurrently.
+//
+void FEM_3LMObject::ElementForces(State &state, unsigned int begin, unsigned int end)
 {
-	integrator->Integrate(*this, timestep);
-	time+=timestep;
+	FEMDomain		*dom = (FEMDomain *) domain;
+	const unsigned int	n = tets.num;
+	Real			Ds[9][FEM_ELEMENT_BATCH], Vs[9][FEM_ELEMENT_BATCH], Di[9][FEM_ELEMENT_BATCH];
+	Real			F[9][FEM_ELEMENT_BATCH], Fd[9][FEM_ELEMENT_BATCH], S[9][FEM_ELEMENT_BATCH];
+	Real			H[9][FEM_ELEMENT_BATCH];
+	unsigned int	b, r, c, j;
+
+	for(unsigned int k0 = begin; k0 < end; k0 += FEM_ELEMENT_BATCH) {
+		unsigned int	nb = (end - k0 < FEM_ELEMENT_BATCH) ? end - k0 : FEM_ELEMENT_BATCH;
+
+		// Gather
+		for(b = 0; b < nb; b++) {
+			unsigned int	k	= k0 + b;
+			const Real		*x0	= state.pos[tets.node[k]].begin();
+			const Real		*v0	= state.vel[tets.node[k]].begin();
+			for(c = 0; c < 3; c++) {
+				const Real	*x = state.pos[tets.node[(c+1)*n + k]].begin();
+				const Real	*v = state.vel[tets.node[(c+1)*n + k]].begin();
+				for(r = 0; r < 3; r++) {
+					Ds[3*r+c][b] = x[r] - x0[r];
+					Vs[3*r+c][b] = v[r] - v0[r];
+				}
+			}
+			for(j = 0; j < 9; j++) {
+				Di[j][b]	= tets.rest_inv[j*n + k];
+				S[j][b]		= dom->DomStress[tets.element[k]][j/3][j%3];
+			}
+		}
 
-	//We alse need to update the Boundary from states 
-	//   so that we will have the correct Boundary definition for boundary calculations
-	State2Bound();
+		// F = Ds Dm^-1, Fd = Vs Dm^-1
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				for(b = 0; b < nb; b++) {
+					F[3*r+c][b]		= Ds[3*r][b]*Di[c][b] + Ds[3*r+1][b]*Di[3+c][b] + Ds[3*r+2][b]*Di[6+c][b];
+					Fd[3*r+c][b]	= Vs[3*r][b]*Di[c][b] + Vs[3*r+1][b]*Di[3+c][b] + Vs[3*r+2][b]*Di[6+c][b];
+				}
+
+		// S += 2 Mu E + 2 Nu Ed, E and Ed from the columns of F and Fd
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				for(b = 0; b < nb; b++) {
+					unsigned int	k = k0 + b;
+					Real	e	= 0.5 * (F[r][b]*F[c][b] + F[3+r][b]*F[3+c][b] + F[6+r][b]*F[6+c][b]) - ((r == c) ? 0.5 : 0.0);
+					Real	ed	= 0.5 * (F[r][b]*Fd[c][b] + F[3+r][b]*Fd[3+c][b] + F[6+r][b]*Fd[6+c][b] +
+									 Fd[r][b]*F[c][b] + Fd[3+r][b]*F[3+c][b] + Fd[6+r][b]*F[6+c][b]);
+					S[3*r+c][b] += 2.0 * tets.mu[k] * e + 2.0 * tets.nu[k] * ed;
+				}
+
+		// Volumetric terms: tr(E) = 1/2 (|F|^2 - 3), tr(Ed) = F : Fd
+		for(b = 0; b < nb; b++) {
+			unsigned int	k = k0 + b;
+			Real	ff = 0.0, ffd = 0.0;
+			for(j = 0; j < 9; j++) {
+				ff	+= F[j][b] * F[j][b];
+				ffd	+= F[j][b] * Fd[j][b];
+			}
+			Real	p = tets.lambda[k] * 0.5 * (ff - 3.0) + tets.phi[k] * ffd;
+			S[0][b] += p;
+			S[4][b] += p;
+			S[8][b] += p;
+		}
 
+		// H = -V/2 F S Dm^-T, columns are the forces on nodes 1..3
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				for(b = 0; b < nb; b++) {
+					Real	fs0 = F[3*r][b]*S[0][b] + F[3*r+1][b]*S[3][b] + F[3*r+2][b]*S[6][b];
+					Real	fs1 = F[3*r][b]*S[1][b] + F[3*r+1][b]*S[4][b] + F[3*r+2][b]*S[7][b];
+					Real	fs2 = F[3*r][b]*S[2][b] + F[3*r+1][b]*S[5][b] + F[3*r+2][b]*S[8][b];
+					H[3*r+c][b] = -0.5 * tets.volume[k0 + b] * (fs0*Di[3*c][b] + fs1*Di[3*c+1][b] + fs2*Di[3*c+2][b]);
+				}
+
+		// Scatter
+		for(b = 0; b < nb; b++) {
+			unsigned int	k	= k0 + b;
+			Real			*f0	= force[tets.node[k]].begin();
+			for(j = 0; j < 9; j++) tets.stress[9*k + j] = S[j][b];
+			for(c = 0; c < 3; c++) {
+				Real	*f = force[tets.node[(c+1)*n + k]].begin();
+				for(r = 0; r < 3; r++) {
+					f[r]	+= H[3*r+c][b];
+					f0[r]	-= H[3*r+c][b];
+				}
+			}
+		}
+	}
 }
 
 
 
+
+// Number of vibration modes kept by the modal integrator
+#define		FEM_MODAL_MODES		20
+
+// Polar decomposition iterations per element and step.  The rotation of
+// the previous step is the starting guess, so a few are enough.
+#define		FEM_POLAR_ITERATIONS	4
+
+// R = rotation matrix of the unit quaternion q = (w,x,y,z)
+static void QuaternionToMatrix(Real R[3][3], const Real *q)
+{
+	Real	w = q[0], x = q[1], y = q[2], z = q[3];
+
+	R[0][0] = 1.0 - 2.0*(y*y + z*z);	R[0][1] = 2.0*(x*y - w*z);			R[0][2] = 2.0*(x*z + w*y);
+	R[1][0] = 2.0*(x*y + w*z);			R[1][1] = 1.0 - 2.0*(x*x + z*z);	R[1][2] = 2.0*(y*z - w*x);
+	R[2][0] = 2.0*(x*z - w*y);			R[2][1] = 2.0*(y*z + w*x);			R[2][2] = 1.0 - 2.0*(x*x + y*y);
+}
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::Geom2State()
+//	PolarRotation()
 //
-//		Copies geometry to state
+//		Rotational part of F, improving the guess q in place.  Each
+//		iteration turns R towards the columns of F by
 //
+//		omega = sum_c (r_c x f_c) / |sum_c r_c . f_c|
 //
-void FEM_3LMObject::Geom2State(void)
+//		which stays well defined for flat and inverted elements
+//		(Muller et al., "A Robust Method to Extract the Rotational
+//		Part of Deformations", 2016).
+//
+static void PolarRotation(Real *q, const Real F[3][3], unsigned int iterations)
 {
-	static TetVolume *geom = (TetVolume *) geometry;
-
-	for(unsigned int i=0; i < geom->num_vertex; i++) {
-		state.pos[i] = geom->vertex[i].pos;
+	Real	R[3][3], omega[3], dq[4], t[4];
+
+	for(unsigned int it = 0; it < iterations; it++) {
+		QuaternionToMatrix(R, q);
+
+		Real	dot = 0.0;
+		omega[0] = omega[1] = omega[2] = 0.0;
+		for(unsigned int c = 0; c < 3; c++) {
+			omega[0] += R[1][c]*F[2][c] - R[2][c]*F[1][c];
+			omega[1] += R[2][c]*F[0][c] - R[0][c]*F[2][c];
+			omega[2] += R[0][c]*F[1][c] - R[1][c]*F[0][c];
+			dot += R[0][c]*F[0][c] + R[1][c]*F[1][c] + R[2][c]*F[2][c];
+		}
+		Real	scale = 1.0 / (fabs(dot) + 1.0e-9);
+		Real	angle = scale * sqrt(omega[0]*omega[0] + omega[1]*omega[1] + omega[2]*omega[2]);
+		if(angle < 1.0e-9) break;
+
+		// q = exp(omega) q
+		Real	s = sin(0.5 * angle) * scale / angle;
+		dq[0] = cos(0.5 * angle);
+		dq[1] = s * omega[0];
+		dq[2] = s * omega[1];
+		dq[3] = s * omega[2];
+		t[0] = dq[0]*q[0] - dq[1]*q[1] - dq[2]*q[2] - dq[3]*q[3];
+		t[1] = dq[0]*q[1] + dq[1]*q[0] + dq[2]*q[3] - dq[3]*q[2];
+		t[2] = dq[0]*q[2] - dq[1]*q[3] + dq[2]*q[0] + dq[3]*q[1];
+		t[3] = dq[0]*q[3] + dq[1]*q[2] - dq[2]*q[1] + dq[3]*q[0];
+
+		Real	norm = 1.0 / sqrt(t[0]*t[0] + t[1]*t[1] + t[2]*t[2] + t[3]*t[3]);
+		for(unsigned int j = 0; j < 4; j++) q[j] = t[j] * norm;
 	}
 }
 
@@ -820,17 +994,30 @@ void FEM_3LMObject::Geom2State(void)
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::State2Geom()
-//
-//		Copies state to geometry
+//	FEM_3LMObject::PrecomputeCorotational()
 //
+//		Allocates the corotational element data and computes the
+//		rest stiffness of every element.  The rotations start at the
+//		identity.
 //
-inline void FEM_3LMObject::State2Geom(void)
+void FEM_3LMObject::PrecomputeCorotational(void)
 {
-	static TetVolume *geom = (TetVolume *) geometry;
+	unsigned int	n = tets.num;
+
+	if(tets.stiffness == NULL) {
+		tets.rest_edge	= new Real[9*n];
+		tets.stiffness	= new Real[81*n];
+		tets.damping	= new Real[81*n];
+		tets.rotation	= new Real[4*n];
+		if(tets.rest_edge == NULL || tets.stiffness == NULL || tets.damping == NULL || tets.rotation == NULL) {
+			error_exit(-1, "Cannot allocate memory for corotational elements!\n");
+		}
+	}
 
-	for(unsigned int i=0; i<geom->num_vertex; i++) {
-		geom->vertex[i].pos = state.pos[i];
+	for(unsigned int k = 0; k < n; k++) {
+		tets.rotation[4*k]		= 1.0;
+		tets.rotation[4*k+1]	= tets.rotation[4*k+2] = tets.rotation[4*k+3] = 0.0;
+		CorotationalRest(k);
 	}
 }
 
@@ -838,128 +1025,1266 @@ inline void FEM_3LMObject::State2Geom(void)
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::State2Bound()
+//	FEM_3LMObject::CorotationalRest()
 //
-//		Copies state to boundary
+//		Rest edges and the linear stiffness and damping blocks of
+//		slot k.  With g_a the shape function gradients these are the
+//		small strain limits of the St. Venant-Kirchhoff element,
 //
+//		K_ab = V/2 (Lambda g_a g_b^T + Mu g_b g_a^T + Mu (g_a.g_b) I)
 //
-inline void FEM_3LMObject::State2Bound(void)
+//		and C_ab the same with Phi and Nu.  Only nodes 1..3 are kept;
+//		the rows and columns of node 0 follow from sum_b K_ab = 0.
+//
+void FEM_3LMObject::CorotationalRest(unsigned int k)
 {
-	static FEMBoundary		*bound = (FEMBoundary *) boundary;
+	const unsigned int	n = tets.num;
+	Real				Di[3][3], *E = tets.rest_edge + 9*k;
+	unsigned int		r, c;
+
+	for(r = 0; r < 3; r++)
+		for(c = 0; c < 3; c++) Di[r][c] = tets.rest_inv[(3*r+c)*n + k];
+
+	// Dm = (Dm^-1)^-1
+	Real	det =	Di[0][0] * (Di[1][1]*Di[2][2] - Di[1][2]*Di[2][1]) -
+					Di[0][1] * (Di[1][0]*Di[2][2] - Di[1][2]*Di[2][0]) +
+					Di[0][2] * (Di[1][0]*Di[2][1] - Di[1][1]*Di[2][0]);
+	for(r = 0; r < 3; r++)
+		for(c = 0; c < 3; c++) {
+			unsigned int	r1 = (c+1)%3, r2 = (c+2)%3, c1 = (r+1)%3, c2 = (r+2)%3;
+			E[3*r+c] = (Di[r1][c1]*Di[r2][c2] - Di[r1][c2]*Di[r2][c1]) / det;
+		}
 
-	for(unsigned int i=0; i<bound->num_vertex; i++) {
-		bound->vertex[i].pos = state.pos[bound->global_id[i]];
-	}
-	bound->calcNormals();
+	RestBlocks(k, tets.stiffness + 81*k, tets.damping + 81*k);
 }
 
+
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::ResetInitialBoundaryCondition()
-//
-//		Reset boundary condition to initial values.
+//	FEM_3LMObject::RestBlocks()
 //
+//		The nine 3x3 blocks K_ab and C_ab, a, b = 1..3, of slot k
+//		described in CorotationalRest(), into kb and cb
 //
-inline void FEM_3LMObject::ResetInitialBoundaryCondition(void)
+void FEM_3LMObject::RestBlocks(unsigned int k, Real *kb, Real *cb)
 {
+	const unsigned int	n = tets.num;
+	Real				Di[3][3];
+	unsigned int		a, b, r, c;
+
+	for(r = 0; r < 3; r++)
+		for(c = 0; c < 3; c++) Di[r][c] = tets.rest_inv[(3*r+c)*n + k];
+
+	Real	v2 = tets.volume[k] * 0.5;
+	for(a = 0; a < 3; a++)
+		for(b = 0; b < 3; b++) {
+			const Real	*ga = Di[a], *gb = Di[b];
+			Real		gg = ga[0]*gb[0] + ga[1]*gb[1] + ga[2]*gb[2];
+			Real		*kab = kb + 9*(3*a+b);
+			Real		*cab = cb + 9*(3*a+b);
+
+			for(r = 0; r < 3; r++)
+				for(c = 0; c < 3; c++) {
+					kab[3*r+c] = v2 * (tets.lambda[k] * ga[r] * gb[c] + tets.mu[k] * gb[r] * ga[c] +
+									   ((r == c) ? tets.mu[k] * gg : 0.0));
+					cab[3*r+c] = v2 * (tets.phi[k] * ga[r] * gb[c] + tets.nu[k] * gb[r] * ga[c] +
+									   ((r == c) ? tets.nu[k] * gg : 0.0));
+				}
+		}
 }
 
+
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::SetupDisplay()
+//	FEM_3LMObject::CorotationalForces()
 //
-//		Sets up the display of the FEM mesh
+//		Corotational element forces of slots [begin, end).  The
+//		rotation R of F = Ds Dm^-1 is updated from the previous one,
+//		and the precomputed blocks act in the rotated frame:
 //
+//		f_a = -R sum_b (K_ab (R^T (x_b - x_0) - (X_b - X_0))
+//							+ C_ab R^T (v_b - v_0)),	a, b = 1..3
 //
-void FEM_3LMObject::SetupDisplay(XMLNodeList * simObjectChildren)
+//		with f_0 = -(f_1 + f_2 + f_3).  The domain stress adds
+//		-V/2 F S g_a as in ElementForces().  Like ElementForces(),
+//		it only writes force[] at the nodes of its slots.
+//
+void FEM_3LMObject::CorotationalForces(State &state, unsigned int begin, unsigned int end)
 {
-	DisplayHeader	header;
-
-	header.objType				= GIPSI_DRAW_TRIANGLE;
-	header.polyMode				= GIPSI_POLYGON_FILL;
-	header.shadeMode			= GIPSI_SHADE_FLAT;
-	header.dataType				= 0x06;
-
-	displayMngr = new TetVolumeDisplayManager((TetVolume *) geometry, &header);
-	// Use this if you want to display the boundary surface instead of the tet volume
-    //displayMngr = new TriSurfaceDisplayManager((TriSurface *) boundary, header);
-	displayMngr->SetObjectName(GetName());
+	FEMDomain		*dom = (FEMDomain *) domain;
+	const unsigned int	n = tets.num;
+	unsigned int	a, b, r, c;
+
+	for(unsigned int k = begin; k < end; k++) {
+		Real	Ds[3][3], Vs[3][3], F[3][3], R[3][3], u[3][3], w[3][3], l[3][3];
+		const unsigned int	*id = tets.node + k;
+		const Real			*x0 = state.pos[id[0]].begin();
+		const Real			*v0 = state.vel[id[0]].begin();
+		const Real			*E	= tets.rest_edge + 9*k;
+
+		// Ds, Vs: edges in the columns
+		for(c = 0; c < 3; c++) {
+			const Real	*x = state.pos[id[(c+1)*n]].begin();
+			const Real	*v = state.vel[id[(c+1)*n]].begin();
+			for(r = 0; r < 3; r++) {
+				Ds[r][c] = x[r] - x0[r];
+				Vs[r][c] = v[r] - v0[r];
+			}
+		}
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				F[r][c] =	Ds[r][0] * tets.rest_inv[c*n + k] + Ds[r][1] * tets.rest_inv[(3+c)*n + k] +
+							Ds[r][2] * tets.rest_inv[(6+c)*n + k];
+
+		PolarRotation(tets.rotation + 4*k, F, FEM_POLAR_ITERATIONS);
+		QuaternionToMatrix(R, tets.rotation + 4*k);
+
+		// Displacements and velocities of nodes 1..3 in the element frame
+		for(b = 0; b < 3; b++)
+			for(r = 0; r < 3; r++) {
+				u[b][r] = R[0][r]*Ds[0][b] + R[1][r]*Ds[1][b] + R[2][r]*Ds[2][b] - E[3*r+b];
+				w[b][r] = R[0][r]*Vs[0][b] + R[1][r]*Vs[1][b] + R[2][r]*Vs[2][b];
+			}
 
-	// Load texture names for each DisplayManager
-	XMLNode * geometriesNode = simObjectChildren->GetNode("geometries");
-	XMLNodeList * geometriesChildren = geometriesNode->GetChildren();
-	XMLNode * geometryNode = geometriesChildren->GetNode("geometry");
-	XMLNodeList * geometryChildren = geometryNode->GetChildren();
-	XMLNode * textureNamesNode = geometryChildren->GetNode("textureNames");
-	if (textureNamesNode->GetNumChildren() > 0)
-	{
-		XMLNodeList * textureNamesChildren = textureNamesNode->GetChildren();
+		for(a = 0; a < 3; a++) {
+			l[a][0] = l[a][1] = l[a][2] = 0.0;
+			for(b = 0; b < 3; b++) {
+				const Real	*kb = tets.stiffness + 81*k + 9*(3*a+b);
+				const Real	*cb = tets.damping + 81*k + 9*(3*a+b);
+				for(r = 0; r < 3; r++)
+					l[a][r] +=	kb[3*r]*u[b][0] + kb[3*r+1]*u[b][1] + kb[3*r+2]*u[b][2] +
+								cb[3*r]*w[b][0] + cb[3*r+1]*w[b][1] + cb[3*r+2]*w[b][2];
+			}
+		}
 
-		for (int i = 0; i < textureNamesChildren->GetLength(); i++)
-		{
-			XMLNode * textureNameNode = textureNamesChildren->GetNode(i);
-			char * textureName = textureNameNode->GetValue();
-			displayMngr->AddTexture(textureName);
-			delete textureName;
-			delete textureNameNode;
+		// F S, S the domain stress
+		const Matrix<Real>	&Sd = dom->DomStress[tets.element[k]];
+		Real				FS[3][3];
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				FS[r][c] = F[r][0]*Sd[0][c] + F[r][1]*Sd[1][c] + F[r][2]*Sd[2][c];
+
+		Real	*f0 = force[id[0]].begin();
+		Real	v2 = tets.volume[k] * 0.5;
+		for(a = 0; a < 3; a++) {
+			Real	*f = force[id[(a+1)*n]].begin();
+			const Real	ga[3] = { tets.rest_inv[(3*a)*n + k], tets.rest_inv[(3*a+1)*n + k], tets.rest_inv[(3*a+2)*n + k] };
+			for(r = 0; r < 3; r++) {
+				Real	fr = -(R[r][0]*l[a][0] + R[r][1]*l[a][1] + R[r][2]*l[a][2])
+							 - v2 * (FS[r][0]*ga[0] + FS[r][1]*ga[1] + FS[r][2]*ga[2]);
+				f[r]	+= fr;
+				f0[r]	-= fr;
+			}
 		}
-		delete textureNamesChildren;
 	}
-	delete textureNamesNode;
-	delete geometryChildren;
-	delete geometryNode;
-	delete geometriesChildren;
-	delete geometriesNode;
 }
 
 
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::Display()
-//
-//		Displays the FEM mesh
+//	FEM_3LMObject::CorotationalTangents()
 //
+//		Adds R K_ab R^T and R C_ab R^T of slots [begin, end) for all
+//		16 node pairs, with the rotations of the last force
+//		evaluation.  The change of R with the positions is left out.
 //
-void FEM_3LMObject::Display(void)
+void FEM_3LMObject::CorotationalTangents(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C,
+										 unsigned int begin, unsigned int end)
 {
-	// Copy the state into the geometry
-	State2Geom();
+	unsigned int	a, b, r, c, j;
+
+	for(unsigned int k = begin; k < end; k++) {
+		Real	R[3][3], kf[16][9], cf[16][9], t[9];
+
+		// Full 4x4 block pattern from the blocks of nodes 1..3
+		for(j = 0; j < 16*9; j++) kf[j/9][j%9] = cf[j/9][j%9] = 0.0;
+		for(a = 1; a < 4; a++)
+			for(b = 1; b < 4; b++) {
+				const Real	*kb = tets.stiffness + 81*k + 9*(3*(a-1)+(b-1));
+				const Real	*cb = tets.damping + 81*k + 9*(3*(a-1)+(b-1));
+				for(j = 0; j < 9; j++) {
+					kf[4*a+b][j] = kb[j];	kf[4*a][j] -= kb[j];	kf[b][j] -= kb[j];	kf[0][j] += kb[j];
+					cf[4*a+b][j] = cb[j];	cf[4*a][j] -= cb[j];	cf[b][j] -= cb[j];	cf[0][j] += cb[j];
+				}
+			}
 
-	displayMngr->Display();
+		QuaternionToMatrix(R, tets.rotation + 4*k);
+		for(j = 0; j < 16; j++) {
+			Real	*blk[2] = { kf[j], cf[j] };
+			for(unsigned int m = 0; m < 2; m++) {
+				// t = R B, B = t R^T
+				for(r = 0; r < 3; r++)
+					for(c = 0; c < 3; c++)
+						t[3*r+c] = R[r][0]*blk[m][c] + R[r][1]*blk[m][3+c] + R[r][2]*blk[m][6+c];
+				for(r = 0; r < 3; r++)
+					for(c = 0; c < 3; c++)
+						blk[m][3*r+c] = t[3*r]*R[c][0] + t[3*r+1]*R[c][1] + t[3*r+2]*R[c][2];
+			}
+			K.addBlock(element_block[16*k + j], kf[j], 1.0);
+			C.addBlock(element_block[16*k + j], cf[j], 1.0);
+		}
+	}
 }
 
 
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::GetNodePosition()
-//
-//		Returns node position
+//	FEM_3LMObject::InitElementPattern()
 //
+//		Sets A to the block pattern of the elements: one block per
+//		pair of nodes sharing an element.  The block positions of the
+//		element node pairs are found on the first call; every matrix
+//		set up here shares them.
 //
-Vector<Real>		FEM_3LMObject::GetNodePosition(unsigned int index)
+void FEM_3LMObject::InitElementPattern(BlockCRSMatrix<Real> &A)
 {
-	return state.pos[index];
+	const unsigned int	n = tets.num;
+	unsigned int		i, k, a, b;
+
+	unsigned int	*pairs = new unsigned int[12*n];
+	if(pairs == NULL) {
+		error_exit(-1, "Cannot allocate memory for element pattern!\n");
+	}
+	for(k = 0, i = 0; k < n; k++)
+		for(a = 0; a < 4; a++)
+			for(b = a+1; b < 4; b++) {
+				pairs[i++] = tets.node[a*n + k];
+				pairs[i++] = tets.node[b*n + k];
+			}
+	A.initPattern(num_node, 6*n, pairs);
+	delete[] pairs;
+
+	if(element_block == NULL) {
+		element_block = new unsigned int[16*n];
+		if(element_block == NULL) {
+			error_exit(-1, "Cannot allocate memory for element blocks!\n");
+		}
+		for(k = 0; k < n; k++)
+			for(a = 0; a < 4; a++)
+				for(b = 0; b < 4; b++)
+					element_block[16*k + 4*a + b] = A.find(tets.node[a*n + k], tets.node[b*n + k]);
+	}
 }
 
 
 
+typedef struct {
+	FEM_3LMObject			*object;
+	FEM_3LMObject::State	*state;
+	BlockCRSMatrix<Real>	*K;
+	BlockCRSMatrix<Real>	*C;
+	unsigned int			offset;		// First slot of the current colour
+} TangentTaskArg;
+
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::GetNodeVelocity()
-//
-//		Returns node velocity
+//	FEM_3LMObject::AssembleTangent()
 //
+//		K = -df/dx and C = -df/dv of the element forces at state, on
+//		matrices set up by InitElementPattern().  The stress term of
+//		K uses the stresses of the last UpdateForces(), which must
+//		have been called on the same state.  Like UpdateForces(),
+//		the colours are assembled one after the other, each in
+//		parallel.
 //
-Vector<Real>		FEM_3LMObject::GetNodeVelocity(unsigned int index)
+void FEM_3LMObject::AssembleTangent(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C, State &state)
 {
-	return	state.vel[index];
+	TangentTaskArg	arg;
+
+	arg.object	= this;
+	arg.state	= &state;
+	arg.K		= &K;
+	arg.C		= &C;
+
+	K.zero();
+	C.zero();
+	for(unsigned int c = 0; c < tets.num_color; c++) {
+		arg.offset = tets.color_ptr[c];
+		ParallelFor(tets.color_ptr[c+1] - tets.color_ptr[c], ElementTangentTask, &arg, FEM_ELEMENTS_PER_THREAD);
+	}
+}
+
+
+
+void FEM_3LMObject::ElementTangentTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	TangentTaskArg	*a = (TangentTaskArg *) arg;
+
+	if(a->object->element_model == FEM_ELEMENT_COROTATIONAL)
+		a->object->CorotationalTangents(*a->K, *a->C, a->offset + begin, a->offset + end);
+	else
+		a->object->ElementTangents(*a->K, *a->C, *a->state, a->offset + begin, a->offset + end);
 }
 
 
 
 ////////////////////////////////////////////////////////////////
 //
-//	FEM_3LMObject::GetNodeForce()
+//	FEM_3LMObject::ElementTangents()
+//
+//		Adds the tangent blocks of slots [begin, end).  With F the
+//		deformation gradient, S the stress and g_a the shape function
+//		gradients of an element, the stiffness block of nodes a and b
+//		is
+//
+//		K_ab = V/2 (Lambda h_a h_b^T + Mu h_b h_a^T + Mu (g_a.g_b) F F^T
+//					+ (g_a^T S g_b) I),		h_a = F g_a
+//
+//		and the damping block has the same form with Phi and Nu and
+//		no stress term.  The change of the strain velocity with the
+//		positions is left out of K.
+//
+void FEM_3LMObject::ElementTangents(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C, State &state,
+									unsigned int begin, unsigned int end)
+{
+	const unsigned int	n = tets.num;
+	unsigned int		k, a, b, r, c;
+
+	for(k = begin; k < end; k++) {
+		Real	gr[4][3], h[4][3], F[3][3], FFt[3][3], kb[9], cb[9];
+		Real	v2		= tets.volume[k] * 0.5;
+		const Real	*S	= tets.stress + 9*k;
+
+		for(c = 0; c < 3; c++) {
+			gr[0][c] = 0.0;
+			for(a = 1; a < 4; a++) {
+				gr[a][c] = tets.rest_inv[(3*(a-1)+c)*n + k];
+				gr[0][c] -= gr[a][c];
+			}
+		}
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				F[r][c] = 0.0;
+				for(a = 0; a < 4; a++) F[r][c] += state.pos[tets.node[a*n + k]][r] * gr[a][c];
+			}
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++)
+				FFt[r][c] = F[r][0]*F[c][0] + F[r][1]*F[c][1] + F[r][2]*F[c][2];
+		for(a = 0; a < 4; a++)
+			for(r = 0; r < 3; r++)
+				h[a][r] = F[r][0]*gr[a][0] + F[r][1]*gr[a][1] + F[r][2]*gr[a][2];
+
+		for(a = 0; a < 4; a++) {
+			for(b = 0; b < 4; b++) {
+				Real	gg = gr[a][0]*gr[b][0] + gr[a][1]*gr[b][1] + gr[a][2]*gr[b][2];
+				Real	gsg = 0.0;
+				for(r = 0; r < 3; r++)
+					for(c = 0; c < 3; c++) gsg += gr[a][r] * S[3*r + c] * gr[b][c];
+
+				for(r = 0; r < 3; r++)
+					for(c = 0; c < 3; c++) {
+						kb[3*r+c] = v2 * (tets.lambda[k] * h[a][r] * h[b][c] + tets.mu[k] * h[b][r] * h[a][c] +
+										  tets.mu[k] * gg * FFt[r][c] + ((r == c) ? gsg : 0.0));
+						cb[3*r+c] = v2 * (tets.phi[k] * h[a][r] * h[b][c] + tets.nu[k] * h[b][r] * h[a][c] +
+										  tets.nu[k] * gg * FFt[r][c]);
+					}
+				K.addBlock(element_block[16*k + 4*a + b], kb, 1.0);
+				C.addBlock(element_block[16*k + 4*a + b], cb, 1.0);
+			}
+		}
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AllocModal()
+//
+//		Allocates the modal reduction data.  The modes are computed
+//		by the first ModalBegin(), once the boundary conditions are
+//		set.
+//
+void FEM_3LMObject::AllocModal(void)
+{
+	modal		= new ModalBasis();
+	modal_fixed	= new unsigned char[num_node];
+	modal_x0	= new Real[3*num_node];
+	modal_f0	= new Real[3*num_node];
+	modal_q		= modal_qdot = modal_fq = modal_damp = NULL;
+	if(modal == NULL || modal_fixed == NULL || modal_x0 == NULL || modal_f0 == NULL) {
+		error_exit(-1, "Cannot allocate memory for modal reduction!\n");
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::BuildModal()
+//
+//		Linearizes the elastic forces about the given state and
+//		computes the lowest vibration modes.  Dirichlet nodes at this
+//		point stay fixed.
+//
+void FEM_3LMObject::BuildModal(State &state)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+	unsigned int	i, c, k;
+
+	memset(modal_fixed, 0, num_node);
+	for(i = 0; i < bound->num_vertex; i++)
+		if(bound->boundary_type[i] == 1) modal_fixed[bound->global_id[i]] = 1;
+
+	// Forces and element stresses at rest
+	Vector<Real>	*vel = new Vector<Real>[num_node];
+	for(i = 0; i < num_node; i++) {
+		vel[i] = state.vel[i];
+		state.vel[i] = 0.0;
+	}
+	UpdateForces(state);
+	for(i = 0; i < num_node; i++) {
+		for(c = 0; c < 3; c++) {
+			modal_x0[3*i+c] = state.pos[i][c];
+			modal_f0[3*i+c] = force[i][c];
+		}
+		state.vel[i] = vel[i];
+	}
+
+	BlockCRSMatrix<Real>	K, C;
+	InitElementPattern(K);
+	InitElementPattern(C);
+	AssembleTangent(K, C, state);
+
+	logger->Message(GetName(), "Computing vibration modes...", 1);
+	if(!modal->Compute(K, mass.begin(), modal_fixed, FEM_MODAL_MODES))
+		logger->Message(GetName(), "Vibration modes did not fully converge.", 1);
+	if(modal->NumModes() == 0) {
+		error_exit(-1, "Cannot compute the vibration modes of the FEM model!\n");
+	}
+
+	unsigned int	num = modal->NumModes();
+	if(modal_q != NULL) {
+		delete[] modal_q;	delete[] modal_qdot;
+		delete[] modal_fq;	delete[] modal_damp;
+	}
+	modal_q		= new Real[num];
+	modal_qdot	= new Real[num];
+	modal_fq	= new Real[num];
+	modal_damp	= new Real[num];
+	modal->ProjectDiagonal(modal_damp, C);
+
+	// q = 0 at the linearization, qdot = U^T M v
+	for(k = 0; k < num; k++) modal_q[k] = modal_qdot[k] = 0.0;
+	for(i = 0; i < num_node; i++) {
+		if(modal_fixed[i]) continue;
+		Real	mv[3] = { mass[i] * vel[i][0], mass[i] * vel[i][1], mass[i] * vel[i][2] };
+		modal->ProjectNode(modal_qdot, i, mv);
+	}
+	delete[] vel;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ModalBegin()
+//
+//		Builds the modes on the first call and projects the rest
+//		forces and the boundary tractions onto them
+//
+void FEM_3LMObject::ModalBegin(State &state, const Real h)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	if(modal->NumModes() == 0) BuildModal(state);
+
+	modal->Project(modal_fq, modal_f0);
+	for(unsigned int i = 0; i < bound->num_vertex; i++) {
+		unsigned int	id = bound->global_id[i];
+		if(bound->boundary_type[i] == 1 || modal_fixed[id]) continue;
+		modal->ProjectNode(modal_fq, id, bound->boundary_value[i].begin());
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ModalEnd()
+//
+//		Reconstructs the boundary nodes only; Display() and
+//		GetNodePosition() reconstruct the interior on demand
+//
+void FEM_3LMObject::ModalEnd(State &state)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	for(unsigned int i = 0; i < bound->num_vertex; i++) {
+		unsigned int	id = bound->global_id[i];
+		if(bound->boundary_type[i] == 1) {
+			state.pos[id] = bound->boundary_value[i];
+			state.vel[id] = 0.0;
+		}
+		else ModalReconstructNode(id);
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ModalReconstruct()
+//
+//		Reconstructs all nodes from the reduced coordinates
+//
+void FEM_3LMObject::ModalReconstruct(void)
+{
+	for(unsigned int i = 0; i < num_node; i++) ModalReconstructNode(i);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ModalReconstructNode()
+//
+//		x = x0 + U q and v = U qdot for one node
+//
+void FEM_3LMObject::ModalReconstructNode(unsigned int index)
+{
+	Real	u[3], v[3];
+
+	if(modal_fixed[index]) return;
+	modal->ReconstructNode(u, index, modal_q);
+	modal->ReconstructNode(v, index, modal_qdot);
+	for(unsigned int c = 0; c < 3; c++) {
+		state.pos[index][c] = modal_x0[3*index+c] + u[c];
+		state.vel[index][c] = v[c];
+	}
+}
+
+
+
+typedef struct {
+	FEM_3LMObject					*object;
+	const SkylineCholesky<Real>		*factor;
+	const BlockCRSMatrix<Real>		*damping;
+	const unsigned char				*fixed;
+	const unsigned int				*node_slot;	// Some slot at each node
+} HapticTaskArg;
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::BuildHapticModel()
+//
+//		Assembles the small strain stiffness and damping of the
+//		object at rest, factors the stiffness and condenses both to
+//		every boundary vertex, so that a contact never waits for a
+//		solve.  Dirichlet nodes at this point stay fixed and get no
+//		model.  If the stiffness is singular, which is the case when
+//		no node is fixed, the object has no haptic model.
+//
+void FEM_3LMObject::BuildHapticModel(void)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+	const unsigned int	n = tets.num;
+	unsigned int	i, j, k, a, b, l;
+
+	haptic_KC	= new Real[18*bound->num_vertex];
+	haptic_slot	= new unsigned int[bound->num_vertex];
+	unsigned char	*fixed = new unsigned char[num_node];
+	if(haptic_KC == NULL || haptic_slot == NULL || fixed == NULL) {
+		error_exit(-1, "Cannot allocate memory for the haptic model!\n");
+	}
+	memset(fixed, 0, num_node);
+	for(i = 0; i < bound->num_vertex; i++) {
+		if(bound->boundary_type[i] == 1) fixed[bound->global_id[i]] = 1;
+		haptic_slot[i] = FEM_NO_HAPTIC;
+	}
+
+	// Rest blocks of every element, the rows and columns of node 0 from
+	// sum_b K_ab = 0 as in CorotationalTangents()
+	BlockCRSMatrix<Real>	K, C;
+	InitElementPattern(K);
+	InitElementPattern(C);
+	for(k = 0; k < n; k++) {
+		Real	kb[81], cb[81], kf[16][9], cf[16][9];
+
+		RestBlocks(k, kb, cb);
+		for(j = 0; j < 16*9; j++) kf[j/9][j%9] = cf[j/9][j%9] = 0.0;
+		for(a = 1; a < 4; a++)
+			for(b = 1; b < 4; b++)
+				for(j = 0; j < 9; j++) {
+					Real	kv = kb[9*(3*(a-1)+(b-1)) + j], cv = cb[9*(3*(a-1)+(b-1)) + j];
+					kf[4*a+b][j] = kv;	kf[4*a][j] -= kv;	kf[b][j] -= kv;	kf[0][j] += kv;
+					cf[4*a+b][j] = cv;	cf[4*a][j] -= cv;	cf[b][j] -= cv;	cf[0][j] += cv;
+				}
+		for(j = 0; j < 16; j++) {
+			K.addBlock(element_block[16*k + j], kf[j], 1.0);
+			C.addBlock(element_block[16*k + j], cf[j], 1.0);
+		}
+	}
+
+	// Scalar envelope of K, see ModalBasis::Compute()
+	SkylineCholesky<Real>	factor;
+	unsigned int	*pairs = new unsigned int[6*num_node];
+	for(i = 0; i < num_node; i++) {
+		unsigned int	c = K.col(K.rowBegin(i));
+		for(l = 0; l < 3; l++) {
+			pairs[2*(3*i+l)]	= 3*i + l;
+			pairs[2*(3*i+l)+1]	= 3*c;
+		}
+	}
+	factor.initPattern(3*num_node, 3*num_node, pairs);
+	delete[] pairs;
+
+	for(i = 0; i < num_node; i++) {
+		if(fixed[i]) {
+			for(l = 0; l < 3; l++) factor.add(3*i+l, 3*i+l, 1.0);
+			continue;
+		}
+		for(k = K.rowBegin(i); k < K.rowEnd(i); k++) {
+			j = K.col(k);
+			if(j > i || fixed[j]) continue;
+			const Real	*blk = K.block(k);
+			for(a = 0; a < 3; a++)
+				for(b = 0; b < 3; b++)
+					if(3*j+b <= 3*i+a) factor.add(3*i+a, 3*j+b, blk[3*a+b]);
+		}
+	}
+
+	logger->Message(GetName(), "Factoring the haptic stiffness...", 1);
+	if(!factor.factor()) {
+		logger->Message(GetName(), "The haptic stiffness is singular, no haptic model.", 1);
+		delete[] fixed;
+		return;
+	}
+
+	// Any element at a node carries its rotation
+	unsigned int	*node_slot = new unsigned int[num_node];
+	for(i = 0; i < num_node; i++) node_slot[i] = FEM_NO_HAPTIC;
+	for(k = 0; k < n; k++)
+		for(l = 0; l < 4; l++) node_slot[tets.node[l*n + k]] = k;
+
+	HapticTaskArg	arg = { this, &factor, &C, fixed, node_slot };
+	ParallelFor(bound->num_vertex, HapticModelTask, &arg, 16);
+
+	delete[] node_slot;
+	delete[] fixed;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::HapticModelTask()
+//
+//		ParallelFor task: condenses the rest stiffness and damping
+//		to boundary vertices [begin, end), see condenseNode()
+//
+void FEM_3LMObject::HapticModelTask(void *arg, unsigned int begin, unsigned int end, unsigned int /*thread*/)
+{
+	HapticTaskArg	*a = (HapticTaskArg *) arg;
+	FEM_3LMObject	*obj = a->object;
+	FEMBoundary		*bound = (FEMBoundary *) obj->boundary;
+	unsigned int	i;
+
+	Real	*X = new Real[9*obj->num_node];
+	if(X == NULL) {
+		error_exit(-1, "Cannot allocate memory for the haptic model!\n");
+	}
+
+	for(i = begin; i < end; i++) {
+		unsigned int	node = bound->global_id[i];
+
+		if(a->fixed[node]) continue;
+		if(condenseNode(obj->haptic_KC + 18*i, obj->haptic_KC + 18*i + 9, *a->factor, *a->damping, node, X))
+			obj->haptic_slot[i] = a->node_slot[node];
+	}
+
+	delete[] X;
+}
+
+
+
+/**
+ *	FEM_3LMObject::ReturnHapticModel()
+ *	Returns a haptic model of the object condensed to the contact node.
+ *	The force at the node responds to its displacement and velocity
+ *	through D alone, the condensed stiffness and damping of
+ *	BuildHapticModel(), which are computed for every boundary vertex at
+ *	load.  The model is sized for six states like the QSDS model, since
+ *	a model without states is taken for the null model of the probe,
+ *	but A, B and C are left zero, so the states stay at rest.  A call
+ *	only reads the current force at the node and, for corotational
+ *	elements, turns the response with the rotation of an element at the
+ *	node.  Model is filled in place, see ReserveHapticModel().
+ */
+int FEM_3LMObject::ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderLinearHapticModel &Model)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+	unsigned int	r, c;
+
+	if(BoundaryNodeIndex >= bound->num_vertex) return -1;
+	if(haptic_slot == NULL || haptic_slot[BoundaryNodeIndex] == FEM_NO_HAPTIC) return -1;
+	unsigned int	node = bound->global_id[BoundaryNodeIndex];
+
+	const Real	*haptic_K = haptic_KC + 18*BoundaryNodeIndex;
+	const Real	*haptic_C = haptic_K + 9;
+	Real		K[9], C[9];
+	if(element_model == FEM_ELEMENT_COROTATIONAL) {
+		Real	R[3][3], tk[9], tc[9];
+
+		// R K R^T and R C R^T
+		QuaternionToMatrix(R, tets.rotation + 4*haptic_slot[BoundaryNodeIndex]);
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				tk[3*r+c] = R[r][0]*haptic_K[c] + R[r][1]*haptic_K[3+c] + R[r][2]*haptic_K[6+c];
+				tc[3*r+c] = R[r][0]*haptic_C[c] + R[r][1]*haptic_C[3+c] + R[r][2]*haptic_C[6+c];
+			}
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				K[3*r+c] = tk[3*r]*R[c][0] + tk[3*r+1]*R[c][1] + tk[3*r+2]*R[c][2];
+				C[3*r+c] = tc[3*r]*R[c][0] + tc[3*r+1]*R[c][1] + tc[3*r+2]*R[c][2];
+			}
+	}
+	else {
+		for(c = 0; c < 9; c++) {
+			K[c] = haptic_K[c];
+			C[c] = haptic_C[c];
+		}
+	}
+
+	// calculate the Low Order Linear Haptic Model, six idle states
+	unsigned int n = 6;
+	unsigned int m = 6;
+	unsigned int k = 3;
+
+	ReserveHapticModel(Model, n, m, k);
+
+	// f_0 is the force of the last step, D holds -C for the velocity
+	// and -K for the displacement of the node
+	Real	*f_0 = Model.f_0->begin();
+	for(r = 0; r < 3; r++) {
+		Real	*d = (*(Model.D))[r];
+		f_0[r] = force[node][r];
+		for(c = 0; c < 3; c++) {
+			d[c]	= -C[3*r+c];
+			d[3+c]	= -K[3*r+c];
+		}
+	}
+
+	return 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AccumState()
+//
+//		Computes x(t+h) = x(t) + h * f(..)
+//
+//		where	x(t+h)	= new_state
+//				x(t)	= state
+//				f(..)	= deriv
+//
+inline void FEM_3LMObject::AccumState(State &new_state, const State &state, const State &deriv, const Real &h)
+{
+	unsigned int i;
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	// NOTE: The below is a good point to measure the overhead caused by binary operators
+	for(i = 0; i < state.size; i++) {
+		new_state.pos[i] = state.pos[i] + deriv.pos[i] * h;
+		new_state.vel[i] = state.vel[i] + deriv.vel[i] * h;
+	}
+	for(i = 0; i < bound->num_vertex; i++) {
+		switch (bound->boundary_type[i]) {
+			case (0):   // Neumann type boundary condition   (Specify traction)
+				break;
+			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
+					    // Position specified in boundary_value
+				new_state.pos[bound->global_id[i]]=bound->boundary_value[i];
+				break;
+			case (2):  // Mixed boundary condition type i: 
+					   // Normal displacement (not position) specified in boundary_value2_scalar
+					   //        with normal direction specified in boundary_value2_vector
+					   //   and tangential traction specified in boundary_value
+				new_state.pos[bound->global_id[i]]+=bound->boundary_value2_scalar[i] * bound->boundary_value2_vector[i];
+				break;
+			default:
+				error_exit(0,"Unrecognized boundary condition type\n");
+		}
+	}
+
+}
+
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::DerivState()
+//
+//		Computes the derivatives of state variables. This is simply 
+//		the f() evaluation where f() = dx/dt.
+//
+//
+inline void FEM_3LMObject::DerivState(State &deriv, State &state)
+{
+	unsigned int i;
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	UpdateForces(state);
+
+	for(i = 0; i < state.size; i++) {
+		// dpos/dt = vel
+		deriv.pos[i] = state.vel[i];
+
+		// dvel/dt = force/m
+		deriv.vel[i] = force[i];
+		deriv.vel[i] /= mass[i];
+	}
+	for(i = 0; i < bound->num_vertex; i++) {
+		switch (bound->boundary_type[i]) {
+			case (0):   // Neumann type boundary condition   (Specify traction)
+				deriv.vel[bound->global_id[i]] += bound->boundary_value[i]*(1.0/mass[bound->global_id[i]]);
+				break;
+			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
+					    // Position specified in boundary_value
+				deriv.vel[bound->global_id[i]] = 0.0;
+				deriv.pos[bound->global_id[i]] = 0.0;
+				break;
+			case (2):  // Mixed boundary condition type i: 
+					   // Normal displacement (not position) specified in boundary_value2_scalar
+					   //        with normal direction specified in boundary_value2_vector
+					   //   and tangential traction specified in boundary_value
+				deriv.vel[bound->global_id[i]] += bound->boundary_value[i]*(1.0/mass[bound->global_id[i]]);
+				deriv.vel[bound->global_id[i]] -= bound->boundary_value2_vector[i] * (deriv.vel[bound->global_id[i]] * bound->boundary_value2_vector[i]);
+				deriv.pos[bound->global_id[i]] -= bound->boundary_value2_vector[i] * (deriv.pos[bound->global_id[i]] * bound->boundary_value2_vector[i]);
+				break;
+			default:
+				error_exit(0,"Unrecognized boundary condition type\n");
+		}
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AllocState()
+//
+//		Allocates the memory for the integrator's local state 
+//		members.  The nodes refer into one contiguous vector each
+//		for the positions and the velocities, so that the implicit
+//		integrators can work on whole states.
+//
+inline void FEM_3LMObject::AllocState(State &s)
+{
+	unsigned int	i;
+
+	s.POS = new Vector<Real>(3*state.size, 0.0);
+	s.pos = new Vector<Real>[state.size];
+	if(s.POS == NULL || s.pos == NULL) {
+		error_exit(-1, "Cannot allocate memory for positions!\n");
+	}
+	for(i = 0; i<state.size; i++)	s.pos[i].remap(3, &((*s.POS)[3*i]));
+
+	s.VEL = new Vector<Real>(3*state.size, 0.0);
+	s.vel = new Vector<Real>[state.size];
+	if(s.VEL == NULL || s.vel == NULL) {
+		error_exit(-1, "Cannot allocate memory for velocity!\n");
+	}
+	for(i = 0; i<state.size; i++)	s.vel[i].remap(3, &((*s.VEL)[3*i]));
+
+	s.size = state.size;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AllocJacobian()
+//
+//		Allocates the Jacobian of the implicit integrators.  The
+//		pattern is fixed by the elements, IdentityMinushJacobian()
+//		only refills the values.
+//
+void FEM_3LMObject::AllocJacobian(Jacobian &J)
+{
+	J.A11 = new BlockCRSMatrix<Real>();
+	J.A12 = new BlockCRSMatrix<Real>();
+	if(J.A11 == NULL || J.A12 == NULL) {
+		error_exit(-1, "Cannot allocate memory for jacobian!\n");
+	}
+	InitElementPattern(*J.A11);
+	InitElementPattern(*J.A12);
+
+	J.size = state.size;
+	J.dA21 = 0;
+	J.dA22 = 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AddState()
+//
+//		new_state = state1 + h * state2
+//
+void FEM_3LMObject::AddState(State &new_state, const State &state1, const State &state2, const Real h)
+{
+	(*new_state.VEL) = (*state1.VEL) + h*(*state2.VEL);
+	(*new_state.POS) = (*state1.POS) + h*(*state2.POS);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ScaleState()
+//
+//		new_state = h * state
+//
+void FEM_3LMObject::ScaleState(State &new_state, const State &state, const Real h)
+{
+	(*new_state.VEL) = h*(*state.VEL);
+	(*new_state.POS) = h*(*state.POS);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::NormState()
+//
+Real FEM_3LMObject::NormState(const State &state)
+{
+	return sqrt((*state.POS).length_sq() + (*state.VEL).length_sq());
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::StateDotState()
+//
+Real FEM_3LMObject::StateDotState(const State &state1, const State &state2)
+{
+	return ((*state1.POS)*(*state2.POS) + (*state1.VEL)*(*state2.VEL));
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::MultiplyJacobianState()
+//
+//		out_state = J * state
+//
+void FEM_3LMObject::MultiplyJacobianState(State &out_state, const Jacobian &J, const State &state)
+{
+	ASSERT(J.size == state.size);
+	multMV((*out_state.VEL), (*J.A11), (*state.VEL));
+	multAddMV((*out_state.VEL), (*J.A12), (*state.POS));
+	(*out_state.POS) = (J.dA21)*(*state.VEL) + (J.dA22)*(*state.POS);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::IdentityMinushJacobian()
+//
+//		Computes I - h J for the state (vel, pos):
+//
+//		| I + h/m C |  h/m K  |
+//		|-----------|---------|
+//		|   -h I    |    I    |
+//
+//		The stresses of the tangent are those of the last force
+//		evaluation; the implicit integrators call DerivState() on
+//		the same state right before.  The rows of the Dirichlet
+//		nodes are replaced by the identity.
+//
+void FEM_3LMObject::IdentityMinushJacobian(Jacobian &J, State &state, const Real h)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+	unsigned int	i;
+
+	AssembleTangent(*J.A12, *J.A11, state);
+
+	for(i = 0; i < J.A11->mb(); i++) {
+		Real	h_m = h / mass[i];
+		J.A11->scaleRow(i, h_m);
+		J.A12->scaleRow(i, h_m);
+
+		Real	*d = J.A11->diag(i);
+		d[0] += 1.0;
+		d[4] += 1.0;
+		d[8] += 1.0;
+	}
+
+	J.dA21 = -h;
+	J.dA22 = 1.0;
+
+	for(i = 0; i < bound->num_vertex; i++) {
+		if(bound->boundary_type[i] == 1) {
+			J.A11->setRowIdentity(bound->global_id[i]);
+			J.A12->setRowIdentity(bound->global_id[i]);
+		}
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::AllocMultigrid()
+//
+//		Allocates the multigrid solver of ImplicitEulerMG with the
+//		cycle and smoother of multigrid_param.  The hierarchy is
+//		built by the first MultigridSolve().  The solver of an
+//		earlier call is freed first.
+//
+void FEM_3LMObject::AllocMultigrid(void)
+{
+	FreeMultigrid();
+
+	multigrid		= new ImplicitMultigrid();
+	multigrid_fixed	= new unsigned char[num_node];
+	if(multigrid == NULL || multigrid_fixed == NULL) {
+		error_exit(-1, "Cannot allocate memory for multigrid!\n");
+	}
+	multigrid->Hierarchy().SetParameters(multigrid_param);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::FreeMultigrid()
+//
+//		Frees the multigrid solver, if any.
+//
+void FEM_3LMObject::FreeMultigrid(void)
+{
+	if(multigrid != NULL) {
+		delete multigrid;
+		delete [] multigrid_fixed;
+		multigrid		= NULL;
+		multigrid_fixed	= NULL;
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::MultigridSolve()
+//
+//		Solves J x = b for the Jacobian of IdentityMinushJacobian()
+//		with the velocity system M + h C + h^2 K, see
+//		ImplicitMultigrid.  tol is relative to |b| of that system.
+//
+unsigned int FEM_3LMObject::MultigridSolve(State &x, const Jacobian &J, const State &b, Real tol, unsigned int max_iter)
+{
+	FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	memset(multigrid_fixed, 0, num_node);
+	for(unsigned int i = 0; i < bound->num_vertex; i++) {
+		if(bound->boundary_type[i] == 1) multigrid_fixed[bound->global_id[i]] = 1;
+	}
+
+	return multigrid->Solve(x.VEL->begin(), x.POS->begin(), *J.A11, *J.A12, J.dA21, J.dA22,
+							b.VEL->begin(), b.POS->begin(), mass.begin(), multigrid_fixed, tol, max_iter);
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::Simulate()
+//
+//		Simulates the FEM_3LM object by a single timestep
+//
+//
+void FEM_3LMObject::Simulate(void)
+{
+	integrator->Integrate(*this, timestep);
+	time+=timestep;
+
+	//We alse need to update the Boundary from states 
+	//   so that we will have the correct Boundary definition for boundary calculations
+	State2Bound();
+
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::Geom2State()
+//
+//		Copies geometry to state
+//
+//
+void FEM_3LMObject::Geom2State(void)
+{
+	static TetVolume *geom = (TetVolume *) geometry;
+
+	for(unsigned int i=0; i < geom->num_vertex; i++) {
+		state.pos[i] = geom->vertex[i].pos;
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::State2Geom()
+//
+//		Copies state to geometry
+//
+//
+inline void FEM_3LMObject::State2Geom(void)
+{
+	static TetVolume *geom = (TetVolume *) geometry;
+
+	for(unsigned int i=0; i<geom->num_vertex; i++) {
+		geom->vertex[i].pos = state.pos[i];
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::State2Bound()
+//
+//		Copies state to boundary
+//
+//
+inline void FEM_3LMObject::State2Bound(void)
+{
+	static FEMBoundary		*bound = (FEMBoundary *) boundary;
+
+	for(unsigned int i=0; i<bound->num_vertex; i++) {
+		bound->vertex[i].pos = state.pos[bound->global_id[i]];
+	}
+	bound->calcNormals();
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::ResetInitialBoundaryCondition()
+//
+//		Reset boundary condition to initial values.
+//
+//
+inline void FEM_3LMObject::ResetInitialBoundaryCondition(void)
+{
+}
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::SetupDisplay()
+//
+//		Sets up the display of the FEM mesh
+//
+//
+void FEM_3LMObject::SetupDisplay(XMLNodeList * simObjectChildren)
+{
+	DisplayHeader	header;
+
+	header.objType				= GIPSI_DRAW_TRIANGLE;
+	header.polyMode				= GIPSI_POLYGON_FILL;
+	header.shadeMode			= GIPSI_SHADE_FLAT;
+	header.dataType				= 0x06;
+
+	displayMngr = new TetVolumeDisplayManager((TetVolume *) geometry, &header);
+	// Use this if you want to display the boundary surface instead of the tet volume
+    //displayMngr = new TriSurfaceDisplayManager((TriSurface *) boundary, header);
+	displayMngr->SetObjectName(GetName());
+
+	// Load texture names for each DisplayManager
+	XMLNode * geometriesNode = simObjectChildren->GetNode("geometries");
+	XMLNodeList * geometriesChildren = geometriesNode->GetChildren();
+	XMLNode * geometryNode = geometriesChildren->GetNode("geometry");
+	XMLNodeList * geometryChildren = geometryNode->GetChildren();
+	XMLNode * textureNamesNode = geometryChildren->GetNode("textureNames");
+	if (textureNamesNode->GetNumChildren() > 0)
+	{
+		XMLNodeList * textureNamesChildren = textureNamesNode->GetChildren();
+
+		for (int i = 0; i < textureNamesChildren->GetLength(); i++)
+		{
+			XMLNode * textureNameNode = textureNamesChildren->GetNode(i);
+			char * textureName = textureNameNode->GetValue();
+			displayMngr->AddTexture(textureName);
+			delete textureName;
+			delete textureNameNode;
+		}
+		delete textureNamesChildren;
+	}
+	delete textureNamesNode;
+	delete geometryChildren;
+	delete geometryNode;
+	delete geometriesChildren;
+	delete geometriesNode;
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::Display()
+//
+//		Displays the FEM mesh
+//
+//
+void FEM_3LMObject::Display(void)
+{
+	// The modal integrator only keeps the boundary nodes current
+	if(modal != NULL && modal->NumModes() > 0) ModalReconstruct();
+
+	// Copy the state into the geometry
+	State2Geom();
+
+	displayMngr->Display();
+}
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::GetNodePosition()
+//
+//		Returns node position
+//
+//
+Vector<Real>		FEM_3LMObject::GetNodePosition(unsigned int index)
+{
+	if(modal != NULL && modal->NumModes() > 0) ModalReconstructNode(index);
+	return state.pos[index];
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::GetNodeVelocity()
+//
+//		Returns node velocity
+//
+//
+Vector<Real>		FEM_3LMObject::GetNodeVelocity(unsigned int index)
+{
+	if(modal != NULL && modal->NumModes() > 0) ModalReconstructNode(index);
+	return	state.vel[index];
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::GetNodeForce()
 //
 //		Returns the nodal force
 //         
@@ -971,6 +2296,36 @@ Vector<Real>		FEM_3LMObject::GetNodeForce(unsigned int index)
 
 
 
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::NodePosition()
+//
+//		Returns node position without a copy
+//
+//
+const Real		*FEM_3LMObject::NodePosition(unsigned int index)
+{
+	if(modal != NULL && modal->NumModes() > 0) ModalReconstructNode(index);
+	return state.pos[index].begin();
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	FEM_3LMObject::NodeVelocity()
+//
+//		Returns node velocity without a copy
+//
+//
+const Real		*FEM_3LMObject::NodeVelocity(unsigned int index)
+{
+	if(modal != NULL && modal->NumModes() > 0) ModalReconstructNode(index);
+	return state.vel[index].begin();
+}
+
+
+
 ////////////////////////////////////////////////////////////////
 //
 //	FEM_3LMObject::SetMaterial
@@ -986,6 +2341,13 @@ void		FEM_3LMObject::SetMaterial(unsigned int element_index, Real Rho, Real Mu,
 	elements[element_index].Nu			=	Nu;
 	elements[element_index].Phi			=	Phi;
 
+	unsigned int	k = tets.slot[element_index];
+	tets.mu[k]							=	Mu;
+	tets.lambda[k]						=	Lambda;
+	tets.nu[k]							=	Nu;
+	tets.phi[k]							=	Phi;
+	if(tets.stiffness != NULL) CorotationalRest(k);
+
 	// NOTE:	This function does not update the mass. You need to call updateMass()
 	//			after you are done setting materials of elements.
 }
@@ -998,6 +2360,12 @@ void		FEM_3LMObject::SetMaterial(Real *Rho, Real *Mu, Real *Lambda, Real *Nu, Re
 		elements[index].Lambda		=	Lambda[index];
 		elements[index].Nu			=	Nu[index];
 		elements[index].Phi			=	Phi[index];
+
+		tets.mu[tets.slot[index]]		=	Mu[index];
+		tets.lambda[tets.slot[index]]	=	Lambda[index];
+		tets.nu[tets.slot[index]]		=	Nu[index];
+		tets.phi[tets.slot[index]]		=	Phi[index];
+		if(tets.stiffness != NULL) CorotationalRest(tets.slot[index]);
 	}
 
 	updateMass();
@@ -1012,6 +2380,12 @@ void		FEM_3LMObject::SetMaterial(Real Rho, Real Mu, Real Lambda, Real Nu, Real P
 		elements[index].Lambda		=	Lambda;
 		elements[index].Nu			=	Nu;
 		elements[index].Phi			=	Phi;
+
+		tets.mu[tets.slot[index]]		=	Mu;
+		tets.lambda[tets.slot[index]]	=	Lambda;
+		tets.nu[tets.slot[index]]		=	Nu;
+		tets.phi[tets.slot[index]]		=	Phi;
+		if(tets.stiffness != NULL) CorotationalRest(tets.slot[index]);
 	}
 
 	updateMass();
@@ -1141,7 +2515,7 @@ void			FEMBoundary::GetVelocity	(Vector<Real> *Bvel)
 //
 Vector<Real>	FEMBoundary::GetReactionForce	(unsigned int index)
 {
-	Vector<Real>	ResForce;
+	Vector<Real>	ResForce(3,0.0);
 
 	switch (boundary_type[index]) {
 		case (0):   // Neumann type boundary condition   (Specify traction)
@@ -1173,6 +2547,64 @@ void			FEMBoundary::GetReactionForce	(Vector<Real> *Bforce)
 
 
 
+////////////////////////////////////////////////////////////////
+//
+//	FEMBoundary::GetPositions
+//
+//		Get Positions, Velocities and Reaction forces of the listed
+//		nodes of the boundary, 3 Reals per node
+//
+void			FEMBoundary::GetPositions(unsigned int n, const unsigned int *index, Real *Bpos)
+{
+	FEM_3LMObject	*obj = (FEM_3LMObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bpos+=3) {
+		const Real	*p = obj->NodePosition(global_id[index[i]]);
+		Bpos[0]=p[0];	Bpos[1]=p[1];	Bpos[2]=p[2];
+	}
+}
+
+void			FEMBoundary::GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel)
+{
+	FEM_3LMObject	*obj = (FEM_3LMObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bvel+=3) {
+		const Real	*v = obj->NodeVelocity(global_id[index[i]]);
+		Bvel[0]=v[0];	Bvel[1]=v[1];	Bvel[2]=v[2];
+	}
+}
+
+void			FEMBoundary::GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce)
+{
+	FEM_3LMObject	*obj = (FEM_3LMObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bforce+=3) {
+		unsigned int	k = index[i];
+		const Real		*f, *d;
+		Real			fd;
+
+		switch (boundary_type[k]) {
+			case (0):   // Neumann type boundary condition   (Specify traction)
+				Bforce[0]=Bforce[1]=Bforce[2]=0.0;
+				break;
+			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
+				f = obj->NodeForce(global_id[k]);
+				Bforce[0]=f[0];	Bforce[1]=f[1];	Bforce[2]=f[2];
+				break;
+			case (2):	// Mixed boundary condition type i: normal component of the force
+				f = obj->NodeForce(global_id[k]);
+				d = boundary_value2_vector[k].begin();
+				fd = f[0]*d[0] + f[1]*d[1] + f[2]*d[2];
+				Bforce[0]=d[0]*fd;	Bforce[1]=d[1]*fd;	Bforce[2]=d[2]*fd;
+				break;
+			default:
+				error_exit(0,"Unrecognized boundary condition type\n");
+		}
+	}
+}
+
+
+
 
 ////////////////////////////////////////////////////////////////
 //
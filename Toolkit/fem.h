@@ -30,6 +30,8 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include "GiPSiAPI.h"
 #include "GiPSiCompToolset.h"
 #include "XMLNode.h"
+#include "modal_basis.h"
+#include "multigrid.h"
 
 using namespace GiPSiXMLWrapper;
 
@@ -113,16 +115,65 @@ public:
 
 
 
+// Rest state of a set of tetrahedra in structure-of-arrays form.  Component
+// j of slot k is stored at [j*num + k], so a batch of consecutive slots
+// reads each component contiguously.  The slots are ordered by colour: no
+// two elements of a colour share a node, so a colour can be assembled in
+// parallel without write conflicts.
+typedef struct {
+	unsigned int	*element;	// Element index of each slot
+	unsigned int	*slot;		// Slot of each element
+	unsigned int	*color_ptr;	// Start slot of each colour, num_color+1 entries
+	unsigned int	num_color;	// Number of colours
+	unsigned int	*node;		// Node ids, 4 per element
+	Real			*rest_inv;	// Inverse rest shape matrix Dm^-1, 9 per element (row-major);
+								//   row c is the gradient of shape function c+1
+	Real			*volume;	// Rest volume
+	Real			*mu;		// Material parameters, copied from the elements
+	Real			*lambda;	//   by SetMaterial()
+	Real			*nu;
+	Real			*phi;
+	Real			*stress;	// Stress of the last force evaluation, 9 per slot
+	// Corotational element only, NULL otherwise.  Stored per slot:
+	Real			*rest_edge;	// Rest edges X_c - X_0 as the columns of Dm, 9 (row-major)
+	Real			*stiffness;	// Rest stiffness blocks K_ab of nodes 1..3, 81: block
+								//   (a-1,b-1) at [9*(3*(a-1)+(b-1))], row-major
+	Real			*damping;	// Rest damping blocks C_ab, same layout
+	Real			*rotation;	// Rotation of the last force evaluation, quaternion (w,x,y,z)
+	unsigned int	num;		// Number of elements
+} TetArray;
+
+// Element models of FEM_3LMObject
+#define		FEM_ELEMENT_NONLINEAR		0	// St. Venant-Kirchhoff, strain recomputed every step
+#define		FEM_ELEMENT_COROTATIONAL	1	// Linear element in the rotated frame of each element
+
+// Slot of a boundary vertex without a haptic model
+#define		FEM_NO_HAPTIC				0xffffffff
+
+
 // Base class for 3D Linear Material FEM Object
 class FEM_3LMObject: public DeformableSolidObject {
 public:
 	// State info for the FEM_3LM
 	typedef struct {
+		Vector<Real>	*POS;		// positions, 3*size, pos[i] refers into it
+		Vector<Real>	*VEL;		// velocities, 3*size, vel[i] refers into it
 		Vector<Real>	*pos;		// position of nodes		[m]
 		Vector<Real>	*vel;		// velocity of nodes		[m/s]
 		unsigned int	size;
 	} State;
 
+	// Jacobian of the implicit integrators, in the form of MSDObject's:
+	// A11 = I + h/m C and A12 = h/m K with K and C the tangent stiffness
+	// and damping of the elements, A21 = -h I and A22 = I
+	typedef struct {
+		BlockCRSMatrix<Real>	*A11;	// 3*size x 3*size, 3x3 blocks following the elements
+		BlockCRSMatrix<Real>	*A12;	// same pattern as A11
+		Real					dA21;
+		Real					dA22;
+		unsigned int			size;	// Jacobian size (=state size)
+	} Jacobian;
+
 	FEM_3LMObject(	XMLNode * simObjectNode,
 					Real in_g		= 10.0, 
 					Real mass		= 1.0);
@@ -139,10 +190,24 @@ public:
 	void			AllocState(State &s);
 	void			Simulate(void);
 
+	// Implicit integrator interface
+	void			AllocJacobian(Jacobian &J);
+	void			AddState(State &new_state, const State &state1, const State &state2, const Real h);
+	void			ScaleState(State &new_state, const State &state, const Real h);
+	Real			NormState(const State &state);
+	Real			StateDotState(const State &state1, const State &state2);
+	void			MultiplyJacobianState(State &out_state, const Jacobian &J, const State &state);
+	void			IdentityMinushJacobian(Jacobian &J, State &state, const Real h);
+	unsigned int	MultigridSolve(State &x, const Jacobian &J, const State &b, Real tol, unsigned int max_iter);
+
 	// Get and Set interfaces for the Boundary and the Domain
 	Vector<Real>	GetNodePosition(unsigned int index);
 	Vector<Real>	GetNodeVelocity(unsigned int index);
 	Vector<Real>	GetNodeForce(unsigned int index);
+	// Raw views of the node state for bulk boundary access, 3 Reals each
+	const Real		*NodePosition(unsigned int index);
+	const Real		*NodeVelocity(unsigned int index);
+	const Real		*NodeForce(unsigned int index)	{ return force[index].begin(); }
 	void			SetMaterial(unsigned int element_index, Real Rho, Real Mu, Real Lambda, Real Nu, Real Phi);
 	void			SetMaterial(Real *Rho, Real *Mu, Real *Lambda, Real *Nu, Real *Phi);
 	void			SetMaterial(Real Rho, Real Mu, Real Lambda, Real Nu, Real Phi);
@@ -160,8 +225,19 @@ public:
 
 	State&			GetState(void)	{	return	state; }
 
+	// Modal reduction interface, see ModalIntegrator
+	void			ModalBegin(State &state, const Real h);
+	unsigned int	ModalCount(void)				{ return modal->NumModes(); }
+	Real			*ModalCoord(void)				{ return modal_q; }
+	Real			*ModalVelocity(void)			{ return modal_qdot; }
+	const Real		*ModalForce(void)				{ return modal_fq; }
+	Real			ModalStiffness(unsigned int k)	{ return modal->Eigenvalue(k); }
+	Real			ModalDamping(unsigned int k)	{ return modal_damp[k]; }
+	void			ModalEnd(State &state);
+	void			ModalReconstruct(void);			// All nodes from the reduced coordinates
+
 	// Haptics API
-	int					ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderLinearHapticModel &Model) {return 0; }
+	int					ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderLinearHapticModel &Model);
 	int					ReturnHapticModel(unsigned int BoundaryFaceIndex, Vector<Real> BarycentricCoord,
 											Vector<Real> position, GiPSiLowOrderLinearHapticModel &Model)  {return 0; }
 	// from Paul Model...
@@ -182,9 +258,34 @@ protected:
 	unsigned int				num_node;
     unsigned int				num_element;
     Tetrahedra3DFEMElement		*elements;
+	TetArray					tets;			// Precomputed element data for the force loop
+	int							element_model;	// FEM_ELEMENT_*, set by the Element parameter
+	unsigned int				*element_block;	// Tangent block of each node pair (a,b) of a slot,
+												//   16 per slot, shared by all matrices of
+												//   InitElementPattern()
 
 	Integrator<FEM_3LMObject>	*integrator;
 
+	// Modal reduction, allocated when numericMethod is "Modal"
+	ModalBasis					*modal;			// Modes of the model linearized at modal_x0
+	unsigned char				*modal_fixed;	// Dirichlet nodes the modes were computed with
+	Real						*modal_x0;		// Positions of the linearization, 3*num_node
+	Real						*modal_f0;		// Force at modal_x0 at rest (domain stress)
+	Real						*modal_q;		// Reduced coordinates, u = U q
+	Real						*modal_qdot;	// Reduced velocities
+	Real						*modal_fq;		// Reduced force of the current step
+	Real						*modal_damp;	// Modal damping u_k^T C u_k
+
+	// Multigrid solver, allocated when numericMethod is "ImEulerMG"
+	ImplicitMultigrid			*multigrid;		// Hierarchy of the velocity system
+	unsigned char				*multigrid_fixed;	// Dirichlet nodes of the current step
+	MultigridParameters			multigrid_param;	// Cycle and smoother, "multigrid" of NHParameters
+
+	// Haptic model, condensed to every boundary vertex at load
+	Real						*haptic_KC;		// Stiffness and damping at rest, 18 per boundary vertex
+	unsigned int				*haptic_slot;	// A slot at each boundary vertex, rotates its
+												//   response, FEM_NO_HAPTIC if it has no model
+
 	const Real					g;				// Local copy of the gravity			[m/s2]
 	Real						defaultMass;	// The default mass value of the mesh	[g]
 
@@ -194,6 +295,37 @@ protected:
 	// Initialization and allocation of internal variables
 	//   invoked from Load() method
 	void			init(unsigned int num_node, unsigned int num_element); 
+
+	// Element force kernel on batches of consecutive slots in [begin, end)
+	void			PrecomputeElements(void);
+	void			ColorElements(unsigned int *color);
+	void			ElementForces(State &state, unsigned int begin, unsigned int end);
+	static void		ElementForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
+	// Corotational element
+	void			PrecomputeCorotational(void);
+	void			CorotationalRest(unsigned int k);
+	void			RestBlocks(unsigned int k, Real *kb, Real *cb);
+	void			CorotationalForces(State &state, unsigned int begin, unsigned int end);
+	void			CorotationalTangents(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C,
+										 unsigned int begin, unsigned int end);
+
+	// Tangent stiffness K = -df/dx and damping C = -df/dv
+	void			InitElementPattern(BlockCRSMatrix<Real> &A);
+	void			AssembleTangent(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C, State &state);
+	void			ElementTangents(BlockCRSMatrix<Real> &K, BlockCRSMatrix<Real> &C, State &state,
+									unsigned int begin, unsigned int end);
+	static void		ElementTangentTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
+	void			AllocModal(void);
+	void			BuildModal(State &state);
+	void			ModalReconstructNode(unsigned int index);
+
+	void			AllocMultigrid(void);
+	void			FreeMultigrid(void);
+
+	void			BuildHapticModel(void);
+	static void		HapticModelTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
     
 	friend LoaderUnitTest;
 };
@@ -213,6 +345,9 @@ public:
 	void				GetVelocity(Vector<Real> *Bvel);	
 	Vector<Real>		GetReactionForce(unsigned int index);
 	void				GetReactionForce(Vector<Real> *Bforce);	
+	void				GetPositions(unsigned int n, const unsigned int *index, Real *Bpos);
+	void				GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel);
+	void				GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce);
 
 	void				Set(unsigned int index, unsigned int boundary_type, 
 							Vector<Real> boundary_value, 
@@ -36,6 +36,7 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu.
 #include "GiPSiException.h"
 #include "logger.h"
 #include "lumpedfluid.h"
+#include "parallel.h"
 #include "timing.h"
 #include "XMLNodeList.h"
 
@@ -50,7 +51,8 @@ LumpedFluidObject::LumpedFluidObject(XMLNode * simObjectNode,
 									 Real _Ri,
 									 Real _Ro)
 									 :	SIMObject(simObjectNode),
-									 Pi(_Pi),Po(_Po),Pfo(_Pfo),K(_K),B(_B),Ri(_Ri),Ro(_Ro)
+									 Pi(_Pi),Po(_Po),Pfo(_Pfo),K(_K),B(_B),Ri(_Ri),Ro(_Ro),
+									 chamber_pos(NULL),chamber_partial(NULL),chamber_threads(0)
 {
 	try
 	{
@@ -469,19 +471,10 @@ void LumpedFluidObject::Load(char *basename)
 	/*	Initialize the states				*/
 	/****************************************/
   
-	// first find the center of the chamber
-	Vector<Real>	tempv(3,0.0);
 	for (i=0; i<ChamberGeometry->num_vertex; i++)
 		state.pos[i]=ChamberGeometry->vertex[i].pos;
-	for (i=0; i<state.size; i++)
-		tempv+=state.pos[i];
-	tempv=tempv*(1.0/state.size);
-	state.Vf=0;
-	for (i=0;i<ChamberGeometry->num_face;i++) 
-		state.Vf-=TetrahedraVolume(ChamberGeometry->face[i].vertex[0]->pos,
-								ChamberGeometry->face[i].vertex[1]->pos,
-								ChamberGeometry->face[i].vertex[2]->pos,
-								tempv);
+	chamber_pos=NULL;
+	state.Vf=ChamberVolume(state);
 	Vm=state.Vf;
 	VfminusVm_last=0.0;
 	Pf=Pfo;
@@ -506,6 +499,8 @@ void LumpedFluidObject::Load(char *basename)
 //
 inline void LumpedFluidObject::AccumState(State &new_state, const State &state, const State &deriv, const Real &h)
 {
+	if(new_state.pos == chamber_pos) chamber_pos = NULL;
+
 	new_state.Vf = state.Vf + deriv.Vf * h;
 	for(unsigned int i = 0; i <state.size; i++) {
 		new_state.pos[i] = state.pos[i] + deriv.pos[i] * h;
@@ -525,20 +520,10 @@ inline void LumpedFluidObject::DerivState(State &deriv, State &state)
 {
 	unsigned int			i;
 	LumpedFluidBoundary		*bound=(LumpedFluidBoundary *) this->boundary;
-	Vector<Real>			tempv(3,0.0);
 	Real					Vm,qi,qo,Pf;
 
-	// first find the center of the chamber
-	for (i=0; i<state.size; i++)
-		tempv+=state.pos[i];
-	tempv=tempv*(1.0/state.size);
-	// now calculate chamber volume Vm, 
-	Vm=0;
-	for (i=0;i<bound->num_face;i++) 
-		Vm-=TetrahedraVolume(state.pos[bound->face[i].vertex[0]->refid],
-								state.pos[bound->face[i].vertex[1]->refid],
-								state.pos[bound->face[i].vertex[2]->refid],
-								tempv);
+	// chamber volume Vm, shared with Simulate() for the current state
+	Vm=ChamberVolume(state);
 	
 	for (i=0; i<state.size; i++) 
 	{
@@ -597,21 +582,9 @@ void LumpedFluidObject::Simulate(void)
 	//   so that we will have the correct Boundary definition for boundary calculations
 	State2Bound();
 
-	// now calculate chamber volume Vm, 
-	unsigned int i;
-	LumpedFluidBoundary		*bound=(LumpedFluidBoundary *) this->boundary;
-	// first find the center of the chamber
-	Vector<Real>	tempv(3,0.0);
-	for (i=0; i<state.size; i++)
-		tempv+=state.pos[i];
-	tempv=tempv*(1.0/state.size);
-	// then calculate volume
-	Vm=0;
-	for (i=0;i<bound->num_face;i++) 
-		Vm-=TetrahedraVolume(state.pos[bound->face[i].vertex[0]->refid],
-								state.pos[bound->face[i].vertex[1]->refid],
-								state.pos[bound->face[i].vertex[2]->refid],
-								tempv);
+	// now calculate chamber volume Vm, which the first derivative
+	//   evaluation of the next step reuses
+	Vm=ChamberVolume(state);
 	// and chamber pressure
 	Pf=K*(state.Vf-Vm)+Pfo+B*(state.Vf-Vm-VfminusVm_last)/timestep;
 	VfminusVm_last=state.Vf-Vm;
@@ -622,6 +595,126 @@ void LumpedFluidObject::Simulate(void)
 
 
 
+// Minimum work per thread of the chamber volume reduction
+#define		LF_NODES_PER_THREAD		2048
+#define		LF_FACES_PER_THREAD		1024
+
+typedef struct {
+	const Vector<Real>	*pos;
+	const unsigned int	*face;			// 3 node indices per face
+	Real				center[3];
+	Real				*partial;		// 4 per thread
+} ChamberTaskArg;
+
+////////////////////////////////////////////////////////////////
+//
+//	LumpedFluidObject::ChamberVolume()
+//
+//		Volume enclosed by the boundary faces at the positions of
+//		s, summed over the tetrahedra formed by each face and the
+//		center of the nodes.  Both sums are parallel reductions,
+//		whose partial sums are added in thread order.
+//
+Real LumpedFluidObject::ChamberVolume(const State &s)
+{
+	LumpedFluidBoundary		*bound=(LumpedFluidBoundary *) this->boundary;
+	ChamberTaskArg			arg;
+	unsigned int			threads = GetParallelThreads(), t;
+	Real					volume;
+
+	if(s.pos == chamber_pos)	return chamber_volume;
+
+	if(threads > chamber_threads) {
+		delete[] chamber_partial;
+		if((chamber_partial = new Real[4*threads]) == NULL) {
+			error_exit(-1, "Cannot allocate memory for chamber volume!\n");
+		}
+		chamber_threads = threads;
+	}
+
+	arg.pos		= s.pos;
+	arg.face	= bound->facetovertexids;
+	arg.partial	= chamber_partial;
+
+	// first find the center of the chamber
+	for(t = 0; t < 4*threads; t++)	chamber_partial[t] = 0.0;
+	ParallelFor(s.size, ChamberCenterTask, &arg, LF_NODES_PER_THREAD);
+	arg.center[0] = arg.center[1] = arg.center[2] = 0.0;
+	for(t = 0; t < threads; t++) {
+		arg.center[0] += chamber_partial[4*t+0];
+		arg.center[1] += chamber_partial[4*t+1];
+		arg.center[2] += chamber_partial[4*t+2];
+	}
+	for(t = 0; t < 3; t++)	chamber_center[t] = arg.center[t] = arg.center[t] / s.size;
+
+	// then sum up the volume
+	for(t = 0; t < threads; t++)	chamber_partial[4*t+3] = 0.0;
+	ParallelFor(bound->num_face, ChamberVolumeTask, &arg, LF_FACES_PER_THREAD);
+	volume = 0.0;
+	for(t = 0; t < threads; t++)	volume += chamber_partial[4*t+3];
+
+	chamber_pos		= s.pos;
+	chamber_volume	= volume / 6.0;
+
+	return chamber_volume;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	LumpedFluidObject::ChamberCenterTask()
+//
+//		ParallelFor task: sum of the positions of nodes [begin, end)
+//
+void LumpedFluidObject::ChamberCenterTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	ChamberTaskArg	*a = (ChamberTaskArg *) arg;
+	Real			x = 0.0, y = 0.0, z = 0.0;
+
+	for(unsigned int i = begin; i < end; i++) {
+		const Vector<Real>	&p = a->pos[i];
+		x += p[0];	y += p[1];	z += p[2];
+	}
+
+	a->partial[4*thread+0] = x;
+	a->partial[4*thread+1] = y;
+	a->partial[4*thread+2] = z;
+}
+
+
+
+////////////////////////////////////////////////////////////////
+//
+//	LumpedFluidObject::ChamberVolumeTask()
+//
+//		ParallelFor task: six times the volume of the tetrahedra of
+//		faces [begin, end), oriented as TetrahedraVolume(p0, p1, p2, c)
+//		with the sign flipped
+//
+void LumpedFluidObject::ChamberVolumeTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	ChamberTaskArg		*a = (ChamberTaskArg *) arg;
+	const unsigned int	*f = a->face + 3*begin;
+	Real				sum = 0.0;
+
+	for(unsigned int i = begin; i < end; i++, f += 3) {
+		const Vector<Real>	&p0 = a->pos[f[0]], &p1 = a->pos[f[1]], &p2 = a->pos[f[2]];
+
+		// (p1 - p0) x (p2 - p1) . (p0 - c)
+		Real	ax = p1[0] - p0[0],			ay = p1[1] - p0[1],			az = p1[2] - p0[2];
+		Real	bx = p2[0] - p1[0],			by = p2[1] - p1[1],			bz = p2[2] - p1[2];
+		Real	dx = p0[0] - a->center[0],	dy = p0[1] - a->center[1],	dz = p0[2] - a->center[2];
+
+		sum +=	(ay*bz - az*by) * dx + (az*bx - ax*bz) * dy + (ax*by - ay*bx) * dz;
+	}
+
+	a->partial[4*thread+3] = sum;
+}
+
+
+
+
 ////////////////////////////////////////////////////////////////
 //
 //	LumpedFluidObject::Display()
@@ -654,6 +747,7 @@ void LumpedFluidObject::Geom2State(void)
 	for(unsigned int i=0; i < geom->num_vertex; i++) {
 		state.pos[i] = geom->vertex[i].pos;
 	}
+	chamber_pos = NULL;
 }
 
 
@@ -879,3 +973,14 @@ void	LumpedFluidBoundary::Set(unsigned int *boundary_type, Vector<Real> *boundar
 	}
 }
 
+void	LumpedFluidBoundary::SetBoundaryValues(unsigned int n, const unsigned int *index,
+											   unsigned int boundary_type, const Real *boundary_value)
+{
+	for (unsigned int i=0; i < n; i++, boundary_value+=3){
+		Real	*v = this->boundary_value[index[i]].begin();
+
+		this->boundary_type[index[i]]		=boundary_type;
+		v[0]=boundary_value[0];	v[1]=boundary_value[1];	v[2]=boundary_value[2];
+	}
+}
+
@@ -92,6 +92,13 @@ protected:
 	void LoadGeometry(XMLNodeList * simObjectChildren);
 	void InitializeTransformation(XMLNodeList * simObjectChildren);
 
+	// Chamber volume of a state, enclosed by the boundary faces.  The last
+	//   result is kept until the positions it was computed from are
+	//   written by AccumState() or Geom2State().
+	Real			ChamberVolume(const State &s);
+	static void		ChamberCenterTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+	static void		ChamberVolumeTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
 	State			state;
 	unsigned int	num_node;
 	Real			Pi;
@@ -105,6 +112,12 @@ protected:
 	Real			VfminusVm_last;
 	TriSurface *	ChamberGeometry;
 
+	const Vector<Real>	*chamber_pos;		// Positions of the cached volume, NULL if none
+	Real				chamber_volume;
+	Real				chamber_center[3];
+	Real				*chamber_partial;	// Per thread partial sums, 4 per thread
+	unsigned int		chamber_threads;
+
 	Integrator<LumpedFluidObject>		*integrator;
 
 	friend LoaderUnitTest;
@@ -136,6 +149,9 @@ public:
 
 	void		Set(int index, unsigned int boundary_type, Vector<Real> boundary_value);
 	void		Set(unsigned int *boundary_type, Vector<Real> *boundary_value);
+	// Bulk Set() for the nodes index[0..n), 3 Reals of boundary_value per node
+	void		SetBoundaryValues(unsigned int n, const unsigned int *index,
+								  unsigned int boundary_type, const Real *boundary_value);
 
 protected:
  
@@ -29,6 +29,10 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
 
 #include "algebra.h"
 #include "errors.h"
@@ -39,9 +43,16 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 #include "msd.h"
 #include "XMLNodeList.h"
 #include "msd_haptics.h"
+#include "parallel.h"
 
 #define		DELIM 10
 
+// Fixed iteration budget of the projective dynamics integrator
+#define		MSD_PD_ITERATIONS	10
+
+// Number of vibration modes kept by the modal integrator
+#define		MSD_MODAL_MODES		20
+
 void vprint(Vector<Real> vec) 
 {	 
 	for(unsigned int i=0;i<vec.size();i++) 
@@ -98,6 +109,178 @@ Real Spring::getEnergy(void)
 }
 
 
+/**
+ * AllocSpringArray()
+ * Allocates the storage of num springs.
+ * @param springs spring array.
+ * @param num number of springs.
+ */
+static void AllocSpringArray(SpringArray &springs, unsigned int num)
+{
+	springs.num		= num;
+	springs.node	= new unsigned int[2*num];
+	springs.l_zero	= new Real[num];
+	springs.k_stiff	= new Real[num];
+	springs.b_damp	= new Real[num];
+	if(springs.node == NULL || springs.l_zero == NULL || springs.k_stiff == NULL || springs.b_damp == NULL) {
+		error_exit(-1, "Cannot allocate memory for springs!\n");
+	}
+}
+
+
+/****************************************/
+/*	Binary MSD (.msdb) format			*/
+/****************************************/
+// A .msdb file is an MSDBHeader followed by the sections listed in
+// MSDBSectionIndex, each starting on an MSDB_ALIGN byte boundary at the offset
+// given in the header (0 for an absent section).  Everything is stored in
+// the byte order and Real type of the machine that wrote it, so that the
+// loader can use the arrays in place; a file written elsewhere is
+// rejected and the text files are read instead.  The header also records
+// the size and modification time of the .msd and .map files it was
+// converted from, and the file is ignored once they change.  Node indices
+// are 0-based.  Bump MSDB_VERSION whenever the layout changes.
+#define		MSDB_MAGIC			"GIPSIMSD"
+#define		MSDB_VERSION		2
+#define		MSDB_BYTE_ORDER		0x01020304
+#define		MSDB_ALIGN			8
+
+enum MSDBSourceIndex {
+	MSDB_SRC_MSD = 0,
+	MSDB_SRC_MAP,
+	MSDB_NUM_SOURCES
+};
+
+enum MSDBSectionIndex {
+	MSDB_MASS = 0,			// Real[num_mass]
+	MSDB_POSITION,			// Real[3*num_mass]
+	MSDB_GROUND,			// Real[3*num_ground] ground positions
+	MSDB_SPRING_NODE,		// unsigned int[2*num_spring]
+	MSDB_SPRING_LZERO,		// Real[num_spring]
+	MSDB_SPRING_KSTIFF,		// Real[num_spring]
+	MSDB_SPRING_BDAMP,		// Real[num_spring]
+	MSDB_VSPRING_NODE,		// unsigned int[2*num_vspring], mass node then ground node
+	MSDB_VSPRING_LZERO,		// Real[num_vspring]
+	MSDB_VSPRING_KSTIFF,	// Real[num_vspring]
+	MSDB_VSPRING_BDAMP,		// Real[num_vspring]
+	MSDB_BOUNDARY,			// unsigned int[num_boundary]
+	MSDB_MAPPING,			// unsigned int[2*num_mapping], msd index then obj index
+	MSDB_ADJ_PTR,			// unsigned int[num_mass+1], optional
+	MSDB_ADJ_NODE,			// unsigned int[num_adjacency], optional
+	MSDB_ADJ_SPRING,		// unsigned int[num_adjacency], optional
+	MSDB_NUM_SECTIONS
+};
+
+typedef struct {
+	char			magic[8];		// MSDB_MAGIC, not terminated
+	unsigned int	version;		// MSDB_VERSION
+	unsigned int	byte_order;		// MSDB_BYTE_ORDER as written
+	unsigned int	real_size;		// sizeof(Real)
+	unsigned int	num_mass;
+	unsigned int	num_ground;
+	unsigned int	num_spring;
+	unsigned int	num_vspring;
+	unsigned int	num_boundary;
+	unsigned int	num_mapping;
+	unsigned int	num_adjacency;	// 0 if the adjacency sections are absent
+	long long		source_size[MSDB_NUM_SOURCES];		// -1 for a missing file
+	long long		source_time[MSDB_NUM_SOURCES];
+	unsigned int	offset[MSDB_NUM_SECTIONS];
+	unsigned int	size[MSDB_NUM_SECTIONS];
+} MSDBHeader;
+
+// Start of section s in a mapped .msdb image
+inline static char *MSDBSection(char *data, const MSDBHeader *header, unsigned int s)
+{
+	return data + header->offset[s];
+}
+
+// True if the count entries index[0], index[stride], ... are below limit
+inline static bool MSDBIndexBelow(const unsigned int *index, unsigned int count, unsigned int stride, unsigned int limit)
+{
+	for(unsigned int i = 0; i < count; i++)
+		if(index[i*stride] >= limit) return false;
+	return true;
+}
+
+
+/**
+ * MSDBStamp()
+ * Size and modification time of the .msd and .map files of a .msdb file,
+ * which sit next to it with the same base name.
+ * @param filename .msdb file name.
+ * @param size file sizes, -1 for a missing file.
+ * @param time modification times.
+ */
+static void MSDBStamp(const char *filename, long long *size, long long *time)
+{
+	size_t			len = strlen(filename);
+	char			*source = new char[len + 1];
+	struct stat		st;
+
+	// name.msdb -> name.msd and name.map
+	strcpy(source, filename);
+	source[len - 1] = '\0';
+	for(unsigned int s = 0; s < MSDB_NUM_SOURCES; s++) {
+		if(s == MSDB_SRC_MAP && len >= 4) strcpy(source + len - 4, "map");
+		if(stat(source, &st) == 0) {
+			size[s] = (long long) st.st_size;
+			time[s] = (long long) st.st_mtime;
+		}
+		else size[s] = time[s] = -1;
+	}
+
+	delete [] source;
+}
+
+
+/**
+ * BuildSpringAdjacency()
+ * Builds the CSR node-spring adjacency of a spring set. The neighbours of a
+ * node are listed by increasing spring index; springs with an end outside
+ * 0..num_node-1 are only listed at their other end.
+ * @param num_node number of nodes.
+ * @param springs spring array.
+ * @param adj_ptr row pointers, size = num_node+1.
+ * @param adj_node neighbour of each entry, size = 2*springs.num.
+ * @param adj_spring spring of each entry, size = 2*springs.num.
+ */
+static void BuildSpringAdjacency(unsigned int num_node, const SpringArray &springs,
+								 unsigned int *adj_ptr, unsigned int *adj_node, unsigned int *adj_spring)
+{
+	unsigned int	i;
+
+	// Count the springs of each node, then fill in spring order
+	memset(adj_ptr, 0, (num_node+1)*sizeof(unsigned int));
+	for(i=0; i<springs.num; i++)
+	{
+		unsigned int node0 = springs.node[2*i];
+		unsigned int node1 = springs.node[2*i+1];
+		if (node0 < num_node)	adj_ptr[node0+1]++;
+		if (node1 < num_node)	adj_ptr[node1+1]++;
+	}
+	for(i=0; i<num_node; i++) adj_ptr[i+1] += adj_ptr[i];
+
+	for(i=0; i<springs.num; i++)
+	{
+		unsigned int node0 = springs.node[2*i];
+		unsigned int node1 = springs.node[2*i+1];
+		if (node0 < num_node) {
+			adj_node[adj_ptr[node0]]	= node1;
+			adj_spring[adj_ptr[node0]]	= i;
+			adj_ptr[node0]++;
+		}
+		if (node1 < num_node) {
+			adj_node[adj_ptr[node1]]	= node0;
+			adj_spring[adj_ptr[node1]]	= i;
+			adj_ptr[node1]++;
+		}
+	}
+	for(i=num_node; i>0; i--) adj_ptr[i] = adj_ptr[i-1];
+	adj_ptr[0] = 0;
+}
+
+
 /**
  * MSDObject::MSDObject()
  * Constructor.
@@ -108,8 +291,32 @@ MSDObject::MSDObject(	XMLNode * simObjectNode,
 						Real g)
 						:	DeformableSolidObject(simObjectNode),
 							int_method(0),
+							msd_of_obj(NULL),
+							obj_of_msd(NULL),
+							fixed_node(NULL),
+							num_obj_index(0),
+							num_msd_index(0),
+							spring_block(NULL),
+							spring_order(NULL),
+							color_ptr(NULL),
+							num_color(0),
+							adj_ptr(NULL),
+							adj_node(NULL),
+							adj_spring(NULL),
 							g(g)
 {
+	projective.system		= NULL;
+	projective.h			= 0.0;
+	modal.basis				= NULL;
+	multigrid				= NULL;
+	multigrid_fixed			= NULL;
+	modal.cache				= NULL;
+	modal.num_modes			= MSD_MODAL_MODES;
+	haptic_cache.node		= -1;
+	haptic_cache.generation	= 0;
+	haptic_cache.model		= NULL;
+	pthread_mutex_init(&haptic_lock, NULL);
+
 	try
 	{
 		// Extract initialization information
@@ -424,6 +631,7 @@ void MSDObject::LoadModelFiles(XMLNodeList * simObjectChildren)
 		XMLNode * numericMethodNode = NHParametersChildren->GetNode("numericMethod");
 		const char * numericMethod = numericMethodNode->GetValue();
 		int_method = getIntegrationMethod(numericMethod);
+		GetMultigridParameters(NHParametersChildren, multigrid_param);
 
 		// Format file name
 		char * msdFileName = new char[strlen(path) + strlen(fileName) + 4];
@@ -434,12 +642,34 @@ void MSDObject::LoadModelFiles(XMLNodeList * simObjectChildren)
 		mapFileName[strlen(mapFileName) - 2] = 'a';
 		mapFileName[strlen(mapFileName) - 1] = 'p';
 
-		// Load the map file
-		logger->Message(GetName(), "Loading MAP file...", 1);
-		LoadMAP(mapFileName);
-		logger->Message(GetName(), "Loading MSD file...", 1);
-		LoadMSD(msdFileName);
+		char * msdbFileName = new char[strlen(msdFileName) + 2];
+		strcpy(msdbFileName, msdFileName);
+		strcat(msdbFileName, "b");
+
+		// Vibration modes of the "Modal" integrator are cached next to it
+		modal.cache = new char[strlen(msdFileName) + 7];
+		strcpy(modal.cache, msdFileName);
+		strcat(modal.cache, ".modes");
+
+		// Use the binary model next to the .msd file when there is a
+		// current one, otherwise load the text files
+		logger->Message(GetName(), "Loading MSDB file...", 1);
+		if(!LoadMSDB(msdbFileName)) {
+			// Load the map file
+			logger->Message(GetName(), "Loading MAP file...", 1);
+			LoadMAP(mapFileName);
+			logger->Message(GetName(), "Loading MSD file...", 1);
+			LoadMSD(msdFileName);
+			ReorderMasses(GetMeshOrder());
+
+			// Convert for the next run if asked to
+			if(getenv("GIPSI_WRITE_MSDB") != NULL) {
+				logger->Message(GetName(), "Writing MSDB file...", 1);
+				SaveMSDB(msdbFileName);
+			}
+		}
 
+		delete msdbFileName;
 		delete mapFileName;
 		delete msdFileName;
 		delete path;
@@ -573,10 +803,7 @@ void MSDObject::LoadMSD(const char *filename)
 	}
 
 	// Allocate force
-	force = new Vector<Real>[this->num_mass];
-	if(force == NULL) {
-		error_exit(-1, "Cannot allocate memory for forces!\n");
-	}
+	AllocForce();
 	
 	// Allocate mass
 	mass = new Real[this->num_mass];
@@ -591,10 +818,7 @@ void MSDObject::LoadMSD(const char *filename)
 	}
 
 	// Allocate springs
-	this->spring = new Spring[this->num_spring];
-	if(this->spring == NULL) {
-		error_exit(-1, "Cannot allocate memory for springs!\n");
-	}
+	AllocSpringArray(this->spring, this->num_spring);
 
 	// Allocate ground_pos
 	ground_pos = new Vector<Real>[this->num_ground];
@@ -603,10 +827,7 @@ void MSDObject::LoadMSD(const char *filename)
 	}
 
 	// Allocate virtual springs
-	this->vspring = new Spring[this->num_vspring];
-	if(this->vspring == NULL) {
-		error_exit(-1, "Cannot allocate memory for virtual springs!\n");
-	}
+	AllocSpringArray(this->vspring, this->num_vspring);
 
 	// Allocate fix boundary
 	fix_boundary = (unsigned int *) malloc(num_boundary*sizeof(unsigned int));		
@@ -664,13 +885,11 @@ void MSDObject::LoadMSD(const char *filename)
 		v1--;
 		v2--;
 
-		spring[i].node[0] = v1;
-		spring[i].node[1] = v2;
-
-		//spring[i].dir = geom->vertex[v2].pos - geom->vertex[v1].pos;
-		spring[i].dir = massPoint[v1].pos - massPoint[v2].pos;
-		spring[i].setProperties(L0,K0,B0);
-		spring[i].refid = i;
+		spring.node[2*i]	= v1;
+		spring.node[2*i+1]	= v2;
+		spring.l_zero[i]	= L0;
+		spring.k_stiff[i]	= K0;
+		spring.b_damp[i]	= B0;
 
 		i++;
 	}
@@ -690,13 +909,11 @@ void MSDObject::LoadMSD(const char *filename)
 		v1--;
 		v2--;
 
-		vspring[i].node[0] = v1; // mass node
-		vspring[i].node[1] = v2; // ground node
-
-		//vspring[i].dir = geom->vertex[v1].pos - ground_pos[v2];
-		vspring[i].dir = massPoint[v1].pos - ground_pos[v2];
-		vspring[i].setProperties(L0,K0,B0);
-		vspring[i].refid = i;
+		vspring.node[2*i]	= v1; // mass node
+		vspring.node[2*i+1]	= v2; // ground node
+		vspring.l_zero[i]	= L0;
+		vspring.k_stiff[i]	= K0;
+		vspring.b_damp[i]	= B0;
 
 		i++;
 	}
@@ -722,6 +939,385 @@ void MSDObject::LoadMSD(const char *filename)
 }
 
 
+/**
+ * MSDObject::ReorderMasses()
+ * Renumbers the masses read by LoadMAP() and LoadMSD() so that connected
+ * masses are close in memory, and sorts the springs by their lowest mass.
+ * The virtual springs, the fixed boundary and the mapping follow, so the
+ * OBJ side of the model is unchanged. Call before SaveMSDB(), the .msdb
+ * file then keeps the new order.
+ * @param method MESH_ORDER_RCM or MESH_ORDER_SFC, MESH_ORDER_NONE does nothing.
+ */
+void MSDObject::ReorderMasses(int method)
+{
+	unsigned int	i, c;
+
+	if(method == MESH_ORDER_NONE || num_mass == 0) return;
+
+	vector<unsigned int>	order(num_mass), inv(num_mass);
+	vector<Real>			pos(3*num_mass), tmp(num_mass);
+	for(i = 0; i < num_mass; i++)
+		for(c = 0; c < 3; c++) pos[3*i+c] = massPoint[i].pos[c];
+	MeshNodeOrder(method, num_mass, &pos[0], num_spring, spring.node, &order[0]);
+	for(i = 0; i < num_mass; i++) inv[order[i]] = i;
+
+	// Masses
+	for(i = 0; i < num_mass; i++) tmp[i] = mass[i];
+	for(i = 0; i < num_mass; i++) {
+		mass[i] = tmp[order[i]];
+		for(c = 0; c < 3; c++) massPoint[i].pos[c] = pos[3*order[i]+c];
+	}
+
+	// Springs by their lowest mass
+	if(num_spring > 0) {
+		vector<unsigned int>	key(num_spring), sorder(num_spring), node(spring.node, spring.node + 2*num_spring);
+		vector<Real>			l_zero(spring.l_zero, spring.l_zero + num_spring),
+								k_stiff(spring.k_stiff, spring.k_stiff + num_spring),
+								b_damp(spring.b_damp, spring.b_damp + num_spring);
+		for(i = 0; i < num_spring; i++) {
+			node[2*i]	= inv[node[2*i]];
+			node[2*i+1]	= inv[node[2*i+1]];
+			key[i]		= (node[2*i] < node[2*i+1]) ? node[2*i] : node[2*i+1];
+		}
+		MeshItemOrder(num_spring, &key[0], num_mass, &sorder[0]);
+		for(i = 0; i < num_spring; i++) {
+			spring.node[2*i]	= node[2*sorder[i]];
+			spring.node[2*i+1]	= node[2*sorder[i]+1];
+			spring.l_zero[i]	= l_zero[sorder[i]];
+			spring.k_stiff[i]	= k_stiff[sorder[i]];
+			spring.b_damp[i]	= b_damp[sorder[i]];
+		}
+	}
+
+	// Virtual springs tie a mass to a ground point. With one per mass the
+	// haptic model finds them by mass index, so they follow the masses.
+	for(i = 0; i < num_vspring; i++) vspring.node[2*i] = inv[vspring.node[2*i]];
+	if(num_vspring == num_mass) {
+		vector<unsigned int>	vorder(num_mass, num_mass), node(vspring.node, vspring.node + 2*num_vspring);
+		vector<Real>			l_zero(vspring.l_zero, vspring.l_zero + num_vspring),
+								k_stiff(vspring.k_stiff, vspring.k_stiff + num_vspring),
+								b_damp(vspring.b_damp, vspring.b_damp + num_vspring);
+		for(i = 0; i < num_vspring; i++) vorder[node[2*i]] = i;
+		for(i = 0; i < num_mass && vorder[i] < num_vspring; i++);
+		if(i == num_mass) {
+			for(i = 0; i < num_vspring; i++) {
+				vspring.node[2*i]	= node[2*vorder[i]];
+				vspring.node[2*i+1]	= node[2*vorder[i]+1];
+				vspring.l_zero[i]	= l_zero[vorder[i]];
+				vspring.k_stiff[i]	= k_stiff[vorder[i]];
+				vspring.b_damp[i]	= b_damp[vorder[i]];
+			}
+		}
+	}
+	for(i = 0; i < num_boundary; i++) fix_boundary[i] = inv[fix_boundary[i]];
+	for(i = 0; i < num_mapping; i++) mapping[2*i] = inv[mapping[2*i]];
+}
+
+
+/**
+ * MSDObject::AllocForce()
+ * Allocates the force vectors of num_mass nodes.
+ */
+void MSDObject::AllocForce(void)
+{
+	unsigned int	i;
+
+	FORCE = new Vector<Real>(this->num_mass * 3, 0.0);
+	if(FORCE == NULL) {
+		error_exit(-1, "Cannot allocate memory for forces!\n");
+	}
+	force = new Vector<Real>[this->num_mass];
+	if(force == NULL) {
+		error_exit(-1, "Cannot allocate memory for forces!\n");
+	}
+	for(i = 0; i < num_mass; i++)
+		force[i].remap(3, &((*FORCE)[3*i]));
+}
+
+
+/**
+ * MSDObject::LoadMSDB()
+ * Maps in a .msdb file. The mass, spring, boundary and mapping arrays are
+ * used in place; only the points and the force vectors are allocated.
+ * @param filename .msdb file name.
+ * @return bool false if the file is missing, was written by an other
+ * version or machine type, is older than its .msd or .map file, or is
+ * corrupt, including indices out of range. Nothing is loaded in that case.
+ */
+bool MSDObject::LoadMSDB(const char *filename)
+{
+	unsigned int	i;
+	size_t			expected[MSDB_NUM_SECTIONS];
+
+	if(!model_file.Open(filename)) return false;
+
+	char			*data = model_file.Data();
+	size_t			data_size = model_file.Size();
+	MSDBHeader		*header = (MSDBHeader *) data;
+
+	if(data_size < sizeof(MSDBHeader) || memcmp(header->magic, MSDB_MAGIC, 8) ||
+	   header->version != MSDB_VERSION || header->byte_order != MSDB_BYTE_ORDER ||
+	   header->real_size != sizeof(Real)) {
+		printf("Ignoring MSDB file %s: wrong version or machine type\n", filename);
+		model_file.Close();
+		return false;
+	}
+
+	long long		source_size[MSDB_NUM_SOURCES], source_time[MSDB_NUM_SOURCES];
+	MSDBStamp(filename, source_size, source_time);
+	for(i = 0; i < MSDB_NUM_SOURCES; i++) {
+		if(source_size[i] != header->source_size[i] || source_time[i] != header->source_time[i]) {
+			printf("Ignoring MSDB file %s: the MSD or MAP file has changed\n", filename);
+			model_file.Close();
+			return false;
+		}
+	}
+
+	expected[MSDB_MASS]				= header->num_mass * sizeof(Real);
+	expected[MSDB_POSITION]			= 3 * header->num_mass * sizeof(Real);
+	expected[MSDB_GROUND]			= 3 * header->num_ground * sizeof(Real);
+	expected[MSDB_SPRING_NODE]		= 2 * header->num_spring * sizeof(unsigned int);
+	expected[MSDB_SPRING_LZERO]		= header->num_spring * sizeof(Real);
+	expected[MSDB_SPRING_KSTIFF]	= header->num_spring * sizeof(Real);
+	expected[MSDB_SPRING_BDAMP]		= header->num_spring * sizeof(Real);
+	expected[MSDB_VSPRING_NODE]		= 2 * header->num_vspring * sizeof(unsigned int);
+	expected[MSDB_VSPRING_LZERO]	= header->num_vspring * sizeof(Real);
+	expected[MSDB_VSPRING_KSTIFF]	= header->num_vspring * sizeof(Real);
+	expected[MSDB_VSPRING_BDAMP]	= header->num_vspring * sizeof(Real);
+	expected[MSDB_BOUNDARY]			= header->num_boundary * sizeof(unsigned int);
+	expected[MSDB_MAPPING]			= 2 * header->num_mapping * sizeof(unsigned int);
+	expected[MSDB_ADJ_PTR]			= (header->num_adjacency > 0) ? (header->num_mass + 1) * sizeof(unsigned int) : 0;
+	expected[MSDB_ADJ_NODE]			= header->num_adjacency * sizeof(unsigned int);
+	expected[MSDB_ADJ_SPRING]		= header->num_adjacency * sizeof(unsigned int);
+
+	for(i = 0; i < MSDB_NUM_SECTIONS; i++) {
+		if(header->size[i] != expected[i] || (header->offset[i] % MSDB_ALIGN) != 0 ||
+		   header->offset[i] + (size_t) header->size[i] > data_size ||
+		   (header->size[i] > 0 && header->offset[i] < sizeof(MSDBHeader))) {
+			printf("Ignoring MSDB file %s: corrupt section %d\n", filename, i);
+			model_file.Close();
+			return false;
+		}
+	}
+
+	// The indices are used unchecked by the simulation, so a stale or
+	// corrupt file is rejected here and the text files are loaded instead
+	const unsigned int	*spring_node	= (unsigned int *) MSDBSection(data, header, MSDB_SPRING_NODE);
+	const unsigned int	*vspring_node	= (unsigned int *) MSDBSection(data, header, MSDB_VSPRING_NODE);
+	const unsigned int	*boundary		= (unsigned int *) MSDBSection(data, header, MSDB_BOUNDARY);
+	const unsigned int	*map			= (unsigned int *) MSDBSection(data, header, MSDB_MAPPING);
+	unsigned int		num_obj			= (geometry != NULL) ? ((TriSurface *) geometry)->num_vertex : (unsigned int) -1;
+	bool				in_range		=
+		MSDBIndexBelow(spring_node, 2 * header->num_spring, 1, header->num_mass) &&
+		MSDBIndexBelow(vspring_node, header->num_vspring, 2, header->num_mass) &&
+		MSDBIndexBelow(vspring_node + 1, header->num_vspring, 2, header->num_ground) &&
+		MSDBIndexBelow(boundary, header->num_boundary, 1, header->num_mass) &&
+		MSDBIndexBelow(map, header->num_mapping, 2, header->num_mass) &&
+		MSDBIndexBelow(map + 1, header->num_mapping, 2, num_obj);
+	if(in_range && header->num_adjacency > 0) {
+		const unsigned int	*ptr = (unsigned int *) MSDBSection(data, header, MSDB_ADJ_PTR);
+		in_range = ptr[0] == 0 && ptr[header->num_mass] == header->num_adjacency &&
+				   MSDBIndexBelow((unsigned int *) MSDBSection(data, header, MSDB_ADJ_NODE), header->num_adjacency, 1, header->num_mass) &&
+				   MSDBIndexBelow((unsigned int *) MSDBSection(data, header, MSDB_ADJ_SPRING), header->num_adjacency, 1, header->num_spring);
+		for(i = 0; in_range && i < header->num_mass; i++)
+			if(ptr[i] > ptr[i+1]) in_range = false;
+	}
+	if(!in_range) {
+		printf("Ignoring MSDB file %s: index out of range\n", filename);
+		model_file.Close();
+		return false;
+	}
+
+	num_mass		= header->num_mass;
+	num_ground		= header->num_ground;
+	num_spring		= header->num_spring;
+	num_vspring		= header->num_vspring;
+	num_boundary	= header->num_boundary;
+	num_mapping		= header->num_mapping;
+	printf("File type : <MSDB v%d>\tMass: %d\tV Mass: %d\tSpring: %d\tV Spring:%d\tBoundary: %d\tMapping: %d\n",
+			header->version, num_mass, num_ground, num_spring, num_vspring, num_boundary, num_mapping);
+
+	mass				= (Real *) MSDBSection(data, header, MSDB_MASS);
+	spring.num			= num_spring;
+	spring.node			= (unsigned int *) MSDBSection(data, header, MSDB_SPRING_NODE);
+	spring.l_zero		= (Real *) MSDBSection(data, header, MSDB_SPRING_LZERO);
+	spring.k_stiff		= (Real *) MSDBSection(data, header, MSDB_SPRING_KSTIFF);
+	spring.b_damp		= (Real *) MSDBSection(data, header, MSDB_SPRING_BDAMP);
+	vspring.num			= num_vspring;
+	vspring.node		= (unsigned int *) MSDBSection(data, header, MSDB_VSPRING_NODE);
+	vspring.l_zero		= (Real *) MSDBSection(data, header, MSDB_VSPRING_LZERO);
+	vspring.k_stiff		= (Real *) MSDBSection(data, header, MSDB_VSPRING_KSTIFF);
+	vspring.b_damp		= (Real *) MSDBSection(data, header, MSDB_VSPRING_BDAMP);
+	fix_boundary		= (unsigned int *) MSDBSection(data, header, MSDB_BOUNDARY);
+	mapping				= (unsigned int *) MSDBSection(data, header, MSDB_MAPPING);
+	if(header->num_adjacency > 0) {
+		adj_ptr			= (unsigned int *) MSDBSection(data, header, MSDB_ADJ_PTR);
+		adj_node		= (unsigned int *) MSDBSection(data, header, MSDB_ADJ_NODE);
+		adj_spring		= (unsigned int *) MSDBSection(data, header, MSDB_ADJ_SPRING);
+	}
+	else {
+		adj_ptr			= NULL;
+		adj_node		= NULL;
+		adj_spring		= NULL;
+	}
+
+	// Allocate force
+	AllocForce();
+
+	// Allocate massPoint
+	massPoint = new Point[this->num_mass];
+	if(massPoint == NULL) {
+		error_exit(-1, "Cannot allocate memory for massPoint!\n");
+	}
+	const Real		*position = (Real *) MSDBSection(data, header, MSDB_POSITION);
+	for(i = 0; i < num_mass; i++) {
+		massPoint[i].refid	= i;
+		massPoint[i].pos[0]	= position[3*i];
+		massPoint[i].pos[1]	= position[3*i+1];
+		massPoint[i].pos[2]	= position[3*i+2];
+	}
+
+	// Allocate ground_pos
+	ground_pos = new Vector<Real>[this->num_ground];
+	if(ground_pos == NULL) {
+		error_exit(-1, "Cannot allocate memory for ground position!\n");
+	}
+	const Real		*ground = (Real *) MSDBSection(data, header, MSDB_GROUND);
+	for(i = 0; i < num_ground; i++) {
+		ground_pos[i] = Vector<Real>(3, 0.0);
+		ground_pos[i][0] = ground[3*i];
+		ground_pos[i][1] = ground[3*i+1];
+		ground_pos[i][2] = ground[3*i+2];
+	}
+
+	return true;
+}
+
+
+/**
+ * MSDObject::getSpringAdjacency()
+ * Returns the spring adjacency stored in the loaded .msdb file.
+ * @param ptr CSR row pointers, size = num_mass+1.
+ * @param node neighbour of each entry.
+ * @param spring spring of each entry.
+ * @return bool false if the model was not loaded with an adjacency.
+ */
+bool MSDObject::getSpringAdjacency(const unsigned int *&ptr, const unsigned int *&node, const unsigned int *&spring)
+{
+	if(adj_ptr == NULL) return false;
+
+	ptr		= adj_ptr;
+	node	= adj_node;
+	spring	= adj_spring;
+	return true;
+}
+
+
+/**
+ * MSDObject::SaveMSDB()
+ * Writes the model read by LoadMAP() and LoadMSD() as a .msdb file, with
+ * the spring adjacency precomputed. Call before the model is transformed.
+ * @param filename .msdb file name.
+ */
+void MSDObject::SaveMSDB(const char *filename)
+{
+	FILE			*fp;
+	unsigned int	i;
+	char			errmsg[1024];
+	MSDBHeader		header;
+	const void		*section[MSDB_NUM_SECTIONS];
+	char			pad[MSDB_ALIGN];
+
+	// Flatten the point and ground positions
+	Real			*position		= new Real[3*num_mass];
+	Real			*ground			= new Real[3*num_ground];
+	unsigned int	*ptr			= new unsigned int[num_mass+1];
+	unsigned int	*node			= new unsigned int[2*num_spring];
+	unsigned int	*adj			= new unsigned int[2*num_spring];
+	if(position == NULL || ground == NULL || ptr == NULL || node == NULL || adj == NULL) {
+		error_exit(-1, "Cannot allocate memory for MSDB conversion!\n");
+	}
+	for(i = 0; i < num_mass; i++) {
+		position[3*i]	= massPoint[i].pos[0];
+		position[3*i+1]	= massPoint[i].pos[1];
+		position[3*i+2]	= massPoint[i].pos[2];
+	}
+	for(i = 0; i < num_ground; i++) {
+		ground[3*i]		= ground_pos[i][0];
+		ground[3*i+1]	= ground_pos[i][1];
+		ground[3*i+2]	= ground_pos[i][2];
+	}
+	BuildSpringAdjacency(num_mass, spring, ptr, node, adj);
+
+	memset(&header, 0, sizeof(MSDBHeader));
+	memcpy(header.magic, MSDB_MAGIC, 8);
+	header.version			= MSDB_VERSION;
+	header.byte_order		= MSDB_BYTE_ORDER;
+	header.real_size		= sizeof(Real);
+	header.num_mass			= num_mass;
+	header.num_ground		= num_ground;
+	header.num_spring		= num_spring;
+	header.num_vspring		= num_vspring;
+	header.num_boundary		= num_boundary;
+	header.num_mapping		= num_mapping;
+	header.num_adjacency	= ptr[num_mass];
+	MSDBStamp(filename, header.source_size, header.source_time);
+
+	section[MSDB_MASS]				= mass;				header.size[MSDB_MASS]				= num_mass * sizeof(Real);
+	section[MSDB_POSITION]			= position;			header.size[MSDB_POSITION]			= 3 * num_mass * sizeof(Real);
+	section[MSDB_GROUND]			= ground;			header.size[MSDB_GROUND]			= 3 * num_ground * sizeof(Real);
+	section[MSDB_SPRING_NODE]		= spring.node;		header.size[MSDB_SPRING_NODE]		= 2 * num_spring * sizeof(unsigned int);
+	section[MSDB_SPRING_LZERO]		= spring.l_zero;	header.size[MSDB_SPRING_LZERO]		= num_spring * sizeof(Real);
+	section[MSDB_SPRING_KSTIFF]		= spring.k_stiff;	header.size[MSDB_SPRING_KSTIFF]		= num_spring * sizeof(Real);
+	section[MSDB_SPRING_BDAMP]		= spring.b_damp;	header.size[MSDB_SPRING_BDAMP]		= num_spring * sizeof(Real);
+	section[MSDB_VSPRING_NODE]		= vspring.node;		header.size[MSDB_VSPRING_NODE]		= 2 * num_vspring * sizeof(unsigned int);
+	section[MSDB_VSPRING_LZERO]		= vspring.l_zero;	header.size[MSDB_VSPRING_LZERO]		= num_vspring * sizeof(Real);
+	section[MSDB_VSPRING_KSTIFF]	= vspring.k_stiff;	header.size[MSDB_VSPRING_KSTIFF]	= num_vspring * sizeof(Real);
+	section[MSDB_VSPRING_BDAMP]		= vspring.b_damp;	header.size[MSDB_VSPRING_BDAMP]		= num_vspring * sizeof(Real);
+	section[MSDB_BOUNDARY]			= fix_boundary;		header.size[MSDB_BOUNDARY]			= num_boundary * sizeof(unsigned int);
+	section[MSDB_MAPPING]			= mapping;			header.size[MSDB_MAPPING]			= 2 * num_mapping * sizeof(unsigned int);
+	section[MSDB_ADJ_PTR]			= ptr;				header.size[MSDB_ADJ_PTR]			= (header.num_adjacency > 0) ? (num_mass + 1) * sizeof(unsigned int) : 0;
+	section[MSDB_ADJ_NODE]			= node;				header.size[MSDB_ADJ_NODE]			= header.num_adjacency * sizeof(unsigned int);
+	section[MSDB_ADJ_SPRING]		= adj;				header.size[MSDB_ADJ_SPRING]		= header.num_adjacency * sizeof(unsigned int);
+
+	// Lay the sections out back to back after the header
+	size_t			offset = sizeof(MSDBHeader);
+	for(i = 0; i < MSDB_NUM_SECTIONS; i++) {
+		offset = ((offset + MSDB_ALIGN - 1) / MSDB_ALIGN) * MSDB_ALIGN;
+		header.offset[i] = (header.size[i] > 0) ? (unsigned int) offset : 0;
+		offset += header.size[i];
+	}
+
+	fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		sprintf(errmsg, "Cannot open MSDB file %s\n", filename);
+		error_exit(-1, errmsg);
+	}
+
+	memset(pad, 0, MSDB_ALIGN);
+	bool			ok = (fwrite(&header, sizeof(MSDBHeader), 1, fp) == 1);
+	offset = sizeof(MSDBHeader);
+	for(i = 0; i < MSDB_NUM_SECTIONS && ok; i++) {
+		if(header.size[i] == 0) continue;
+		size_t	gap = header.offset[i] - offset;
+		if(gap > 0) ok = (fwrite(pad, 1, gap, fp) == gap);
+		ok = ok && (fwrite(section[i], 1, header.size[i], fp) == header.size[i]);
+		offset = header.offset[i] + header.size[i];
+	}
+	if(fclose(fp) != 0) ok = false;
+	if(!ok) {
+		sprintf(errmsg, "Cannot write MSDB file %s\n", filename);
+		error_exit(-1, errmsg);
+	}
+
+	delete[] position;
+	delete[] ground;
+	delete[] ptr;
+	delete[] node;
+	delete[] adj;
+}
+
+
 /** 
  * MSDObject::init()
  * Initilize the MSDObject.
@@ -771,6 +1367,11 @@ void MSDObject::Init(void)
 		//printf("%s -> vertex %d:%lf, %lf, %lf\n",GetName(), i,massPoint[i].pos[0], massPoint[i].pos[1], massPoint[i].pos[2]);
 	}
 	
+	/****************************************/
+	/*	Set up index tables					*/
+	/****************************************/
+	BuildIndexTables();
+
 	/****************************************/
 	/*	Set up boundary						*/
 	/****************************************/
@@ -839,15 +1440,16 @@ void MSDObject::Init(void)
 
 	delete[] g2b;		
 
+	/****************************************/
+	/*	Set up parallel force schedule		*/
+	/****************************************/
+	ColorSprings();
+
 	/****************************************/
 	/*	Built MSDModel						*/
 	/****************************************/
-	msdModel = new MSDModel[num_mass];
-	if(msdModel == NULL) {
-		error_exit(-1, "Cannot allocate memory for MSDModel!\n");
-	}
-	msdModelBuilder.BuildModel(msdModel, this, 2);
-	//msdModelBuilder.print(msdModel);
+	msdModelBuilder.Init(this, 2);
+	//msdModelBuilder.print();
 }
 
 
@@ -858,6 +1460,17 @@ void MSDObject::Init(void)
  */
 void MSDObject::SetIntegrationMethod(int method)
 {
+	// Leaving the modal integrator: the full state becomes current again
+	// and the modes are dropped, so node queries stop reconstructing from
+	// them. Selecting "Modal" again relinearizes at the current state.
+	if(modal.basis != NULL) {
+		if(modal.basis->NumModes() > 0) ModalReconstruct();
+		FreeModal();
+	}
+
+	// The multigrid hierarchy is only kept while "ImEulerMG" is selected
+	if(method != 11) FreeMultigrid();
+
 	switch(method)
 	{
 		case 1: //Euler
@@ -884,6 +1497,18 @@ void MSDObject::SetIntegrationMethod(int method)
 		case 8: //MidPoint
 			integrator = new ImplicitMidPoint<MSDObject>(*this);
 			break;
+		case 9: //Projective Dynamics
+			AllocProjective();
+			integrator = new ProjectiveDynamics<MSDObject>(*this, MSD_PD_ITERATIONS);
+			break;
+		case 10: //Modal reduction
+			AllocModal();
+			integrator = new ModalIntegrator<MSDObject>(*this);
+			break;
+		case 11: //Implicit Euler with multigrid
+			AllocMultigrid();
+			integrator = new ImplicitEulerMG<MSDObject>(*this);
+			break;
 	}
 }
 
@@ -913,6 +1538,12 @@ int MSDObject::getIntegrationMethod(const char * method)
 		result = 7;
 	else if (strcmp(method, "ImMidpoint") == 0)
 		result = 8;
+	else if (strcmp(method, "PD") == 0)
+		result = 9;
+	else if (strcmp(method, "Modal") == 0)
+		result = 10;
+	else if (strcmp(method, "ImEulerMG") == 0)
+		result = 11;
 	return result;
 }
 
@@ -927,13 +1558,40 @@ Real MSDObject::getEnergy(void)
 	double Potential = 0.0;
 	for(unsigned int i=0;i<num_mass;i++)
 		Kinetic += 0.5*mass[i]*state.vel[i].length_sq();
-	for(unsigned int i=0;i<num_spring;i++)
-		Potential += spring[i].getEnergy();	
+	for(unsigned int i=0;i<num_spring;i++) {
+		const Real	*p1 = state.pos[spring.node[2*i]].begin();
+		const Real	*p2 = state.pos[spring.node[2*i+1]].begin();
+		Real		d0 = p1[0] - p2[0];
+		Real		d1 = p1[1] - p2[1];
+		Real		d2 = p1[2] - p2[2];
+		Real		s = sqrt(d0*d0 + d1*d1 + d2*d2) - spring.l_zero[i];
+		Potential += 0.5*spring.k_stiff[i]*s*s;
+	}
 	//printf("K = %.9f, P = %.9f, Total = %.9f\n",Kinetic,Potential,Kinetic+Potential);
 	return Kinetic+Potential;
 }
 
 
+/**
+ * MSDObject::getSpring()
+ * Assembles a Spring from the spring arrays. The direction is taken from
+ * the current state.
+ * @param index spring index.
+ * @return Spring spring.
+ */
+Spring MSDObject::getSpring(unsigned int index)
+{
+	Spring	s;
+
+	s.refid = index;
+	s.setMassIndex(spring.node[2*index], spring.node[2*index+1]);
+	s.setProperties(spring.l_zero[index], spring.k_stiff[index], spring.b_damp[index]);
+	s.dir = state.pos[s.node[0]] - state.pos[s.node[1]];
+
+	return s;
+}
+
+
 /**
  * MSDObject::ResetInitialBoundaryCondition()
  * Reset MSD boundary condition to initial values.
@@ -968,81 +1626,195 @@ inline void MSDObject::ResetInitialBoundaryCondition(void)
 }
 
 
+// Minimum work per thread of the parallel force pass
+#define MSD_NODES_PER_THREAD	1024
+#define MSD_SPRINGS_PER_THREAD	256
+
+typedef struct {
+	MSDObject			*object;
+	MSDObject::State	*state;
+	unsigned int		offset;		/**< first spring_order entry of the current colour */
+} ForceTaskArg;
+
 /**
  * MSDObject::UpdateForces()
  * Updates the forces.
  * @param state state information.
  */
-inline void MSDObject::UpdateForces(State &state)   
+void MSDObject::UpdateForces(State &state)   
 {
 	unsigned int	i;
-	static			Real gg[3] = { 0.0, -g, 0.0 };
-	static			const Vector<Real> g_vector(3, gg);
-	static			Vector<Real> g_force(3), d_force(3), s_force(3);
-	static			Vector<Real> rel_vel(3, 0.0);
+	ForceTaskArg	arg;
 
-	// Clear the forces
-	for(i = 0; i < state.size; i++) force[i] = zero_vector3;
+	arg.object	= this;
+	arg.state	= &state;
+	arg.offset	= 0;
 
-	// Update them by adding each component
-	for(i = 0; i < state.size; i++) {
-		// Add gravity
-		g_force = g_vector;
-		g_force *= mass[i]; 
-		force[i] += g_force;
+	// Clear the forces and add the per node terms
+	ParallelFor(state.size, NodeForceTask, &arg, MSD_NODES_PER_THREAD);
+
+	// Springs one colour at a time.  Within a colour every node is touched by
+	// at most one spring, so the chunks can scatter into force[] directly.
+	for(i = 0; i < num_color; i++) {
+		arg.offset = color_ptr[i];
+		ParallelFor(color_ptr[i+1] - color_ptr[i], SpringForceTask, &arg, MSD_SPRINGS_PER_THREAD);
+	}
+
+	// Virtual springs are few and may share nodes, keep them serial
+	const Real		*pos = state.POS->begin();
+	const Real		*vel = state.VEL->begin();
+	int				v1, v2;
+	for(i = 0; i < num_vspring; i++) {
+		// dir = v1-v2
+		v1 = vspring.node[2*i];		// mass node
+		v2 = vspring.node[2*i+1];	// ground node (no force on it)
+		
+		Real	dir[3];
+		Real	*f	 = force[v1].begin();
+		dir[0] = pos[3*v1]   - ground_pos[v2][0];
+		dir[1] = pos[3*v1+1] - ground_pos[v2][1];
+		dir[2] = pos[3*v1+2] - ground_pos[v2][2];
+		Real	L2 = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+
+		// Add spring force
+		// f = -k * (1 - L/L0) * dir
+		Real	c = -vspring.k_stiff[i];
+		f[0] += c * dir[0];
+		f[1] += c * dir[1];
+		f[2] += c * dir[2];
+
+		// Add local damping
+		if(L2>0.0) {	// check for divide by zero
+			c = -vspring.b_damp[i] * (vel[3*v1]*dir[0] + vel[3*v1+1]*dir[1] + vel[3*v1+2]*dir[2]) / L2;
+			f[0] += c * dir[0];
+			f[1] += c * dir[1];
+			f[2] += c * dir[2];
+		}
+	}
+}
+
+
+/**
+ * MSDObject::NodeForceTask()
+ * Clears the force of nodes [begin, end) and adds gravity.
+ * @param arg ForceTaskArg.
+ */
+void MSDObject::NodeForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	ForceTaskArg	*a		= (ForceTaskArg *) arg;
+	MSDObject		*obj	= a->object;
 
-		// Add global damping
-		//d_force = state.vel[i];
-		//d_force *= -D;
-		//force[i] += d_force;
+	for(unsigned int i = begin; i < end; i++) {
+		Real	*f = obj->force[i].begin();
+
+		// Add gravity
+		f[0] = 0.0;
+		f[1] = -obj->g * obj->mass[i];
+		f[2] = 0.0;
 
 		// NOTE: Add others here...
 	}
+}
+
+
+/**
+ * MSDObject::SpringForceTask()
+ * Accumulates the spring and damping forces of springs [begin, end) of the
+ * colour starting at arg->offset.
+ * @param arg ForceTaskArg.
+ */
+void MSDObject::SpringForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	ForceTaskArg	*a		= (ForceTaskArg *) arg;
+	MSDObject		*obj	= a->object;
+	const Real		*pos	= a->state->POS->begin();
+	const Real		*vel	= a->state->VEL->begin();
+
+	for(unsigned int j = begin; j < end; j++) {
+		unsigned int	s	= obj->spring_order[a->offset + j];
+		unsigned int	v1	= obj->spring.node[2*s];
+		unsigned int	v2	= obj->spring.node[2*s+1];
+		Real			dir[3];
 
-	int v1, v2;
-	for(i = 0; i < num_spring; i++) {
 		// dir = v1-v2
-		v1 = spring[i].node[0];
-		v2 = spring[i].node[1];
-		
-		spring[i].dir = state.pos[v1] - state.pos[v2];
-		Real L = spring[i].length();
+		dir[0] = pos[3*v1]   - pos[3*v2];
+		dir[1] = pos[3*v1+1] - pos[3*v2+1];
+		dir[2] = pos[3*v1+2] - pos[3*v2+2];
+		Real	L2	= dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+
+		if(L2>0.0){
+			Real	L	= sqrt(L2);
+			Real	*f1	= obj->force[v1].begin();
+			Real	*f2	= obj->force[v2].begin();
 
-		if(L>0.0){
 			// Add spring force
 			// f = -k * (1 - L0/L) * dir				
-			s_force = -spring[i].k_stiff * (1 - spring[i].l_zero / L) * spring[i].dir;						
-			force[v1] += s_force;
-			force[v2] -= s_force;
+			Real	c = -obj->spring.k_stiff[s] * (1 - obj->spring.l_zero[s] / L);
 
 			// Add local damping
-			rel_vel = state.vel[v1] - state.vel[v2];
-			d_force = -spring[i].b_damp * ((rel_vel * spring[i].dir) / (L*L)) * spring[i].dir;
-			force[v1] += d_force;
-			force[v2] -= d_force;
+			Real	rel0 = vel[3*v1]   - vel[3*v2];
+			Real	rel1 = vel[3*v1+1] - vel[3*v2+1];
+			Real	rel2 = vel[3*v1+2] - vel[3*v2+2];
+			c += -obj->spring.b_damp[s] * (rel0*dir[0] + rel1*dir[1] + rel2*dir[2]) / L2;
+
+			f1[0] += c * dir[0];	f2[0] -= c * dir[0];
+			f1[1] += c * dir[1];	f2[1] -= c * dir[1];
+			f1[2] += c * dir[2];	f2[2] -= c * dir[2];
 		}
 	}
+}
 
-	for(i = 0; i < num_vspring; i++) {
-		// dir = v1-v2
-		v1 = vspring[i].node[0];	// mass node
-		v2 = vspring[i].node[1];	// ground node (no force on it)
-		
-		vspring[i].dir = state.pos[v1] - ground_pos[v2];
-		Real L = vspring[i].length();
 
-		// Add spring force
-		// f = -k * (1 - L/L0) * dir
-		s_force = -vspring[i].k_stiff * vspring[i].dir;
-		force[v1] += s_force;		
+/**
+ * MSDObject::ColorSprings()
+ * Greedy edge colouring of the spring graph.  Fills spring_order, color_ptr
+ * and num_color so that no two springs of the same colour share a node.
+ */
+void MSDObject::ColorSprings(void)
+{
+	unsigned int		i, c;
+	unsigned int		*color	= new unsigned int[num_spring];
+	vector<unsigned int>	*used	= new vector<unsigned int>[num_mass];	// colours taken at each node
+	vector<unsigned int>	stamp;											// stamp[c] == i+1 : c is taken for spring i
 
-		// Add local damping
-		if(L>0.0) {	// check for divide by zero
-			rel_vel = state.vel[v1];
-			d_force = -vspring[i].b_damp * ((rel_vel * vspring[i].dir) / (L*L)) * vspring[i].dir;
-			force[v1] += d_force;		
+	if(color == NULL || used == NULL) {
+		error_exit(-1, "Cannot allocate memory for spring colouring!\n");
+	}
+
+	num_color = 0;
+	for(i = 0; i < num_spring; i++) {
+		for(unsigned int e = 0; e < 2; e++) {
+			vector<unsigned int>	&u = used[spring.node[2*i+e]];
+			for(unsigned int k = 0; k < u.size(); k++) stamp[u[k]] = i + 1;
+		}
+		for(c = 0; c < num_color && stamp[c] == i + 1; c++);
+		if(c == num_color) {
+			num_color++;
+			stamp.push_back(0);
 		}
+		color[i] = c;
+		used[spring.node[2*i]].push_back(c);
+		used[spring.node[2*i+1]].push_back(c);
+	}
+
+	// Bucket the springs by colour, keeping index order within a colour
+	if(spring_order != NULL)	delete[] spring_order;
+	if(color_ptr != NULL)		delete[] color_ptr;
+	spring_order	= new unsigned int[num_spring];
+	color_ptr		= new unsigned int[num_color + 1];
+	if(spring_order == NULL || color_ptr == NULL) {
+		error_exit(-1, "Cannot allocate memory for spring colouring!\n");
 	}
+
+	for(c = 0; c <= num_color; c++)	color_ptr[c] = 0;
+	for(i = 0; i < num_spring; i++)	color_ptr[color[i] + 1]++;
+	for(c = 0; c < num_color; c++)	color_ptr[c + 1] += color_ptr[c];
+	for(i = 0; i < num_spring; i++)	spring_order[color_ptr[color[i]]++] = i;
+	for(c = num_color; c > 0; c--)	color_ptr[c] = color_ptr[c - 1];
+	color_ptr[0] = 0;
+
+	delete[] color;
+	delete[] used;
 }
 
 
@@ -1252,15 +2024,49 @@ inline void MSDObject::AllocState(State &s)
  */
 inline void MSDObject::AllocJacobian(Jacobian &J)
 {   
-	J.A11 = new Matrix<Real>(3*state.size,3*state.size,0.0);
+	unsigned int	i;
+
+	// The pattern follows the spring connectivity: one diagonal block per
+	// node and one block per spring endpoint pair
+	unsigned int	*pairs = new unsigned int[2*num_spring];
+	if(pairs == NULL) {
+		error_exit(-1, "Cannot allocate memory for jacobian pattern!\n");
+	}
+	for(i = 0; i < num_spring; i++) {
+		pairs[2*i]		= spring.node[2*i];
+		pairs[2*i+1]	= spring.node[2*i+1];
+	}
+
+	J.A11 = new BlockCRSMatrix<Real>();
 	if(J.A11 == NULL) {
 		error_exit(-1, "Cannot allocate memory for jacobian A11!\n");
 	}	
+	J.A11->initPattern(state.size, num_spring, pairs);
 	
-	J.A12 = new Matrix<Real>(3*state.size,3*state.size,0.0);
+	J.A12 = new BlockCRSMatrix<Real>();
 	if(J.A12 == NULL) {
 		error_exit(-1, "Cannot allocate memory for jacobian A12!\n");
 	}	
+	J.A12->initPattern(state.size, num_spring, pairs);
+
+	delete[] pairs;
+
+	// Block positions of each spring, shared by every Jacobian since the
+	// pattern only depends on the springs
+	if(spring_block == NULL) {
+		spring_block = new unsigned int[4*num_spring];
+		if(spring_block == NULL) {
+			error_exit(-1, "Cannot allocate memory for spring blocks!\n");
+		}
+		for(i = 0; i < num_spring; i++) {
+			unsigned int	m1 = spring.node[2*i];
+			unsigned int	m2 = spring.node[2*i+1];
+			spring_block[4*i]	= J.A11->find(m1, m1);
+			spring_block[4*i+1]	= J.A11->find(m1, m2);
+			spring_block[4*i+2]	= J.A11->find(m2, m1);
+			spring_block[4*i+3]	= J.A11->find(m2, m2);
+		}
+	}
 
 	J.size = state.size;
 	J.dA21 = 0;
@@ -1327,17 +2133,21 @@ inline Real MSDObject::StateDotState(const State &state1, const State &state2)
 inline void MSDObject::MultiplyJacobianState(State &out_state, const Jacobian &J, const State &state)
 {
 	ASSERT(J.size == state.size);	
-	(*out_state.VEL) = (*J.A11)*(*state.VEL) + (*J.A12)*(*state.POS);
+	multMV((*out_state.VEL), (*J.A11), (*state.VEL));
+	multAddMV((*out_state.VEL), (*J.A12), (*state.POS));
 	(*out_state.POS) = (J.dA21)*(*state.VEL) + (J.dA22)*(*state.POS);	
 }
 
 void MSDObject::PrintJacobian(const Jacobian &J)
 {
-	int size = J.size;
+	Matrix<Real>	A(J.A11->m(), J.A11->n(), 0.0);
+
 	printf("A11 = ");
-	vprint((*J.A11));	
+	J.A11->toDense(A);
+	vprint(A);	
 	printf("A12 = ");
-	vprint((*J.A12));	
+	J.A12->toDense(A);
+	vprint(A);	
 	printf("dA21 = %f, dA22 = %f\n",J.dA21,J.dA22);
 }
 
@@ -1369,9 +2179,9 @@ inline void MSDObject::IdentityMinushJacobian(Jacobian &J, const State &state, c
 	Vector<Real> v	= zero_vector3;
 	Vector<Real> w	= zero_vector3;	    
 
-	// clear Jacobian A11 A12 matrix
-	*(J.A11) = Matrix<Real>(3*state.size,3*state.size,0.0);
-	*(J.A12) = Matrix<Real>(3*state.size,3*state.size,0.0);
+	// clear Jacobian A11 A12 values, the pattern is kept
+	J.A11->zero();
+	J.A12->zero();
 
 /*
  * |         |         |   |     h df |    h df  |
@@ -1387,25 +2197,22 @@ inline void MSDObject::IdentityMinushJacobian(Jacobian &J, const State &state, c
 	for(unsigned int i=0;i<num_spring;i++)
 	{
 		// mass index start from 0
-		m1 = spring[i].node[0];
-		m2 = spring[i].node[1];		
+		m1 = spring.node[2*i];
+		m2 = spring.node[2*i+1];		
 		p = state.pos[m1];
 		q = state.pos[m2];
 		v = state.vel[m1];
 		w = state.vel[m2];
-		AddInternalSpringEntries(J.A11, J.A12, m1, m2, p, q, v, w, 
- 			spring[i].k_stiff, spring[i].l_zero, spring[i].b_damp);		
+		AddInternalSpringEntries(J.A11, J.A12, spring_block + 4*i, p, q, v, w, 
+ 			spring.k_stiff[i], spring.l_zero[i], spring.b_damp[i]);		
 	}		
 	
 	// A11 = -h/m Jv, A12 = -h/m Jx	
-	for(unsigned int i=0; i<J.A11->m(); i++)
+	for(unsigned int i=0; i<J.A11->mb(); i++)
 	{
-		h_m = -h/mass[i/3];
-		for(unsigned int j=0; j<J.A11->n(); j++)	
-		{	
-			(*(J.A11))[i][j] *= h_m;
-			(*(J.A12))[i][j] *= h_m;
-		}  
+		h_m = -h/mass[i];
+		J.A11->scaleRow(i, h_m);
+		J.A12->scaleRow(i, h_m);
 	}	
 
 	// dA21 = -hI, dA22 = I
@@ -1413,9 +2220,13 @@ inline void MSDObject::IdentityMinushJacobian(Jacobian &J, const State &state, c
 	J.dA22 = 1.0;
 
 	// A11 = I - h/m Jv
-	for(unsigned int i=0; i<J.A11->m(); i++)		
-		(*(J.A11))[i][i] += 1.0;		
-	// If boundary is set, set matrix row i to zero
+	for(unsigned int i=0; i<J.A11->mb(); i++) {
+		Real	*d = J.A11->diag(i);
+		d[0] += 1.0;
+		d[4] += 1.0;
+		d[8] += 1.0;
+	}
+	// If boundary is set, set matrix row i to identity
 	MSDBoundary		*bound = (MSDBoundary *) boundary;
 	for(unsigned int i = 0; i < num_mapping; i++) {	
 		unsigned int	index_msd;
@@ -1423,20 +2234,8 @@ inline void MSDObject::IdentityMinushJacobian(Jacobian &J, const State &state, c
 		index_msd = *(mapping+2*i);
 		index_obj = *(mapping+2*i+1);	
 		if (bound->boundary_type[index_obj]==1) {
-			for(unsigned int indexi = 3*index_msd; indexi < 3*index_msd+3; indexi++){
-				for(unsigned int indexj = 0; indexj < J.A11->n(); indexj++)
-				{
-					if(indexi!=indexj){
-						(*(J.A11))[indexi][indexj] = 0.0;								
-						(*(J.A12))[indexi][indexj] = 0.0;
-					}
-					else
-					{
-						(*(J.A11))[indexi][indexj] = 1.0;								
-						(*(J.A12))[indexi][indexj] = 1.0;
-					}
-				}								
-			}
+			J.A11->setRowIdentity(index_msd);
+			J.A12->setRowIdentity(index_msd);
 		}
 	}		
 }
@@ -1471,7 +2270,609 @@ inline void MSDObject::AccumStateSemiExplicit(State &new_state, const State &sta
 		new_state.pos[i] = temp;
   }
 }
-
+/**
+ * MSDObject::AllocProjective()
+ * Allocates the projective dynamics solver data. The skyline envelope
+ * follows the springs in node order, so its size depends on the node
+ * numbering of the .msd file. Data of an earlier call is freed first.
+ */
+void MSDObject::AllocProjective(void)
+{
+	// Selecting "PD" again starts over
+	if(projective.system != NULL) {
+		delete projective.system;
+		delete [] projective.fixed;
+		delete [] projective.fixed_now;
+		delete projective.X0;
+		delete projective.RHS0;
+		delete projective.RHS;
+	}
+
+	projective.system		= new SkylineCholesky<Real>();
+	projective.fixed		= new unsigned char[num_mass];
+	projective.fixed_now	= new unsigned char[num_mass];
+	projective.X0			= new Vector<Real>(3*num_mass, 0.0);
+	projective.RHS0			= new Vector<Real>(3*num_mass, 0.0);
+	projective.RHS			= new Vector<Real>(3*num_mass, 0.0);
+	if(projective.system == NULL || projective.fixed == NULL || projective.fixed_now == NULL ||
+	   projective.X0 == NULL || projective.RHS0 == NULL || projective.RHS == NULL) {
+		error_exit(-1, "Cannot allocate memory for projective dynamics!\n");
+	}
+
+	projective.system->initPattern(num_mass, num_spring, spring.node);
+	memset(projective.fixed, 0, num_mass);
+	projective.h			= 0.0;
+}
+
+
+/**
+ * MSDObject::FactorProjective()
+ * Assembles and factors the global matrix
+ *		M/h^2 + sum_springs (k + b/h) A^T A + sum_vsprings (k + b/h) S^T S
+ * with the rows and columns of the Dirichlet nodes in projective.fixed_now
+ * replaced by the identity. The damping of a spring acts on the full
+ * relative velocity of its ends here, not only along the spring.
+ * @param h time step.
+ */
+void MSDObject::FactorProjective(const Real h)
+{
+	SkylineCholesky<Real>	*A = projective.system;
+	unsigned int			i;
+
+	A->zero();
+	for(i = 0; i < num_mass; i++)
+		A->add(i, i, mass[i] / (h*h));
+
+	for(i = 0; i < num_spring; i++) {
+		unsigned int	v1 = spring.node[2*i];
+		unsigned int	v2 = spring.node[2*i+1];
+		Real			w  = spring.k_stiff[i] + spring.b_damp[i] / h;
+
+		A->add(v1, v1, w);
+		A->add(v2, v2, w);
+		A->add(v1, v2, -w);
+	}
+
+	for(i = 0; i < num_vspring; i++) {
+		unsigned int	v1 = vspring.node[2*i];
+		A->add(v1, v1, vspring.k_stiff[i] + vspring.b_damp[i] / h);
+	}
+
+	memcpy(projective.fixed, projective.fixed_now, num_mass);
+	for(i = 0; i < num_mass; i++)
+		if(projective.fixed[i]) A->setRowIdentity(i);
+
+	if(!A->factor()) {
+		error_exit(-1, "Projective dynamics system is not positive definite!\n");
+	}
+	projective.h = h;
+}
+
+
+/**
+ * MSDObject::ProjectiveBegin()
+ * Starts a projective dynamics step: refactors the global matrix if h or
+ * the Dirichlet nodes changed, sets the state to the inertial prediction
+ *		y = x + h v + h^2 M^-1 f_ext
+ * and computes the part of the right hand side that stays constant over
+ * the iterations. Gravity and the boundary tractions are the external
+ * forces; virtual springs pull towards their ground positions.
+ * @param state current state, overwritten with the initial guess.
+ * @param h time step.
+ */
+void MSDObject::ProjectiveBegin(State &state, const Real h)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+	Real			*x		= state.POS->begin();
+	const Real		*v		= state.VEL->begin();
+	Real			*x0		= projective.X0->begin();
+	Real			*rhs0	= projective.RHS0->begin();
+	const unsigned char	*fixed = projective.fixed_now;
+	unsigned int	i, c;
+	unsigned int	index_msd, index_obj;
+
+	// Dirichlet nodes of this step, refactor when they or h change
+	memset(projective.fixed_now, 0, num_mass);
+	for(i = 0; i < num_mapping; i++) {
+		index_msd = mapping[2*i];
+		index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] == 1) projective.fixed_now[index_msd] = 1;
+	}
+	if(h != projective.h || memcmp(projective.fixed, projective.fixed_now, num_mass) != 0)
+		FactorProjective(h);
+
+	*projective.X0 = *state.POS;
+
+	// y = x + h v + h^2 g, RHS0 = M/h^2 y
+	for(i = 0; i < num_mass; i++) {
+		Real	m = mass[i] / (h*h);
+		for(c = 0; c < 3; c++) {
+			Real	y = x0[3*i+c] + h * v[3*i+c];
+			if(c == 1) y -= g * h * h;
+			x[3*i+c]	= y;
+			rhs0[3*i+c]	= m * y;
+		}
+	}
+
+	// Boundary tractions: y += h^2/m f, RHS0 += f
+	for(i = 0; i < num_mapping; i++) {
+		index_msd = mapping[2*i];
+		index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] == 1) continue;
+		for(c = 0; c < 3; c++) {
+			Real	f = bound->boundary_value[index_obj][c];
+			x[3*index_msd+c]	+= h * h / mass[index_msd] * f;
+			rhs0[3*index_msd+c]	+= f;
+		}
+	}
+
+	// Spring damping: b/h A^T A x(t)
+	for(i = 0; i < num_spring; i++) {
+		unsigned int	v1 = spring.node[2*i];
+		unsigned int	v2 = spring.node[2*i+1];
+		Real			w  = spring.b_damp[i] / h;
+		for(c = 0; c < 3; c++) {
+			Real	d = w * (x0[3*v1+c] - x0[3*v2+c]);
+			rhs0[3*v1+c] += d;
+			rhs0[3*v2+c] -= d;
+		}
+	}
+
+	// Virtual springs: k ground + b/h x(t)
+	for(i = 0; i < num_vspring; i++) {
+		unsigned int	v1 = vspring.node[2*i];
+		unsigned int	v2 = vspring.node[2*i+1];
+		for(c = 0; c < 3; c++)
+			rhs0[3*v1+c] += vspring.k_stiff[i] * ground_pos[v2][c] + vspring.b_damp[i] / h * x0[3*v1+c];
+	}
+
+	// Dirichlet nodes: identity rows, their coupling moves to the right
+	// hand side of the free neighbours
+	for(i = 0; i < num_mapping; i++) {
+		index_msd = mapping[2*i];
+		index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] != 1) continue;
+		for(c = 0; c < 3; c++) {
+			x[3*index_msd+c]	= bound->boundary_value[index_obj][c];
+			rhs0[3*index_msd+c]	= x[3*index_msd+c];
+		}
+	}
+	for(i = 0; i < num_spring; i++) {
+		unsigned int	v1 = spring.node[2*i];
+		unsigned int	v2 = spring.node[2*i+1];
+		if(fixed[v1] == fixed[v2]) continue;
+		if(fixed[v1]) std::swap(v1, v2);
+		Real			w  = spring.k_stiff[i] + spring.b_damp[i] / h;
+		for(c = 0; c < 3; c++)
+			rhs0[3*v1+c] += w * x[3*v2+c];
+	}
+}
+
+
+/**
+ * MSDObject::ProjectiveLocal()
+ * Local step: projects every spring onto its rest length and adds
+ * k A^T p to the right hand side. Runs one spring colour at a time.
+ * @param state current iterate.
+ */
+void MSDObject::ProjectiveLocal(State &state)
+{
+	ForceTaskArg	arg;
+	unsigned int	i;
+
+	arg.object	= this;
+	arg.state	= &state;
+	arg.offset	= 0;
+
+	ParallelFor(num_mass, ProjectiveCopyTask, &arg, MSD_NODES_PER_THREAD);
+	for(i = 0; i < num_color; i++) {
+		arg.offset = color_ptr[i];
+		ParallelFor(color_ptr[i+1] - color_ptr[i], ProjectiveSpringTask, &arg, MSD_SPRINGS_PER_THREAD);
+	}
+}
+
+
+/**
+ * MSDObject::ProjectiveGlobal()
+ * Global step: solves the prefactored system for each coordinate.
+ * @param state current iterate, overwritten with the solution.
+ */
+void MSDObject::ProjectiveGlobal(State &state)
+{
+	*state.POS = *projective.RHS;
+	for(unsigned int c = 0; c < 3; c++)
+		projective.system->solve(state.POS->begin() + c, 3);
+}
+
+
+/**
+ * MSDObject::ProjectiveEnd()
+ * Finishes a projective dynamics step: v = (x - x(t)) / h, then applies
+ * the mixed boundary conditions the way AccumState() does.
+ * @param state final iterate.
+ * @param h time step.
+ */
+void MSDObject::ProjectiveEnd(State &state, const Real h)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+	Real			*x		= state.POS->begin();
+	Real			*v		= state.VEL->begin();
+	const Real		*x0		= projective.X0->begin();
+	unsigned int	i, c;
+
+	// Dirichlet nodes keep their velocity, as with the other integrators
+	for(i = 0; i < num_mass; i++) {
+		if(projective.fixed[i]) continue;
+		for(c = 0; c < 3; c++)
+			v[3*i+c] = (x[3*i+c] - x0[3*i+c]) / h;
+	}
+
+	// Mixed boundary: no motion along the normal, plus the prescribed
+	// normal displacement
+	for(i = 0; i < num_mapping; i++) {
+		unsigned int	index_msd = mapping[2*i];
+		unsigned int	index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] != 2) continue;
+
+		Real	*n	= bound->boundary_value2_vector[index_obj].begin();
+		Real	s	= bound->boundary_value2_scalar[index_obj];
+		Real	dn	= 0.0;
+		for(c = 0; c < 3; c++) dn += (x[3*index_msd+c] - x0[3*index_msd+c]) * n[c];
+		for(c = 0; c < 3; c++) {
+			x[3*index_msd+c]	+= (s - dn) * n[c];
+			v[3*index_msd+c]	-= dn / h * n[c];
+		}
+	}
+}
+
+
+/**
+ * MSDObject::ProjectiveCopyTask()
+ * Starts the right hand side of nodes [begin, end) from RHS0.
+ * @param arg ForceTaskArg.
+ */
+void MSDObject::ProjectiveCopyTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	MSDObject		*obj	= ((ForceTaskArg *) arg)->object;
+	const Real		*rhs0	= obj->projective.RHS0->begin();
+	Real			*rhs	= obj->projective.RHS->begin();
+
+	memcpy(rhs + 3*begin, rhs0 + 3*begin, 3*(end - begin)*sizeof(Real));
+}
+
+
+/**
+ * MSDObject::ProjectiveSpringTask()
+ * Projects springs [begin, end) of the colour starting at arg->offset and
+ * scatters k p into the right hand side of their free ends.
+ * @param arg ForceTaskArg.
+ */
+void MSDObject::ProjectiveSpringTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread)
+{
+	ForceTaskArg		*a		= (ForceTaskArg *) arg;
+	MSDObject			*obj	= a->object;
+	const Real			*pos	= a->state->POS->begin();
+	Real				*rhs	= obj->projective.RHS->begin();
+	const unsigned char	*fixed	= obj->projective.fixed;
+
+	for(unsigned int j = begin; j < end; j++) {
+		unsigned int	s	= obj->spring_order[a->offset + j];
+		unsigned int	v1	= obj->spring.node[2*s];
+		unsigned int	v2	= obj->spring.node[2*s+1];
+		Real			dir[3];
+
+		dir[0] = pos[3*v1]   - pos[3*v2];
+		dir[1] = pos[3*v1+1] - pos[3*v2+1];
+		dir[2] = pos[3*v1+2] - pos[3*v2+2];
+		Real	L2	= dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+		if(L2 <= 0.0) continue;
+
+		// k p = k * L0/L * dir
+		Real	c = obj->spring.k_stiff[s] * obj->spring.l_zero[s] / sqrt(L2);
+		if(!fixed[v1]) {
+			rhs[3*v1]	+= c * dir[0];
+			rhs[3*v1+1]	+= c * dir[1];
+			rhs[3*v1+2]	+= c * dir[2];
+		}
+		if(!fixed[v2]) {
+			rhs[3*v2]	-= c * dir[0];
+			rhs[3*v2+1]	-= c * dir[1];
+			rhs[3*v2+2]	-= c * dir[2];
+		}
+	}
+}
+
+
+/**
+ * MSDObject::AllocMultigrid()
+ * Allocates the multigrid solver of ImplicitEulerMG with the cycle and
+ * smoother of multigrid_param. The hierarchy is built by the first
+ * MultigridSolve(). The solver of an earlier call is freed first.
+ */
+void MSDObject::AllocMultigrid(void)
+{
+	// Selecting "ImEulerMG" again starts over
+	FreeMultigrid();
+
+	multigrid		= new ImplicitMultigrid();
+	multigrid_fixed	= new unsigned char[num_mass];
+	if(multigrid == NULL || multigrid_fixed == NULL) {
+		error_exit(-1, "Cannot allocate memory for multigrid!\n");
+	}
+	multigrid->Hierarchy().SetParameters(multigrid_param);
+}
+
+
+/**
+ * MSDObject::FreeMultigrid()
+ * Frees the multigrid solver, if any.
+ */
+void MSDObject::FreeMultigrid(void)
+{
+	if(multigrid != NULL) {
+		delete multigrid;
+		delete [] multigrid_fixed;
+		multigrid		= NULL;
+		multigrid_fixed	= NULL;
+	}
+}
+
+
+/**
+ * MSDObject::MultigridSolve()
+ * Solves J x = b for the Jacobian of IdentityMinushJacobian() through the
+ * velocity system M - h Jv - h^2 Jx, see ImplicitMultigrid.
+ * @param x solution.
+ * @param J Jacobian.
+ * @param b right hand side.
+ * @param tol tolerance relative to the right hand side of the velocity system.
+ * @param max_iter maximum number of CG iterations.
+ * @return unsigned int number of CG iterations.
+ */
+unsigned int MSDObject::MultigridSolve(State &x, const Jacobian &J, const State &b, Real tol, unsigned int max_iter)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+
+	memset(multigrid_fixed, 0, num_mass);
+	for(unsigned int i = 0; i < num_mapping; i++) {
+		unsigned int	index_msd = mapping[2*i];
+		unsigned int	index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] == 1) multigrid_fixed[index_msd] = 1;
+	}
+
+	return multigrid->Solve(x.VEL->begin(), x.POS->begin(), *J.A11, *J.A12, J.dA21, J.dA22,
+							b.VEL->begin(), b.POS->begin(), mass, multigrid_fixed, tol, max_iter);
+}
+
+
+/**
+ * MSDObject::AllocModal()
+ * Allocates the modal reduction data. The modes themselves are computed
+ * by the first ModalBegin(), once the boundary conditions are known.
+ */
+void MSDObject::AllocModal(void)
+{
+	modal.basis			= new ModalBasis();
+	modal.fixed			= new unsigned char[num_mass];
+	modal.X0			= new Vector<Real>(3*num_mass, 0.0);
+	modal.F0			= new Vector<Real>(3*num_mass, 0.0);
+	modal.Q				= NULL;
+	modal.QDOT			= NULL;
+	modal.FQ			= NULL;
+	modal.DAMP			= NULL;
+	if(modal.basis == NULL || modal.fixed == NULL || modal.X0 == NULL || modal.F0 == NULL) {
+		error_exit(-1, "Cannot allocate memory for modal reduction!\n");
+	}
+	memset(modal.fixed, 0, num_mass);
+}
+
+
+/**
+ * MSDObject::FreeModal()
+ * Frees the modal reduction data allocated by AllocModal() and BuildModal().
+ */
+void MSDObject::FreeModal(void)
+{
+	delete modal.basis;
+	delete [] modal.fixed;
+	delete modal.X0;
+	delete modal.F0;
+	delete modal.Q;
+	delete modal.QDOT;
+	delete modal.FQ;
+	delete modal.DAMP;
+	modal.basis			= NULL;
+	modal.fixed			= NULL;
+	modal.X0			= NULL;
+	modal.F0			= NULL;
+	modal.Q				= NULL;
+	modal.QDOT			= NULL;
+	modal.FQ			= NULL;
+	modal.DAMP			= NULL;
+}
+
+
+/**
+ * MSDObject::BuildModal()
+ * Linearizes the model about the given state and computes its lowest
+ * vibration modes, or loads them from the cache file when it was written
+ * for the same linearization. The springs contribute the tangent
+ * stiffness
+ *		K = k [ (1 - L0/L) I + L0/L n n^T ]
+ * and the damping C = b n n^T; the nodes with a Dirichlet boundary
+ * condition at this point stay fixed in every mode.
+ * @param state state to linearize about, its velocity becomes the
+ *		initial reduced velocity.
+ */
+void MSDObject::BuildModal(State &state)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+	const Real		*x		= state.POS->begin();
+	unsigned int	i, r, c;
+
+	memset(modal.fixed, 0, num_mass);
+	for(i = 0; i < num_mapping; i++)
+		if(bound->boundary_type[mapping[2*i+1]] == 1) modal.fixed[mapping[2*i]] = 1;
+
+	// Rest forces: gravity and whatever the springs carry at X0
+	*modal.X0 = *state.POS;
+	Vector<Real>	vel(*state.VEL);
+	*state.VEL = 0.0;
+	UpdateForces(state);
+	*modal.F0 = *FORCE;
+	*state.VEL = vel;
+
+	BlockCRSMatrix<Real>	K, C;
+	Real					kb[9], cb[9], n[3];
+
+	K.initPattern(num_mass, num_spring, spring.node);
+	C.initPattern(num_mass, num_spring, spring.node);
+	for(i = 0; i < num_spring; i++) {
+		unsigned int	v1 = spring.node[2*i];
+		unsigned int	v2 = spring.node[2*i+1];
+		for(c = 0; c < 3; c++) n[c] = x[3*v1+c] - x[3*v2+c];
+		Real	L = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(L <= 0.0) continue;
+		for(c = 0; c < 3; c++) n[c] /= L;
+
+		Real	ki = spring.k_stiff[i] * (1.0 - spring.l_zero[i] / L);
+		Real	kn = spring.k_stiff[i] * spring.l_zero[i] / L;
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				kb[3*r+c] = kn * n[r] * n[c] + ((r == c) ? ki : 0.0);
+				cb[3*r+c] = spring.b_damp[i] * n[r] * n[c];
+			}
+
+		K.addBlock(K.find(v1, v1), kb, 1.0);	C.addBlock(C.find(v1, v1), cb, 1.0);
+		K.addBlock(K.find(v2, v2), kb, 1.0);	C.addBlock(C.find(v2, v2), cb, 1.0);
+		K.addBlock(K.find(v1, v2), kb, -1.0);	C.addBlock(C.find(v1, v2), cb, -1.0);
+		K.addBlock(K.find(v2, v1), kb, -1.0);	C.addBlock(C.find(v2, v1), cb, -1.0);
+	}
+
+	// Virtual springs have zero rest length
+	for(i = 0; i < num_vspring; i++) {
+		unsigned int	v1 = vspring.node[2*i];
+		unsigned int	v2 = vspring.node[2*i+1];
+		for(c = 0; c < 3; c++) n[c] = x[3*v1+c] - ground_pos[v2][c];
+		Real	L = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				kb[3*r+c] = (r == c) ? vspring.k_stiff[i] : 0.0;
+				cb[3*r+c] = (L > 0.0) ? vspring.b_damp[i] * n[r] * n[c] / (L*L) : 0.0;
+			}
+		K.addBlock(K.find(v1, v1), kb, 1.0);
+		C.addBlock(C.find(v1, v1), cb, 1.0);
+	}
+
+	unsigned int	key = ModalBasis::Key(K, mass, modal.fixed, modal.num_modes);
+	if(modal.cache == NULL || !modal.basis->Load(modal.cache, key) || modal.basis->NumNodes() != num_mass) {
+		logger->Message(GetName(), "Computing vibration modes...", 1);
+		if(!modal.basis->Compute(K, mass, modal.fixed, modal.num_modes))
+			logger->Message(GetName(), "Vibration modes did not fully converge.", 1);
+		if(modal.basis->NumModes() == 0) {
+			error_exit(-1, "Cannot compute the vibration modes of the MSD model!\n");
+		}
+		if(modal.cache != NULL && getenv("GIPSI_WRITE_MODES") != NULL)
+			modal.basis->Save(modal.cache, key);
+	}
+
+	unsigned int	num = modal.basis->NumModes();
+	if(modal.Q != NULL) {
+		delete modal.Q;		delete modal.QDOT;
+		delete modal.FQ;	delete modal.DAMP;
+	}
+	modal.Q		= new Vector<Real>(num, 0.0);
+	modal.QDOT	= new Vector<Real>(num, 0.0);
+	modal.FQ	= new Vector<Real>(num, 0.0);
+	modal.DAMP	= new Vector<Real>(num, 0.0);
+	modal.basis->ProjectDiagonal(modal.DAMP->begin(), C);
+
+	// q = 0 at X0, qdot = U^T M v
+	for(i = 0; i < num_mass; i++) {
+		if(modal.fixed[i]) continue;
+		Real	mv[3] = { mass[i] * vel[3*i], mass[i] * vel[3*i+1], mass[i] * vel[3*i+2] };
+		modal.basis->ProjectNode(modal.QDOT->begin(), i, mv);
+	}
+}
+
+
+/**
+ * MSDObject::ModalBegin()
+ * Starts a modal step: builds the modes on the first call and projects
+ * the rest forces and the boundary tractions onto them.
+ * @param state current state.
+ * @param h time step.
+ */
+void MSDObject::ModalBegin(State &state, const Real h)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+
+	if(modal.basis->NumModes() == 0) BuildModal(state);
+
+	modal.basis->Project(modal.FQ->begin(), modal.F0->begin());
+	for(unsigned int i = 0; i < num_mapping; i++) {
+		unsigned int	index_msd = mapping[2*i];
+		unsigned int	index_obj = mapping[2*i+1];
+		if(bound->boundary_type[index_obj] == 1 || modal.fixed[index_msd]) continue;
+		modal.basis->ProjectNode(modal.FQ->begin(), index_msd, bound->boundary_value[index_obj].begin());
+	}
+}
+
+
+/**
+ * MSDObject::ModalEnd()
+ * Finishes a modal step by reconstructing the mapped nodes, which are
+ * all that the boundary, the display and the collision detection read.
+ * Dirichlet nodes take their prescribed positions.
+ * @param state state to update.
+ */
+void MSDObject::ModalEnd(State &state)
+{
+	MSDBoundary		*bound	= (MSDBoundary *) boundary;
+
+	for(unsigned int i = 0; i < num_mapping; i++) {
+		unsigned int	index_msd = mapping[2*i];
+		unsigned int	index_obj = mapping[2*i+1];
+		Real			*x = state.pos[index_msd].begin();
+		Real			*v = state.vel[index_msd].begin();
+
+		if(bound->boundary_type[index_obj] == 1) {
+			state.pos[index_msd]	= bound->boundary_value[index_obj];
+			state.vel[index_msd]	= 0.0;
+		}
+		else ModalReconstructNode(index_msd, x, v);
+	}
+}
+
+
+/**
+ * MSDObject::ModalReconstruct()
+ * Reconstructs the full state from the reduced coordinates, for users
+ * that need the unmapped nodes as well.
+ */
+void MSDObject::ModalReconstruct(void)
+{
+	for(unsigned int i = 0; i < num_mass; i++)
+		ModalReconstructNode(i, state.pos[i].begin(), state.vel[i].begin());
+}
+
+
+/**
+ * MSDObject::ModalReconstructNode()
+ * x = X0 + U q and v = U qdot for one node.
+ */
+void MSDObject::ModalReconstructNode(unsigned int index, Real *x, Real *v)
+{
+	const Real		*x0 = modal.X0->begin() + 3*index;
+	Real			u[3];
+
+	if(modal.fixed[index]) return;
+	modal.basis->ReconstructNode(u, index, modal.Q->begin());
+	x[0] = x0[0] + u[0];	x[1] = x0[1] + u[1];	x[2] = x0[2] + u[2];
+	modal.basis->ReconstructNode(v, index, modal.QDOT->begin());
+}
+
+
 void MSDObject::setInitialCondition(void)
 {	
 	state.pos[1][1] = 0.0;
@@ -1633,6 +3034,9 @@ void MSDObject::SetupDisplay(XMLNodeList * simObjectChildren)
  */
 Vector<Real>		MSDObject::GetNodePosition(unsigned int index)
 {
+	// Only the mapped nodes are kept current by the modal integrator
+	if(modal.basis != NULL && modal.basis->NumModes() > 0)
+		ModalReconstructNode(index, state.pos[index].begin(), state.vel[index].begin());
 	return state.pos[index];
 }
 
@@ -1645,6 +3049,8 @@ Vector<Real>		MSDObject::GetNodePosition(unsigned int index)
  */
 Vector<Real>		MSDObject::GetNodeVelocity(unsigned int index)
 {
+	if(modal.basis != NULL && modal.basis->NumModes() > 0)
+		ModalReconstructNode(index, state.pos[index].begin(), state.vel[index].begin());
 	return	state.vel[index];
 }
 
@@ -1661,6 +3067,34 @@ Vector<Real>		MSDObject::GetNodeForce(unsigned int index)
 }
 
 
+/**
+ * MSDObject::NodePosition()
+ * Returns node position without a copy.
+ * @param index node index.
+ * @return pointer to the 3 coordinates of the node.
+ */
+const Real			*MSDObject::NodePosition(unsigned int index)
+{
+	if(modal.basis != NULL && modal.basis->NumModes() > 0)
+		ModalReconstructNode(index, state.pos[index].begin(), state.vel[index].begin());
+	return state.pos[index].begin();
+}
+
+
+/**
+ * MSDObject::NodeVelocity()
+ * Returns node velocity without a copy.
+ * @param index node index.
+ * @return pointer to the 3 components of the velocity.
+ */
+const Real			*MSDObject::NodeVelocity(unsigned int index)
+{
+	if(modal.basis != NULL && modal.basis->NumModes() > 0)
+		ModalReconstructNode(index, state.pos[index].begin(), state.vel[index].begin());
+	return state.vel[index].begin();
+}
+
+
 /**
  * MSDObject::Display()
  * Displays the MSD mesh
@@ -1674,9 +3108,122 @@ void MSDObject::Display(void)
 }
 
 
+// Matrix entries added for a HapticTerm
+#define HAPTIC_TERM_NONE		0
+#define HAPTIC_TERM_CONTACT		1	// contact node to internal node ind[0]
+#define HAPTIC_TERM_CONTACT_D	2	// contact node to a fixed node or the ground, D only
+#define HAPTIC_TERM_INTERNAL	3	// internal nodes ind[0] and ind[1]
+#define HAPTIC_TERM_BOUNDARY	4	// internal node ind[0] to a boundary node
+
+/**
+ *	MSDObject::BuildHapticTerms()
+ *	Resolves the springs of the neighbourhood of node into HapticTerms.
+ *	This only depends on the topology, so it is done once per contact node.
+ */
+void MSDObject::BuildHapticTerms(HapticCache &cache, int node)
+{
+	MSDModel		*msdmodel = msdModelBuilder.GetModel(node);
+	unsigned int	num_mass_internal = msdmodel->getMassSize(1);
+	HapticTerm		term;
+
+	cache.node			= node;
+	cache.generation	= msdModelBuilder.GetGeneration();
+	cache.model			= msdmodel;
+	cache.terms.clear();
+	cache.force.resize(3*(num_mass_internal+1));
+
+	// loop through the spring types
+	for(unsigned int type=0; type<3; type++)
+	{
+		for(unsigned int i = 0; i<msdmodel->getSpringSize(type); i++)
+		{
+			unsigned int	s		= msdmodel->getSpringIndex(type, i);
+			unsigned int	v1		= spring.node[2*s];
+			unsigned int	v2		= spring.node[2*s+1];
+
+			term.spring		= s;
+			term.virt		= 0;
+			term.kind		= HAPTIC_TERM_NONE;
+			term.ind[0]		= -1;
+			term.ind[1]		= -1;
+
+			// forces are collected on the contact node and the internal nodes only
+			term.slot[0]	= (v1 == (unsigned int) node) ? num_mass_internal : msdmodel->getMassNum(1, v1);
+			term.slot[1]	= (v2 == (unsigned int) node) ? num_mass_internal : msdmodel->getMassNum(1, v2);
+
+			if(type==0)  // contact spring
+			{
+				// the end that is not the contact node
+				unsigned int	other = msdmodel->isInMassIndex(type, v1) ? v2 : v1;
+				if( !isFixedBoundary(other) ) 
+				{
+					term.ind[0] = msdmodel->getMassNum(type+1, other);
+					if(term.ind[0] != -1) term.kind = HAPTIC_TERM_CONTACT;
+				}
+				else
+					term.kind = HAPTIC_TERM_CONTACT_D;
+			}
+
+			if(type==1) // internal spring
+			{
+				// check if node[0] and node[1] are not boundary nodes
+				if( !(isFixedBoundary(v1) || isFixedBoundary(v2)) ) 
+				{
+					term.kind	= HAPTIC_TERM_INTERNAL;
+					term.ind[0]	= msdmodel->getMassNum(type, v1);
+					term.ind[1]	= msdmodel->getMassNum(type, v2);
+				}
+			}
+
+			if(type==2) // boundary spring
+			{
+				// the end that is not the boundary node
+				unsigned int	other = msdmodel->isInMassIndex(type, v1) ? v2 : v1;
+				term.ind[0] = msdmodel->getMassNum(type-1, other);
+				if(term.ind[0] != -1) term.kind = HAPTIC_TERM_BOUNDARY;
+			}
+
+			cache.terms.push_back(term);
+		}
+	}
+
+	// virtual springs: the index of vspring is the same as the node index
+	if(num_ground>0)
+	{
+		for(unsigned int type=0; type<3; type++) 
+		{
+			for(unsigned int i = 0; i<msdmodel->getMassSize(type); i++)
+			{
+				unsigned int	mass_index = msdmodel->getMassIndex(type, i);
+
+				term.spring		= mass_index;
+				term.virt		= 1;
+				term.kind		= HAPTIC_TERM_NONE;
+				term.ind[0]		= -1;
+				term.ind[1]		= -1;
+				term.slot[0]	= (type==0) ? num_mass_internal : ((type==1) ? (int) i : -1);
+				term.slot[1]	= -1;		// no force on the ground
+
+				if(type==0)
+					term.kind = HAPTIC_TERM_CONTACT_D;
+				if(type==2) {
+					term.ind[0] = msdmodel->getMassNum(type-1, vspring.node[2*mass_index]);
+					if(term.ind[0] != -1) term.kind = HAPTIC_TERM_BOUNDARY;
+				}
+
+				cache.terms.push_back(term);
+			}
+		}
+	}
+}
+
+
 /**
  *	MSDObject::ReturnHapticModel()
- *	Returns a haptic model built around the current node and current face
+ *	Returns a haptic model built around the current node and current face.
+ *	Model is filled in place, see ReserveHapticModel(). The neighbourhood
+ *	of the contact node is cached, so repeated calls for the same contact
+ *	only evaluate the springs.
  *
  */     
 int MSDObject::ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderLinearHapticModel &Model)
@@ -1685,369 +3232,188 @@ int MSDObject::ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderLi
 	 * because Haptic units are in F[N], L[mm], v[mm/s]
 	 * but in model units are in F[0.00001N], L[cm], v[cm/s], m[g]
 	 */
-	static MSDBoundary	*bound = (MSDBoundary *) boundary;	
-	
 	int msd_index = getMSDIndex(BoundaryNodeIndex);
 	if(msd_index < 0) return -1;
-	
-	// build msd_model around BoundaryNodeIndex
-	MSDModel  *msdmodel = &msdModel[msd_index];	
-	unsigned int num_mass_internal = msdmodel->getMassSize(1);
-	unsigned int num_spring[3];
-	unsigned mass_index;
-	unsigned spring_index;	
-	
-	//Vector<Real> oldpos(3, 0.0);
-	//Vector<Real> oldvel(3, 0.0);
-	
-	// get number of spring in each type of spring
-	num_spring[0] = msdmodel->getSpringSize(0);
-	num_spring[1] = msdmodel->getSpringSize(1);
-	num_spring[2] = msdmodel->getSpringSize(2);
-	
-	// save old position and velocity of BoundaryNodeIndex
-	//oldpos = state.pos[msd_index];	
-	//oldvel = state.vel[msd_index];	
 
-	// update the position of BoundaryNodeIndex	(Boundary type 1)
-	//state.pos[msd_index] = bound->GetPosition(BoundaryNodeIndex); //bound->boundary_value[BoundaryNodeIndex];
-			
+	pthread_mutex_lock(&haptic_lock);
+
+	// build the neighbourhood terms around BoundaryNodeIndex
+	HapticCache		&cache = haptic_cache;
+	if(cache.node != msd_index || cache.generation != msdModelBuilder.GetGeneration())
+		BuildHapticTerms(cache, msd_index);
+
+	MSDModel		*msdmodel = cache.model;
+	unsigned int	num_mass_internal = msdmodel->getMassSize(1);
+
+	// The modal integrator only keeps the mapped nodes current; bring the
+	// neighbourhood the model reads up to date
+	if(modal.basis != NULL && modal.basis->NumModes() > 0) {
+		for(unsigned int type = 0; type < 3; type++)
+			for(unsigned int i = 0; i < msdmodel->getMassSize(type); i++) {
+				unsigned int	index = msdmodel->getMassIndex(type, i);
+				ModalReconstructNode(index, state.pos[index].begin(), state.vel[index].begin());
+			}
+	}
+
 	// calculate the Low Order Linear Haptic Model
 	unsigned int n = num_mass_internal*2*3;
 	unsigned int m = 6;
 	unsigned int k = 3;
 	unsigned int n_2 = n/2;	
 
-	GiPSiLowOrderLinearHapticModel* model = new GiPSiLowOrderLinearHapticModel();		
-
-	model->_n = n;
-	model->_m = m;
-	model->_k = k;
-
-	// allocate memory
-	model->A11 = new Matrix<Real>(n_2, n_2, 0.0);
-	model->A12 = new Matrix<Real>(n_2, n_2, 0.0);
-	model->B1  = new Matrix<Real>(n_2, m  , 0.0);
-	model->C11 = new Matrix<Real>(k  , n_2, 0.0);
-	model->C12 = new Matrix<Real>(k  , n_2, 0.0);
-	model->D   = new Matrix<Real>(k  , m  , 0.0);
-	model->f_0 = new Vector<Real>(k, 0.0);
-	model->zdot_0 = new Vector<Real>(n, 0.0);
-	model->normal = new Vector<Real>(k, 0.0);
-
-	// seed f_0
-	(*(model->f_0))[0] = 0.0;
-	(*(model->f_0))[1] = 0.0; 
-	(*(model->f_0))[2] = 0.0;
-	
-	// calculate the force at BoundaryNodeIndex (type 0) and internal node (type 1)
-	Vector<Real> dir;
-	Vector<Real> rel_vel;
-	Vector<Real> s_force = zero_vector3;
-	Vector<Real> d_force = zero_vector3; 
-	Vector<Real> temp_force = zero_vector3;
-
-	Vector<Real> *internal_node_force; 
-	Vector<Real> contact_node_force;
-	
-	// Allocate internal_node_force
-	internal_node_force = new Vector<Real>[num_mass_internal];
-	if(internal_node_force == NULL) {
-		error_exit(-1, "Cannot allocate memory for internal_node_forces!\n");
-	}
-	
-	// Clear the forces
-	contact_node_force = zero_vector3;
-	for(unsigned int i = 0; i < num_mass_internal; i++) internal_node_force[i] = zero_vector3;
+	ReserveHapticModel(Model, n, m, k);
 
-	int v1, v2; // spring node 1 and 2 in full model
-	int m1, m2; // spring node 1 and 2 in msdmodel
+	const Real		*pos = state.POS->begin();
+	const Real		*vel = state.VEL->begin();
+	static const Real	ground_vel[3] = { 0.0, 0.0, 0.0 };
+	Real			*force = &cache.force[0];
+	unsigned int	t;
+
+	for(t = 0; t < cache.force.size(); t++) force[t] = 0.0;
 
 	//
 	// We will first calculate z_dot_0 and f_0
 	//
-
-	// loop through the spring types
-	for(unsigned int type=0; type<3; type++) 
+	for(t = 0; t < cache.terms.size(); t++)
 	{
-		// loop through the springs of the given type
-		for(unsigned int i = 0; i<num_spring[type]; i++)
-		{			
-			// dir = v1-v2
-			spring_index = msdmodel->getSpringIndex(type, i);
-			v1 = spring[spring_index].node[0];
-			v2 = spring[spring_index].node[1];
-			// collect the force on internal node only (type 1)
-			m1 = msdmodel->getMassNum(1, v1);
-			m2 = msdmodel->getMassNum(1, v2);
-			 
-			dir = state.pos[v1] - state.pos[v2];
-			Real L = dir.length();			
-
-			if(L>0.0){
-				// Add spring force
-				// f = -k * (1 - L0/L) * dir
-				temp_force = -spring[spring_index].k_stiff * (1 - spring[spring_index].l_zero / L) * dir;
-				// Add local damping
-				rel_vel = state.vel[v1] - state.vel[v2];
-				temp_force += -spring[spring_index].b_damp * ((rel_vel * dir) / (L*L)) * dir;
-			}
-			if(type == 0)
-			{
-				if( spring[spring_index].node[0] == msd_index ) 
-				{
-					contact_node_force += temp_force;
-					internal_node_force[m2] -= temp_force;
-				}
-				else
-				{
-					internal_node_force[m1] += temp_force;				
-					contact_node_force -= temp_force;					
-				}
-			} 
-			
-			if(type == 1) 
-			{				
-				internal_node_force[m1] += temp_force;
-				internal_node_force[m2] -= temp_force;			
-			}
+		const HapticTerm	&term = cache.terms[t];
+		if(term.slot[0] == -1 && term.slot[1] == -1) continue;
+
+		const Real	*p, *q, *v, *w;
+		Real		k_stiff, l_zero, b_damp;
+		if(term.virt) {
+			unsigned int	v1 = vspring.node[2*term.spring];
+			p = pos + 3*v1;		v = vel + 3*v1;
+			q = ground_pos[vspring.node[2*term.spring+1]].begin();	w = ground_vel;
+			k_stiff	= vspring.k_stiff[term.spring];
+			l_zero	= 0.0;
+			b_damp	= vspring.b_damp[term.spring];
+		}
+		else {
+			unsigned int	v1 = spring.node[2*term.spring];
+			unsigned int	v2 = spring.node[2*term.spring+1];
+			p = pos + 3*v1;		v = vel + 3*v1;
+			q = pos + 3*v2;		w = vel + 3*v2;
+			k_stiff	= spring.k_stiff[term.spring];
+			l_zero	= spring.l_zero[term.spring];
+			b_damp	= spring.b_damp[term.spring];
+		}
 
-			if(type == 2)
-			{
-				if( msdmodel->isInMassIndex(1, v1) ) 				
-					internal_node_force[m1] += temp_force;			
-				if( msdmodel->isInMassIndex(1, v2) ) 				
-					internal_node_force[m2] -= temp_force;			 
-			}			
+		// dir = v1-v2
+		Real	dir[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+		Real	L2 = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+		Real	c = 0.0;
+
+		if(term.virt) {
+			// f = -k * dir, the virtual springs have no rest length
+			c = -k_stiff;
+			if(L2>0.0)
+				c += -b_damp * (v[0]*dir[0] + v[1]*dir[1] + v[2]*dir[2]) / L2;
+		}
+		else if(L2>0.0) {
+			// f = -k * (1 - L0/L) * dir, plus local damping
+			c = -k_stiff * (1 - l_zero / sqrt(L2));
+			c += -b_damp * ((v[0]-w[0])*dir[0] + (v[1]-w[1])*dir[1] + (v[2]-w[2])*dir[2]) / L2;
 		}
-	}
 
-	// for virtual spring ////////////////////////////////////////////
-	if(num_ground>0) {		
-		// loop through the mass types
-		for(unsigned int type=0; type<2; type++) 
-		{
-			// loop through the mass of the given type
-			for(unsigned int i = 0; i<msdModel->getMassSize(type); i++)
-			{
-				mass_index = msdmodel->getMassIndex(type,i);
-				// force from vspring 
-				// because index of vspring is the same as node index and ground index
-				// dir = v1-v2
-				v1 = vspring[mass_index].node[0];	// mass node
-				v2 = vspring[mass_index].node[1];	// ground node (no force on it)
-				
-				dir = state.pos[v1] - ground_pos[v2];
-				Real L = dir.length();
-
-				// Add spring force
-				// f = -k * (1 - L/L0) * dir
-				temp_force = -vspring[mass_index].k_stiff * dir;				
-				
-				// Add local damping
-				if(L>0.0) {	// check for divide by zero
-					rel_vel = state.vel[v1];
-					temp_force += -vspring[mass_index].b_damp * ((rel_vel * dir) / (L*L)) * dir;				
-				}
-				if(type==0)
-					contact_node_force += temp_force;
-				if(type==1)
-					internal_node_force[i] += temp_force;
-			}
+		if(term.slot[0] != -1) {
+			Real	*f = force + 3*term.slot[0];
+			f[0] += c * dir[0];		f[1] += c * dir[1];		f[2] += c * dir[2];
+		}
+		if(term.slot[1] != -1) {
+			Real	*f = force + 3*term.slot[1];
+			f[0] -= c * dir[0];		f[1] -= c * dir[1];		f[2] -= c * dir[2];
 		}
 	}
-	// end for virtual spring //////////////////////////////////////////
 
-	(*(model->f_0)) = contact_node_force;
+	Real	*f_0	= Model.f_0->begin();
+	Real	*zdot_0	= Model.zdot_0->begin();
+
+	f_0[0] = force[3*num_mass_internal];
+	f_0[1] = force[3*num_mass_internal+1];
+	f_0[2] = force[3*num_mass_internal+2];
 	
 	// seed z_dot0	
 	for(unsigned int i = 0; i < num_mass_internal; i++)
 	{	
-		Vector<Real> acc = zero_vector3;
-		Vector<Real> vel = zero_vector3;
-		mass_index = msdmodel->getMassIndex(1, i);
-		double mm = mass[mass_index];
+		unsigned int	mass_index = msdmodel->getMassIndex(1, i);
+		double			mm = mass[mass_index];
+		double			mmi = (mm > 0) ? 1/mm : 0.0;
 
-		if (mm > 0)
-		{
-			double mmi = 1/mm;			
-			acc = internal_node_force[i] * mmi;
-		} 		
-	
 		// acc
-		(*(model->zdot_0))[3*i]   = acc[0];
-		(*(model->zdot_0))[3*i+1] = acc[1];
-		(*(model->zdot_0))[3*i+2] = acc[2];
+		zdot_0[3*i]   = force[3*i]   * mmi;
+		zdot_0[3*i+1] = force[3*i+1] * mmi;
+		zdot_0[3*i+2] = force[3*i+2] * mmi;
 
 		// vel
-		 vel = GetNodeVelocity(mass_index);
-		(*(model->zdot_0))[n_2+3*i]   = vel[0];
-		(*(model->zdot_0))[n_2+3*i+1] = vel[1];
-		(*(model->zdot_0))[n_2+3*i+2] = vel[2];
+		zdot_0[n_2+3*i]   = vel[3*mass_index];
+		zdot_0[n_2+3*i+1] = vel[3*mass_index+1];
+		zdot_0[n_2+3*i+2] = vel[3*mass_index+2];
 	}
 	
 	//
 	// We will now calculate A, B, C, and D matrices
 	//
-
-	// loop through the spring types
-	for(unsigned int type=0; type<3; type++)
+	for(t = 0; t < cache.terms.size(); t++)
 	{
-		// loop through the springs of the given type
-		for(unsigned int i = 0; i< num_spring[type]; i++)
-		{
-			spring_index = msdmodel->getSpringIndex(type, i);
-			Spring& s = spring[spring_index];
-			Vector<Real> p = GetNodePosition(s.node[0]);
-			Vector<Real> q = GetNodePosition(s.node[1]);
-			Vector<Real> v = GetNodeVelocity(s.node[0]);
-			Vector<Real> w = GetNodeVelocity(s.node[1]);
-
-			if(type==0)  // contact spring
-			{
-				// check if node[0] is contact node or not
-				if(msdmodel->isInMassIndex(type, s.node[0])) 
-				{
-					// node[0] is contact node then 
-					// check if node[1] is boundary node or not
-					if( !isFixedBoundary(s.node[1]) ) 					
-					{
-						// node[1] is not boundary node, then spring is contact spring
-						// node[1] is internal node
-						int index = msdmodel->getMassNum(type+1, s.node[1]);
-						if(index != -1)
-							AddContactSpringEntries(model, index, p, q, v, w, s.k_stiff, s.l_zero, s.b_damp);	
-					}
-					else 
-						// node[1] is boundary node, then spring is boundary spring (add only D matrix)
-						AddContactSpringEntries(model, p, q, v, w, s.k_stiff, s.l_zero, s.b_damp);						
-				}
-				else
-				{
-					// node[1] is contact node then 
-					// check if node[0] is boundary node or not
-					if( !isFixedBoundary(s.node[0]) )
-					{
-						// node[0] is not boundary node, then spring is contact spring
-						// node[0] is internal node
-						int index = msdmodel->getMassNum(type+1, s.node[0]);
-						if(index != -1)
-							AddContactSpringEntries(model, index, q, p, w, v, s.k_stiff, s.l_zero, s.b_damp);							
-					}
-					else 
-						// node[0] is boundary node, then spring is contact spring (add only D matrix)
-						AddContactSpringEntries(model, q, p, w, v, s.k_stiff, s.l_zero, s.b_damp);						
-				}
-			}
-			
-			if(type==1) // internal spring
-			{
-				// check if node[0] and node[1] are not boundary nodes
-				if( !(isFixedBoundary(s.node[0]) || isFixedBoundary(s.node[1])) ) 
-					AddInternalSpringEntries(model, msdmodel->getMassNum(type, s.node[0]), msdmodel->getMassNum(type, s.node[1]), p, q, v, w, s.k_stiff, s.l_zero, s.b_damp);						
-			}
-
-			if(type==2) // boundary spring
-			{
-				// check if node[0] is boundary node or not
-				if(msdmodel->isInMassIndex(type, s.node[0])) 
-				{
-					int index = msdmodel->getMassNum(type-1, s.node[1]);
-					if(index != -1)
-						AddBoundarySpringEntries(model, index, q, p, w, v, s.k_stiff, s.l_zero, s.b_damp);						
-				}
-				else 
-				{
-					int index = msdmodel->getMassNum(type-1, s.node[0]);
-					if(index != -1)						
-						AddBoundarySpringEntries(model, index, p, q, v, w, s.k_stiff, s.l_zero, s.b_damp);					
-				}
-			}			
+		const HapticTerm	&term = cache.terms[t];
+		if(term.kind == HAPTIC_TERM_NONE) continue;
+
+		const Real	*p, *q, *v, *w;
+		Real		mK[9], mB[9], mV[9];
+		if(term.virt) {
+			unsigned int	v1 = vspring.node[2*term.spring];
+			p = pos + 3*v1;		v = vel + 3*v1;
+			q = ground_pos[vspring.node[2*term.spring+1]].begin();	w = ground_vel;
+			BuildSpringMatrices(p, q, v, w, vspring.k_stiff[term.spring], vspring.l_zero[term.spring], vspring.b_damp[term.spring], mK, mB, mV);
 		}
-	}
-
-	// for virtual spring ////////////////////////////////////////////
-	if(num_ground>0)
-	{
-		// loop through the mass types
-		for(unsigned int type=0; type<3; type++) 
-		{
-			// loop through the mass of the given type
-			for(unsigned int i = 0; i<msdModel->getMassSize(type); i++)
-			{
-				mass_index = msdmodel->getMassIndex(type, i);				
-				// force from vspring 
-				// because index of vspring is the same as node index and ground index
-				Spring& s = vspring[mass_index];
-				Vector<Real> p = GetNodePosition(s.node[0]);
-				Vector<Real> q = ground_pos[s.node[1]];	// ground
-				Vector<Real> v = GetNodeVelocity(s.node[0]);
-				Vector<Real> w = zero_vector3;			// ground
-				if(type==0)			
-					AddContactSpringEntries(model, p, q, v, w, s.k_stiff, s.l_zero, s.b_damp);																		
-				if(type==2)	{
-					int index = msdmodel->getMassNum(type-1, s.node[0]);
-					if(index!=-1)
-						AddBoundarySpringEntries(model, index, q, p, w, v, s.k_stiff, s.l_zero, s.b_damp);						
-				}
-			}
+		else {
+			unsigned int	v1 = spring.node[2*term.spring];
+			unsigned int	v2 = spring.node[2*term.spring+1];
+			p = pos + 3*v1;		v = vel + 3*v1;
+			q = pos + 3*v2;		w = vel + 3*v2;
+			BuildSpringMatrices(p, q, v, w, spring.k_stiff[term.spring], spring.l_zero[term.spring], spring.b_damp[term.spring], mK, mB, mV);
 		}
-	}
-	// end for virtual spring //////////////////////////////////////////
 
-	// divide rows of A11, A12 by node masses
-	for(unsigned int i = 0; i < model->A11->m(); i++)
-	{
-		double mm = mass[msdmodel->getMassIndex(1, i/3)];
-		if( mm > 0.0)
-		{
-			double mmi = 1/mm;
-			for(unsigned int j = 0; j < model->A11->n(); j++)
-			{			
-				(*(model->A11))[i][j] = (*(model->A11))[i][j] * mmi;
-				(*(model->A12))[i][j] = (*(model->A12))[i][j] * mmi;
-			}  
-		}
-		else
-		{
-			for(unsigned int j = 0; j < model->A11->n(); j++)
-	 		{			
-				(*(model->A11))[i][j] = 0.0;
-				(*(model->A12))[i][j] = 0.0;				
-			}  			
+		switch(term.kind) {
+			case HAPTIC_TERM_CONTACT:
+				AddContactSpringEntries(&Model, term.ind[0], mK, mB, mV);
+				break;
+			case HAPTIC_TERM_CONTACT_D:
+				AddContactSpringEntries(&Model, mK, mB, mV);
+				break;
+			case HAPTIC_TERM_INTERNAL:
+				AddInternalSpringEntries(&Model, term.ind[0], term.ind[1], mK, mB, mV);
+				break;
+			case HAPTIC_TERM_BOUNDARY:
+				AddBoundarySpringEntries(&Model, term.ind[0], mK, mB, mV);
+				break;
 		}
-
 	}
 
-	// divide rows of B1 by node masses
-	for(unsigned int i = 0; i < model->B1->m(); i++)
+	// divide rows of A11, A12 and B1 by node masses
+	for(unsigned int i = 0; i < n_2; i++)
 	{
-		double mm = mass[msdmodel->getMassIndex(1, i/3)];
-		if(mm > 0.0)
-		{
-			double mmi = 1/mm;
-			for(unsigned int j = 0; j < model->B1->n(); j++)
-				(*(model->B1))[i][j] = (*(model->B1))[i][j] * mmi;  
-		}		
-		else
-		{
-			for(unsigned int j = 0; j < model->B1->n(); j++)
-				(*(model->B1))[i][j] = 0.0; 
-		}
+		double	mm = mass[msdmodel->getMassIndex(1, i/3)];
+		double	mmi = (mm > 0.0) ? 1/mm : 0.0;
+		Real	*a11 = (*(Model.A11))[i];
+		Real	*a12 = (*(Model.A12))[i];
+		Real	*b1	 = (*(Model.B1))[i];
+
+		for(unsigned int j = 0; j < n_2; j++)
+		{			
+			a11[j] *= mmi;
+			a12[j] *= mmi;
+		}  
+		for(unsigned int j = 0; j < m; j++)
+			b1[j] *= mmi;  
 	}
 	
-	//printf("\n D\n");		vprint(*(model->D));
-	//printf("\n C11\n");	vprint(*(model->C11));
-	//printf("\n C12\n");	vprint(*(model->C12));
-
-	delete []internal_node_force;
+	//printf("\n D\n");		vprint(*(Model.D));
+	//printf("\n C11\n");	vprint(*(Model.C11));
+	//printf("\n C12\n");	vprint(*(Model.C12));
 
-	Model = (*model);
-	delete model;
-	
-	// set state back to old state
-	//state.pos[msd_index] = oldpos;	
-	//state.vel[msd_index] = oldvel;	
+	pthread_mutex_unlock(&haptic_lock);
 
 	return 0;	
 }
@@ -2083,59 +3449,48 @@ int MSDObject::ReturnHapticModel(unsigned int FaceNodeIndex1,
 		return false;
 }
 */
-bool MSDObject::isFixedBoundary(unsigned int index)
-{
-	bool found = false;	
-	for(unsigned int i=0; i<num_boundary; i++)
-	{
-		if( fix_boundary[i] == index ) {
-			found = true;
-			break;
-		}
-	}
-	return found;
-}
 
-int MSDObject::getMSDIndex(unsigned int OBJIndex)
+/**
+ * MSDObject::BuildIndexTables()
+ * Builds the MSD <-> OBJ index tables and the fixed node flags from
+ * mapping and fix_boundary. When a node is mapped more than once the
+ * first entry of mapping wins, as with the former linear search.
+ */
+void MSDObject::BuildIndexTables(void)
 {
-	bool found = false;	
-	unsigned int	index_msd;
-	unsigned int	index_obj;
-	
-	for(unsigned int i=0; i<num_mapping; i++)
-	{
-		index_msd = *(mapping+2*i);
-		index_obj = *(mapping+2*i+1);
-		if( OBJIndex == index_obj ) {
-			found = true;
-			break;
-		}
-	}
+	unsigned int	i;
 
-	if(!found) index_msd = -1;
+	delete[] msd_of_obj;
+	delete[] obj_of_msd;
+	delete[] fixed_node;
 
-	return index_msd;
-}
+	num_msd_index = num_mass;
+	num_obj_index = (geometry != NULL) ? ((TriSurface *) geometry)->num_vertex : 0;
+	for(i = 0; i < num_mapping; i++)
+		if(mapping[2*i+1] >= num_obj_index) num_obj_index = mapping[2*i+1] + 1;
 
-int MSDObject::getOBJIndex(unsigned int MSDIndex)
-{
-	bool found = false;	
-	unsigned int	index_msd;
-	unsigned int	index_obj;
-	
-	for(unsigned int i=0; i<num_mapping; i++)
-	{
-		index_msd = *(mapping+2*i);
-		index_obj = *(mapping+2*i+1);
-		if( MSDIndex == index_msd ) {
-			found = true;
-			break;
-		}
+	msd_of_obj	= new int[num_obj_index];
+	obj_of_msd	= new int[num_msd_index];
+	fixed_node	= new unsigned char[num_msd_index];
+	if(msd_of_obj == NULL || obj_of_msd == NULL || fixed_node == NULL) {
+		error_exit(-1, "Cannot allocate memory for index tables!\n");
 	}
 
-	if(!found) index_obj = -1;
+	for(i = 0; i < num_obj_index; i++)	msd_of_obj[i] = -1;
+	for(i = 0; i < num_msd_index; i++)	obj_of_msd[i] = -1;
+	memset(fixed_node, 0, num_msd_index);
+
+	for(i = 0; i < num_mapping; i++) {
+		unsigned int	index_msd = mapping[2*i];
+		unsigned int	index_obj = mapping[2*i+1];
+		if(msd_of_obj[index_obj] == -1)
+			msd_of_obj[index_obj] = index_msd;
+		if(index_msd < num_msd_index && obj_of_msd[index_msd] == -1)
+			obj_of_msd[index_msd] = index_obj;
+	}
 
-	return index_obj;
+	for(i = 0; i < num_boundary; i++)
+		if(fix_boundary[i] < num_msd_index) fixed_node[fix_boundary[i]] = 1;
 }
 
 /**
@@ -2371,11 +3726,14 @@ Vector<Real>	MSDBoundary::GetPosition(unsigned int index)
  */
 void			MSDBoundary::GetPosition(Vector<Real> *Bpos)
 {
-	int msd_index;
+	MSDObject				*obj		= (MSDObject *) Object;
+	const MSDObject::State	&state		= obj->GetState();
+	const int				*msd_index	= obj->getMSDIndexTable();
+	unsigned int			num_index	= obj->getNumOBJIndex();
+
 	for (unsigned int index=0; index < this->num_vertex; index++) {
-		msd_index = ((MSDObject*)Object)->getMSDIndex(index);
-		if (msd_index != -1)
-			Bpos[index] = Object->GetNodePosition(msd_index);
+		if (index < num_index && msd_index[index] != -1)
+			Bpos[index] = state.pos[msd_index[index]];
 		else
 			Bpos[index] = vertex[index].pos;
 	}
@@ -2413,14 +3771,16 @@ Vector<Real>	MSDBoundary::GetVelocity(unsigned int index)
  */
 void			MSDBoundary::GetVelocity(Vector<Real> *Bvel)	
 {
-	Vector<Real>	Vel(3,0.0);
-	int msd_index;
+	MSDObject				*obj		= (MSDObject *) Object;
+	const MSDObject::State	&state		= obj->GetState();
+	const int				*msd_index	= obj->getMSDIndexTable();
+	unsigned int			num_index	= obj->getNumOBJIndex();
+
 	for (unsigned int index=0; index < this->num_vertex; index++) {
-		msd_index = ((MSDObject*)Object)->getMSDIndex(index);
-		if (msd_index != -1)
-			Bvel[index] = Object->GetNodeVelocity(msd_index);
+		if (index < num_index && msd_index[index] != -1)
+			Bvel[index] = state.vel[msd_index[index]];
 		else
-			Bvel[index] = Vel;
+			Bvel[index] = zero_vector3;
 	}
 	
 	/*
@@ -2512,6 +3872,99 @@ void			MSDBoundary::GetReactionForce(Vector<Real> *Bforce)
 }
 
 
+/**
+ * MSDBoundary::GetPositions
+ * Get positions of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bpos 3 coordinates per listed node.
+ */
+void			MSDBoundary::GetPositions(unsigned int n, const unsigned int *index, Real *Bpos)
+{
+	MSDObject				*obj		= (MSDObject *) Object;
+	const int				*msd_index	= obj->getMSDIndexTable();
+	unsigned int			num_index	= obj->getNumOBJIndex();
+
+	for (unsigned int i=0; i < n; i++, Bpos+=3) {
+		unsigned int	k = index[i];
+		const Real		*p;
+
+		if (k < num_index && msd_index[k] != -1)
+			p = obj->NodePosition(msd_index[k]);
+		else
+			p = vertex[k].pos.begin();
+		Bpos[0]=p[0];	Bpos[1]=p[1];	Bpos[2]=p[2];
+	}
+}
+
+
+/**
+ * MSDBoundary::GetVelocities
+ * Get velocities of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bvel 3 components per listed node.
+ */
+void			MSDBoundary::GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel)
+{
+	MSDObject				*obj		= (MSDObject *) Object;
+	const int				*msd_index	= obj->getMSDIndexTable();
+	unsigned int			num_index	= obj->getNumOBJIndex();
+
+	for (unsigned int i=0; i < n; i++, Bvel+=3) {
+		unsigned int	k = index[i];
+
+		if (k < num_index && msd_index[k] != -1) {
+			const Real	*v = obj->NodeVelocity(msd_index[k]);
+			Bvel[0]=v[0];	Bvel[1]=v[1];	Bvel[2]=v[2];
+		}
+		else
+			Bvel[0]=Bvel[1]=Bvel[2]=0.0;
+	}
+}
+
+
+/**
+ * MSDBoundary::GetReactionForces
+ * Get reaction forces of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bforce 3 components per listed node.
+ */
+void			MSDBoundary::GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce)
+{
+	MSDObject				*obj		= (MSDObject *) Object;
+	const int				*msd_index	= obj->getMSDIndexTable();
+	unsigned int			num_index	= obj->getNumOBJIndex();
+
+	for (unsigned int i=0; i < n; i++, Bforce+=3) {
+		unsigned int	k = index[i];
+		const Real		*f, *d;
+		Real			fd;
+
+		Bforce[0]=Bforce[1]=Bforce[2]=0.0;
+		if (k >= num_index || msd_index[k] == -1) continue;
+
+		switch (boundary_type[k]) {
+			case (0):   // Neumann type boundary condition   (Specify traction)
+				break;
+			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
+				f = obj->NodeForce(msd_index[k]);
+				Bforce[0]=f[0];	Bforce[1]=f[1];	Bforce[2]=f[2];
+				break;
+			case (2):	// Mixed boundary condition type i: normal component of the force
+				f = obj->NodeForce(msd_index[k]);
+				d = boundary_value2_vector[k].begin();
+				fd = f[0]*d[0] + f[1]*d[1] + f[2]*d[2];
+				Bforce[0]=d[0]*fd;	Bforce[1]=d[1]*fd;	Bforce[2]=d[2]*fd;
+				break;
+			default:
+				error_exit(0,"Unrecognized boundary condition type\n");
+		}
+	}
+}
+
+
 /**
  * MSDBoundary::Set
  * Sets MSD Boundary.
@@ -2699,16 +4152,72 @@ bool MassNode::isInSpringIndex(unsigned int index)
 
 MSDModel::MSDModel()
 {
+	finalized = false;
 }
 
 void MSDModel::addSpringIndex(unsigned int type, unsigned int index)
 {
 	spring_index[type].push_back(index);	
+	finalized = false;
 }
 
 void MSDModel::addMassIndex(unsigned int type, unsigned int index)
 {
 	mass_index[type].push_back(index);
+	finalized = false;
+}
+
+void MSDModel::clear(void)
+{
+	for(unsigned int type=0; type<3; type++)
+	{
+		mass_index[type].clear();
+		spring_index[type].clear();
+		mass_order[type].clear();
+		spring_order[type].clear();
+	}
+	finalized = false;
+}
+
+// Orders local nums by the global index they hold
+struct LocalNumLess {
+	const vector<unsigned int>	*index;
+	bool operator()(unsigned int a, unsigned int b) const { return (*index)[a] < (*index)[b]; }
+};
+
+static void SortLocalNums(const vector<unsigned int> &index, vector<unsigned int> &order)
+{
+	LocalNumLess	less;
+
+	order.resize(index.size());
+	for(unsigned int i=0; i<order.size(); i++) order[i] = i;
+	less.index = &index;
+	sort(order.begin(), order.end(), less);
+}
+
+// Local num of a global index through the sorted order, -1 if absent
+static int FindLocalNum(const vector<unsigned int> &index, const vector<unsigned int> &order, unsigned int value)
+{
+	unsigned int	lo = 0;
+	unsigned int	hi = order.size();
+
+	while(lo < hi) {
+		unsigned int	mid = (lo + hi) / 2;
+		if(index[order[mid]] < value)	lo = mid + 1;
+		else							hi = mid;
+	}
+	if(lo < order.size() && index[order[lo]] == value) return order[lo];
+	return -1;
+}
+
+void MSDModel::finalize(void)
+{
+	for(unsigned int type=0; type<3; type++)
+	{
+		SortLocalNums(mass_index[type], mass_order[type]);
+		SortLocalNums(spring_index[type], spring_order[type]);
+	}
+	finalized = true;
 }
 
 vector<unsigned int> MSDModel::getMassIndex(unsigned int type)
@@ -2733,6 +4242,8 @@ unsigned int MSDModel::getSpringIndex(unsigned int type, unsigned int num)
 
 int MSDModel::getMassNum(unsigned int type, unsigned int index)
 {
+	if(finalized) return FindLocalNum(mass_index[type], mass_order[type], index);
+
 	int found = -1;
 	for(unsigned int i=0;i<mass_index[type].size(); i++)
 	{
@@ -2746,6 +4257,8 @@ int MSDModel::getMassNum(unsigned int type, unsigned int index)
 
 int MSDModel::getSpringNum(unsigned int type, unsigned int index)
 {
+	if(finalized) return FindLocalNum(spring_index[type], spring_order[type], index);
+
 	int found = -1;
 	for(unsigned int i=0;i<spring_index[type].size(); i++)
 	{
@@ -2759,6 +4272,8 @@ int MSDModel::getSpringNum(unsigned int type, unsigned int index)
 
 bool MSDModel::isInSpringIndex(unsigned int type, unsigned int index)
 {
+	if(finalized) return FindLocalNum(spring_index[type], spring_order[type], index) != -1;
+
 	bool found = false;
 	for(unsigned int i=0;i<spring_index[type].size(); i++)
 	{
@@ -2772,6 +4287,8 @@ bool MSDModel::isInSpringIndex(unsigned int type, unsigned int index)
 
 bool MSDModel::isInMassIndex(unsigned int type, unsigned int index)
 {
+	if(finalized) return FindLocalNum(mass_index[type], mass_order[type], index) != -1;
+
 	bool found = false;
 	for(unsigned int i=0;i<mass_index[type].size(); i++)
 	{
@@ -2788,144 +4305,170 @@ MSDModelBuilder::MSDModelBuilder()
 	depth = 0;
 	msd = NULL;
 	total_msdModel = 0;
+	adj_ptr = NULL;
+	adj_node = NULL;
+	adj_spring = NULL;
+	node_stamp = NULL;
+	node_level = NULL;
+	spring_stamp = NULL;
+	stamp = 0;
+	model = NULL;
+	model_valid = NULL;
+	generation = 0;
 }
 
 MSDModelBuilder::~MSDModelBuilder()
 {	
-	delete massnode;
+	Release();
 }
 
-void MSDModelBuilder::BuildModel(MSDModel *msdModel, MSDObject *msd, unsigned int depth)
+void MSDModelBuilder::Release(void)
 {
-	//MSDBoundary*	bound = (MSDBoundary *) msd->GetBoundaryPtr();	
-	//total_msdModel = bound->num_vertex;
-	total_msdModel = msd->getNumMass();
+	delete[] adj_ptr;		adj_ptr = NULL;
+	delete[] adj_node;		adj_node = NULL;
+	delete[] adj_spring;	adj_spring = NULL;
+	delete[] node_stamp;	node_stamp = NULL;
+	delete[] node_level;	node_level = NULL;
+	delete[] spring_stamp;	spring_stamp = NULL;
+	delete[] model;			model = NULL;
+	delete[] model_valid;	model_valid = NULL;
+}
 
-	unsigned int total_mass = msd->getNumMass();
-	unsigned int total_spring = msd->getNumSpring();
-	
+/**
+ * MSDModelBuilder::Init()
+ * Builds the spring graph of msd. Models are built on demand by GetModel().
+ * @param msd MSD object.
+ * @param depth depth of the neighbourhood.
+ */
+void MSDModelBuilder::Init(MSDObject *msd, unsigned int depth)
+{
 	this->depth = depth;
 	this->msd = msd;
 
-	// create the massnode
-	massnode = new MassNode[total_mass];
-	if(massnode==NULL) {
-		error_exit(-1, "Cannot allocate memory for massnode!\n");
+	BuildGraph(true);
+}
+
+/**
+ * MSDModelBuilder::Invalidate()
+ * Drops the cached models and rebuilds the spring graph.
+ */
+void MSDModelBuilder::Invalidate(void)
+{
+	if(msd != NULL) BuildGraph(false);
+}
+
+void MSDModelBuilder::BuildGraph(bool use_stored)
+{
+	unsigned int	total_spring = msd->getNumSpring();
+	unsigned int	i;
+
+	Release();
+	total_msdModel = msd->getNumMass();
+
+	adj_ptr			= new unsigned int[total_msdModel+1];
+	adj_node		= new unsigned int[2*total_spring];
+	adj_spring		= new unsigned int[2*total_spring];
+	node_stamp		= new unsigned int[total_msdModel];
+	node_level		= new unsigned int[total_msdModel];
+	spring_stamp	= new unsigned int[total_spring];
+	model			= new MSDModel[total_msdModel];
+	model_valid		= new unsigned char[total_msdModel];
+	if(adj_ptr == NULL || adj_node == NULL || adj_spring == NULL || node_stamp == NULL ||
+	   node_level == NULL || spring_stamp == NULL || model == NULL || model_valid == NULL) {
+		error_exit(-1, "Cannot allocate memory for MSDModelBuilder!\n");
 	}
-	// add mass index information to each massnode
-	for(unsigned int i=0; i<total_mass; i++)
-	{
-		massnode[i].refid = i;				
+
+	// Use the adjacency stored with the model unless the topology was
+	// changed since it was loaded
+	const unsigned int	*ptr, *node, *spring;
+	if(use_stored && msd->getSpringAdjacency(ptr, node, spring)) {
+		memcpy(adj_ptr, ptr, (total_msdModel+1)*sizeof(unsigned int));
+		memcpy(adj_node, node, ptr[total_msdModel]*sizeof(unsigned int));
+		memcpy(adj_spring, spring, ptr[total_msdModel]*sizeof(unsigned int));
 	}
-	// add spring index information to each massnode
-	for(unsigned int i=0; i<total_spring; i++)
-	{
-		unsigned int sIndex = msd->getSpring(i).refid;
-		unsigned int node0 = msd->getSpring(i).node[0];
-		unsigned int node1 = msd->getSpring(i).node[1];
-		if (node0 < total_mass)
-			massnode[node0].addSpringIndex(sIndex);
-		if (node1 < total_mass)
-			massnode[node1].addSpringIndex(sIndex);				
+	else {
+		BuildSpringAdjacency(total_msdModel, msd->getSprings(), adj_ptr, adj_node, adj_spring);
 	}
 
-	// offline build msd model for all nodeIndex (i=nodeIndex)
-	for(unsigned int i=0; i<total_msdModel; i++)
-	{		
-		// initilize num_mass and num_spring to zero
-		unsigned int nodeIndex = massnode[i].refid;
+	memset(node_stamp, 0, total_msdModel*sizeof(unsigned int));
+	memset(spring_stamp, 0, total_spring*sizeof(unsigned int));
+	memset(model_valid, 0, total_msdModel);
+	stamp = 0;
+	generation++;
+}
 
-		// initilzation part // depth = 1 //////////////////////////////////////////////////
-		// for nodeIndex is contact node (type 0). 
-		// All springs that contact this nodeIndex will be the contact spring (type 0)
-		// get number of spring of massnode i
-		unsigned int sNum = massnode[nodeIndex].getSpringSize();
-		
-		msdModel[nodeIndex].addMassIndex(0, nodeIndex);
-		// for all spring_index that connected with nodeIndex i
-		for(unsigned int sIndex = 0; sIndex<sNum; sIndex++)
+/**
+ * MSDModelBuilder::GetModel()
+ * Returns the model around node, building it on first use.
+ * @param node MSD node index.
+ * @return MSDModel* model, NULL if node is out of range.
+ */
+MSDModel* MSDModelBuilder::GetModel(unsigned int node)
+{
+	if(node >= total_msdModel) return NULL;
+
+	if(!model_valid[node]) {
+		BuildModel(model[node], node);
+		model_valid[node] = 1;
+	}
+	return &model[node];
+}
+
+/**
+ * MSDModelBuilder::BuildModel()
+ * Breadth first search from node. The node itself and the springs on it
+ * are the contact part (type 0), nodes closer than depth and the springs
+ * between them are internal (type 1), nodes at depth and the springs
+ * reaching them are boundary (type 2).
+ */
+void MSDModelBuilder::BuildModel(MSDModel &msdModel, unsigned int node)
+{
+	unsigned int	head = 0;
+
+	// Bump the stamp, a wrap around needs the stamps cleared
+	if(++stamp == 0) {
+		memset(node_stamp, 0, total_msdModel*sizeof(unsigned int));
+		memset(spring_stamp, 0, msd->getNumSpring()*sizeof(unsigned int));
+		stamp = 1;
+	}
+
+	msdModel.clear();
+	msdModel.addMassIndex(0, node);
+	node_stamp[node] = stamp;
+	node_level[node] = 0;
+
+	queue.clear();
+	queue.push_back(node);
+
+	while(head < queue.size())
+	{
+		unsigned int	u	= queue[head++];
+		unsigned int	lu	= node_level[u];
+
+		if(lu >= depth) continue;
+
+		for(unsigned int k=adj_ptr[u]; k<adj_ptr[u+1]; k++)
 		{
-			unsigned int spring_index = massnode[nodeIndex].getSpringIndex(sIndex);
-			msdModel[nodeIndex].addSpringIndex(0, spring_index);
-			Spring spring = msd->getSpring(spring_index);
-			if (spring.node[0] == nodeIndex) 
-			{
-				if ( !msdModel[nodeIndex].isInMassIndex(1, spring.node[1]) )
-					msdModel[nodeIndex].addMassIndex(1, spring.node[1]);
-			}
-			else 
-			{
-				if ( !msdModel[nodeIndex].isInMassIndex(1, spring.node[0]) )
-					msdModel[nodeIndex].addMassIndex(1, spring.node[0]);		
+			unsigned int	v = adj_node[k];
+			unsigned int	s = adj_spring[k];
+
+			if(node_stamp[v] != stamp) {
+				node_stamp[v] = stamp;
+				node_level[v] = lu+1;
+				msdModel.addMassIndex((lu+1 < depth) ? 1 : 2, v);
+				queue.push_back(v);
 			}
-		}	
 
-		// depth looping part ////////////////////////////////////////////////////////////
-		for(unsigned int d=1; d<depth; d++) 
-		{
-			unsigned int num_mass = msdModel[nodeIndex].getMassSize(1);
-			vector<unsigned int> mass_index_list = msdModel[nodeIndex].getMassIndex(1);
-			for(unsigned int j=0; j<num_mass; j++) 
-			{
-				unsigned int mass_index = massnode[mass_index_list[j]].refid;
-				// get number of spring of massnode j
-				sNum = massnode[mass_index].getSpringSize();
-				// for all spring_index that connected with nodeIndex i
-				for(unsigned int sIndex = 0; sIndex<sNum; sIndex++)
-				{
-					unsigned int spring_index = massnode[mass_index].getSpringIndex(sIndex);
-					Spring spring = msd->getSpring(spring_index);
+			if(spring_stamp[s] == stamp) continue;
+			spring_stamp[s] = stamp;
 
-					if(d<(depth-1)) // nodes will be internal node, spring will be internal spring
-					{
-						msdModel[nodeIndex].addSpringIndex(1, spring_index);					
-						
-						if (spring.node[0]==mass_index)
-						{
-							if ( !msdModel[nodeIndex].isInMassIndex(1, spring.node[1]) )
-								msdModel[nodeIndex].addMassIndex(1, spring.node[1]);
-						}
-						else
-						{
-							if ( !msdModel[nodeIndex].isInMassIndex(1, spring.node[0]) )
-								msdModel[nodeIndex].addMassIndex(1, spring.node[0]);	 	
-						}
-					}
-					else 
-					{						
-						// spring will be internal spring
-						if( msdModel[nodeIndex].isInMassIndex(1, spring.node[0]) &&
-							msdModel[nodeIndex].isInMassIndex(1, spring.node[1]) )
-						{
-							if ( !msdModel[nodeIndex].isInSpringIndex(1, spring_index) )
-								msdModel[nodeIndex].addSpringIndex(1, spring_index);
-						}
-
-						// spring will be boundary spring
-						if( !(msdModel[nodeIndex].isInSpringIndex(0, spring_index) ||
-							  msdModel[nodeIndex].isInSpringIndex(1, spring_index)) ) 
-						{
-							if ( !msdModel[nodeIndex].isInSpringIndex(2, spring_index) )
-								msdModel[nodeIndex].addSpringIndex(2, spring_index);							
-						
-							// nodes will be boundary node, 
-							if (spring.node[0]==mass_index) 
-							{
-								if( !msdModel[nodeIndex].isInMassIndex(2, spring.node[1]) && !msdModel[nodeIndex].isInMassIndex(1, spring.node[1]))
-									msdModel[nodeIndex].addMassIndex(2, spring.node[1]);
-							}
-							else
-							{
-								if( !msdModel[nodeIndex].isInMassIndex(2, spring.node[0]) && !msdModel[nodeIndex].isInMassIndex(1, spring.node[0]))
-									msdModel[nodeIndex].addMassIndex(2, spring.node[0]);
-							}
-						} 						
-					} 
-				}
-			}
+			if(lu == 0)						msdModel.addSpringIndex(0, s);
+			else if(node_level[v] < depth)	msdModel.addSpringIndex(1, s);
+			else							msdModel.addSpringIndex(2, s);
 		}
-		// no need finalize part because all springs in finalize step are connected with boundary node		
 	}
+
+	msdModel.finalize();
 }
 
 /*
@@ -3032,26 +4575,26 @@ void MSDModelBuilder::BuildModel(MSDModel *msdModel, MSDObject *msd, unsigned in
 }
 */
 
-void MSDModelBuilder::print(MSDModel* msdModel)
+void MSDModelBuilder::print(void)
 {
-	for(unsigned int i=0; i<total_msdModel; i++)
+	for(unsigned int mass_index=0; mass_index<total_msdModel; mass_index++)
 	{
-		unsigned int mass_index = massnode[i].refid;
+		MSDModel *msdModel = GetModel(mass_index);
 		printf("= msdModel %3d ==============================================================\n", mass_index);
 
 		for(unsigned int type=0; type<3; type++)
 		{
 			printf("--- type : %d ---------------------\n", type);
-			unsigned int num_mass = msdModel[mass_index].getMassSize(type);
-			unsigned int num_spring = msdModel[mass_index].getSpringSize(type);			
+			unsigned int num_mass = msdModel->getMassSize(type);
+			unsigned int num_spring = msdModel->getSpringSize(type);			
 			printf("#mass_index = %d, #spring_index = %d\n", num_mass, num_spring);
 			printf("mass_index [");
 			for(unsigned int j=0; j<num_mass; j++)
-				printf(" %d",msdModel[mass_index].getMassIndex(type, j));
+				printf(" %d",msdModel->getMassIndex(type, j));
 			printf(" ]\n");
 			printf("spring_index [");
 			for(unsigned int j=0; j<num_spring; j++)
-				printf(" %d",msdModel[mass_index].getSpringIndex(type, j));
+				printf(" %d",msdModel->getSpringIndex(type, j));
 			printf(" ]\n");
 		}
 		printf("=============================================================================\n\n");
@@ -31,9 +31,14 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 #define _MSD_H
 
 #include <vector>
+#include <pthread.h>
 #include "GiPSiAPI.h"
 #include "GiPSiCompToolset.h"
 #include "XMLNode.h"
+#include "mapped_file.h"
+#include "mesh_order.h"
+#include "modal_basis.h"
+#include "multigrid.h"
 
 using namespace GiPSiXMLWrapper;
 
@@ -118,6 +123,8 @@ public:
 	vector<unsigned int>	spring_index[3];	//spring indices in each spring type
 	void					addSpringIndex(unsigned int type, unsigned int index);
 	void					addMassIndex(unsigned int type, unsigned int index);
+	void					clear(void);
+	void					finalize(void);		//sort the lookups, call after the last add
 	unsigned int			getMassSize(unsigned int type) { return mass_index[type].size(); }
 	unsigned int			getSpringSize(unsigned int type) { return spring_index[type].size(); }	
 	vector<unsigned int>	getMassIndex(unsigned int type);
@@ -128,23 +135,51 @@ public:
 	int						getSpringNum(unsigned int type, unsigned int index);	//get local num from global index	
 	bool					isInSpringIndex(unsigned int type, unsigned int index);
 	bool					isInMassIndex(unsigned int type, unsigned int index);
+protected:
+	vector<unsigned int>	mass_order[3];		//local nums sorted by global index, valid when finalized
+	vector<unsigned int>	spring_order[3];	//local nums sorted by global index, valid when finalized
+	bool					finalized;
 };
 
 /**
  * MSDModelBuilder Class.
- * Base class of MSDModelBuilder which create all msdModel.
+ * Builds the MSDModel of a node on first use and caches it. The spring
+ * adjacency of the MSD is kept as a CSR graph and the neighbourhood of
+ * a node is found by a breadth first search to the given depth.
+ * Nodes at distance 1..depth-1 are internal, nodes at distance depth
+ * are boundary nodes.
  */
 class MSDModelBuilder {
 public:
 	MSDModelBuilder();
 	~MSDModelBuilder();
-	void			BuildModel(MSDModel* msdModel, MSDObject* msd, unsigned int depth);	
-	void			print(MSDModel* msdModel);
+	void			Init(MSDObject* msd, unsigned int depth);	// build the spring graph
+	MSDModel*		GetModel(unsigned int node);				// cached model around node
+	void			Invalidate(void);							// call when the spring topology changes
+	unsigned int	GetGeneration(void) { return generation; }	// changes whenever the models are rebuilt
+	void			print(void);
 protected:			
+	void			BuildGraph(bool use_stored);			// use_stored: take the adjacency loaded with the model
+	void			BuildModel(MSDModel &model, unsigned int node);
+	void			Release(void);
+
 	unsigned int	depth;
 	unsigned int	total_msdModel;
-	MassNode*		massnode;	
 	MSDObject*		msd;
+
+	unsigned int	*adj_ptr;		// CSR row pointers, size = total_msdModel+1
+	unsigned int	*adj_node;		// neighbour of each adjacency entry
+	unsigned int	*adj_spring;	// spring of each adjacency entry
+
+	unsigned int	*node_stamp;	// BFS visit stamps, size = total_msdModel
+	unsigned int	*node_level;	// BFS distance, valid where node_stamp == stamp
+	unsigned int	*spring_stamp;	// spring visit stamps, size = number of springs
+	unsigned int	stamp;
+	vector<unsigned int>	queue;
+
+	MSDModel		*model;			// model cache, size = total_msdModel
+	unsigned char	*model_valid;
+	unsigned int	generation;
 };
 
 /** 
@@ -177,6 +212,19 @@ public:
 	Real			getEnergy();
 };
 
+/**
+ * SpringArray.
+ * Structure-of-arrays storage of a set of springs. Spring i connects
+ * node[2*i] to node[2*i+1].
+ */
+typedef struct {
+	unsigned int	*node;		/**< end node indices, size = 2*num */
+	Real			*l_zero;	/**< rest lengths */
+	Real			*k_stiff;	/**< stiffnesses */
+	Real			*b_damp;	/**< internal dampings */
+	unsigned int	num;		/**< number of springs */
+} SpringArray;
+
 /**
  * MSDObject Class.
  * Base class for Mass Spring Damper Object.
@@ -193,16 +241,61 @@ public:
 		unsigned int	size;		/**< state size */
 	} State;
 
+	/**< One spring of a haptic model, resolved against the contact neighbourhood */
+	typedef struct {
+		unsigned int	spring;		/**< spring index, or virtual spring index if virt is set */
+		unsigned char	virt;		/**< 1 for a virtual spring */
+		unsigned char	kind;		/**< matrix entries to add, HAPTIC_TERM_* in msd.cpp */
+		int				ind[2];		/**< internal node nums used for the matrix entries */
+		int				slot[2];	/**< force slots of the two ends, -1 if not collected */
+	} HapticTerm;
+
+	/**< Contact dependent part of ReturnHapticModel, kept while the contact node stays the same */
+	typedef struct {
+		int					node;		/**< MSD index of the contact node, -1 if empty */
+		unsigned int		generation;	/**< msdModelBuilder generation of terms */
+		MSDModel			*model;		/**< neighbourhood of node */
+		vector<HapticTerm>	terms;		/**< springs in model order, then virtual springs */
+		vector<Real>		force;		/**< force slots, internal nodes then the contact node */
+	} HapticCache;
+
 	/**< Jacobian parameter for the MSD with Implicit method */
 	typedef struct 
 	{
-		Matrix<Real>	*A11;		/**< Matrix A11  : 3*size x 3*size */
-		Matrix<Real>	*A12;		/**< Matrix A12  : 3*size x 3*size */
+		BlockCRSMatrix<Real>	*A11;	/**< Matrix A11  : 3*size x 3*size, 3x3 blocks following the springs */
+		BlockCRSMatrix<Real>	*A12;	/**< Matrix A12  : 3*size x 3*size, same pattern as A11 */
 		Real			dA21;		/**< Real dA21 : value of diagonal matrix A21 */
 		Real			dA22;		/**< Real dA22 : value of diagonal matrix A22 */
 		unsigned int	size;		/**< Jabobian size (=state size) */
 	} Jacobian;
 
+	/**< Projective dynamics solver data, see ProjectiveBegin() */
+	typedef struct
+	{
+		SkylineCholesky<Real>	*system;	/**< factored M/h^2 + weighted spring Laplacian, num_mass x num_mass */
+		Real			h;			/**< time step of the factorization, 0 if none */
+		unsigned char	*fixed;		/**< 1 for the Dirichlet nodes of the factorization, size = num_mass */
+		unsigned char	*fixed_now;	/**< Dirichlet nodes of the current step, size = num_mass */
+		Vector<Real>	*X0;		/**< positions at the start of the step, 3*num_mass */
+		Vector<Real>	*RHS0;		/**< step constant part of the right hand side, 3*num_mass */
+		Vector<Real>	*RHS;		/**< right hand side of the current iteration, 3*num_mass */
+	} Projective;
+
+	/**< Modal reduction data, see ModalBegin() */
+	typedef struct
+	{
+		ModalBasis		*basis;		/**< modes of the model linearized at X0, empty until the first step */
+		unsigned char	*fixed;		/**< Dirichlet nodes the modes were computed with, size = num_mass */
+		Vector<Real>	*X0;		/**< positions of the linearization, 3*num_mass */
+		Vector<Real>	*F0;		/**< force at X0 with zero velocity: gravity and spring prestress */
+		Vector<Real>	*Q;			/**< reduced coordinates, displacement u = U q from X0 */
+		Vector<Real>	*QDOT;		/**< reduced velocities */
+		Vector<Real>	*FQ;		/**< reduced force of the current step */
+		Vector<Real>	*DAMP;		/**< modal damping u_k^T C u_k */
+		unsigned int	num_modes;	/**< requested number of modes */
+		char			*cache;		/**< mode cache file name, NULL if none */
+	} Modal;
+
 	// Constructors
 	MSDObject(	XMLNode * simObjectNode,
 				Real g			= 0.0);
@@ -216,6 +309,7 @@ public:
 	// Force calculators
 	void				UpdateForces(State	&state);	
 	void				UpdateForces(unsigned int index);	
+	void				ColorSprings(void);
 	void				GravityForce(void);
 	void				SpringForce(void);
 	void				DampingForce(void);
@@ -234,10 +328,28 @@ public:
 	Real				StateDotState(const State &state1, const State &state2);
 	void				MultiplyJacobianState(State &out_state, const Jacobian &J, const State &state);
 	void				IdentityMinushJacobian(Jacobian &J, const State &state, const Real h); 
+	unsigned int		MultigridSolve(State &x, const Jacobian &J, const State &b, Real tol, unsigned int max_iter);
 	void				AccumStateSemiExplicit(State &new_state, const State &state, const State &deriv, const Real &h);
 	void				PrintJacobian(const Jacobian &J);
 	void				PrintState(const State &state);
 
+	// Projective dynamics interface
+	void				ProjectiveBegin(State &state, const Real h);
+	void				ProjectiveLocal(State &state);
+	void				ProjectiveGlobal(State &state);
+	void				ProjectiveEnd(State &state, const Real h);
+
+	// Modal reduction interface
+	void				ModalBegin(State &state, const Real h);
+	unsigned int		ModalCount(void)			{ return modal.basis->NumModes(); }
+	Real				*ModalCoord(void)			{ return modal.Q->begin(); }
+	Real				*ModalVelocity(void)		{ return modal.QDOT->begin(); }
+	const Real			*ModalForce(void)			{ return modal.FQ->begin(); }
+	Real				ModalStiffness(unsigned int k)	{ return modal.basis->Eigenvalue(k); }
+	Real				ModalDamping(unsigned int k)	{ return (*modal.DAMP)[k]; }
+	void				ModalEnd(State &state);
+	void				ModalReconstruct(void);		// full state from the reduced one
+
 	void				SetIntegrationMethod(int method);
 	int					getIntegrationMethod(const char * method);
 
@@ -265,14 +377,28 @@ public:
 
 	State&				GetState(void)	{	return	state; }	
 
+	// Raw views of the node state for bulk boundary access, 3 Reals each
+	const Real			*NodePosition(unsigned int index);
+	const Real			*NodeVelocity(unsigned int index);
+	const Real			*NodeForce(unsigned int index)	{ return force[index].begin(); }
+
 	// Utitity functions
 	Real				getEnergy(void);
 	unsigned int		getNumMass(void) { return num_mass; }
 	unsigned int		getNumSpring(void) { return num_spring; }
-	Spring				getSpring(unsigned int index) { return spring[index]; }
-	bool				isFixedBoundary(unsigned int index);
-	int					getMSDIndex(unsigned int OBJIndex);
-	int					getOBJIndex(unsigned int MSDIndex);
+	Spring				getSpring(unsigned int index);
+	unsigned int		getSpringNode(unsigned int index, unsigned int end) { return spring.node[2*index+end]; }
+	const SpringArray	&getSprings(void) { return spring; }
+	bool				isFixedBoundary(unsigned int index) { return (index < num_msd_index) && fixed_node[index]; }
+	int					getMSDIndex(unsigned int OBJIndex) { return (OBJIndex < num_obj_index) ? msd_of_obj[OBJIndex] : -1; }
+	int					getOBJIndex(unsigned int MSDIndex) { return (MSDIndex < num_msd_index) ? obj_of_msd[MSDIndex] : -1; }
+	// Bulk views of the index tables, -1 marks an unmapped node
+	const int			*getMSDIndexTable(void) { return msd_of_obj; }		/**< size = getNumOBJIndex() */
+	const int			*getOBJIndexTable(void) { return obj_of_msd; }		/**< size = getNumMass() */
+	unsigned int		getNumOBJIndex(void) { return num_obj_index; }
+	void				BuildIndexTables(void);
+	// Precomputed spring adjacency (CSR) of a model loaded from a .msdb file
+	bool				getSpringAdjacency(const unsigned int *&ptr, const unsigned int *&node, const unsigned int *&spring);
 	// Set IC for doing experiment, user hard code
 	void				setInitialCondition(void);
 
@@ -291,6 +417,10 @@ protected: // protected methods.
 	void				Load(const char *filename);		// .OBJ Loader
 	void				LoadMAP(const char *filename);	// .MAP Loader
 	void				LoadMSD(const char *filename);	// .MSD Loader
+	bool				LoadMSDB(const char *filename);	// .MSDB Loader, false if the file is missing or stale
+	void				SaveMSDB(const char *filename);	// Writes the loaded .MSD/.MAP model as .MSDB
+	void				ReorderMasses(int method);		// Renumbers the loaded .MSD/.MAP model, see MeshNodeOrder()
+	void				AllocForce(void);
 	void				Init(void);					// Initilization MSD Model
 
 protected: // protected variables.
@@ -301,17 +431,17 @@ protected: // protected variables.
 	//Real					defaultMass;	// The default mass value of the nodes	[g]
 
 	State						state;			/**< state information */	
-	Vector<Real>				*force;			/**< Force vector	[g cm/s2 = 10 N] */
+	Vector<Real>				*FORCE;			/**< Global force vector, size = 3*num_mass */
+	Vector<Real>				*force;			/**< Force of nodes, remapped into FORCE	[g cm/s2 = 10 N] */
 	Real						*mass;			/**< Mass vector	[g] */
 	Point						*massPoint;		/**< Position of Mass */
-	Spring						*spring;		/**< spring */	
+	SpringArray					spring;			/**< spring */	
 	unsigned int				num_mass;		/**< number of mass */
     unsigned int				num_spring;		/**< number of spring */
 	MSDModelBuilder				msdModelBuilder;
-	MSDModel					*msdModel;
 
 	Vector<Real>				*ground_pos;	/**< ground position */
-	Spring						*vspring;		/**< virtual spring */
+	SpringArray					vspring;		/**< virtual spring */
 	unsigned int				num_ground;		/**< number of ground mass */
 	unsigned int				num_vspring;	/**< number of virtual spring */
 	
@@ -321,6 +451,58 @@ protected: // protected variables.
 	unsigned int				*mapping;		/**< mapping array size = 2*num_mapping */
 	unsigned int				num_mapping;	/**< number of mapping */
 
+	// Dense lookup tables derived from mapping and fix_boundary by
+	// BuildIndexTables(), rebuild them whenever either one changes
+	int							*msd_of_obj;	/**< MSD index of each OBJ vertex, size = num_obj_index */
+	int							*obj_of_msd;	/**< OBJ index of each mass, size = num_msd_index */
+	unsigned char				*fixed_node;	/**< 1 if the mass is in fix_boundary, size = num_msd_index */
+	unsigned int				num_obj_index;	/**< size of msd_of_obj */
+	unsigned int				num_msd_index;	/**< size of obj_of_msd and fixed_node */
+
+	// Set by LoadMSDB(): mass, spring, vspring, fix_boundary and mapping
+	// then point into the mapped file instead of owning their storage
+	MappedFile					model_file;		/**< mapped .msdb image */
+	const unsigned int			*adj_ptr;		/**< precomputed adjacency row pointers, NULL if absent */
+	const unsigned int			*adj_node;		/**< neighbour of each adjacency entry */
+	const unsigned int			*adj_spring;	/**< spring of each adjacency entry */
+
+	unsigned int				*spring_block;	/**< Jacobian block indices of each spring, size = 4*num_spring */
+
+	// Springs grouped by colour: no two springs of a colour share a node, so
+	// each colour can be accumulated in parallel without write conflicts
+	unsigned int				*spring_order;	/**< spring indices sorted by colour, size = num_spring */
+	unsigned int				*color_ptr;		/**< start of each colour in spring_order, size = num_color+1 */
+	unsigned int				num_color;		/**< number of spring colours */
+
+	// Parallel force kernels, arg is a ForceTaskArg (msd.cpp)
+	static void					NodeForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+	static void					SpringForceTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+
+	// Projective dynamics
+	void						AllocProjective(void);
+	void						FactorProjective(const Real h);
+	static void					ProjectiveCopyTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+	static void					ProjectiveSpringTask(void *arg, unsigned int begin, unsigned int end, unsigned int thread);
+	Projective					projective;		/**< allocated by SetIntegrationMethod() for "PD" */
+
+	// Modal reduction
+	void						AllocModal(void);
+	void						FreeModal(void);
+	void						BuildModal(State &state);
+	void						ModalReconstructNode(unsigned int index, Real *x, Real *v);
+	Modal						modal;			/**< allocated by SetIntegrationMethod() for "Modal" */
+
+	// Multigrid solver of the implicit Euler
+	void						AllocMultigrid(void);
+	void						FreeMultigrid(void);
+	ImplicitMultigrid			*multigrid;		/**< allocated by SetIntegrationMethod() for "ImEulerMG" */
+	MultigridParameters			multigrid_param;	/**< cycle and smoother, "multigrid" of NHParameters */
+	unsigned char				*multigrid_fixed;	/**< Dirichlet nodes of the current step, size = num_mass */
+
+	void						BuildHapticTerms(HapticCache &cache, int node);
+	HapticCache					haptic_cache;	/**< last haptic model neighbourhood */
+	pthread_mutex_t				haptic_lock;	/**< serializes ReturnHapticModel */
+
 	Integrator<MSDObject>		*integrator;	/**< intergrator pointer */
 	unsigned int				int_method;		/**< integrator method */
 
@@ -345,6 +527,9 @@ public:
 	void				GetVelocity(Vector<Real> *Bvel);	
 	Vector<Real>		GetReactionForce(unsigned int index);
 	void				GetReactionForce(Vector<Real> *Bforce);	
+	void				GetPositions(unsigned int n, const unsigned int *index, Real *Bpos);
+	void				GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel);
+	void				GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce);
 
 	void				Set(unsigned int index, unsigned int boundary_type, 
 							Vector<Real> boundary_value, 
@@ -278,4 +278,106 @@ void AddInternalSpringEntries(Matrix<Real>* A11, Matrix<Real>* A12, int ind1, in
 	AddKMatrixToA(A12, ind1, ind2, p, q, k, lzero);
     AddVMatrixToA(A12, ind1, ind2, p, q, v, w, b);   
 }
-///// end for implicit //////////////////////////////////////
\ No newline at end of file
+
+void AddInternalSpringEntries(BlockCRSMatrix<Real>* A11, BlockCRSMatrix<Real>* A12, const unsigned int *blk, 
+								Vector<Real> p, Vector<Real> q, Vector<Real> v, Vector<Real> w, 
+								double k, double lzero, double b)
+{
+	static const Real	sign[4] = { -1.0, 1.0, 1.0, -1.0 };
+	Matrix<Real>		mB = BuildBMatrix(p, q, b);
+	Matrix<Real>		mK = BuildKMatrix(p, q, k, lzero);
+	Matrix<Real>		mV = BuildVMatrix(p, q, v, w, b);
+
+	for(unsigned int i = 0; i < 4; i++) {
+		A11->addBlock(blk[i], mB.begin(), sign[i]);
+		A12->addBlock(blk[i], mK.begin(), sign[i]);
+		A12->addBlock(blk[i], mV.begin(), sign[i]);
+	}
+}
+///// end for implicit //////////////////////////////////////
+
+///// raw array versions //////////////////////////////////////
+void BuildSpringMatrices(const Real *p, const Real *q, const Real *v, const Real *w, 
+								double k, double lzero, double b, Real *mK, Real *mB, Real *mV)
+{
+	Real	t[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+	double	norm = sqrt(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+
+	for(unsigned int i = 0; i < 9; i++) mK[i] = mB[i] = mV[i] = 0.0;
+	if (norm <= 0) return;
+
+	double	wvqp = (w[0] - v[0])*t[0] + (w[1] - v[1])*t[1] + (w[2] - v[2])*t[2];
+
+	for(unsigned int i = 0; i < 3; i++) {
+		mK[4*i] = Aentry(k, lzero, p[i], q[i], norm);
+		mB[4*i] = Eentry(b, p[i], q[i], norm);
+		mV[4*i] = Centry(b, wvqp, v[i], w[i], p[i], q[i], norm);
+		for(unsigned int j = 0; j < 3; j++) {
+			if (j == i) continue;
+			if (j > i) {
+				mK[3*i+j] = mK[3*j+i] = Bentry(k, lzero, p[i], p[j], q[i], q[j], norm);
+				mB[3*i+j] = mB[3*j+i] = Fentry(b, p[i], p[j], q[i], q[j], norm);
+			}
+			mV[3*i+j] = Dentry(b, wvqp, v[j], w[j], p[i], p[j], q[i], q[j], norm);
+		}
+	}
+}
+
+inline static void SplatBlock(Matrix<Real>& result, const Real *a, unsigned int r, unsigned int c, double alpha)
+{
+	for(unsigned int i=0; i < 3; i++) {
+		Real	*row = result[r+i] + c;
+		row[0] += a[3*i]*alpha;
+		row[1] += a[3*i+1]*alpha;
+		row[2] += a[3*i+2]*alpha;
+	}
+}
+
+void AddInternalSpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind1, int ind2, 
+								const Real *mK, const Real *mB, const Real *mV)
+{
+	static const Real	sign[2][2] = { { -1.0, 1.0 }, { 1.0, -1.0 } };
+	const int			ind[2] = { ind1, ind2 };
+
+	for(unsigned int i = 0; i < 2; i++)
+		for(unsigned int j = 0; j < 2; j++) {
+			SplatBlock(*(model->A12), mK, ind[i] *3, ind[j] *3, sign[i][j]);
+			SplatBlock(*(model->A12), mV, ind[i] *3, ind[j] *3, sign[i][j]);
+			SplatBlock(*(model->A11), mB, ind[i] *3, ind[j] *3, sign[i][j]);
+		}
+}
+
+void AddBoundarySpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind, 
+								const Real *mK, const Real *mB, const Real *mV)
+{
+	SplatBlock(*(model->A11), mB, ind *3, ind *3, -1.0);		
+	SplatBlock(*(model->A12), mV, ind *3, ind *3, -1.0);
+	SplatBlock(*(model->A12), mK, ind *3, ind *3, -1.0);
+}
+
+void AddContactSpringEntries(GiPSiLowOrderLinearHapticModel* model, 
+								const Real *mK, const Real *mB, const Real *mV)
+{
+	SplatBlock(*(model->D), mB, 0, 0, -1.0);
+	SplatBlock(*(model->D), mV, 0, 3, -1.0); 	
+	SplatBlock(*(model->D), mK, 0, 3, -1.0);
+}
+
+void AddContactSpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind, 
+								const Real *mK, const Real *mB, const Real *mV)
+{
+	SplatBlock(*(model->A11), mB, ind *3, ind *3, -1.0);
+	SplatBlock(*(model->A12), mV, ind *3, ind *3, -1.0);
+	SplatBlock(*(model->A12), mK, ind *3, ind *3, -1.0);	
+
+	SplatBlock(*(model->B1), mB, ind *3, 0, 1.0);
+	SplatBlock(*(model->B1), mV, ind *3, 3, 1.0);
+	SplatBlock(*(model->B1), mK, ind *3, 3, 1.0);
+	
+	SplatBlock(*(model->C11), mB, 0, ind *3, -1.0);
+	SplatBlock(*(model->C12), mV, 0, ind *3, -1.0);
+	SplatBlock(*(model->C12), mK, 0, ind *3, -1.0);	
+	
+	AddContactSpringEntries(model, mK, mB, mV);
+}
+///// end raw array versions //////////////////////////////////////
\ No newline at end of file
@@ -58,6 +58,28 @@ void AddContactSpringEntries(GiPSiLowOrderLinearHapticModel* model,
 void AddInternalSpringEntries(Matrix<Real>* A11, Matrix<Real>* A12, int ind1, int ind2, 
 								Vector<Real> p, Vector<Real> q, Vector<Real> v, Vector<Real> w, 
 								double k, double lzero, double b);
+// block sparse version, blk holds the block indices of (1,1) (1,2) (2,1) (2,2)
+void AddInternalSpringEntries(BlockCRSMatrix<Real>* A11, BlockCRSMatrix<Real>* A12, const unsigned int *blk, 
+								Vector<Real> p, Vector<Real> q, Vector<Real> v, Vector<Real> w, 
+								double k, double lzero, double b);
 // end for implicit state
 
+// Raw array versions, no temporaries. The 3x3 blocks are row major and do not
+// depend on which end of the spring is p, so one set serves every entry.
+void BuildSpringMatrices(const Real *p, const Real *q, const Real *v, const Real *w, 
+								double k, double lzero, double b, Real *mK, Real *mB, Real *mV);
+
+void AddInternalSpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind1, int ind2, 
+								const Real *mK, const Real *mB, const Real *mV);
+
+void AddContactSpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind, 
+								const Real *mK, const Real *mB, const Real *mV);
+
+void AddBoundarySpringEntries(GiPSiLowOrderLinearHapticModel* model, int ind, 
+								const Real *mK, const Real *mB, const Real *mV);
+
+// for springs between the contact node and a fixed node or the ground
+void AddContactSpringEntries(GiPSiLowOrderLinearHapticModel* model, 
+								const Real *mK, const Real *mB, const Real *mV);
+
 #endif
\ No newline at end of file
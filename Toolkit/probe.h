@@ -28,6 +28,8 @@ Contributor(s): Tolga Goktekin, M. Cenk Cavusoglu, Suriya Natsupakpong.
 #ifndef _PROBE_H
 #define _PROBE_H
 
+#include <string.h>
+
 #include "GiPSiAPI.h"
 #include "XMLNode.h"
 
@@ -98,22 +100,19 @@ protected:
 // Boundary for RigidProbeHIO 
 class RigidProbeHIOBoundary : public HapticInterfaceObjectBoundary {
 public:
+	RigidProbeHIOBoundary()		{ memset(&hm, 0, sizeof(GiPSiLowOrderLinearHapticModel)); }
+	~RigidProbeHIOBoundary()	{ FreeHapticModel(hm); }
+
 	void SetNullModel() 
 	{		
-		hm._n=0;								// number of states of the low order linear model
-		hm._m=6;								// number of inputs	: Dimension of the position measurement
-		hm._k=3;								// number of outputs: DImension of force ouput
-		hm.A11=new Matrix<Real>(0,0,0.0);		// _n x _n matrix
-		hm.A12=new Matrix<Real>(0,0,0.0);
-		hm.B1=new Matrix<Real>(0,6,0.0);		// _n x _m matrix
-		hm.C11=new Matrix<Real>(3,0,0.0);		// _k x _n matrix
-		hm.C12=new Matrix<Real>(3,0,0.0);
-		hm.D=new Matrix<Real>(3,6,0.0);			// _k x _m matrix
-		hm.f_0=new Vector<Real>(3,0.0);			// _k x  1 vector
-		hm.zdot_0=new Vector<Real>(0,0.0);		// _n x  1 vector
-		hm.normal=new Vector<Real>(3,0.0);
+		// no states, 6 inputs (position measurement), 3 outputs (force)
+		ReserveHapticModel(hm, 0, 6, 3);
 	}
 
+	// The model storage of the probe. Contact models are generated into
+	// it in place, so its matrices live as long as the probe.
+	GiPSiLowOrderLinearHapticModel	&ContactModel(void)	{ return hm; }
+
 	void SetHapticModel(unsigned int index, GiPSiLowOrderLinearHapticModel  HapticModel)
 	{
 		hm = HapticModel;
@@ -129,6 +128,8 @@ public:
 		}
 	};
 
+	// The haptic interface copies the returned model, its matrices stay
+	// with the probe
 	GiPSiLowOrderLinearHapticModel	ReturnHapticModel()
 	{
 		return hm;
@@ -639,6 +639,24 @@ Vector<Real> QSDSObject::GetNodeForce(unsigned int index)
 	return -spring.k_stiff * dir;
 }
 
+/**
+ * QSDSObject::NodeForce()
+ * Computes the nodal force without temporaries.
+ * @param index node index.        
+ * @param f 3 components of the force.
+ */
+void QSDSObject::NodeForce(unsigned int index, Real *f)
+{
+	TriSurface *init_geom = (TriSurface *) init_geometry;	
+	QSDSBoundary  *bound = (QSDSBoundary *) boundary;
+	const Real	*p = bound->boundary_value[index].begin();
+	const Real	*q = init_geom->vertex[index].pos.begin();
+
+	f[0] = -spring.k_stiff * (p[0] - q[0]);
+	f[1] = -spring.k_stiff * (p[1] - q[1]);
+	f[2] = -spring.k_stiff * (p[2] - q[2]);
+}
+
 /**
  * Displays the QSDSObject mesh.
  */
@@ -717,30 +735,11 @@ int QSDSObject::ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderL
 	unsigned int n = 6;
 	unsigned int m = 6;
 	unsigned int k = 3;
-	unsigned int n_2 = n/2;	
-
-	GiPSiLowOrderLinearHapticModel* model = new GiPSiLowOrderLinearHapticModel();		
-
-	model->_n = n;
-	model->_m = m;
-	model->_k = k;
-
-	// allocate memory
-	model->A11 = new Matrix<Real>(n_2, n_2, 0.0);
-	model->A12 = new Matrix<Real>(n_2, n_2, 0.0);
-	model->B1  = new Matrix<Real>(n_2, m  , 0.0);
-	model->C11 = new Matrix<Real>(k  , n_2, 0.0);
-	model->C12 = new Matrix<Real>(k  , n_2, 0.0);
-	model->D   = new Matrix<Real>(k  , m  , 0.0);
-	model->f_0 = new Vector<Real>(k, 0.0);
-	model->zdot_0 = new Vector<Real>(n, 0.0);
-	model->normal = new Vector<Real>(k, 0.0);
-
-	// seed f_0
-	(*(model->f_0))[0] = 0.0;
-	(*(model->f_0))[1] = 0.0; 
-	(*(model->f_0))[2] = 0.0;
-	
+
+	// size the model in place, see ReserveHapticModel()
+	ReserveHapticModel(Model, n, m, k);
+	GiPSiLowOrderLinearHapticModel* model = &Model;
+
 	// calculate the force at BoundaryNodeIndex (type 0) and internal node (type 1)
 	Vector<Real> dir;
 	Vector<Real> rel_vel;
@@ -765,9 +764,6 @@ int QSDSObject::ReturnHapticModel(unsigned int BoundaryNodeIndex, GiPSiLowOrderL
 	(*(model->f_0)) = temp_force;
 		
 	AddContactSpringEntries(model, p, q, zero_vector3, zero_vector3, spring.k_stiff, spring.l_zero, spring.b_damp);
-
-	Model = (*model);
-	delete model;	
 	
 	return 0;
 }
@@ -917,6 +913,75 @@ void QSDSBoundary::GetReactionForce(Vector<Real> *Bforce)
 	}
 }
 
+/**
+ * QSDSBoundary::GetPositions
+ * Get positions of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bpos 3 coordinates per listed node.
+ */
+void QSDSBoundary::GetPositions(unsigned int n, const unsigned int *index, Real *Bpos)
+{
+	QSDSObject	*obj = (QSDSObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bpos+=3) {
+		const Real	*p = obj->NodePosition(index[i]);
+		Bpos[0]=p[0];	Bpos[1]=p[1];	Bpos[2]=p[2];
+	}
+}
+
+/**
+ * QSDSBoundary::GetVelocities
+ * Get velocities of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bvel 3 components per listed node.
+ */
+void QSDSBoundary::GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel)
+{
+	QSDSObject	*obj = (QSDSObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bvel+=3) {
+		const Real	*v = obj->NodeVelocity(index[i]);
+		Bvel[0]=v[0];	Bvel[1]=v[1];	Bvel[2]=v[2];
+	}
+}
+
+/**
+ * QSDSBoundary::GetReactionForces
+ * Get reaction forces of the listed nodes of the boundary.
+ * @param n number of listed nodes.
+ * @param index boundary node indices.
+ * @param Bforce 3 components per listed node.
+ */
+void QSDSBoundary::GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce)
+{
+	QSDSObject	*obj = (QSDSObject *) Object;
+
+	for (unsigned int i=0; i < n; i++, Bforce+=3) {
+		unsigned int	k = index[i];
+		const Real		*d;
+		Real			fd;
+
+		switch (boundary_type[k]) {
+			case (0):   // Neumann type boundary condition   (Specify traction)
+				Bforce[0]=Bforce[1]=Bforce[2]=0.0;
+				break;
+			case (1):   // Drichlett type boundary condition (Fixed boundary - e.g. wall)
+				obj->NodeForce(k, Bforce);
+				break;
+			case (2):	// Mixed boundary condition type i: normal component of the force
+				obj->NodeForce(k, Bforce);
+				d = boundary_value2_vector[k].begin();
+				fd = Bforce[0]*d[0] + Bforce[1]*d[1] + Bforce[2]*d[2];
+				Bforce[0]=d[0]*fd;	Bforce[1]=d[1]*fd;	Bforce[2]=d[2]*fd;
+				break;
+			default:
+				error_exit(0,"Unrecognized boundary condition type\n");
+		}
+	}
+}
+
 /**
  * QSDSBoundary::Set
  * Sets MSD Boundary.
@@ -70,6 +70,10 @@ public:
 	Vector<Real>	GetNodePosition(unsigned int index);
 	Vector<Real>	GetNodeVelocity(unsigned int index);
 	Vector<Real>	GetNodeForce(unsigned int index);
+	// Raw views of the node state for bulk boundary access, 3 Reals each
+	const Real		*NodePosition(unsigned int index)	{ return state.pos[index].begin(); }
+	const Real		*NodeVelocity(unsigned int index)	{ return state.vel[index].begin(); }
+	void			NodeForce(unsigned int index, Real *f);
 
 	// Display functions
 	void			Display(void);
@@ -119,6 +123,9 @@ public:
 	void				GetVelocity(Vector<Real> *Bvel);	
 	Vector<Real>		GetReactionForce(unsigned int index);
 	void				GetReactionForce(Vector<Real> *Bforce);	
+	void				GetPositions(unsigned int n, const unsigned int *index, Real *Bpos);
+	void				GetVelocities(unsigned int n, const unsigned int *index, Real *Bvel);
+	void				GetReactionForces(unsigned int n, const unsigned int *index, Real *Bforce);
 
 	void				Set(unsigned int index, unsigned int boundary_type, 
 							Vector<Real> boundary_value, 
@@ -0,0 +1,797 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is Source for GiPSi Algebra Unit Test (AlgebraUnitTest.cpp).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	ALGEBRAUNITTEST.CPP v0.0
+////
+////	Source for GiPSi Algebra Unit Test
+////
+////////////////////////////////////////////////////////////////
+
+/*
+===============================================================================
+	Headers
+===============================================================================
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+#include "AlgebraUnitTest.h"
+#include "correspondence.h"
+#include "memory_pool.h"
+#include "mesh_order.h"
+#include "modal_basis.h"
+#include "multigrid.h"
+#include "timing.h"
+
+/*
+===============================================================================
+	AlgebraUnitTest class
+===============================================================================
+*/
+
+AlgebraUnitTest::AlgebraUnitTest()
+{
+	myFailedCount = 0;
+}
+
+void AlgebraUnitTest::Run()
+{
+	TestAllocator();
+	TestSmallInverse();
+	TestBlockSparse();
+	TestSkylineCholesky();
+	TestCondensation();
+	TestModalBasis();
+	TestMultigrid();
+	TestMeshOrder();
+	TestCorrespondence();
+}
+
+// Frees the blocks handed over by TestAllocator on another thread
+static void *FreeBlocksThread(void *arg)
+{
+	void	**blocks = (void **) arg;
+
+	for(unsigned int i = 0; i < 256; i++)
+		AlgebraDeallocate(blocks[i], 3 * sizeof(Real));
+
+	return NULL;
+}
+
+void AlgebraUnitTest::TestAllocator()
+{
+	AlgebraAllocStats	stats;
+
+	printf("\nTesting algebra storage allocator\n");
+
+	// Small vectors and matrices are recycled through the thread pool
+	printf("Testing pool reuse:\t\t\t");
+	Real	*first;
+	{
+		Vector<Real>	v(3, 1.0);
+		first = v.begin();
+	}
+	ResetAlgebraAllocStats();
+	{
+		Vector<Real>	v(3, 2.0);
+		Matrix<Real>	M(3, 3, 0.0);
+		GetAlgebraAllocStats(stats);
+		TEST_VERIFY(v.begin() == first && stats.pool_allocs == 2 && stats.heap_allocs == 0);
+	}
+
+	// Large arrays go straight to the heap
+	printf("Testing heap fallback:\t\t\t");
+	ResetAlgebraAllocStats();
+	{
+		Vector<Real>	v(1000, 0.0);
+		GetAlgebraAllocStats(stats);
+		TEST_VERIFY(stats.heap_allocs == 1 && stats.pool_allocs == 0);
+	}
+	GetAlgebraAllocStats(stats);
+	printf("Testing heap release:\t\t\t");
+	TEST_VERIFY(stats.heap_frees == 1);
+
+	// Temporaries inside an arena scope are bump allocated and
+	// reclaimed in one go
+	printf("Testing arena allocation:\t\t");
+	AlgebraArena	arena(4096);
+	ResetAlgebraAllocStats();
+	{
+		AlgebraArenaScope	scope(arena);
+		Vector<Real>		a(3, 1.0), b(3, 2.0);
+		Vector<Real>		c = a + b;
+		GetAlgebraAllocStats(stats);
+		TEST_VERIFY(arena.Owns(c.begin()) && stats.pool_allocs == 0 && c[2] == 3.0);
+	}
+	GetAlgebraAllocStats(stats);
+	printf("Testing arena release:\t\t\t");
+	TEST_VERIFY(stats.pool_frees == 0 && arena.Used() > 0);
+
+	printf("Testing arena reset:\t\t\t");
+	arena.Reset();
+	TEST_VERIFY(arena.Used() == 0 && arena.HighWater() > 0);
+
+	// Requests larger than the arena fall through
+	printf("Testing arena overflow:\t\t\t");
+	ResetAlgebraAllocStats();
+	{
+		AlgebraArenaScope	scope(arena);
+		Vector<Real>		v(1024, 0.0);
+		GetAlgebraAllocStats(stats);
+		TEST_VERIFY(!arena.Owns(v.begin()) && stats.heap_allocs == 1);
+	}
+
+	// Blocks freed on another thread go back to the allocating thread, so
+	// a producer/consumer pair keeps reusing the same slabs
+	printf("Testing cross-thread free:\t\t");
+	void		*blocks[256];
+	pthread_t	consumer;
+	bool		bounded = true;
+	for(unsigned int i = 0; i < 256; i++)
+		blocks[i] = AlgebraAllocate(3 * sizeof(Real));
+	pthread_create(&consumer, NULL, FreeBlocksThread, blocks);
+	pthread_join(consumer, NULL);
+	ResetAlgebraAllocStats();
+	for(unsigned int round = 0; round < 64 && bounded; round++) {
+		for(unsigned int i = 0; i < 256; i++)
+			blocks[i] = AlgebraAllocate(3 * sizeof(Real));
+		pthread_create(&consumer, NULL, FreeBlocksThread, blocks);
+		pthread_join(consumer, NULL);
+		GetAlgebraAllocStats(stats);
+		bounded = (stats.slabs == 0);
+	}
+	TEST_VERIFY(bounded);
+}
+
+// Largest deviation of A * B from the identity over a batch of n x n pairs
+static Real IdentityError(const Real *A, const Real *B, unsigned int n, unsigned int count)
+{
+	Real	err = 0.0;
+
+	for(unsigned int b = 0; b < count; b++)
+		for(unsigned int i = 0; i < n; i++)
+			for(unsigned int j = 0; j < n; j++) {
+				Real	sum = (i == j) ? -1.0 : 0.0;
+				for(unsigned int k = 0; k < n; k++)
+					sum += A[b*n*n + i*n + k] * B[b*n*n + k*n + j];
+				if(fabs(sum) > err) err = fabs(sum);
+			}
+
+	return err;
+}
+
+// Fills a batch with random SPD matrices R R^T + n I
+static void RandomSPDBatch(Real *A, unsigned int n, unsigned int count)
+{
+	Real	R[36];
+
+	for(unsigned int b = 0; b < count; b++) {
+		for(unsigned int i = 0; i < n*n; i++)
+			R[i] = 2.0 * rand() / RAND_MAX - 1.0;
+		for(unsigned int i = 0; i < n; i++)
+			for(unsigned int j = 0; j < n; j++) {
+				Real	sum = (i == j) ? n : 0.0;
+				for(unsigned int k = 0; k < n; k++)
+					sum += R[i*n + k] * R[j*n + k];
+				A[b*n*n + i*n + j] = sum;
+			}
+	}
+}
+
+void AlgebraUnitTest::TestSmallInverse()
+{
+	const unsigned int	count = 10000;
+	DenseWorkspace		ws;
+	Real				*A		= new Real[36 * count];
+	Real				*Ainv	= new Real[36 * count];
+
+	printf("\nTesting small dense inverses\n");
+	srand(1);
+	init_timers();
+
+	for(unsigned int n = 2; n <= 6; n++) {
+		RandomSPDBatch(A, n, count);
+
+		printf("Testing %dx%d invMBatch:\t\t\t", n, n);
+		start_timer(0);
+		int failed = invMBatch(Ainv, A, n, count, ws);
+		double t_lu = get_timer(0);
+		TEST_VERIFY(failed == 0 && IdentityError(A, Ainv, n, count) < 1e-10);
+
+		printf("Testing %dx%d invSPDBatch:\t\t", n, n);
+		start_timer(0);
+		failed = invSPDBatch(Ainv, A, n, count, ws);
+		double t_chol = get_timer(0);
+		TEST_VERIFY(failed == 0 && IdentityError(A, Ainv, n, count) < 1e-10);
+
+		printf("\t%d matrices: general %.3f ms, SPD %.3f ms\n", count, t_lu, t_chol);
+	}
+
+	// Matrix interface, in place and singular input
+	printf("Testing invM 4x4:\t\t\t");
+	RandomSPDBatch(A, 4, 1);
+	Matrix<Real>	M(4, 4, A), Minv(4, 4, 0.0);
+	TEST_VERIFY(invM(Minv, M, ws) == 0 && IdentityError(M.begin(), Minv.begin(), 4, 1) < 1e-10);
+
+	printf("Testing invM singular:\t\t\t");
+	Matrix<Real>	S(3, 3, 1.0), Sinv(3, 3, 0.0);
+	TEST_VERIFY(invM(Sinv, S) != 0);
+
+	delete[] A;
+	delete[] Ainv;
+}
+
+void AlgebraUnitTest::TestBlockSparse()
+{
+	// A chain of 6 nodes with one extra cross link, duplicate pair included
+	const unsigned int	nb = 6;
+	unsigned int		pairs[] = { 0,1, 1,2, 2,3, 3,4, 4,5, 0,5, 2,1 };
+	BlockCRSMatrix<Real>	A;
+
+	printf("\nTesting block sparse matrix\n");
+
+	printf("Testing pattern:\t\t\t");
+	A.initPattern(nb, 7, pairs);
+	TEST_VERIFY(A.nnzb() == nb + 2*6 && A.find(0, 5) >= 0 && A.find(0, 3) < 0);
+
+	// Random values, then compare against the dense expansion
+	srand(2);
+	for(unsigned int k = 0; k < A.nnzb(); k++)
+		for(unsigned int l = 0; l < 9; l++)
+			A.block(k)[l] = 2.0 * rand() / RAND_MAX - 1.0;
+	A.setRowIdentity(3);
+	A.scaleRow(1, 0.5);
+
+	Matrix<Real>	D(3*nb, 3*nb, 0.0);
+	Vector<Real>	x(3*nb), y(3*nb), yd(3*nb);
+	for(unsigned int i = 0; i < 3*nb; i++) x[i] = i + 1.0;
+	A.toDense(D);
+
+	printf("Testing multMV:\t\t\t\t");
+	multMV(y, A, x);
+	yd = D * x;
+	TEST_VERIFY((y - yd).length() < 1e-12 && y[9] == x[9] && y[11] == x[11]);
+
+	printf("Testing multAddMV:\t\t\t");
+	multAddMV(y, A, x);
+	TEST_VERIFY((y - 2.0 * yd).length() < 1e-12);
+}
+
+void AlgebraUnitTest::TestSkylineCholesky()
+{
+	// Ring of 8 nodes plus two chords: a weighted graph Laplacian with a
+	// positive diagonal shift, i.e. the matrix of a projective dynamics step
+	const unsigned int	n = 8;
+	unsigned int		pairs[] = { 0,1, 1,2, 2,3, 3,4, 4,5, 5,6, 6,7, 7,0, 5,2, 1,6 };
+	const unsigned int	num_pairs = 10;
+	SkylineCholesky<Real>	A;
+
+	printf("\nTesting skyline Cholesky\n");
+
+	printf("Testing envelope:\t\t\t");
+	A.initPattern(n, num_pairs, pairs);
+	TEST_VERIFY(A.inPattern(7, 0) && A.inPattern(3, 2) && !A.inPattern(2, 0) &&
+				A.nnz() == 1+2+2+2+2+4+6+8);
+
+	srand(3);
+	Matrix<Real>	D(n, n, 0.0);
+	for(unsigned int i = 0; i < n; i++) {
+		Real	m = 1.0 + (Real) rand() / RAND_MAX;
+		A.add(i, i, m);
+		D[i][i] += m;
+	}
+	for(unsigned int k = 0; k < num_pairs; k++) {
+		unsigned int	i = pairs[2*k], j = pairs[2*k+1];
+		Real			w = 1.0 + 10.0 * rand() / RAND_MAX;
+		A.add(i, i, w);		A.add(j, j, w);		A.add(i, j, -w);
+		D[i][i] += w;		D[j][j] += w;		D[i][j] -= w;		D[j][i] -= w;
+	}
+
+	// Interleaved right hand sides, solved one component at a time
+	Vector<Real>	b(3*n), x(3*n), r(n), xc(n), bc(n);
+	for(unsigned int i = 0; i < 3*n; i++) b[i] = x[i] = (Real) rand() / RAND_MAX - 0.5;
+
+	printf("Testing factor and solve:\t\t");
+	bool	factored = A.factor();
+	for(unsigned int c = 0; c < 3; c++) A.solve(x.begin() + c, 3);
+	Real	err = 0.0;
+	for(unsigned int c = 0; c < 3; c++) {
+		for(unsigned int i = 0; i < n; i++) {
+			xc[i] = x[3*i+c];
+			bc[i] = b[3*i+c];
+		}
+		r = D * xc - bc;
+		if(r.length() > err) err = r.length();
+	}
+	TEST_VERIFY(factored && A.isFactored() && err < 1e-10);
+
+	printf("Testing Dirichlet rows:\t\t\t");
+	A.zero();
+	for(unsigned int i = 0; i < n; i++)
+		for(unsigned int j = 0; j <= i; j++)
+			if(A.inPattern(i, j)) A.add(i, j, D[i][j]);
+	A.setRowIdentity(4);
+	A.factor();
+	Vector<Real>	e(n, 0.0);
+	e[4] = 2.0;
+	A.solve(e.begin());
+	TEST_VERIFY(fabs(e[4] - 2.0) < 1e-12 && fabs(e[3]) < 1e-12 && fabs(e[5]) < 1e-12);
+
+	printf("Testing indefinite matrix:\t\t");
+	A.zero();
+	A.add(0, 0, 1.0);	A.add(1, 1, 1.0);	A.add(1, 0, 2.0);
+	TEST_VERIFY(!A.factor() && !A.isFactored());
+}
+
+void AlgebraUnitTest::TestCondensation()
+{
+	// Springs between the neighbours of an n^3 grid with random
+	// directions, the x = 0 face clamped as the FEM haptic model does it
+	const unsigned int	n = 3, nn = n*n*n;
+	unsigned int		pairs[2*3*nn], np = 0, i, j, k, l, r, c;
+	BlockCRSMatrix<Real>	K, C;
+	SkylineCholesky<Real>	A;
+	unsigned char		fixed[nn];
+
+	printf("\nTesting static condensation\n");
+
+	for(i = 0; i < nn; i++) {
+		if(i % n < n-1)			{ pairs[2*np] = i; pairs[2*np+1] = i+1;		np++; }
+		if(i / n % n < n-1)		{ pairs[2*np] = i; pairs[2*np+1] = i+n;		np++; }
+		if(i / (n*n) < n-1)		{ pairs[2*np] = i; pairs[2*np+1] = i+n*n;	np++; }
+		fixed[i] = (i % n == 0);
+	}
+	K.initPattern(nn, np, pairs);
+	C.copyPattern(K);
+	srand(7);
+	for(unsigned int p = 0; p < np; p++) {
+		unsigned int	a = pairs[2*p], b = pairs[2*p+1];
+		Real			d[3], SK[9], SC[9];
+		Real			ks = 1.0 + 10.0 * rand() / RAND_MAX, cs = 0.1 + (Real) rand() / RAND_MAX;
+		for(c = 0; c < 3; c++) d[c] = 2.0 * rand() / RAND_MAX - 1.0;
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				SK[3*r+c] = ks * (d[r]*d[c] + ((r == c) ? 0.5 : 0.0));
+				SC[3*r+c] = cs * (d[r]*d[c] + ((r == c) ? 0.2 : 0.0));
+			}
+		K.addBlock(K.find(a, a), SK, 1.0);		C.addBlock(C.find(a, a), SC, 1.0);
+		K.addBlock(K.find(b, b), SK, 1.0);		C.addBlock(C.find(b, b), SC, 1.0);
+		K.addBlock(K.find(a, b), SK, -1.0);		C.addBlock(C.find(a, b), SC, -1.0);
+		K.addBlock(K.find(b, a), SK, -1.0);		C.addBlock(C.find(b, a), SC, -1.0);
+	}
+
+	// Skyline factor with identity rows at the clamped nodes
+	unsigned int	spairs[2*3*nn];
+	for(i = 0; i < nn; i++)
+		for(l = 0; l < 3; l++) {
+			spairs[2*(3*i+l)]	= 3*i + l;
+			spairs[2*(3*i+l)+1]	= 3*K.col(K.rowBegin(i));
+		}
+	A.initPattern(3*nn, 3*nn, spairs);
+	for(i = 0; i < nn; i++) {
+		if(fixed[i]) {
+			for(l = 0; l < 3; l++) A.add(3*i+l, 3*i+l, 1.0);
+			continue;
+		}
+		for(k = K.rowBegin(i); k < K.rowEnd(i); k++) {
+			j = K.col(k);
+			if(j > i || fixed[j]) continue;
+			for(r = 0; r < 3; r++)
+				for(c = 0; c < 3; c++)
+					if(3*j+c <= 3*i+r) A.add(3*i+r, 3*j+c, K.block(k)[3*r+c]);
+		}
+	}
+	A.factor();
+
+	// Dense reference: K_NN - K_NR K_RR^-1 K_RN and Psi^T C Psi with
+	// Psi = [I; -K_RR^-1 K_RN] over the free unknowns
+	Matrix<Real>	KD(3*nn, 3*nn, 0.0), CD(3*nn, 3*nn, 0.0);
+	K.toDense(KD);
+	C.toDense(CD);
+
+	Real			*X = new Real[9*nn];
+	Real			errK = 0.0, errC = 0.0, normK = 0.0, normC = 0.0;
+	unsigned int	rest[3*nn];
+	for(unsigned int node = 0; node < nn; node++) {
+		if(fixed[node]) continue;
+
+		unsigned int	nr = 0;
+		for(i = 0; i < nn; i++)
+			if(!fixed[i] && i != node)
+				for(l = 0; l < 3; l++) rest[nr++] = 3*i + l;
+
+		Matrix<Real>	KRR(nr, nr, 0.0), KRRinv(nr, nr, 0.0), Y(nr, 3, 0.0);
+		for(i = 0; i < nr; i++)
+			for(j = 0; j < nr; j++) KRR[i][j] = KD[rest[i]][rest[j]];
+		invM(KRRinv, KRR);
+		for(i = 0; i < nr; i++)
+			for(c = 0; c < 3; c++)
+				for(j = 0; j < nr; j++) Y[i][c] += KRRinv[i][j] * KD[rest[j]][3*node+c];
+
+		Real	Kref[9], Cref[9], Kc[9], Cc[9];
+		for(r = 0; r < 3; r++)
+			for(c = 0; c < 3; c++) {
+				Real	sk = KD[3*node+r][3*node+c], sc = CD[3*node+r][3*node+c];
+				for(i = 0; i < nr; i++) {
+					sk -= KD[3*node+r][rest[i]] * Y[i][c];
+					sc -= CD[3*node+r][rest[i]] * Y[i][c] + Y[i][r] * CD[rest[i]][3*node+c];
+					for(j = 0; j < nr; j++) sc += Y[i][r] * CD[rest[i]][rest[j]] * Y[j][c];
+				}
+				Kref[3*r+c] = sk;
+				Cref[3*r+c] = sc;
+			}
+
+		if(!condenseNode(Kc, Cc, A, C, node, X)) errK = 1.0;
+		for(l = 0; l < 9; l++) {
+			if(fabs(Kc[l] - Kref[l]) > errK)	errK = fabs(Kc[l] - Kref[l]);
+			if(fabs(Cc[l] - Cref[l]) > errC)	errC = fabs(Cc[l] - Cref[l]);
+			if(fabs(Kref[l]) > normK)			normK = fabs(Kref[l]);
+			if(fabs(Cref[l]) > normC)			normC = fabs(Cref[l]);
+		}
+	}
+	delete[] X;
+
+	printf("Testing condensed stiffness:\t\t");
+	TEST_VERIFY(errK < 1e-10 * normK);
+
+	printf("Testing condensed damping:\t\t");
+	TEST_VERIFY(errC < 1e-10 * normC);
+}
+
+void AlgebraUnitTest::TestModalBasis()
+{
+	// Chain of springs acting equally in x, y and z with node 0 clamped.
+	// The free-fixed chain of nf unit masses has the eigenvalues
+	// 4 k sin^2((2j-1) pi / (2 (2 nf + 1))), each three times here.
+	const unsigned int	nn = 21, nf = nn - 1, r = 6;
+	const Real			k = 50.0;
+	unsigned int		pairs[2*(nn-1)];
+	Real				mass[nn];
+	unsigned char		fixed[nn];
+	BlockCRSMatrix<Real>	K;
+	ModalBasis			modes;
+
+	printf("\nTesting modal basis\n");
+
+	for(unsigned int i = 0; i < nn-1; i++) {
+		pairs[2*i]		= i;
+		pairs[2*i+1]	= i+1;
+	}
+	K.initPattern(nn, nn-1, pairs);
+	Real	I[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+	for(unsigned int i = 0; i < nn-1; i++) {
+		K.addBlock(K.find(i, i), I, k);
+		K.addBlock(K.find(i+1, i+1), I, k);
+		K.addBlock(K.find(i, i+1), I, -k);
+		K.addBlock(K.find(i+1, i), I, -k);
+	}
+	for(unsigned int i = 0; i < nn; i++) {
+		mass[i]		= 1.0;
+		fixed[i]	= (i == 0);
+	}
+
+	printf("Testing eigenvalues:\t\t\t");
+	bool	converged = modes.Compute(K, mass, fixed, r);
+	Real	err = 0.0;
+	for(unsigned int j = 0; j < r; j++) {
+		Real	s		= sin((2.0*(j/3) + 1.0) * M_PI / (2.0 * (2*nf + 1)));
+		Real	exact	= 4.0 * k * s * s;
+		if(fabs(modes.Eigenvalue(j) - exact) / exact > err) err = fabs(modes.Eigenvalue(j) - exact) / exact;
+	}
+	TEST_VERIFY(converged && modes.NumModes() == r && err < 1e-6);
+
+	// U^T M U = I, the clamped node does not move
+	printf("Testing mass orthonormality:\t\t");
+	Real	q[r], u[3], f[3*nn], fq[r];
+	err = 0.0;
+	for(unsigned int a = 0; a < r; a++) {
+		for(unsigned int i = 0; i < 3*nn; i++) f[i] = 0.0;
+		for(unsigned int b = 0; b < r; b++) q[b] = (a == b) ? 1.0 : 0.0;
+		for(unsigned int i = 0; i < nn; i++) {
+			modes.ReconstructNode(u, i, q);
+			for(unsigned int c = 0; c < 3; c++) f[3*i+c] = mass[i] * u[c];
+		}
+		modes.Project(fq, f);
+		for(unsigned int b = 0; b < r; b++)
+			if(fabs(fq[b] - q[b]) > err) err = fabs(fq[b] - q[b]);
+	}
+	modes.ReconstructNode(u, 0, fq);
+	TEST_VERIFY(err < 1e-8 && u[0] == 0.0 && u[1] == 0.0 && u[2] == 0.0);
+
+	printf("Testing cache:\t\t\t\t");
+	unsigned int	key = ModalBasis::Key(K, mass, fixed, r);
+	ModalBasis		cached, stale;
+	bool			saved = modes.Save("modal_basis_test.tmp", key);
+	bool			loaded = cached.Load("modal_basis_test.tmp", key);
+	bool			rejected = !stale.Load("modal_basis_test.tmp", key + 1);
+	remove("modal_basis_test.tmp");
+	TEST_VERIFY(saved && loaded && rejected && cached.NumModes() == r &&
+				cached.Eigenvalue(r-1) == modes.Eigenvalue(r-1));
+}
+
+void AlgebraUnitTest::TestMultigrid()
+{
+	// Springs between the neighbours of an n^3 grid, stiffer along x.
+	// K is singular, the mass makes M + K definite.
+	const unsigned int	n = 8, nn = n*n*n;
+	const Real			k[3] = { 40.0, 10.0, 10.0 }, h = 0.01;
+	unsigned int		pairs[2*3*nn], np = 0;
+	BlockCRSMatrix<Real>	K, A;
+
+	printf("\nTesting multigrid\n");
+
+	for(unsigned int i = 0; i < nn; i++) {
+		if(i % n < n-1)			{ pairs[2*np] = i; pairs[2*np+1] = i+1;		np++; }
+		if(i / n % n < n-1)		{ pairs[2*np] = i; pairs[2*np+1] = i+n;		np++; }
+		if(i / (n*n) < n-1)		{ pairs[2*np] = i; pairs[2*np+1] = i+n*n;	np++; }
+	}
+	K.initPattern(nn, np, pairs);
+	for(unsigned int p = 0; p < np; p++) {
+		unsigned int	a = pairs[2*p], b = pairs[2*p+1];
+		unsigned int	d = (b == a+1) ? 0 : (b == a+n) ? 1 : 2;
+		Real			S[9] = { k[0], 0.0, 0.0, 0.0, k[1], 0.0, 0.0, 0.0, k[2] };
+		S[4*d] *= 2.0;
+		K.addBlock(K.find(a, a), S, 1.0);
+		K.addBlock(K.find(b, b), S, 1.0);
+		K.addBlock(K.find(a, b), S, -1.0);
+		K.addBlock(K.find(b, a), S, -1.0);
+	}
+	A.copyPattern(K);
+	Real	I[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+	for(unsigned int i = 0; i < nn; i++) {
+		for(unsigned int e = K.rowBegin(i); e < K.rowEnd(i); e++)
+			A.addBlock(e, K.block(e), 1.0);
+		A.addBlock(A.find(i, i), I, 0.1);
+	}
+
+	printf("Testing hierarchy:\t\t\t");
+	Multigrid	mg;
+	mg.Setup(A, 10, 40);
+	bool		coarser = mg.NumLevels() > 2 && mg.LevelNodes(mg.NumLevels()-1) <= 40;
+	for(unsigned int l = 1; l < mg.NumLevels(); l++)
+		if(mg.LevelNodes(l) >= mg.LevelNodes(l-1)) coarser = false;
+	TEST_VERIFY(coarser);
+
+	printf("Testing preconditioned CG:\t\t");
+	Vector<Real>	x(3*nn, 0.0), b(3*nn), r(3*nn);
+	for(unsigned int i = 0; i < 3*nn; i++) b[i] = sin(0.7 * i) + 0.1;
+	unsigned int	it = mg.Solve(x.begin(), b.begin(), 1e-8, 100);
+	multMV(r, A, x);
+	r -= b;
+	TEST_VERIFY(it < 30 && r.length() <= 1e-7 * b.length());
+
+	// Implicit Euler system of unit masses with the x = 0 face clamped:
+	// A11 = I + h C, A12 = h K with C = 0.1 K, A21 = -h I, A22 = I
+	printf("Testing implicit system:\t\t");
+	BlockCRSMatrix<Real>	A11, A12;
+	Vector<Real>			mass(nn, 1.0), dv(3*nn), dx(3*nn), bv(3*nn), bx(3*nn);
+	unsigned char			fixed[nn];
+	A11.copyPattern(K);
+	A12.copyPattern(K);
+	for(unsigned int i = 0; i < nn; i++) {
+		for(unsigned int e = K.rowBegin(i); e < K.rowEnd(i); e++) {
+			A11.addBlock(e, K.block(e), 0.1*h);
+			A12.addBlock(e, K.block(e), h);
+		}
+		A11.addBlock(A11.find(i, i), I, 1.0);
+		fixed[i] = (i % n == 0);
+		if(fixed[i]) {
+			A11.setRowIdentity(i);
+			A12.setRowIdentity(i);
+		}
+	}
+	for(unsigned int i = 0; i < 3*nn; i++) {
+		bv[i] = fixed[i/3] ? 0.0 : cos(0.3 * i);
+		bx[i] = 0.01 * sin(1.1 * i);
+	}
+	ImplicitMultigrid	solver;
+	solver.Solve(dv.begin(), dx.begin(), A11, A12, -h, 1.0, bv.begin(), bx.begin(), mass.begin(), fixed, 1e-10, 100);
+	// A second solve reuses the hierarchy
+	it = solver.Solve(dv.begin(), dx.begin(), A11, A12, -h, 1.0, bv.begin(), bx.begin(), mass.begin(), fixed, 1e-10, 100);
+	multMV(r, A11, dv);
+	multAddMV(r, A12, dx);
+	Real	err = 0.0;
+	for(unsigned int i = 0; i < 3*nn; i++) {
+		Real	e = fixed[i/3] ? fabs(dv[i]) : fabs(r[i] - bv[i]);
+		if(e > err) err = e;
+		e = fabs(-h*dv[i] + dx[i] - bx[i]);
+		if(e > err) err = e;
+	}
+	TEST_VERIFY(it < 30 && err < 1e-8);
+}
+
+void AlgebraUnitTest::TestMeshOrder()
+{
+	// Kuhn tetrahedra of an n^3 grid of cubes, nodes in a scrambled order
+	const unsigned int	n = 6, m = n+1, nn = m*m*m, ne = 6*n*n*n;
+	const unsigned int	axes[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+	unsigned int		scramble[nn], i, j, k;
+
+	printf("\nTesting mesh order\n");
+
+	for(i = 0; i < nn; i++) scramble[i] = (i * 173) % nn;
+
+	LoadData	*data = (LoadData *) malloc(sizeof(LoadData));
+	data->type			= TETRAHEDRA;
+	data->num_node		= nn;
+	data->num_element	= ne;
+	data->num_face		= 0;
+	data->num_edge		= 0;
+	data->face			= NULL;
+	data->edge			= NULL;
+	data->node_id		= NULL;
+	data->node			= (LDNode *) malloc(sizeof(LDNode)*nn);
+	data->element		= (LDElement *) malloc(sizeof(LDElement)*ne);
+	for(i = 0; i < nn; i++) {
+		LDNode	&v = data->node[scramble[i]];
+		v.pos[0]		= i % m;
+		v.pos[1]		= i / m % m;
+		v.pos[2]		= i / (m*m);
+		v.num_element	= 0;
+		v.element		= NULL;
+		v.boundary		= 0;
+	}
+	unsigned int	e = 0;
+	for(i = 0; i < n*n*n; i++) {
+		unsigned int	base = i % n + m * (i / n % n) + m * m * (i / (n*n));
+		unsigned int	step[3] = { 1, m, m*m };
+		for(j = 0; j < 6; j++, e++) {
+			LDElement	&t = data->element[e];
+			t.num_node	= 4;
+			t.node[0]	= scramble[base];
+			t.node[1]	= scramble[base + step[axes[j][0]]];
+			t.node[2]	= scramble[base + step[axes[j][0]] + step[axes[j][1]]];
+			t.node[3]	= scramble[base + 1 + m + m*m];
+			for(k = 0; k < 4; k++) t.neigh[k] = -2;
+		}
+	}
+	std::vector<unsigned int>	pairs;
+	for(e = 0; e < ne; e++)
+		for(j = 0; j < 4; j++)
+			for(k = j+1; k < 4; k++) {
+				pairs.push_back(data->element[e].node[j]);
+				pairs.push_back(data->element[e].node[k]);
+			}
+	const unsigned int	np = pairs.size() / 2;
+
+	// Valid permutations that bring the edges closer than the scrambled order
+	unsigned int	order[nn], inv[nn], spread[3] = { 0, 0, 0 };
+	double			pos[3*nn];
+	bool			valid = true;
+	for(i = 0; i < nn; i++)
+		for(j = 0; j < 3; j++) pos[3*i+j] = data->node[i].pos[j];
+	for(k = 0; k < np; k++)
+		spread[0] += abs((int) pairs[2*k] - (int) pairs[2*k+1]);
+	for(int method = MESH_ORDER_RCM; method <= MESH_ORDER_SFC; method++) {
+		MeshNodeOrder(method, nn, pos, np, &pairs[0], order);
+		for(i = 0; i < nn; i++) inv[i] = nn;
+		for(i = 0; i < nn; i++) if(order[i] < nn) inv[order[i]] = i;
+		for(i = 0; i < nn; i++) if(inv[i] == nn) valid = false;
+		for(k = 0; k < np; k++)
+			spread[method] += abs((int) inv[pairs[2*k]] - (int) inv[pairs[2*k+1]]);
+	}
+	printf("Testing RCM:\t\t\t\t");
+	TEST_VERIFY(valid && 2*spread[MESH_ORDER_RCM] < spread[0]);
+	printf("Testing Hilbert curve:\t\t\t");
+	TEST_VERIFY(valid && 2*spread[MESH_ORDER_SFC] < spread[0]);
+
+	// Same tetrahedra after renumbering, sorted by their lowest node
+	printf("Testing load data:\t\t\t");
+	std::vector<LDElement>	before(data->element, data->element + ne);
+	ReorderLoadData(data, MESH_ORDER_RCM);
+	std::vector<int>		count(ne, 0);
+	int						last = -1;
+	valid = data->node_id != NULL;
+	for(e = 0; valid && e < ne; e++) {
+		LDElement	&t = data->element[e];
+		int			low = nn;
+		for(j = 0; j < 4; j++) if(t.node[j] < low) low = t.node[j];
+		if(low < last) valid = false;
+		last = low;
+		// Find the original by the file indices of its nodes
+		for(k = 0; k < ne; k++) {
+			for(j = 0; j < 4; j++)
+				if(before[k].node[j] != data->node_id[t.node[j]]) break;
+			if(j == 4) count[k]++;
+		}
+	}
+	for(e = 0; e < ne; e++) if(count[e] != 1) valid = false;
+	for(i = 0; i < nn; i++) {
+		LDNode	&v = data->node[i];
+		unsigned int	file = data->node_id[i];
+		if(v.pos[0] != pos[3*file] || v.pos[1] != pos[3*file+1] || v.pos[2] != pos[3*file+2]) valid = false;
+	}
+	TEST_VERIFY(valid);
+}
+
+void AlgebraUnitTest::TestCorrespondence()
+{
+	// The two 11x11 sheets of the MSD-QSDS demo, 10 apart along x after
+	// rotating 60 degrees about x
+	const unsigned int	m = 11, nn = m*m, nt = 2*(m-1)*(m-1);
+	const Real			c = cos(60.0 * 3.14159265358979 / 180.0), s = sin(60.0 * 3.14159265358979 / 180.0);
+	Real				sheet1[3*nn], sheet2[3*nn];
+	unsigned int		tri[3*nt], flip[3*nt], match[nn], face[nt], i, j, n;
+	bool				valid;
+
+	printf("\nTesting correspondence\n");
+
+	for(i = 0; i < nn; i++) {
+		Real	x = (Real) (i % m) - 5.0, z = (Real) (i / m) - 5.0;
+		sheet1[3*i+0] = x - 5.0;	sheet1[3*i+1] = -s * z;	sheet1[3*i+2] = c * z + 5.0;
+		sheet2[3*i+0] = x + 5.0;	sheet2[3*i+1] = -s * z;	sheet2[3*i+2] = c * z + 5.0;
+	}
+	for(i = 0, n = 0; i < (m-1)*(m-1); i++) {
+		unsigned int	v = i % (m-1) + m * (i / (m-1));
+		tri[3*n+0] = v;		tri[3*n+1] = v + 1;		tri[3*n+2] = v + m + 1;		n++;
+		tri[3*n+0] = v;		tri[3*n+1] = v + m + 1;	tri[3*n+2] = v + m;			n++;
+	}
+
+	// Same pairs as msd_demo.obj.msd_demo.obj.corr: n 11 1, n 22 12, ...
+	printf("Testing nearest vertex:\t\t\t");
+	n = CorrNearestVertex(nn, sheet1, nn, sheet2, 1e-3, match);
+	valid = (n == m);
+	for(i = 0; i < nn; i++)
+		if(match[i] != ((i % m == m-1) ? i - (m-1) : CORR_NONE)) valid = false;
+	TEST_VERIFY(valid);
+
+	// Points 0.01 off the sheet, above a triangle, an edge and a corner
+	printf("Testing closest point:\t\t\t");
+	Real	p[9], w[9], nrm[3] = { 0.0, c, s };
+	for(j = 0; j < 3; j++) {
+		p[j]	= (2.0*sheet2[3*13+j] + sheet2[3*14+j] + 3.0*sheet2[3*25+j]) / 6.0 + 0.01*nrm[j];
+		p[3+j]	= (sheet2[3*13+j] + sheet2[3*14+j]) / 2.0 + 0.01*nrm[j];
+		p[6+j]	= sheet2[3*(nn-1)+j] + 0.01*nrm[j] + 0.5*(sheet2[3*(nn-1)+j] - sheet2[3*(nn-2)+j]);
+	}
+	n = CorrClosestPoint(3, p, nn, sheet2, nt, tri, 0.1, face, w);
+	valid = (n == 2 && face[1] != CORR_NONE && face[2] == CORR_NONE);
+	valid = valid && face[0] == 24 && fabs(w[0] - 1.0/3.0) < 1e-9 && fabs(w[1] - 1.0/6.0) < 1e-9 && fabs(w[2] - 0.5) < 1e-9;
+	for(j = 0; valid && j < 3; j++) {
+		const unsigned int	*v = tri + 3*face[1];
+		Real				q = w[3]*sheet2[3*v[0]+j] + w[4]*sheet2[3*v[1]+j] + w[5]*sheet2[3*v[2]+j];
+		if(fabs(q - (p[3+j] - 0.01*nrm[j])) > 1e-9) valid = false;
+	}
+	TEST_VERIFY(valid);
+
+	// A sheet against itself with the other orientation
+	printf("Testing face match:\t\t\t");
+	for(i = 0; i < nn; i++) match[i] = i;
+	for(i = 0; i < nt; i++) { flip[3*i] = tri[3*i];	flip[3*i+1] = tri[3*i+2];	flip[3*i+2] = tri[3*i+1]; }
+	n = CorrMatchFaces(nt, tri, match, nn, nt, flip, face);
+	valid = (n == nt);
+	for(i = 0; i < nt; i++) if(face[i] != i) valid = false;
+	TEST_VERIFY(valid);
+}
+
+void AlgebraUnitTest::TEST_VERIFY(bool test)
+{
+	if (test)
+	{
+		printf("Passed\n");
+	}
+	else
+	{
+		myFailedCount++;
+		printf("Failed\n");
+	}
+}
@@ -0,0 +1,55 @@
+/*
+The contents of this file are subject to the GiPSi Public License
+Version 1.0 (the "License"); you may not use this file except in
+compliance with the License. You may obtain a copy of the License at
+http://gipsi.case.edu/GiPSiPL/
+
+Software distributed under the License is distributed on an "AS IS"
+basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+License for the specific language governing rights and limitations
+under the License.
+
+The Original Code is Header for GiPSi Algebra Unit Test (AlgebraUnitTest.h).
+
+The Initial Developers of the Original Code are the GiPSi Developers.
+Portions created by the GiPSi Developers are Copyright (C) 2026.
+All Rights Reserved.
+
+Contributor(s): the GiPSi Developers.
+*/
+
+////	ALGEBRAUNITTEST.H v0.0
+////
+////	Header for GiPSi Algebra Unit Test
+////
+////////////////////////////////////////////////////////////////
+
+#ifndef _ALGEBRA_UNIT_TEST_H_
+#define _ALGEBRA_UNIT_TEST_H_
+
+#include "algebra.h"
+
+class AlgebraUnitTest
+{
+public:
+	AlgebraUnitTest();
+
+	void Run();
+	int GetFailedCount() { return myFailedCount; }
+	void TEST_VERIFY(bool test);
+
+private:
+	void TestAllocator();
+	void TestSmallInverse();
+	void TestBlockSparse();
+	void TestSkylineCholesky();
+	void TestCondensation();
+	void TestModalBasis();
+	void TestMultigrid();
+	void TestMeshOrder();
+	void TestCorrespondence();
+
+	int myFailedCount;
+};
+
+#endif
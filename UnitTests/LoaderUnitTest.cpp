@@ -31,7 +31,9 @@ Contributor(s): John Pao.
 */
 
 
+#include <float.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bioe.h"
 #include "collision.h"
@@ -41,13 +43,17 @@ Contributor(s): John Pao.
 #include "fem.h"
 #include "GiPSiCamera.h"
 #include "GiPSiException.h"
+#include "GiPSiHaptics.h"
 #include "GiPSiLight.h"
+#include "load_mesh.h"
 #include "LoaderUnitTest.h"
 #include "logger.h"
 #include "lumpedfluid.h"
 #include "probe.h"
 #include "msd.h"
+#include "parallel.h"
 #include "simple.h"
+#include "timing.h"
 #include "ToolkitCollisionDARLoader.h"
 #include "ToolkitCollisionDARParams.h"
 #include "ToolkitConnectorLoader.h"
@@ -64,6 +70,1218 @@ Contributor(s): John Pao.
 
 using namespace GiPSiXMLWrapper;
 
+/*
+===============================================================================
+	Mesh cache helpers
+===============================================================================
+*/
+
+// Writes a two tetrahedra mesh as <basename>.node, .ele, .neigh and .face
+static void WriteTestMesh(const char *basename)
+{
+	char	filename[256];
+	FILE	*fp;
+
+	sprintf(filename, "%s.node", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "5 3 0 1\n1 0 0 0 1\n2 0 1 0 1\n3 1 0 0 1\n4 0 0 1 1\n5 1 1 1 1\n");
+	fclose(fp);
+
+	sprintf(filename, "%s.ele", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "2 4 0\n1 1 2 3 4\n2 2 3 4 5\n");
+	fclose(fp);
+
+	sprintf(filename, "%s.neigh", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "2\t4\n1\t2\t-1\t-1\t-1\n2\t-1\t-1\t-1\t1\n");
+	fclose(fp);
+
+	sprintf(filename, "%s.face", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "7 1\n1 1 3 4 1\n2 1 2 3 1\n3 1 4 2 1\n4 2 4 3 0\n5 3 5 4 1\n6 2 5 3 1\n7 2 4 5 1\n");
+	fclose(fp);
+}
+
+// Size of a file, -1 if it is missing
+static long TestFileSize(const char *filename)
+{
+	FILE	*fp = fopen(filename, "rb");
+	long	size = -1;
+
+	if(fp != NULL) {
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fclose(fp);
+	}
+
+	return size;
+}
+
+// Cuts a file down to its first size bytes
+static void TruncateTestFile(const char *filename, long size)
+{
+	FILE	*fp = fopen(filename, "rb");
+	char	*buffer = new char[size];
+	size_t	read = fread(buffer, 1, size, fp);
+
+	fclose(fp);
+	fp = fopen(filename, "wb");
+	fwrite(buffer, 1, read, fp);
+	fclose(fp);
+	delete [] buffer;
+}
+
+// True if two loads of a mesh hold the same nodes, elements and faces
+static bool SameLoadData(const LoadData *a, const LoadData *b)
+{
+	int		i, j;
+
+	if(a == NULL || b == NULL || a->type != b->type || a->num_node != b->num_node ||
+	   a->num_element != b->num_element || a->num_face != b->num_face)
+		return false;
+
+	for(i = 0; i < a->num_node; i++) {
+		const LDNode	&p = a->node[i], &q = b->node[i];
+		if(p.pos[0] != q.pos[0] || p.pos[1] != q.pos[1] || p.pos[2] != q.pos[2] ||
+		   p.boundary != q.boundary || p.num_element != q.num_element)
+			return false;
+		for(j = 0; j < p.num_element; j++)
+			if(p.element[j] != q.element[j]) return false;
+	}
+	for(i = 0; i < a->num_element; i++)
+		for(j = 0; j < 4; j++)
+			if(a->element[i].node[j] != b->element[i].node[j] ||
+			   a->element[i].neigh[j] != b->element[i].neigh[j])
+				return false;
+	for(i = 0; i < a->num_face; i++)
+		for(j = 0; j < 3; j++)
+			if(a->face[i].node[j] != b->face[i].node[j]) return false;
+
+	return true;
+}
+
+// Writes the vertices and faces of a surface as an .obj file
+static void WriteTestSurface(const char *filename, TriSurface *surface)
+{
+	FILE			*fp = fopen(filename, "w");
+	unsigned int	i;
+
+	for(i = 0; i < surface->num_vertex; i++)
+		fprintf(fp, "v %.17g %.17g %.17g\n", surface->vertex[i].pos[0],
+				surface->vertex[i].pos[1], surface->vertex[i].pos[2]);
+	for(i = 0; i < surface->num_face; i++)
+		fprintf(fp, "f %d %d %d\n", (int) (surface->face[i].vertex[0] - surface->vertex) + 1,
+				(int) (surface->face[i].vertex[1] - surface->vertex) + 1,
+				(int) (surface->face[i].vertex[2] - surface->vertex) + 1);
+	fclose(fp);
+}
+
+// Writes an octahedron with its vertices moved off the axes as an .obj file
+static void WriteTestOctahedron(const char *filename)
+{
+	FILE	*fp = fopen(filename, "w");
+
+	fprintf(fp, "v 1.1 0.1 -0.05\nv -0.9 0.05 0.1\nv 0.05 1.2 0.1\n");
+	fprintf(fp, "v -0.1 -0.8 0.05\nv 0.1 -0.05 1.3\nv 0.05 0.1 -0.7\n");
+	fprintf(fp, "f 1 3 5\nf 3 2 5\nf 2 4 5\nf 4 1 5\n");
+	fprintf(fp, "f 3 1 6\nf 2 3 6\nf 4 2 6\nf 1 4 6\n");
+	fclose(fp);
+}
+
+// Writes an n x n sheet of masses in the x-y plane as <basename>.obj, .map
+// and .msd: structural and shear springs, the bottom row fixed and every
+// mass tied to a ground point at its rest position by a weak virtual
+// spring, whose index is that of the mass as the haptic model expects
+static void WriteTestMSD(const char *basename, int n)
+{
+	char	filename[256];
+	FILE	*fp;
+	int		i, r, c;
+
+	sprintf(filename, "%s.obj", basename);
+	fp = fopen(filename, "w");
+	for(i = 0; i < n*n; i++) fprintf(fp, "v %d %d 0\n", i % n, i / n);
+	for(r = 0; r < n-1; r++)
+		for(c = 0; c < n-1; c++) {
+			i = n*r + c + 1;
+			fprintf(fp, "f %d %d %d\nf %d %d %d\n", i, i + 1, i + n + 1, i, i + n + 1, i + n);
+		}
+	fclose(fp);
+
+	sprintf(filename, "%s.map", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "MSDTOOBJ %d 0 0\n", n*n);
+	for(i = 1; i <= n*n; i++) fprintf(fp, "%d\t%d\n", i, i);
+	fclose(fp);
+
+	sprintf(filename, "%s.msd", basename);
+	fp = fopen(filename, "w");
+	fprintf(fp, "MSD %d %d %d %d %d\n", n*n, n*n, 2*n*(n-1) + 2*(n-1)*(n-1), n*n, n);
+	for(i = 0; i < n*n; i++) fprintf(fp, "m 0.1 %d %d 0\n", i % n, i / n);
+	for(i = 1; i <= n*n; i++) fprintf(fp, "g %d\n", i);
+	for(r = 0; r < n; r++)
+		for(c = 0; c < n; c++) {
+			i = n*r + c + 1;
+			if(c < n-1) fprintf(fp, "s %d %d 50 0.5 1\n", i, i + 1);
+			if(r < n-1) fprintf(fp, "s %d %d 50 0.5 1\n", i, i + n);
+			if(c < n-1 && r < n-1) {
+				fprintf(fp, "s %d %d 50 0.5 %.17g\n", i, i + n + 1, sqrt(2.0));
+				fprintf(fp, "s %d %d 50 0.5 %.17g\n", i + 1, i + n, sqrt(2.0));
+			}
+		}
+	for(i = 1; i <= n*n; i++) fprintf(fp, "v %d %d 1 0.01 0\n", i, i);
+	for(i = 1; i <= n; i++) fprintf(fp, "b %d\n", i);
+	fclose(fp);
+}
+
+// Stands in for a haptic device: keeps a copy of the models it is given and
+// evaluates the force of one servo step from rest as the haptic loop of
+// OpenHapticsManager does
+class TestHapticInterface : public HapticInterface {
+public:
+	TestHapticInterface()	{ memset(&model, 0, sizeof(GiPSiLowOrderLinearHapticModel)); }
+	~TestHapticInterface()	{ FreeHapticModel(model); }
+
+	void	UseHapticModel(GiPSiLowOrderLinearHapticModel &Model)
+	{
+		ReserveHapticModel(model, Model._n, Model._m, Model._k);
+		*(model.A11)	= *(Model.A11);
+		*(model.A12)	= *(Model.A12);
+		*(model.B1)		= *(Model.B1);
+		*(model.C11)	= *(Model.C11);
+		*(model.C12)	= *(Model.C12);
+		*(model.D)		= *(Model.D);
+		*(model.f_0)	= *(Model.f_0);
+		*(model.zdot_0)	= *(Model.zdot_0);
+		*(model.normal)	= *(Model.normal);
+	}
+
+	// Force for the input u, velocities then displacements, after a step
+	// of length T
+	void	Force(Real *f, const Real *u, Real T)
+	{
+		unsigned int	n_2 = model._n/2, i, j;
+		Real			dot = 0.0;
+
+		for(i = 0; i < model._k; i++) {
+			f[i] = (*(model.f_0))[i];
+			for(j = 0; j < model._m; j++) f[i] += (*(model.D))[i][j] * u[j];
+		}
+		for(j = 0; j < n_2; j++) {
+			Real	z1 = (*(model.zdot_0))[j], z2 = (*(model.zdot_0))[n_2 + j];
+			for(i = 0; i < model._m; i++) z1 += (*(model.B1))[j][i] * u[i];
+			for(i = 0; i < model._k; i++)
+				f[i] += ((*(model.C11))[i][j] * z1 + (*(model.C12))[i][j] * z2) * T;
+		}
+		for(i = 0; i < model._k; i++) dot += f[i] * (*(model.normal))[i];
+		if(dot < 0.0)
+			for(i = 0; i < model._k; i++) f[i] = 0.0;
+	}
+
+	GiPSiLowOrderLinearHapticModel	model;
+};
+
+/*
+===============================================================================
+	Kernel reference checks
+===============================================================================
+*/
+
+// Largest difference of 3 Reals from a vector
+static Real MaxDifference(const Real *a, const Vector<Real> &b)
+{
+	Real	error = 0.0;
+
+	for(unsigned int r = 0; r < 3; r++)
+		if(fabs(a[r] - b[r]) > error) error = fabs(a[r] - b[r]);
+
+	return error;
+}
+
+// Largest difference of the bulk accessors of a boundary from the single
+// node ones, on every third node in reverse order with free (0), fixed (1)
+// and mixed (2) conditions.  GetBoundaryTypes() and SetBoundaryValues()
+// are checked against GetBoundaryType() and the fields Set() writes.  The
+// conditions of the nodes are restored.
+static Real BoundaryAccessError(SolidBoundary *bound)
+{
+	unsigned int	n = (bound->num_vertex + 2) / 3, i, k;
+	unsigned int	*index = new unsigned int[n], *type = new unsigned int[n], *bulk_type = new unsigned int[n];
+	Vector<Real>	*value = new Vector<Real>[n], *value2 = new Vector<Real>[n];
+	Real			*scalar = new Real[n], *bulk = new Real[3*n];
+	Real			d[3] = { 1.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0 }, zero[3] = { 0.0, 0.0, 0.0 };
+	Vector<Real>	normal(3, d);
+	Real			error = 0.0;
+
+	for(i = 0; i < n; i++) {
+		k = index[i] = bound->num_vertex - 1 - 3*i;
+		type[i]		= bound->boundary_type[k];
+		value[i]	= bound->boundary_value[k];
+		scalar[i]	= bound->boundary_value2_scalar[k];
+		value2[i]	= bound->boundary_value2_vector[k];
+		bound->Set(k, i % 3, value[i], 0.0, normal);
+	}
+
+	bound->GetPositions(n, index, bulk);
+	for(i = 0; i < n; i++)
+		if(MaxDifference(bulk + 3*i, bound->GetPosition(index[i])) > error)
+			error = MaxDifference(bulk + 3*i, bound->GetPosition(index[i]));
+	bound->GetVelocities(n, index, bulk);
+	for(i = 0; i < n; i++)
+		if(MaxDifference(bulk + 3*i, bound->GetVelocity(index[i])) > error)
+			error = MaxDifference(bulk + 3*i, bound->GetVelocity(index[i]));
+	bound->GetReactionForces(n, index, bulk);
+	for(i = 0; i < n; i++)
+		if(MaxDifference(bulk + 3*i, bound->GetReactionForce(index[i])) > error)
+			error = MaxDifference(bulk + 3*i, bound->GetReactionForce(index[i]));
+
+	bound->GetBoundaryTypes(n, index, bulk_type);
+	for(i = 0; i < n; i++)
+		if(bulk_type[i] != (unsigned int) bound->GetBoundaryType(index[i])) error = 1.0;
+
+	for(i = 0; i < 3*n; i++) bulk[i] = sin(1.0 + i);
+	bound->SetBoundaryValues(n, index, 1, bulk);
+	for(i = 0; i < n; i++) {
+		k = index[i];
+		if(bound->GetBoundaryType(k) != 1 || bound->boundary_value2_scalar[k] != 0.0) error = 1.0;
+		if(MaxDifference(bulk + 3*i, bound->boundary_value[k]) > error)
+			error = MaxDifference(bulk + 3*i, bound->boundary_value[k]);
+		if(MaxDifference(zero, bound->boundary_value2_vector[k]) > error)
+			error = MaxDifference(zero, bound->boundary_value2_vector[k]);
+	}
+
+	for(i = 0; i < n; i++) bound->Set(index[i], type[i], value[i], scalar[i], value2[i]);
+
+	delete [] index;	delete [] type;		delete [] bulk_type;
+	delete [] value;	delete [] value2;
+	delete [] scalar;	delete [] bulk;
+
+	return error;
+}
+
+// Largest difference of the positions and normals TriSurface::Transform()
+// gives for the surface in filename from Scale(s), Rotate() by angle about
+// axis, Translate(t) and calcNormals() on a copy of it
+static Real SurfaceTransformError(const char *filename, const Real *s, Real angle,
+								  const Real *axis, const Real *t)
+{
+	TriSurface		rest, surface, reference;
+	Matrix<Real>	R(3,3,0.0);
+	Vector<Real>	scale(3,0.0), translation(3,0.0);
+	Real			A[9], u[3], l, c = cos(angle), sn = sin(angle), error = 0.0;
+	unsigned int	i, r, k;
+
+	rest.Load((char *) filename);
+	surface.Load((char *) filename);
+	reference.Load((char *) filename);
+	for(i = 0; i < rest.num_vertex; i++) rest.vertex[i].n = 0.0;
+	rest.calcNormals();
+
+	l = sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+	for(r = 0; r < 3; r++) u[r] = axis[r] / l;
+	for(r = 0; r < 3; r++) {
+		scale[r] = s[r];
+		translation[r] = t[r];
+		for(k = 0; k < 3; k++) R[r][k] = (1.0 - c) * u[r] * u[k] + ((r == k) ? c : 0.0);
+	}
+	R[0][1] -= sn * u[2];	R[0][2] += sn * u[1];	R[1][2] -= sn * u[0];
+	R[1][0] += sn * u[2];	R[2][0] -= sn * u[1];	R[2][1] += sn * u[0];
+	for(r = 0; r < 3; r++)
+		for(k = 0; k < 3; k++) A[3*r+k] = R[r][k] * s[k];
+
+	reference.Scale(scale);
+	reference.Rotate(R);
+	reference.Translate(translation);
+	for(i = 0; i < reference.num_vertex; i++) reference.vertex[i].n = 0.0;
+	reference.calcNormals();
+
+	surface.Transform(rest, A, t);
+
+	for(i = 0; i < surface.num_vertex; i++) {
+		if(MaxDifference(surface.vertex[i].pos.begin(), reference.vertex[i].pos) > error)
+			error = MaxDifference(surface.vertex[i].pos.begin(), reference.vertex[i].pos);
+		if(MaxDifference(surface.vertex[i].n.begin(), reference.vertex[i].n) > error)
+			error = MaxDifference(surface.vertex[i].n.begin(), reference.vertex[i].n);
+	}
+	for(i = 0; i < surface.num_face; i++)
+		if(MaxDifference(surface.face[i].n.begin(), reference.face[i].n) > error)
+			error = MaxDifference(surface.face[i].n.begin(), reference.face[i].n);
+
+	return error;
+}
+
+// Moves the nodes of fem off their reference positions by a fixed pattern
+// of size dx and gives them velocities of size dv, both relative to the
+// extent of the mesh, which is returned.  dx = dv = 0 puts fem at rest.
+Real LoaderUnitTest::PerturbFEMState(FEM_3LMObject * fem, Real dx, Real dv)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	Real			lo[3], hi[3], size = 0.0;
+	unsigned int	i, r;
+
+	for(r = 0; r < 3; r++) lo[r] = hi[r] = fem->rcpos[0][r];
+	for(i = 1; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++) {
+			if(fem->rcpos[i][r] < lo[r]) lo[r] = fem->rcpos[i][r];
+			if(fem->rcpos[i][r] > hi[r]) hi[r] = fem->rcpos[i][r];
+		}
+	for(r = 0; r < 3; r++)
+		if(hi[r] - lo[r] > size) size = hi[r] - lo[r];
+
+	for(i = 0; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++) {
+			state.pos[i][r] = fem->rcpos[i][r] + dx * size * sin(1.0 + 3.0 * i + r);
+			state.vel[i][r] = dv * size * cos(2.0 + 5.0 * i + r);
+		}
+
+	return size;
+}
+
+// Largest difference of the batched element forces from the per element
+// FEMElement computation they replaced, relative to the largest force
+Real LoaderUnitTest::FEMForceError(FEM_3LMObject * fem)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	FEMDomain		*dom = (FEMDomain *) fem->domain;
+	Vector<Real>	*force = new Vector<Real>[fem->num_node];
+	Real			error = 0.0, scale = 0.0;
+	unsigned int	i, j, k;
+
+	PerturbFEMState(fem, 0.05, 0.5);
+	fem->UpdateForces(state);
+
+	for(i = 0; i < fem->num_node; i++) force[i] = zero_vector3;
+	for(k = 0; k < fem->num_element; k++) {
+		Tetrahedra3DFEMElement	&e = fem->elements[k];
+		Vector<Real>	&p0 = state.pos[e.node_id[0]], &v0 = state.vel[e.node_id[0]];
+		Vector<Real>	&p1 = state.pos[e.node_id[1]], &v1 = state.vel[e.node_id[1]];
+		Vector<Real>	&p2 = state.pos[e.node_id[2]], &v2 = state.vel[e.node_id[2]];
+		Vector<Real>	&p3 = state.pos[e.node_id[3]], &v3 = state.vel[e.node_id[3]];
+
+		e.computeStrain(p0, p1, p2, p3);
+		e.computeStrainVelocity(p0, p1, p2, p3, v0, v1, v2, v3);
+		e.computeStress();
+		e.stress += dom->DomStress[k];
+		e.computeForces(p0, p1, p2, p3);
+
+		for(j = 0; j < 4; j++) force[e.node_id[j]] += e.NodeForce[j];
+	}
+
+	for(i = 0; i < fem->num_node; i++)
+		for(j = 0; j < 3; j++) {
+			if(fabs(force[i][j]) > scale) scale = fabs(force[i][j]);
+			if(fabs(fem->force[i][j] - force[i][j]) > error) error = fabs(fem->force[i][j] - force[i][j]);
+		}
+
+	delete [] force;
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(state);
+
+	return (scale > 0.0) ? error / scale : 1.0;
+}
+
+// True if the slots of fem hold every element once and no two elements
+// of a colour share a node
+bool LoaderUnitTest::FEMColoring(FEM_3LMObject * fem)
+{
+	TetArray		&tets = fem->tets;
+	unsigned int	*mark = new unsigned int[fem->num_node];
+	bool			valid = (tets.num == fem->num_element && tets.color_ptr[0] == 0 &&
+							 tets.color_ptr[tets.num_color] == tets.num);
+	unsigned int	i, a, c, k;
+
+	for(k = 0; valid && k < tets.num; k++)
+		valid = (tets.element[k] < tets.num && tets.slot[tets.element[k]] == k);
+
+	for(i = 0; i < fem->num_node; i++) mark[i] = 0;
+	for(c = 0; valid && c < tets.num_color; c++)
+		for(k = tets.color_ptr[c]; valid && k < tets.color_ptr[c+1]; k++)
+			for(a = 0; a < 4; a++) {
+				unsigned int	node = tets.node[a * tets.num + k];
+				if(node != fem->elements[tets.element[k]].node_id[a] || mark[node] == c + 1) valid = false;
+				mark[node] = c + 1;
+			}
+
+	delete [] mark;
+	return valid;
+}
+
+// Largest difference of the element forces computed on several threads
+// from the forces computed on one
+Real LoaderUnitTest::FEMThreadError(FEM_3LMObject * fem)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	Vector<Real>	*force = new Vector<Real>[fem->num_node];
+	unsigned int	threads = GetParallelThreads();
+	Real			error = 0.0;
+	unsigned int	i, r;
+
+	PerturbFEMState(fem, 0.05, 0.5);
+	SetParallelThreads(1);
+	fem->UpdateForces(state);
+	for(i = 0; i < fem->num_node; i++) force[i] = fem->force[i];
+
+	SetParallelThreads(4);
+	fem->UpdateForces(state);
+	for(i = 0; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++)
+			if(fabs(fem->force[i][r] - force[i][r]) > error) error = fabs(fem->force[i][r] - force[i][r]);
+
+	delete [] force;
+	SetParallelThreads(threads);
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(state);
+
+	return error;
+}
+
+// Largest difference of K d and C d from the differences of the forces of
+// fem along a fixed direction d, a central difference of step h in the
+// positions and a unit change of the velocities, relative to the largest
+// of K d and C d.  fem must be at rest velocity and is left where it is.
+Real LoaderUnitTest::TangentDifference(FEM_3LMObject * fem, Real h)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	Vector<Real>	&POS = *state.POS, &VEL = *state.VEL;
+	unsigned int	n = 3 * fem->num_node, i, j;
+	BlockCRSMatrix<Real>	K, C;
+	Vector<Real>	x(n), d(n), Kd(n), Cd(n), f[4];
+	Real			errorK = 0.0, scaleK = 0.0, errorC = 0.0, scaleC = 0.0;
+
+	for(i = 0; i < n; i++) {
+		x[i] = POS[i];
+		d[i] = sin(7.0 + 11.0 * i);
+	}
+
+	// Forces at x, x + h d, x - h d and x with velocity d.  Each is
+	// evaluated a few times for the rotations of the corotational
+	// element, which start from those of the previous evaluation.
+	for(j = 0; j < 4; j++) {
+		for(i = 0; i < n; i++) {
+			POS[i] = x[i] + ((j == 1) ? h : (j == 2) ? -h : 0.0) * d[i];
+			VEL[i] = (j == 3) ? d[i] : 0.0;
+		}
+		for(i = 0; i < 3; i++) fem->UpdateForces(state);
+		f[j] = Vector<Real>(n);
+		for(i = 0; i < n; i++) f[j][i] = fem->force[i / 3][i % 3];
+
+		if(j == 0) {
+			fem->InitElementPattern(K);
+			fem->InitElementPattern(C);
+			fem->AssembleTangent(K, C, state);
+			multMV(Kd, K, d);
+			multMV(Cd, C, d);
+		}
+	}
+	for(i = 0; i < n; i++) VEL[i] = 0.0;
+
+	for(i = 0; i < n; i++) {
+		Real	dK = Kd[i] + (f[1][i] - f[2][i]) / (2.0 * h);
+		Real	dC = Cd[i] + (f[3][i] - f[0][i]);
+		if(fabs(Kd[i]) > scaleK) scaleK = fabs(Kd[i]);
+		if(fabs(Cd[i]) > scaleC) scaleC = fabs(Cd[i]);
+		if(fabs(dK) > errorK) errorK = fabs(dK);
+		if(fabs(dC) > errorC) errorC = fabs(dC);
+	}
+	if(scaleK == 0.0 || scaleC == 0.0) return 1.0;
+
+	return (errorK / scaleK > errorC / scaleC) ? errorK / scaleK : errorC / scaleC;
+}
+
+// Tangent of the nonlinear element at a fixed deformed state
+Real LoaderUnitTest::FEMTangentError(FEM_3LMObject * fem)
+{
+	Real	size = PerturbFEMState(fem, 0.05, 0.0);
+	Real	error = TangentDifference(fem, 1e-6 * size);
+
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(fem->state);
+
+	return error;
+}
+
+// Moves fem rigidly from its reference positions, a rotation of 0.5 about
+// (1,2,3) around the centroid and a translation, with the velocity of a
+// rigid spin and drift.  Returns the extent of the mesh.
+Real LoaderUnitTest::RigidFEMState(FEM_3LMObject * fem)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	Real			size = PerturbFEMState(fem, 0.0, 0.0);
+	Real			a[3] = { 1.0 / sqrt(14.0), 2.0 / sqrt(14.0), 3.0 / sqrt(14.0) };
+	Real			w[3] = { 0.3, -0.2, 0.1 }, cs = cos(0.5), sn = sin(0.5);
+	Real			R[3][3], c[3] = { 0.0, 0.0, 0.0 };
+	unsigned int	i, r, s;
+
+	// Rodrigues: R = cos I + sin [a]x + (1 - cos) a a^T
+	for(r = 0; r < 3; r++)
+		for(s = 0; s < 3; s++)
+			R[r][s] = (r == s ? cs : 0.0) + (1.0 - cs) * a[r] * a[s];
+	R[0][1] -= sn * a[2];	R[1][0] += sn * a[2];
+	R[0][2] += sn * a[1];	R[2][0] -= sn * a[1];
+	R[1][2] -= sn * a[0];	R[2][1] += sn * a[0];
+
+	for(i = 0; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++) c[r] += fem->rcpos[i][r] / fem->num_node;
+
+	for(i = 0; i < fem->num_node; i++) {
+		Real	x[3];
+		for(r = 0; r < 3; r++)
+			x[r] = R[r][0] * (fem->rcpos[i][0] - c[0]) + R[r][1] * (fem->rcpos[i][1] - c[1]) +
+				   R[r][2] * (fem->rcpos[i][2] - c[2]);
+		for(r = 0; r < 3; r++) state.pos[i][r] = c[r] + x[r] + size * (0.1 * r - 0.1);
+		state.vel[i][0] = w[1] * x[2] - w[2] * x[1] + 0.5 * size;
+		state.vel[i][1] = w[2] * x[0] - w[0] * x[2];
+		state.vel[i][2] = w[0] * x[1] - w[1] * x[0];
+	}
+
+	return size;
+}
+
+// Largest force of the corotational element under the rigid motion of
+// RigidFEMState(), relative to the largest force of a deformed state
+Real LoaderUnitTest::CorotationalRigidForce(FEM_3LMObject * fem)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	int				model = fem->element_model;
+	Real			rigid = 0.0, scale = 0.0;
+	unsigned int	i, r;
+
+	fem->element_model = FEM_ELEMENT_COROTATIONAL;
+	fem->PrecomputeCorotational();
+
+	PerturbFEMState(fem, 0.05, 0.0);
+	for(i = 0; i < 10; i++) fem->UpdateForces(state);
+	for(i = 0; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++)
+			if(fabs(fem->force[i][r]) > scale) scale = fabs(fem->force[i][r]);
+
+	// The rotations start from those of the last call and converge
+	// over a few calls
+	RigidFEMState(fem);
+	for(i = 0; i < 10; i++) fem->UpdateForces(state);
+	for(i = 0; i < fem->num_node; i++)
+		for(r = 0; r < 3; r++)
+			if(fabs(fem->force[i][r]) > rigid) rigid = fabs(fem->force[i][r]);
+
+	fem->element_model = model;
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(state);
+
+	return (scale > 0.0) ? rigid / scale : 1.0;
+}
+
+// Tangent of the corotational element at the rigidly moved rest state,
+// where R K R^T is the exact stiffness
+Real LoaderUnitTest::CorotationalTangentError(FEM_3LMObject * fem)
+{
+	FEM_3LMObject::State	&state = fem->state;
+	int				model = fem->element_model;
+	Real			size, error;
+	unsigned int	i;
+
+	fem->element_model = FEM_ELEMENT_COROTATIONAL;
+	fem->PrecomputeCorotational();
+
+	size = RigidFEMState(fem);
+	for(i = 0; i < 10; i++) fem->UpdateForces(state);
+	error = TangentDifference(fem, 1e-6 * size);
+
+	fem->element_model = model;
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(state);
+
+	return error;
+}
+
+// Bulk boundary access of fem at a fixed perturbed state
+Real LoaderUnitTest::FEMBoundaryError(FEM_3LMObject * fem)
+{
+	Real	error;
+
+	PerturbFEMState(fem, 0.05, 0.5);
+	fem->UpdateForces(fem->state);
+	error = BoundaryAccessError((SolidBoundary *) fem->boundary);
+
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(fem->state);
+
+	return error;
+}
+
+// Largest difference of the response of the haptic model of the first
+// boundary vertex of fem that has one, passed through a stand-in haptic
+// interface, from the rest tangent condensed to the vertex by conjugate
+// gradients, relative to the largest condensed stiffness or damping.  The
+// force without input has to be the force at the node.
+Real LoaderUnitTest::FEMHapticModelError(FEM_3LMObject * fem)
+{
+	FEMBoundary		*bound = (FEMBoundary *) fem->boundary;
+	unsigned int	n = 3 * fem->num_node, index = bound->num_vertex;
+	unsigned int	i, r, s, t, it;
+
+	for(i = 0; i < bound->num_vertex && index == bound->num_vertex; i++)
+		if(fem->haptic_slot != NULL && fem->haptic_slot[i] != FEM_NO_HAPTIC) index = i;
+	if(index == bound->num_vertex) return 1.0;
+	unsigned int	node = bound->global_id[index];
+
+	PerturbFEMState(fem, 0.0, 0.0);
+	fem->UpdateForces(fem->state);
+	BlockCRSMatrix<Real>	K, C;
+	fem->InitElementPattern(K);
+	fem->InitElementPattern(C);
+	fem->AssembleTangent(K, C, fem->state);
+
+	// Columns X = K^-1 E of the unit loads at the node, fixed nodes held
+	unsigned char	*fixed = new unsigned char[n];
+	memset(fixed, 0, n);
+	for(i = 0; i < bound->num_vertex; i++)
+		if(bound->boundary_type[i] == 1)
+			for(r = 0; r < 3; r++) fixed[3*bound->global_id[i] + r] = 1;
+	Vector<Real>	X[3], p(n), q(n), res(n);
+	for(s = 0; s < 3; s++) {
+		Real	rr = 1.0;
+
+		X[s] = Vector<Real>(n, 0.0);
+		res = 0.0;
+		res[3*node + s] = 1.0;
+		p = res;
+		for(it = 0; it < 10*n && rr > 1e-24; it++) {
+			Real	pq = 0.0, rr_new = 0.0;
+			multMV(q, K, p);
+			for(i = 0; i < n; i++) {
+				if(fixed[i]) q[i] = 0.0;
+				pq += p[i] * q[i];
+			}
+			for(i = 0; i < n; i++) {
+				X[s][i]	+= rr / pq * p[i];
+				res[i]	-= rr / pq * q[i];
+				rr_new	+= res[i] * res[i];
+			}
+			for(i = 0; i < n; i++) p[i] = res[i] + rr_new / rr * p[i];
+			rr = rr_new;
+		}
+	}
+	delete [] fixed;
+
+	// Condensed stiffness Kc = G^-1 of the compliance G = E^T X, and
+	// damping Psi^T C Psi on the unit displacement fields Psi = X Kc
+	Matrix<Real>	G(3, 3, 0.0), Kc(3, 3, 0.0), Cc(3, 3, 0.0);
+	Vector<Real>	Psi[3];
+	for(r = 0; r < 3; r++)
+		for(s = 0; s < 3; s++) G[r][s] = X[s][3*node + r];
+	if(invM(Kc, G) != 0) return 1.0;
+	for(s = 0; s < 3; s++) {
+		Psi[s] = Vector<Real>(n, 0.0);
+		for(t = 0; t < 3; t++)
+			for(i = 0; i < n; i++) Psi[s][i] += X[t][i] * Kc[t][s];
+	}
+	for(s = 0; s < 3; s++) {
+		multMV(q, C, Psi[s]);
+		for(r = 0; r < 3; r++)
+			for(i = 0; i < n; i++) Cc[r][s] += Psi[r][i] * q[i];
+	}
+
+	// Response of the model to unit velocities and displacements
+	TestHapticInterface				hi;
+	GiPSiLowOrderLinearHapticModel	model;
+	Real							u[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, f0[3], f[3];
+	Real							errorK = 0.0, scaleK = 0.0, errorC = 0.0, scaleC = 0.0;
+
+	memset(&model, 0, sizeof(GiPSiLowOrderLinearHapticModel));
+	int		result = fem->ReturnHapticModel(index, model);
+	if(result == 0) hi.UseHapticModel(model);
+	FreeHapticModel(model);
+	if(result != 0) return 1.0;
+
+	hi.Force(f0, u, fem->timestep);
+	for(s = 0; s < 6; s++) {
+		u[s] = 1.0;
+		hi.Force(f, u, fem->timestep);
+		u[s] = 0.0;
+		for(r = 0; r < 3; r++) {
+			Real	ref = (s < 3) ? -Cc[r][s] : -Kc[r][s-3];
+			Real	&error = (s < 3) ? errorC : errorK, &scale = (s < 3) ? scaleC : scaleK;
+			if(fabs(f[r] - f0[r] - ref) > error) error = fabs(f[r] - f0[r] - ref);
+			if(fabs(ref) > scale) scale = fabs(ref);
+		}
+	}
+	for(r = 0; r < 3; r++)
+		if(f0[r] != fem->force[node][r]) return 1.0;
+	if(scaleK == 0.0 || scaleC == 0.0) return 1.0;
+
+	return (errorK / scaleK > errorC / scaleC) ? errorK / scaleK : errorC / scaleC;
+}
+
+// Time in ms to extract the haptic model of a boundary vertex of fem and
+// hand it to a haptic interface, averaged over the vertices with a model
+Real LoaderUnitTest::FEMHapticModelTime(FEM_3LMObject * fem)
+{
+	FEMBoundary						*bound = (FEMBoundary *) fem->boundary;
+	TestHapticInterface				hi;
+	GiPSiLowOrderLinearHapticModel	model;
+	unsigned int					count = 0;
+
+	memset(&model, 0, sizeof(GiPSiLowOrderLinearHapticModel));
+	init_timers();
+	start_timer(0);
+	for(unsigned int i = 0; i < bound->num_vertex; i++)
+		if(fem->ReturnHapticModel(i, model) == 0) {
+			hi.UseHapticModel(model);
+			count++;
+		}
+	double	time = get_timer(0);
+	FreeHapticModel(model);
+
+	return (count > 0) ? time / count : 1.0;
+}
+
+// Rest volume of the elements of fem
+Real LoaderUnitTest::FEMVolume(FEM_3LMObject * fem)
+{
+	Real	volume = 0.0;
+
+	for(unsigned int k = 0; k < fem->tets.num; k++) volume += fabs(fem->tets.volume[k]);
+
+	return volume;
+}
+
+// Difference of the chamber volume of lf from the per face TetrahedraVolume
+// sum it replaced, at positions moved off the loaded ones, relative to the
+// volume
+Real LoaderUnitTest::ChamberVolumeError(LumpedFluidObject * lf)
+{
+	LumpedFluidObject::State	&state = lf->state;
+	LumpedFluidBoundary	*bound = (LumpedFluidBoundary *) lf->boundary;
+	Vector<Real>		*pos = new Vector<Real>[state.size];
+	Vector<Real>		center(3, 0.0);
+	Real				volume, reference = 0.0;
+	unsigned int		i, r;
+
+	for(i = 0; i < state.size; i++) {
+		pos[i] = state.pos[i];
+		for(r = 0; r < 3; r++) state.pos[i][r] *= 1.0 + 0.01 * sin(1.0 + 3.0 * i + r);
+	}
+	lf->chamber_pos = NULL;
+	volume = lf->ChamberVolume(state);
+
+	for(i = 0; i < state.size; i++) center += state.pos[i];
+	center = center * (1.0 / state.size);
+	for(i = 0; i < bound->num_face; i++)
+		reference -= TetrahedraVolume(state.pos[bound->face[i].vertex[0]->refid],
+									  state.pos[bound->face[i].vertex[1]->refid],
+									  state.pos[bound->face[i].vertex[2]->refid],
+									  center);
+
+	for(i = 0; i < state.size; i++) state.pos[i] = pos[i];
+	lf->chamber_pos = NULL;
+	delete [] pos;
+
+	return (reference != 0.0) ? fabs(volume - reference) / fabs(reference) : 1.0;
+}
+
+// Largest difference of the batched excitation of cbe and the contraction
+// stresses written by femcbe from the per element CalcExcitation() and
+// Excitation_to_Contraction() they replaced, over the excitation bands of
+// both signs and of the current state, which is restored
+Real LoaderUnitTest::ExcitationError(CardiacBioEObject * cbe, FEM3LM_BIOE_Connector * femcbe)
+{
+	TetVolume		*geom = cbe->HeartMuscleGeometry;
+	Real			x[3] = { 0.5, -0.5, cbe->state.x[0] };
+	Real			error = 0.0;
+	unsigned int	excited = 0, b, i, j, r, c;
+
+	for(b = 0; b < 3; b++) {
+		cbe->state.x[0] = x[b];
+		cbe->UpdateExcitation();
+		femcbe->process();
+
+		for(i = 0; i < geom->num_tet; i++) {
+			Real	xloc = 0.0;
+			for(j = 0; j < 4; j++) xloc += 0.25 * geom->tet[i].vertex[j]->pos[0];
+
+			Real			excitation = cbe->CalcExcitation(xloc);
+			Matrix<Real>	stress = femcbe->Excitation_to_Contraction(excitation);
+			if(excitation > 0.0) excited++;
+
+			if(fabs(cbe->GetExcitation()[i] - excitation) > error) error = fabs(cbe->GetExcitation()[i] - excitation);
+			for(r = 0; r < 3; r++)
+				for(c = 0; c < 3; c++)
+					if(fabs(femcbe->mech->DomStress[i][r][c] - stress[r][c]) > error)
+						error = fabs(femcbe->mech->DomStress[i][r][c] - stress[r][c]);
+		}
+	}
+
+	return (excited > 0) ? error : 1.0;
+}
+
+// Largest difference of the pressure forces femlf applies to the mech
+// boundary from the per face scatter loop the node gather replaced.  The
+// conditions of the nodes are restored.
+Real LoaderUnitTest::PressureForceError(FEM3LM_LUMPEDFLUID_Connector * femlf)
+{
+	FEMBoundary		*mech = femlf->mech;
+	unsigned int	n = femlf->num_vertex, i, j, k;
+	unsigned int	*type = new unsigned int[n];
+	Vector<Real>	*value = new Vector<Real>[n], *value2 = new Vector<Real>[n];
+	Real			*scalar = new Real[n], *force = new Real[3*mech->num_vertex];
+	Real			pressure = femlf->lfluid->GetPressure((unsigned int) 0);
+	Real			error = 0.0, scale = 0.0;
+
+	for(i = 0; i < n; i++) {
+		k = femlf->femnode[i];
+		type[i]		= mech->boundary_type[k];
+		value[i]	= mech->boundary_value[k];
+		scalar[i]	= mech->boundary_value2_scalar[k];
+		value2[i]	= mech->boundary_value2_vector[k];
+	}
+
+	femlf->process();
+
+	for(i = 0; i < n; i++) {
+		Real	*f = force + 3*femlf->femnode[i];
+		f[0] = f[1] = f[2] = 0.0;
+	}
+	for(i = 0; i < femlf->num_face; i++) {
+		unsigned int	femidx = femlf->fcorr[2*i];
+		Real			aread3 = TriangleArea(mech->face[femidx].vertex[0]->pos,
+											  mech->face[femidx].vertex[1]->pos,
+											  mech->face[femidx].vertex[2]->pos);
+		aread3 = fabs(aread3/3.0);
+
+		for(j = 0; j < 3; j++) {
+			k = mech->facetovertexids[3*femidx+j];
+			const Real	*nv = mech->vertex[k].n.begin();
+			Real		*f = force + 3*k;
+			f[0] -= pressure*aread3*nv[0];
+			f[1] -= pressure*aread3*nv[1];
+			f[2] -= pressure*aread3*nv[2];
+		}
+	}
+
+	for(i = 0; i < n; i++) {
+		k = femlf->femnode[i];
+		if(mech->GetBoundaryType(k) != 0) error = 1.0;
+		if(MaxDifference(force + 3*k, mech->boundary_value[k]) > error)
+			error = MaxDifference(force + 3*k, mech->boundary_value[k]);
+		for(j = 0; j < 3; j++)
+			if(fabs(force[3*k+j]) > scale) scale = fabs(force[3*k+j]);
+		mech->Set(k, type[i], value[i], scalar[i], value2[i]);
+	}
+
+	delete [] type;		delete [] value;	delete [] value2;
+	delete [] scalar;	delete [] force;
+
+	return (scale > 0.0) ? error : 1.0;
+}
+
+// True if the MSD/OBJ index tables of msd agree with its mapping and its
+// fixed boundary
+bool LoaderUnitTest::MSDIndexTables(MSDObject * msd)
+{
+	bool	consistent = true;
+
+	for(unsigned int i = 0; i < msd->num_mapping; i++) {
+		unsigned int	index_msd = msd->mapping[2*i];
+		unsigned int	index_obj = msd->mapping[2*i+1];
+		if(msd->getMSDIndex(index_obj) != (int) index_msd || msd->getOBJIndex(index_msd) != (int) index_obj)
+			consistent = false;
+	}
+	for(unsigned int i = 0; i < msd->num_boundary; i++)
+		if(!msd->isFixedBoundary(msd->fix_boundary[i])) consistent = false;
+
+	return consistent &&
+		   msd->getMSDIndex(msd->getNumOBJIndex()) == -1 &&
+		   msd->getOBJIndex(msd->num_mass) == -1;
+}
+
+// True if the haptic neighbourhood of every node of msd is built once and
+// cached, with the node as its only contact mass
+bool LoaderUnitTest::MSDModelCache(MSDObject * msd)
+{
+	bool	cached = true;
+
+	for(unsigned int i = 0; i < msd->num_mass; i++) {
+		MSDModel	*model = msd->msdModelBuilder.GetModel(i);
+		if(model == NULL || model != msd->msdModelBuilder.GetModel(i) ||
+		   model->getMassSize(0) != 1 || model->getMassIndex(0, 0) != i ||
+		   model->getMassNum(0, i) != 0 || model->isInMassIndex(1, i))
+			cached = false;
+	}
+
+	return cached && msd->msdModelBuilder.GetModel(msd->num_mass) == NULL;
+}
+
+// True if a haptic model of msd is refilled in place for the same contact
+// node, and resized without leaking for a node with an other number of
+// internal masses
+bool LoaderUnitTest::MSDHapticReuse(MSDObject * msd)
+{
+	GiPSiLowOrderLinearHapticModel	model;
+	AlgebraAllocStats				stats;
+	unsigned int					*mapping = msd->mapping, num_mapping = msd->num_mapping;
+
+	memset(&model, 0, sizeof(GiPSiLowOrderLinearHapticModel));
+	msd->ReturnHapticModel(mapping[1], model);
+	Matrix<Real>	*A12 = model.A12;
+	Matrix<Real>	A12copy = *A12;
+	Vector<Real>	f0copy = *(model.f_0);
+	bool			reused = (msd->ReturnHapticModel(mapping[1], model) == 0 &&
+							  model.A12 == A12 &&
+							  *(model.A12) == A12copy &&
+							  *(model.f_0) == f0copy);
+
+	unsigned int	n = model._n, other = num_mapping;
+	for(unsigned int i = 1; i < num_mapping && other == num_mapping; i++)
+		if(msd->ReturnHapticModel(mapping[2*i+1], model) == 0 && model._n != n) other = i;
+	ResetAlgebraAllocStats();
+	msd->ReturnHapticModel(mapping[1], model);
+	bool	resized = (model._n == n && model.A11->m() == n/2);
+	if(other < num_mapping) {
+		msd->ReturnHapticModel(mapping[2*other+1], model);
+		resized = resized && model._n != n &&
+				  model.A11->m() == model._n/2 && model.zdot_0->dim() == model._n;
+	}
+	GetAlgebraAllocStats(stats);
+	FreeHapticModel(model);
+
+	return reused && other < num_mapping && resized &&
+		   stats.pool_allocs + stats.heap_allocs == stats.pool_frees + stats.heap_frees;
+}
+
+// True if a and b hold the same model and state, element for element, as
+// when one is loaded from the .msdb file written by the other
+bool LoaderUnitTest::MSDSameModel(MSDObject * a, MSDObject * b)
+{
+	unsigned int	i;
+
+	if(a->num_mass != b->num_mass || a->num_ground != b->num_ground ||
+	   a->num_spring != b->num_spring || a->num_vspring != b->num_vspring ||
+	   a->num_boundary != b->num_boundary || a->num_mapping != b->num_mapping ||
+	   a->num_obj_index != b->num_obj_index || a->num_color != b->num_color)
+		return false;
+
+	bool	same =
+		!memcmp(a->mass, b->mass, a->num_mass * sizeof(Real)) &&
+		!memcmp(a->spring.node, b->spring.node, 2 * a->num_spring * sizeof(unsigned int)) &&
+		!memcmp(a->spring.l_zero, b->spring.l_zero, a->num_spring * sizeof(Real)) &&
+		!memcmp(a->spring.k_stiff, b->spring.k_stiff, a->num_spring * sizeof(Real)) &&
+		!memcmp(a->spring.b_damp, b->spring.b_damp, a->num_spring * sizeof(Real)) &&
+		!memcmp(a->vspring.node, b->vspring.node, 2 * a->num_vspring * sizeof(unsigned int)) &&
+		!memcmp(a->vspring.l_zero, b->vspring.l_zero, a->num_vspring * sizeof(Real)) &&
+		!memcmp(a->vspring.k_stiff, b->vspring.k_stiff, a->num_vspring * sizeof(Real)) &&
+		!memcmp(a->vspring.b_damp, b->vspring.b_damp, a->num_vspring * sizeof(Real)) &&
+		!memcmp(a->fix_boundary, b->fix_boundary, a->num_boundary * sizeof(unsigned int)) &&
+		!memcmp(a->mapping, b->mapping, 2 * a->num_mapping * sizeof(unsigned int)) &&
+		!memcmp(a->msd_of_obj, b->msd_of_obj, a->num_obj_index * sizeof(int)) &&
+		!memcmp(a->obj_of_msd, b->obj_of_msd, a->num_mass * sizeof(int)) &&
+		!memcmp(a->color_ptr, b->color_ptr, (a->num_color + 1) * sizeof(unsigned int)) &&
+		!memcmp(a->spring_order, b->spring_order, a->num_spring * sizeof(unsigned int)) &&
+		*a->state.POS == *b->state.POS &&
+		*a->state.VEL == *b->state.VEL &&
+		*a->FORCE == *b->FORCE;
+	for(i = 0; same && i < a->num_mass; i++)
+		same = a->massPoint[i].pos == b->massPoint[i].pos;
+	for(i = 0; same && i < a->num_ground; i++)
+		same = a->ground_pos[i] == b->ground_pos[i];
+
+	return same;
+}
+
+// Difference of msd released from a displaced state under projective
+// dynamics from implicit Euler, whose step it iterates on, relative to the
+// distance implicit Euler moves.  Selecting "PD" twice has to start over.
+Real LoaderUnitTest::MSDProjectiveError(MSDObject * msd)
+{
+	MSDObject::State	&state = msd->state;
+	const unsigned int	steps = 50;
+	const Real			h = 0.01;
+	Vector<Real>		X0(*state.POS), V0(3*msd->num_mass, 0.0);
+	Real				error = 0.0, disp = 0.0;
+	unsigned int		i, step;
+	bool				finite = true;
+
+	for(i = 0; i < msd->num_mass; i++)
+		if(!msd->isFixedBoundary(i)) {
+			X0[3*i]		+= 0.1 * sin(1.0 + 3.0 * i);
+			X0[3*i+1]	+= 0.1 * sin(2.0 + 3.0 * i);
+		}
+
+	*state.POS = X0;
+	*state.VEL = V0;
+	msd->SetIntegrationMethod(msd->getIntegrationMethod("ImEuler"));
+	for(step = 0; step < steps; step++) msd->integrator->Integrate(*msd, h);
+	Vector<Real>		Xref(*state.POS);
+
+	*state.POS = X0;
+	*state.VEL = V0;
+	msd->int_method = msd->getIntegrationMethod("PD");
+	msd->SetIntegrationMethod(msd->int_method);
+	msd->SetIntegrationMethod(msd->int_method);
+	for(step = 0; step < steps; step++) msd->integrator->Integrate(*msd, h);
+
+	for(i = 0; i < 3*msd->num_mass; i++) {
+		if(!_finite((*state.POS)[i]) || !_finite((*state.VEL)[i])) finite = false;
+		if(fabs((*state.POS)[i] - Xref[i]) > error)	error = fabs((*state.POS)[i] - Xref[i]);
+		if(fabs(Xref[i] - X0[i]) > disp)			disp = fabs(Xref[i] - X0[i]);
+	}
+
+	if(msd->int_method != 9 || !msd->projective.system->isFactored() ||
+	   msd->projective.h != h || !finite || disp == 0.0)
+		return 1.0;
+	return error / disp;
+}
+
+// Difference of msd released from a displaced state under implicit Euler
+// with multigrid from implicit Euler with CG, relative to the distance
+// implicit Euler moves.  Selecting "ImEulerMG" twice has to start over
+// with the project's cycle and smoother, leaving it has to free the solver.
+Real LoaderUnitTest::MSDMultigridError(MSDObject * msd)
+{
+	MSDObject::State	&state = msd->state;
+	const unsigned int	steps = 50;
+	const Real			h = 0.01;
+	Vector<Real>		Xs(*state.POS), Vs(*state.VEL);
+	Vector<Real>		X0(*state.POS), V0(3*msd->num_mass, 0.0);
+	Real				error = 0.0, disp = 0.0;
+	unsigned int		i, step;
+	bool				finite = true;
+
+	for(i = 0; i < msd->num_mass; i++)
+		if(!msd->isFixedBoundary(i)) {
+			X0[3*i]		+= 0.1 * sin(1.0 + 3.0 * i);
+			X0[3*i+1]	+= 0.1 * sin(2.0 + 3.0 * i);
+		}
+
+	*state.POS = X0;
+	*state.VEL = V0;
+	msd->SetIntegrationMethod(msd->getIntegrationMethod("ImEuler"));
+	for(step = 0; step < steps; step++) msd->integrator->Integrate(*msd, h);
+	Vector<Real>		Xref(*state.POS);
+
+	*state.POS = X0;
+	*state.VEL = V0;
+	msd->int_method = msd->getIntegrationMethod("ImEulerMG");
+	msd->SetIntegrationMethod(msd->int_method);
+	msd->SetIntegrationMethod(msd->int_method);
+	for(step = 0; step < steps; step++) msd->integrator->Integrate(*msd, h);
+
+	for(i = 0; i < 3*msd->num_mass; i++) {
+		if(!_finite((*state.POS)[i]) || !_finite((*state.VEL)[i])) finite = false;
+		if(fabs((*state.POS)[i] - Xref[i]) > error)	error = fabs((*state.POS)[i] - Xref[i]);
+		if(fabs(Xref[i] - X0[i]) > disp)			disp = fabs(Xref[i] - X0[i]);
+	}
+	bool				built = msd->multigrid != NULL && msd->multigrid->Hierarchy().NumLevels() > 0;
+
+	msd->int_method = msd->getIntegrationMethod("ImEuler");
+	msd->SetIntegrationMethod(msd->int_method);
+	*state.POS = Xs;
+	*state.VEL = Vs;
+
+	if(!built || msd->multigrid != NULL || msd->multigrid_fixed != NULL || !finite || disp == 0.0)
+		return 1.0;
+	return error / disp;
+}
+
+// Reduced force of a small displacement of msd along its stiffest mode
+// against U^T (f(x0 + eps u_k) - f(x0)) = -eps lambda_k e_k, relative to
+// eps lambda_k
+Real LoaderUnitTest::MSDModalForceError(MSDObject * msd)
+{
+	MSDObject::State	&state = msd->state;
+
+	msd->int_method = msd->getIntegrationMethod("Modal");
+	msd->SetIntegrationMethod(msd->int_method);
+	*state.VEL = 0.0;
+	msd->integrator->Integrate(*msd, 0.01);
+
+	unsigned int	last = msd->ModalCount() - 1;
+	Real			eps = 1e-6, lambda = msd->ModalStiffness(last);
+	for(unsigned int k = 0; k <= last; k++) (*msd->modal.Q)[k] = (*msd->modal.QDOT)[k] = 0.0;
+	(*msd->modal.Q)[last] = eps;
+	*state.POS = *msd->modal.X0;
+	msd->ModalReconstruct();
+	msd->UpdateForces(state);
+
+	Vector<Real>	df(*msd->FORCE), fq(last + 1, 0.0);
+	df -= *msd->modal.F0;
+	msd->modal.basis->Project(fq.begin(), df.begin());
+	Real	error = fabs(fq[last] + eps * lambda);
+	for(unsigned int k = 0; k < last; k++) error += fabs(fq[k]);
+
+	if(msd->int_method != 10 || lambda <= 0.0) return 1.0;
+	return error / (eps * lambda);
+}
+
+// True if the haptic model of msd under modal reduction reads the
+// reconstructed neighbourhood, not the stale full state
+bool LoaderUnitTest::MSDModalHaptics(MSDObject * msd)
+{
+	MSDObject::State				&state = msd->state;
+	GiPSiLowOrderLinearHapticModel	model;
+
+	(*msd->modal.Q)[0] = 0.1;
+	msd->ModalReconstruct();
+	memset(&model, 0, sizeof(GiPSiLowOrderLinearHapticModel));
+	msd->ReturnHapticModel(msd->mapping[1], model);
+	Vector<Real>	f_full = *(model.f_0);
+	*state.POS = *msd->modal.X0;
+	msd->ReturnHapticModel(msd->mapping[1], model);
+	bool			same = (*(model.f_0) == f_full);
+	FreeHapticModel(model);
+
+	return same;
+}
+
+// True if switching msd away from the modal integrator reconstructs the
+// full state and drops the modes
+bool LoaderUnitTest::MSDLeaveModal(MSDObject * msd)
+{
+	MSDObject::State	&state = msd->state;
+	unsigned int		last = msd->num_mass - 1;
+
+	msd->ModalReconstruct();
+	Vector<Real>		full(*state.POS);
+	*state.POS = *msd->modal.X0;
+	msd->int_method = msd->getIntegrationMethod("Euler");
+	msd->SetIntegrationMethod(msd->int_method);
+
+	return msd->modal.basis == NULL &&
+		   *state.POS == full &&
+		   msd->GetNodePosition(last) == Vector<Real>(3, full.begin() + 3*last);
+}
+
+// Largest difference of the coloured spring forces of msd computed on
+// several threads from the forces computed on one, at a perturbed state
+Real LoaderUnitTest::MSDThreadError(MSDObject * msd)
+{
+	MSDObject::State	&state = msd->state;
+	Vector<Real>		X0(*state.POS), V0(*state.VEL);
+	unsigned int		threads = GetParallelThreads();
+	Real				error = 0.0;
+	unsigned int		i;
+
+	for(i = 0; i < 3*msd->num_mass; i++) {
+		(*state.POS)[i] += 0.05 * sin(1.0 + 3.0 * i);
+		(*state.VEL)[i]	 = 0.5 * cos(2.0 + 5.0 * i);
+	}
+	SetParallelThreads(1);
+	msd->UpdateForces(state);
+	Vector<Real>		force(*msd->FORCE);
+
+	SetParallelThreads(4);
+	msd->UpdateForces(state);
+	for(i = 0; i < 3*msd->num_mass; i++)
+		if(fabs((*msd->FORCE)[i] - force[i]) > error) error = fabs((*msd->FORCE)[i] - force[i]);
+
+	SetParallelThreads(threads);
+	*state.POS = X0;
+	*state.VEL = V0;
+	msd->UpdateForces(state);
+
+	return error;
+}
+
 /*
 ===============================================================================
 	LoaderUnitTest class
@@ -86,7 +1304,10 @@ void LoaderUnitTest::Run()
 	FEM_3LMObject * fem = NULL;
 	CardiacBioEObject * cbe = NULL;
 	LumpedFluidObject * lf = NULL;
+	LumpedFluidObject * chamber = NULL;
 	MSDObject * msd = NULL;
+	MSDObject * patch = NULL;
+	MSDObject * grid = NULL;
 	RigidProbeHIO * probe = NULL;
 
 	SimulationKernel * sk = NULL;
@@ -387,6 +1608,170 @@ void LoaderUnitTest::Run()
 	}
 	*/
 
+	// Binary mesh cache of the .node loader
+	try
+	{
+		printf("\nTesting mesh cache\n");
+		const char	*basename	= ".\\objects\\meshb_test";
+		const char	*cachename	= ".\\objects\\meshb_test.meshb";
+		WriteTestMesh(basename);
+		remove(cachename);
+
+		printf("Testing text load:\t\t\t");
+		LoadData	*text = LoadNode(basename);
+		long		full = TestFileSize(cachename);
+		TEST_VERIFY(text != NULL &&
+					text->num_node == 5 &&
+					text->num_element == 2 &&
+					text->num_face == 7 &&
+					full > 0);
+
+		printf("Testing round trip:\t\t\t");
+		LoadData	*cached = LoadNode(basename);
+		TEST_VERIFY(SameLoadData(text, cached));
+
+		// A truncated cache is ignored and written again from the text files
+		printf("Testing truncated cache:\t\t");
+		TruncateTestFile(cachename, full / 2);
+		LoadData	*reloaded = LoadNode(basename);
+		TEST_VERIFY(SameLoadData(text, reloaded) &&
+					TestFileSize(cachename) == full);
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
+	// Single pass transform of a triangle surface
+	try
+	{
+		printf("\nTesting surface transform\n");
+		const char	*filename	= ".\\objects\\transform_test.obj";
+		Real		axis[3]		= { 1.0, 2.0, 3.0 };
+		Real		t[3]		= { 0.3, -0.2, 0.1 };
+		Real		uniform[3]	= { 2.0, 2.0, 2.0 };
+		Real		inflated[3]	= { 1.0, 2.0, 0.5 };
+		WriteTestOctahedron(filename);
+
+		printf("Testing similarity:\t\t\t");
+		TEST_VERIFY(SurfaceTransformError(filename, uniform, 0.5, axis, t) < 1e-12);
+
+		printf("Testing non-uniform scale:\t\t");
+		TEST_VERIFY(SurfaceTransformError(filename, inflated, 0.5, axis, t) < 1e-12);
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
+	// Mass spring damper kernels on a generated model
+	try
+	{
+		printf("\nTesting Mass Spring Damper model\n");
+		WriteTestMSD(".\\objects\\msd_test", 5);
+		remove(".\\objects\\msd_test.msdb");
+		XMLDocument * doc = builder.Build(".\\XMLFiles\\MSD2.xml");
+
+		printf("Testing object initialization:\t");
+		XMLNode * rootNode = doc->GetRootNode();
+		patch = new MSDObject(rootNode);
+		TEST_VERIFY(patch != NULL &&
+					patch->num_mass == 25 &&
+					patch->num_spring == 72 &&
+					patch->num_vspring == 25 &&
+					patch->num_boundary == 5);
+
+		printf("Testing index tables:\t\t");
+		TEST_VERIFY(MSDIndexTables(patch));
+
+		printf("Testing haptic model cache:\t");
+		TEST_VERIFY(MSDModelCache(patch));
+
+		printf("Testing haptic model reuse:\t");
+		TEST_VERIFY(MSDHapticReuse(patch));
+
+		printf("Testing projective dynamics:\t");
+		TEST_VERIFY(MSDProjectiveError(patch) < 0.2);
+
+		printf("Testing multigrid parameters:\t");
+		TEST_VERIFY(patch->multigrid_param.cycle == MG_W_CYCLE &&
+					patch->multigrid_param.smoother == MG_SMOOTH_JACOBI &&
+					patch->multigrid_param.pre_sweeps == 2 &&
+					patch->multigrid_param.post_sweeps == 2 &&
+					patch->multigrid_param.omega == 2.0/3.0);
+
+		printf("Testing implicit Euler multigrid:\t");
+		TEST_VERIFY(MSDMultigridError(patch) < 1e-2);
+
+		printf("Testing modal reduction:\t");
+		TEST_VERIFY(MSDModalForceError(patch) < 1e-2);
+
+		printf("Testing modal haptic model:\t");
+		TEST_VERIFY(MSDModalHaptics(patch));
+
+		printf("Testing leaving modal reduction:\t");
+		TEST_VERIFY(MSDLeaveModal(patch));
+
+		delete rootNode;
+		delete doc;
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
+	// Binary model and parallel spring forces on a sheet large enough to
+	// be split
+	try
+	{
+		printf("\nTesting Mass Spring Damper grid\n");
+		WriteTestMSD(".\\objects\\msd_grid", 64);
+		remove(".\\objects\\msd_grid.msdb");
+		XMLDocument * doc = builder.Build(".\\XMLFiles\\MSDGrid.xml");
+
+		printf("Testing object initialization:\t");
+		XMLNode * rootNode = doc->GetRootNode();
+		init_timers();
+		start_timer(0);
+		grid = new MSDObject(rootNode);
+		double t_text = get_timer(0);
+		TEST_VERIFY(grid != NULL && grid->num_mass == 4096 && grid->num_color > 1 &&
+					!grid->model_file.IsOpen());
+
+		printf("Testing binary model:\t\t");
+		grid->SaveMSDB(".\\objects\\msd_grid.msdb");
+		start_timer(0);
+		MSDObject * binary = new MSDObject(rootNode);
+		double t_binary = get_timer(0);
+		TEST_VERIFY(binary->model_file.IsOpen() && MSDSameModel(grid, binary));
+		delete binary;
+
+		printf("Testing binary load time:\t");
+		TEST_VERIFY(t_binary < t_text);
+		printf("\t%d masses: text %.3f ms, binary %.3f ms\n", grid->num_mass, t_text, t_binary);
+
+		// An out of range index has to send the loader back to the text files
+		printf("Testing corrupt binary model:\t");
+		unsigned int	index_msd = grid->mapping[0];
+		grid->mapping[0] = grid->num_mass;
+		grid->SaveMSDB(".\\objects\\msd_grid.msdb");
+		grid->mapping[0] = index_msd;
+		MSDObject * fallback = new MSDObject(rootNode);
+		TEST_VERIFY(!fallback->model_file.IsOpen() && MSDSameModel(grid, fallback));
+		delete fallback;
+		remove(".\\objects\\msd_grid.msdb");
+
+		printf("Testing threaded forces:\t");
+		TEST_VERIFY(MSDThreadError(grid) == 0.0);
+
+		delete rootNode;
+		delete doc;
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
 	// Test all simulation objects
 	try
 	{
@@ -471,6 +1856,35 @@ void LoaderUnitTest::Run()
 		TEST_VERIFY(fem->displayMngr->displayBuffer.nTextures == 1 &&
 					strcmp(fem->displayMngr->displayBuffer.texture[0], "SmallTGA") == 0);
 
+		printf("Testing element forces:\t\t");
+		TEST_VERIFY(FEMForceError(fem) < 1e-10);
+
+		printf("Testing element colours:\t");
+		TEST_VERIFY(FEMColoring(fem));
+
+		printf("Testing thread count:\t\t");
+		TEST_VERIFY(FEMThreadError(fem) == 0.0);
+
+		printf("Testing tangent:\t\t");
+		TEST_VERIFY(FEMTangentError(fem) < 1e-6);
+
+		printf("Testing corotational element:\t");
+		TEST_VERIFY(CorotationalRigidForce(fem) < 1e-8);
+
+		printf("Testing corotational tangent:\t");
+		TEST_VERIFY(CorotationalTangentError(fem) < 1e-6);
+
+		printf("Testing boundary access:\t");
+		TEST_VERIFY(FEMBoundaryError(fem) == 0.0);
+
+		printf("Testing haptic model:\t\t");
+		TEST_VERIFY(FEMHapticModelError(fem) < 1e-6);
+
+		printf("Testing haptic model time:\t");
+		Real	t_haptic = FEMHapticModelTime(fem);
+		TEST_VERIFY(t_haptic < 0.1);
+		printf("\t%.4f ms per contact model\n", t_haptic);
+
 		delete rootNode;
 		delete doc;
 	}
@@ -625,6 +2039,33 @@ void LoaderUnitTest::Run()
 		TEST_VERIFY(false);
 	}
 
+	try
+	{
+		// LF object on the boundary surface of the FEM object
+		printf("\nTesting Lumped Fluid chamber\n");
+		WriteTestSurface(".\\objects\\lf_test.obj", fem->boundary);
+		XMLDocument * doc = builder.Build(".\\XMLFiles\\LF2.xml");
+
+		printf("Testing object initialization:\t");
+		XMLNode * rootNode = doc->GetRootNode();
+		chamber = new LumpedFluidObject(rootNode);
+		TEST_VERIFY(chamber != NULL);
+
+		printf("Testing chamber volume:\t\t");
+		TEST_VERIFY(ChamberVolumeError(chamber) < 1e-12);
+
+		printf("Testing enclosed volume:\t");
+		Real volume = fabs(chamber->ChamberVolume(chamber->state));
+		TEST_VERIFY(fabs(volume - FEMVolume(fem)) < 1e-10 * volume);
+
+		delete rootNode;
+		delete doc;
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
 	try
 	{
 		// RigidProbeHIO
@@ -810,6 +2251,37 @@ void LoaderUnitTest::Run()
 		TEST_VERIFY(false);
 	}
 
+	try
+	{
+		// FEM/LF connector on a correspondence generated for the chamber
+		printf("\nTesting FEM/LF chamber connector\n");
+		remove("objects\\lf_test.corr.gen");
+		XMLDocument * doc = builder.Build(".\\XMLFiles\\FEM_LF2.xml");
+
+		SIMObject * object[2];
+		object[0] = fem;
+		object[1] = chamber;
+
+		printf("Testing initialization:\t\t");
+		XMLNode * rootNode = doc->GetRootNode();
+		FEM3LM_LUMPEDFLUID_Connector * femlf = new FEM3LM_LUMPEDFLUID_Connector(rootNode, object, 2);
+		TEST_VERIFY(femlf != NULL);
+
+		printf("Testing correspondence:\t\t");
+		TEST_VERIFY(femlf->num_vertex == femlf->mech->num_vertex &&
+					femlf->num_face == femlf->mech->num_face);
+
+		printf("Testing pressure forces:\t");
+		TEST_VERIFY(PressureForceError(femlf) == 0.0);
+		delete femlf;
+		delete rootNode;
+		delete doc;
+	}
+	catch (...)
+	{
+		TEST_VERIFY(false);
+	}
+
 	try
 	{
 		// FEM/CBE connector
@@ -833,6 +2305,9 @@ void LoaderUnitTest::Run()
 		TEST_VERIFY(femcbe->ExcitedStressValueXX == 1 &&
 					femcbe->ExcitedStressValueYY == 2 &&
 					femcbe->ExcitedStressValueZZ == 3);
+
+		printf("Testing contraction:\t\t");
+		TEST_VERIFY(ExcitationError(cbe, femcbe) == 0.0);
 		delete femcbe;
 		delete rootNode;
 		delete doc;
@@ -1301,6 +2776,16 @@ void LoaderUnitTest::Run()
 		delete msd;
 		msd = NULL;
 	}
+	if (patch)
+	{
+		delete patch;
+		patch = NULL;
+	}
+	if (grid)
+	{
+		delete grid;
+		grid = NULL;
+	}
 	if (probe)
 	{
 		delete probe;
@@ -29,6 +29,13 @@ Contributor(s): John Pao.
 
 #include "ProjectLoader.h"
 
+class CardiacBioEObject;
+class FEM_3LMObject;
+class FEM3LM_BIOE_Connector;
+class FEM3LM_LUMPEDFLUID_Connector;
+class LumpedFluidObject;
+class MSDObject;
+
 class LoaderUnitTest
 {
 public:
@@ -39,6 +46,34 @@ public:
 	void TEST_VERIFY(bool test);
 
 private:
+	// Reference checks of the simulation kernels
+	Real PerturbFEMState(FEM_3LMObject * fem, Real dx, Real dv);
+	Real FEMForceError(FEM_3LMObject * fem);
+	bool FEMColoring(FEM_3LMObject * fem);
+	Real FEMThreadError(FEM_3LMObject * fem);
+	Real TangentDifference(FEM_3LMObject * fem, Real h);
+	Real FEMTangentError(FEM_3LMObject * fem);
+	Real RigidFEMState(FEM_3LMObject * fem);
+	Real CorotationalRigidForce(FEM_3LMObject * fem);
+	Real CorotationalTangentError(FEM_3LMObject * fem);
+	Real FEMBoundaryError(FEM_3LMObject * fem);
+	Real FEMHapticModelError(FEM_3LMObject * fem);
+	Real FEMHapticModelTime(FEM_3LMObject * fem);
+	Real FEMVolume(FEM_3LMObject * fem);
+	Real ChamberVolumeError(LumpedFluidObject * lf);
+	Real ExcitationError(CardiacBioEObject * cbe, FEM3LM_BIOE_Connector * femcbe);
+	Real PressureForceError(FEM3LM_LUMPEDFLUID_Connector * femlf);
+	bool MSDIndexTables(MSDObject * msd);
+	bool MSDModelCache(MSDObject * msd);
+	bool MSDHapticReuse(MSDObject * msd);
+	bool MSDSameModel(MSDObject * a, MSDObject * b);
+	Real MSDProjectiveError(MSDObject * msd);
+	Real MSDMultigridError(MSDObject * msd);
+	Real MSDModalForceError(MSDObject * msd);
+	bool MSDModalHaptics(MSDObject * msd);
+	bool MSDLeaveModal(MSDObject * msd);
+	Real MSDThreadError(MSDObject * msd);
+
 	int myFailedCount;
 };
 
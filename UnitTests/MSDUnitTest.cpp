@@ -78,7 +78,7 @@ void MSDUnitTest::Run()
 	TEST_VERIFY(force != NULL &&
 				mass != NULL &&
 				ground_pos != NULL &&
-				spring != NULL &&
+				spring.node != NULL &&
 				fix_boundary != NULL);
 
 	printf("\tTest 1d: init\t");
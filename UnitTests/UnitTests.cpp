@@ -31,6 +31,7 @@ Contributor(s): John Pao, Suriya Natsupakpong.
 */
 
 #include "stdafx.h"
+#include "AlgebraUnitTest.h"
 #include "DisplayBufferUnitTest.h"
 #include "LoaderUnitTest.h"
 #include "LoggerUnitTest.h"
@@ -50,6 +51,7 @@ Contributor(s): John Pao, Suriya Natsupakpong.
 #define RUN_TEXTURE_TESTS		0x00000008
 #define RUN_LOADER_TESTS		0x00000010
 #define RUN_INTEGRATOR_TESTS	0x00000020
+#define RUN_ALGEBRA_TESTS		0x00000040
 
 int _tmain(int argc, _TCHAR* argv[])
 {
@@ -97,6 +99,13 @@ int _tmain(int argc, _TCHAR* argv[])
 		printf("%d Failed\n", IntegratorTest.GetFailedCount());
 	}
 
+	if (x & RUN_ALGEBRA_TESTS)
+	{
+		AlgebraUnitTest AlgebraTest;
+		AlgebraTest.Run();
+		printf("%d Failed\n", AlgebraTest.GetFailedCount());
+	}
+
 	return 0;
 }
 